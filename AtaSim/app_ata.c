@@ -0,0 +1,99 @@
+/* SampleFatSD/ata.c against the drive model, one call of atasim_done()
+   per test; sbi() and cbi() come from compat/deprecated.h today, the
+   WinAVR the driver was written for had them in avr/sfr_defs.h */
+#include <compat/deprecated.h>
+#include <string.h>
+
+#include "../SampleFatSD/ata.c"
+#include "atasim.h"
+
+static unsigned char buffer[ATASIM_SECTORS * 512];
+
+/* sectors of the buffer that do not hold the pattern */
+static uint8_t check(unsigned long lba, uint8_t count, uint8_t seed)
+{
+	uint8_t fails = 0;
+	uint8_t s;
+	uint16_t i;
+
+	for (s = 0; s < count; s++)
+	{
+		for (i = 0; i < 512; i++)
+		{
+			if (buffer[s * 512 + i] != atasim_pattern(lba + s, i, seed))
+			{
+				fails++;
+				break;
+			}
+		}
+	}
+	return fails;
+}
+
+static void fill(unsigned long lba, uint8_t count, uint8_t seed)
+{
+	uint8_t s;
+	uint16_t i;
+
+	for (s = 0; s < count; s++)
+		for (i = 0; i < 512; i++)
+			buffer[s * 512 + i] = atasim_pattern(lba + s, i, seed);
+}
+
+static uint8_t read_n(unsigned long base, uint8_t seed)
+{
+	uint8_t fails = 0;
+	uint8_t n;
+
+	for (n = 1; n <= ATASIM_SECTORS; n++)
+	{
+		unsigned long lba = base + n * (n - 1) / 2;
+
+		memset(buffer, 0, sizeof(buffer));
+		if (ataReadSectorsN(0, lba, n, buffer))
+			fails += n;
+		else
+			fails += check(lba, n, seed);
+	}
+	return fails;
+}
+
+int main(void)
+{
+	unsigned long cache = 0xFFFFFFFF;
+	uint8_t fails;
+	uint8_t n;
+
+	ataInit();
+	atasim_done(ATASIM_INIT, 0);
+
+	atasim_done(ATASIM_READ_N, read_n(ATASIM_READ_LBA, 0));
+
+	fails = 0;
+	for (n = 1; n <= ATASIM_SECTORS; n++)
+	{
+		unsigned long lba = ATASIM_WRITE_LBA + n * (n - 1) / 2;
+
+		fill(lba, n, 1);
+		if (ataWriteSectorsN(0, lba, n, buffer))
+			fails += n;
+	}
+	atasim_done(ATASIM_WRITE_N, fails);
+
+	atasim_done(ATASIM_READ_BACK, read_n(ATASIM_WRITE_LBA, 1));
+
+	/* the second read of the same sector is served from the cache */
+	fails = 0;
+	if (ataReadSectors(0, ATASIM_READ_LBA, buffer, &cache) || ataReadSectors(0, ATASIM_READ_LBA, buffer, &cache))
+		fails++;
+	else
+		fails += check(ATASIM_READ_LBA, 1, 0);
+	fill(ATASIM_WRITE_LBA + 100, 1, 1);
+	if (ataWriteSectors(0, ATASIM_WRITE_LBA + 100, buffer))
+		fails++;
+	atasim_done(ATASIM_SINGLE, fails);
+
+	for (;;)
+	{
+	}
+}
@@ -0,0 +1,761 @@
+/*
+ * atasim - IDE drive model for the SampleFatSD ATA driver.
+ *
+ * usage: atasim [-M mcu] [-f F_CPU] [-m max_multiple] [-p pio_mode] [-c]
+ *               [-b busy_us] program.elf
+ *
+ * program.elf is app_ata.c built with avr-gcc for the ATmega128 of
+ * SampleFatSD. It runs on the core of UartSim (../UartSim/avr.cpp) with
+ * a drive on the ports the way ataconf.h wires it: DD0-7 on port C,
+ * DD8-15 on port B, the register address on PA0-4, DIOW- on PA6 and
+ * DIOR- on PA7. The drive latches a register write when DIOW- goes
+ * high and drives the bus from DIOR- low to DIOR- high.
+ *
+ * It holds a 16 head, 63 sector, 100 cylinder disk and answers IDENTIFY,
+ * READ/WRITE SECTORS, READ/WRITE MULTIPLE, SET MULTIPLE MODE and SET
+ * FEATURES with a PIO transfer mode. IDENTIFY reports -m sectors per
+ * DRQ block (0: no READ/WRITE MULTIPLE, SET MULTIPLE is refused), PIO
+ * modes up to -p and, without -c, LBA support. Every command and every
+ * DRQ block after the first keeps the drive busy for -b us.
+ *
+ * After each test app_ata.c reports how many sectors came back wrong;
+ * the drive adds what it saw: protocol errors (data register accesses
+ * without DRQ, task file writes while busy, DIOR- and DIOW- low at once)
+ * and written sectors that do not hold the expected pattern. The exit
+ * status is 1 when any test failed.
+ *
+ * Data register cycles are also timed against the PIO mode the drive was
+ * set to: t0, t1, t2, t2i, t3 and t4 from the strobe and port edges, an
+ * edge being at the end of the instruction that writes the port, and the
+ * read sample point, half a cycle before the IN (the input synchronizer),
+ * which has to be t2 - t5 after DIOR- falls at least. The worst case of
+ * each mode is printed at the end, a cycle out of spec is a drive error.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../UartSim/avr.h"
+#include "atasim.h"
+
+/* data addresses, the same on the ATmega32 and ATmega128 */
+#define PINC 0x33
+#define DDRC 0x34
+#define PORTC 0x35
+#define PINB 0x36
+#define DDRB 0x37
+#define PORTB 0x38
+#define PORTA 0x3b
+
+/* port A: register address, CS1- and CS0- in bits 4 and 3, and the strobes */
+#define A_ADDR 0x1f
+#define A_WR 0x40
+#define A_RD 0x80
+
+/* registers, reading and writing */
+#define REG_DATA 0x08
+#define REG_ERROR 0x09        /* features */
+#define REG_COUNT 0x0a
+#define REG_SECTOR 0x0b
+#define REG_CYL_LO 0x0c
+#define REG_CYL_HI 0x0d
+#define REG_HEAD 0x0e
+#define REG_STATUS 0x0f       /* command */
+#define REG_ALT_STATUS 0x16   /* device control */
+
+#define ST_BSY 0x80
+#define ST_DRDY 0x40
+#define ST_DSC 0x10
+#define ST_DRQ 0x08
+#define ST_ERR 0x01
+
+#define ERR_IDNF 0x10
+#define ERR_ABRT 0x04
+
+#define DC_SRST 0x04
+#define HEAD_LBA 0x40
+
+#define HEADS 16
+#define SECTORS 63
+#define CYLINDERS 100
+#define BLOCKS ((uint32_t)HEADS * SECTORS * CYLINDERS)
+
+/* PIO timings (ns) for modes 0..4 */
+struct pio_timing
+{
+	double t0;    /* cycle time */
+	double t1;    /* address valid to DIOR-/DIOW- */
+	double t2;    /* DIOR-/DIOW- pulse width */
+	double t2i;   /* DIOR-/DIOW- recovery */
+	double t3;    /* write data setup */
+	double t4;    /* write data hold */
+	double t5;    /* read data setup */
+};
+
+static const struct pio_timing pio_timings[5] = {
+	{ 600, 70, 165, 0, 60, 30, 50 },
+	{ 383, 50, 125, 0, 45, 20, 35 },
+	{ 240, 30, 100, 0, 30, 15, 20 },
+	{ 180, 30, 80, 70, 30, 10, 20 },
+	{ 120, 25, 70, 25, 20, 10, 20 },
+};
+
+/* shortest times seen in data register cycles of a mode, in ns */
+struct timing_seen
+{
+	uint32_t words;
+	double t0;
+	double t1;
+	double t2;
+	double t2i;
+	double t3;
+	double t4;
+	double sample;   /* DIOR- falling to the first sample */
+};
+
+#define MAX_BLOCK 256
+#define MAX_LOGGED 10
+
+static const char* const test_names[ATASIM_TESTS] = {
+	"init", "read n", "write n", "read back", "single",
+};
+
+static unsigned long cfg_f_cpu = 16000000;
+static int cfg_max_multiple = 16;
+static int cfg_pio = 4;
+static int cfg_chs;
+static double cfg_busy_us = 20;
+
+static const char* program;
+static uint8_t* disk;
+
+/* task file as written by the host */
+static uint8_t regs[0x20];
+static uint8_t status_after = ST_DRDY | ST_DSC;
+static uint8_t error;
+static uint64_t busy_until;
+static int in_reset;
+static int multiple;
+static int pio_mode;
+
+/* the command in progress */
+static uint8_t command;
+static uint8_t xfer[MAX_BLOCK * 512];
+static uint32_t xfer_lba;
+static uint32_t xfer_pos;
+static uint32_t xfer_len;
+static uint32_t xfer_block;
+static int xfer_write;
+
+static uint8_t port_a = A_RD | A_WR;
+static uint8_t bus_low = 0xff;
+static uint8_t bus_high = 0xff;
+
+struct test_stats
+{
+	uint32_t commands;
+	uint32_t multiple_commands;   /* READ/WRITE MULTIPLE */
+	uint32_t sectors;
+	uint32_t drq_blocks;
+	uint32_t errors;              /* seen by the drive */
+	uint64_t start;
+};
+
+static struct test_stats stats;
+static struct timing_seen seen[5];
+
+/* port edges of the instruction that runs, timed when it is done */
+static int edge_fall;
+static int edge_rise;
+static int edge_addr;
+static int edge_data;
+static uint8_t edge_reg;
+
+/* the last data register cycle, in cycles, negative if there is none */
+static double fall_at = -1;
+static double rise_at = -1;
+static double sample_at = -1;
+static double hold_from = -1;
+static double addr_at;
+static double data_at;
+static int cycle_write;
+static uint32_t done_pc = AVR_NO_SYMBOL;
+static int tests_done;
+static int failed;
+static int logged;
+
+static uint64_t cycles(double us)
+{
+	return us * cfg_f_cpu / 1e6;
+}
+
+static double us(double cycles)
+{
+	return cycles * 1e6 / cfg_f_cpu;
+}
+
+static void protocol_error(const char* what)
+{
+	stats.errors++;
+	if (logged++ < MAX_LOGGED)
+		printf("  drive: %s at %.1f us, pc 0x%04x\n", what, us(avr_cycles), avr_pc * 2);
+}
+
+/* ---- drive */
+
+static uint8_t drive_status(void)
+{
+	if (in_reset || avr_cycles < busy_until)
+		return ST_BSY;
+	return status_after;
+}
+
+static void busy(uint8_t then)
+{
+	busy_until = avr_cycles + cycles(cfg_busy_us);
+	status_after = then;
+}
+
+static void abort_command(uint8_t why)
+{
+	error = why;
+	busy(ST_DRDY | ST_DSC | ST_ERR);
+}
+
+static uint32_t task_file_lba(void)
+{
+	uint32_t cyl = regs[REG_CYL_LO] | (regs[REG_CYL_HI] << 8);
+
+	if (regs[REG_HEAD] & HEAD_LBA)
+		return regs[REG_SECTOR] | (cyl << 8) | ((uint32_t)(regs[REG_HEAD] & 0x0f) << 24);
+	/* sectors count from 1 in CHS mode, 0 is not a sector */
+	if (!regs[REG_SECTOR] || regs[REG_SECTOR] > SECTORS)
+		return BLOCKS;
+	return (cyl * HEADS + (regs[REG_HEAD] & 0x0f)) * SECTORS + regs[REG_SECTOR] - 1;
+}
+
+static void identify_word(int word, uint16_t value)
+{
+	xfer[word * 2] = value;
+	xfer[word * 2 + 1] = value >> 8;
+}
+
+static void identify(void)
+{
+	const char* model = "ATASIM DRIVE MODEL";
+	int i;
+
+	memset(xfer, 0, 512);
+	identify_word(1, CYLINDERS);
+	identify_word(3, HEADS);
+	identify_word(6, SECTORS);
+	/* two characters per word, the first one in the high byte */
+	for (i = 0; i < 40; i++)
+		xfer[54 + (i ^ 1)] = i < (int)strlen(model) ? model[i] : ' ';
+	identify_word(47, cfg_max_multiple ? 0x8000 | cfg_max_multiple : 0);
+	identify_word(49, cfg_chs ? 0 : 0x0200);
+	identify_word(51, (cfg_pio < 2 ? cfg_pio : 2) << 8);
+	identify_word(53, 0x0003);
+	identify_word(60, BLOCKS & 0xffff);
+	identify_word(61, BLOCKS >> 16);
+	identify_word(64, cfg_pio == 4 ? 0x0003 : cfg_pio == 3 ? 0x0001 : 0);
+	xfer_len = xfer_block = 512;
+	xfer_write = 0;
+	xfer_pos = 0;
+	busy(ST_DRDY | ST_DSC | ST_DRQ);
+	stats.drq_blocks++;
+}
+
+static void start_transfer(int write, int use_multiple)
+{
+	uint32_t count = regs[REG_COUNT] ? regs[REG_COUNT] : 256;
+
+	if (use_multiple && !multiple)
+	{
+		abort_command(ERR_ABRT);
+		return;
+	}
+	xfer_lba = task_file_lba();
+	if (xfer_lba >= BLOCKS || count > BLOCKS - xfer_lba)
+	{
+		abort_command(ERR_IDNF);
+		return;
+	}
+	if (cfg_chs && (regs[REG_HEAD] & HEAD_LBA))
+	{
+		abort_command(ERR_ABRT);
+		return;
+	}
+	xfer_write = write;
+	xfer_len = count * 512;
+	xfer_block = (use_multiple ? multiple : 1) * 512;
+	xfer_pos = 0;
+	if (!write)
+		memcpy(xfer, disk + xfer_lba * 512, xfer_len);
+	stats.sectors += count;
+	stats.multiple_commands += use_multiple;
+	busy(ST_DRDY | ST_DSC | ST_DRQ);
+	stats.drq_blocks++;
+}
+
+static void execute(uint8_t c)
+{
+	int n = regs[REG_COUNT];
+
+	if (drive_status() & (ST_BSY | ST_DRQ))
+		protocol_error("command written while busy or in a transfer");
+	stats.commands++;
+	command = c;
+	error = 0;
+	switch (c)
+	{
+	case 0xec: /* IDENTIFY DEVICE */
+		identify();
+		break;
+	case 0x20: /* READ SECTORS */
+	case 0x21:
+		start_transfer(0, 0);
+		break;
+	case 0x30: /* WRITE SECTORS */
+	case 0x31:
+		start_transfer(1, 0);
+		break;
+	case 0xc4: /* READ MULTIPLE */
+		start_transfer(0, 1);
+		break;
+	case 0xc5: /* WRITE MULTIPLE */
+		start_transfer(1, 1);
+		break;
+	case 0xc6: /* SET MULTIPLE MODE, a power of 2 the drive supports */
+		if (!n || n > cfg_max_multiple || (n & (n - 1)))
+			abort_command(ERR_ABRT);
+		else
+		{
+			multiple = n;
+			busy(ST_DRDY | ST_DSC);
+		}
+		break;
+	case 0xef: /* SET FEATURES, only the PIO transfer mode */
+		if (regs[REG_ERROR] == 0x03 && (n & 0xf8) == 0x08 && (n & 7) <= cfg_pio)
+		{
+			pio_mode = n & 7;
+			busy(ST_DRDY | ST_DSC);
+		}
+		else
+			abort_command(ERR_ABRT);
+		break;
+	default:
+		abort_command(ERR_ABRT);
+	}
+}
+
+/* the written sectors, as app_ata.c fills them */
+static void commit_write(void)
+{
+	uint32_t s;
+	uint32_t i;
+
+	memcpy(disk + xfer_lba * 512, xfer, xfer_len);
+	for (s = 0; s < xfer_len / 512; s++)
+	{
+		for (i = 0; i < 512; i++)
+		{
+			if (xfer[s * 512 + i] != atasim_pattern(xfer_lba + s, i, 1))
+			{
+				protocol_error("written sector does not hold the pattern");
+				break;
+			}
+		}
+	}
+}
+
+/* one data word went over the bus */
+static void data_word(void)
+{
+	xfer_pos += 2;
+	if (xfer_pos == xfer_len)
+	{
+		if (xfer_write)
+		{
+			commit_write();
+			busy(ST_DRDY | ST_DSC);
+		}
+		else
+			status_after = ST_DRDY | ST_DSC;
+	}
+	else if (xfer_pos % xfer_block == 0)
+	{
+		busy(ST_DRDY | ST_DSC | ST_DRQ);
+		stats.drq_blocks++;
+	}
+}
+
+static int data_ready(void)
+{
+	if (!(drive_status() & ST_DRQ))
+	{
+		protocol_error("data register accessed without DRQ");
+		return 0;
+	}
+	return 1;
+}
+
+/* DIOR- went low, the drive puts the register on the bus */
+static void read_start(uint8_t reg)
+{
+	bus_high = 0xff;
+	switch (reg)
+	{
+	case REG_DATA:
+		if (data_ready())
+		{
+			bus_low = xfer[xfer_pos];
+			bus_high = xfer[xfer_pos + 1];
+		}
+		else
+			bus_low = 0xff;
+		break;
+	case REG_ERROR:
+		bus_low = error;
+		break;
+	case REG_STATUS:
+	case REG_ALT_STATUS:
+		bus_low = drive_status();
+		break;
+	default:
+		bus_low = regs[reg];
+	}
+}
+
+/* DIOR- went high */
+static void read_end(uint8_t reg)
+{
+	if (reg == REG_DATA && (drive_status() & ST_DRQ) && !xfer_write)
+		data_word();
+	bus_low = bus_high = 0xff;
+}
+
+/* DIOW- went high, the drive latches the bus */
+static void write_end(uint8_t reg)
+{
+	uint8_t low = avr_mem[DDRC] == 0xff ? avr_mem[PORTC] : 0xff;
+	uint8_t high = avr_mem[DDRB] == 0xff ? avr_mem[PORTB] : 0xff;
+
+	if (reg == REG_ALT_STATUS)
+	{
+		if (low & DC_SRST)
+			in_reset = 1;
+		else if (in_reset)
+		{
+			/* the reset is done some time after SRST is cleared */
+			in_reset = 0;
+			multiple = 0;
+			pio_mode = 0;
+			error = 1;
+			busy(ST_DRDY | ST_DSC);
+		}
+		return;
+	}
+	if (avr_mem[DDRC] != 0xff)
+		protocol_error("register written with DD0-7 not driven");
+	if (reg == REG_DATA)
+	{
+		if (!data_ready() || !xfer_write)
+			return;
+		if (avr_mem[DDRB] != 0xff)
+			protocol_error("data written with DD8-15 not driven");
+		xfer[xfer_pos] = low;
+		xfer[xfer_pos + 1] = high;
+		data_word();
+		return;
+	}
+	if (drive_status() & ST_BSY)
+	{
+		protocol_error("task file written while busy");
+		return;
+	}
+	if (reg == REG_STATUS)
+		execute(low);
+	else
+		regs[reg] = low;
+}
+
+/* ---- timing */
+
+static void timing_check(double* worst, double value, double limit, const char* name)
+{
+	char what[80];
+
+	if (value < *worst)
+		*worst = value;
+	if (value < limit - 0.01)
+	{
+		snprintf(what, sizeof(what), "%s %.0f ns in PIO mode %d, needs %.0f", name, value, pio_mode, limit);
+		protocol_error(what);
+	}
+}
+
+static double ns(double cycles)
+{
+	return cycles * 1e9 / cfg_f_cpu;
+}
+
+/* the instruction that ended at avr_cycles moved these edges */
+static void timing_edges(void)
+{
+	const struct pio_timing* t = &pio_timings[pio_mode];
+	struct timing_seen* s = &seen[pio_mode];
+	double now = avr_cycles;
+
+	if (edge_addr)
+		addr_at = now;
+	if (edge_data)
+	{
+		if (hold_from >= 0)
+			timing_check(&s->t4, ns(now - hold_from), t->t4, "t4 (write data hold)");
+		hold_from = -1;
+		data_at = now;
+	}
+	if (edge_fall && edge_reg == REG_DATA)
+	{
+		if (fall_at >= 0)
+			timing_check(&s->t0, ns(now - fall_at), t->t0, "t0 (cycle time)");
+		if (rise_at >= 0 && t->t2i)
+			timing_check(&s->t2i, ns(now - rise_at), t->t2i, "t2i (recovery)");
+		timing_check(&s->t1, ns(now - addr_at), t->t1, "t1 (address setup)");
+		fall_at = now;
+		sample_at = -1;
+		cycle_write = edge_fall == A_WR;
+	}
+	else if (edge_fall)
+		fall_at = rise_at = -1;
+	if (edge_rise && fall_at >= 0)
+	{
+		s->words++;
+		timing_check(&s->t2, ns(now - fall_at), t->t2, "t2 (pulse width)");
+		if (cycle_write)
+		{
+			timing_check(&s->t3, ns(now - data_at), t->t3, "t3 (write data setup)");
+			hold_from = now;
+		}
+		else if (sample_at >= 0)
+			timing_check(&s->sample, ns(sample_at - fall_at), t->t2 - t->t5, "read sample");
+		rise_at = now;
+	}
+	edge_fall = edge_rise = edge_addr = edge_data = 0;
+}
+
+static void timing_report(void)
+{
+	int mode;
+
+	for (mode = 0; mode < 5; mode++)
+	{
+		const struct pio_timing* t = &pio_timings[mode];
+		const struct timing_seen* s = &seen[mode];
+
+		if (!s->words)
+			continue;
+		printf("  PIO mode %d, %u words, shortest (needed) in ns: t0 %.0f (%.0f), t1 %.0f (%.0f), t2 %.0f (%.0f)",
+		       mode, s->words, s->t0, t->t0, s->t1, t->t1, s->t2, t->t2);
+		if (t->t2i)
+			printf(", t2i %.0f (%.0f)", s->t2i, t->t2i);
+		if (s->t3 < 1e9)
+			printf(", t3 %.0f (%.0f), t4 %.0f (%.0f)", s->t3, t->t3, s->t4, t->t4);
+		if (s->sample < 1e9)
+			printf(", read sample %.0f (%.0f)", s->sample, t->t2 - t->t5);
+		printf("\n");
+	}
+}
+
+/* ---- ports */
+
+static void port_a_write(uint16_t addr, uint8_t value)
+{
+	uint8_t old = port_a;
+
+	avr_mem[addr] = value;
+	port_a = value;
+	if ((old ^ value) & A_ADDR)
+		edge_addr = 1;
+	if ((old & ~value) & (A_RD | A_WR))
+	{
+		edge_fall = (old & ~value) & (A_RD | A_WR);
+		edge_reg = value & A_ADDR;
+	}
+	if ((~old & value) & (A_RD | A_WR))
+		edge_rise = 1;
+	if (!(value & (A_RD | A_WR)))
+		protocol_error("DIOR- and DIOW- low at once");
+	if ((old & A_RD) && !(value & A_RD))
+		read_start(value & A_ADDR);
+	else if (!(old & A_RD) && (value & A_RD))
+		read_end(old & A_ADDR);
+	if (!(old & A_WR) && (value & A_WR))
+		write_end(old & A_ADDR);
+}
+
+/* an input pin reads what the drive drives, the pull-up otherwise */
+static uint8_t pin_read(uint16_t addr)
+{
+	uint8_t ddr = avr_mem[addr + 1];
+	uint8_t port = avr_mem[addr + 2];
+	uint8_t bus = 0xff;
+
+	if (!(port_a & A_RD))
+	{
+		bus = addr == PINC ? bus_low : bus_high;
+		/* the pin as it was half a cycle before the IN */
+		if ((port_a & A_ADDR) == REG_DATA && fall_at >= 0 && sample_at < 0)
+			sample_at = avr_cycles - 0.5;
+	}
+	return (port & ddr) | (bus & ~ddr);
+}
+
+/* DD0-15 change, for the write data setup and hold times */
+static void data_write(uint16_t addr, uint8_t value)
+{
+	if (avr_mem[addr] != value)
+		edge_data = 1;
+	avr_mem[addr] = value;
+}
+
+static uint8_t no_irq(void)
+{
+	return 0;
+}
+
+static void no_ack(uint8_t vector)
+{
+	(void)vector;
+}
+
+/* ---- tests */
+
+static void done(uint8_t test, uint8_t fails)
+{
+	const char* name = test < ATASIM_TESTS ? test_names[test] : "?";
+
+	printf("  %-10s %s, %u commands", name, fails || stats.errors ? "FAIL" : "ok", stats.commands);
+	if (stats.multiple_commands)
+		printf(" (%u READ/WRITE MULTIPLE)", stats.multiple_commands);
+	printf(", %u sectors in %u DRQ blocks, %.0f us", stats.sectors, stats.drq_blocks,
+	       us(avr_cycles - stats.start));
+	if (fails)
+		printf(", %u sectors wrong", fails);
+	if (stats.errors)
+		printf(", %u drive errors", stats.errors);
+	printf("\n");
+	if (test == ATASIM_INIT)
+		printf("  %-10s PIO mode %d, %d sectors per DRQ block\n", "", pio_mode, multiple);
+	if (fails || stats.errors)
+		failed = 1;
+	memset(&stats, 0, sizeof(stats));
+	stats.start = avr_cycles;
+	tests_done++;
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "usage: %s [-M mcu] [-f F_CPU] [-m max_multiple] [-p pio_mode] [-c] [-b busy_us] program.elf\n",
+	        name);
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	const struct avr_mcu* mcu = avr_find_mcu("atmega128");
+	uint64_t deadline;
+	uint32_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "M:f:m:p:cb:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'M':
+			mcu = avr_find_mcu(optarg);
+			if (!mcu)
+			{
+				fprintf(stderr, "%s: unknown mcu %s\n", argv[0], optarg);
+				return 2;
+			}
+			break;
+		case 'f':
+			cfg_f_cpu = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			cfg_max_multiple = atoi(optarg);
+			break;
+		case 'p':
+			cfg_pio = atoi(optarg);
+			break;
+		case 'c':
+			cfg_chs = 1;
+			break;
+		case 'b':
+			cfg_busy_us = strtod(optarg, NULL);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || !cfg_f_cpu || cfg_max_multiple < 0 || cfg_max_multiple > 255 ||
+	    cfg_pio < 0 || cfg_pio > 4)
+		usage(argv[0]);
+	program = argv[optind];
+
+	disk = (uint8_t*)malloc((size_t)BLOCKS * 512);
+	if (!disk)
+	{
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 2;
+	}
+	for (i = 0; i < BLOCKS * 512; i++)
+		disk[i] = atasim_pattern(i / 512, i % 512, 0);
+
+	avr_load(mcu, program);
+	done_pc = avr_symbol("atasim_done");
+	if (done_pc == AVR_NO_SYMBOL)
+	{
+		fprintf(stderr, "%s has no atasim_done()\n", program);
+		return 2;
+	}
+	done_pc /= 2;
+	avr_hook(PORTA, NULL, port_a_write);
+	avr_hook(PINB, pin_read, NULL);
+	avr_hook(PINC, pin_read, NULL);
+	avr_hook(PORTB, NULL, data_write);
+	avr_hook(DDRB, NULL, data_write);
+	avr_hook(PORTC, NULL, data_write);
+	avr_hook(DDRC, NULL, data_write);
+	for (i = 0; i < 5; i++)
+		seen[i].t0 = seen[i].t1 = seen[i].t2 = seen[i].t2i = seen[i].t3 = seen[i].t4 = seen[i].sample = 1e9;
+	avr_irq_hooks(no_irq, no_ack);
+
+	printf("%s on %s at %lu Hz, drive: %s, %d sectors per DRQ block at most, PIO modes up to %d\n",
+	       program, mcu->name, cfg_f_cpu, cfg_chs ? "CHS only" : "LBA", cfg_max_multiple, cfg_pio);
+	deadline = 10 * (uint64_t)cfg_f_cpu;
+	while (tests_done < ATASIM_TESTS)
+	{
+		uint16_t pc = avr_pc;
+		uint8_t r24 = avr_mem[24];
+		uint8_t r22 = avr_mem[22];
+
+		if (!avr_step())
+			avr_cycles++;
+		timing_edges();
+		if (pc == done_pc)
+			done(r24, r22);
+		if (avr_cycles > deadline)
+		{
+			printf("  did not finish, %d of %d tests done\n", tests_done, ATASIM_TESTS);
+			failed = 1;
+			break;
+		}
+	}
+	timing_report();
+	printf("  %s\n", failed ? "FAIL" : "OK");
+	return failed;
+}
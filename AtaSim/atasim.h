@@ -0,0 +1,41 @@
+/*
+ * atasim - what app_ata.c and the drive model agree on.
+ *
+ * app_ata.c runs SampleFatSD/ata.c against the drive in atasim.cpp and
+ * calls atasim_done() after each test with the number of sectors that
+ * came back wrong; the simulator stops there, takes the test and the
+ * count from r24 and r22, and adds what it saw on the bus.
+ */
+#ifndef ATASIM_H
+#define ATASIM_H
+
+#include <stdint.h>
+
+#define ATASIM_INIT       0   /* ataInit(): reset, IDENTIFY, SET FEATURES, SET MULTIPLE */
+#define ATASIM_READ_N     1   /* ataReadSectorsN() of 1..ATASIM_SECTORS sectors */
+#define ATASIM_WRITE_N    2   /* ataWriteSectorsN() of 1..ATASIM_SECTORS sectors */
+#define ATASIM_READ_BACK  3   /* ataReadSectorsN() of what was written */
+#define ATASIM_SINGLE     4   /* ataReadSectors() twice, cached, and ataWriteSectors() */
+#define ATASIM_TESTS      5
+
+/* sectors per transfer at most, the buffer has to fit into the RAM */
+#define ATASIM_SECTORS    6
+
+/* first sectors of the areas the tests use, transfer n starts n * (n - 1) / 2
+   sectors further on; with the model's 16 heads of 63 sectors both areas
+   cross into the next cylinder in CHS mode */
+#define ATASIM_READ_LBA   1000UL
+#define ATASIM_WRITE_LBA  2000UL
+
+/* byte i of a sector, seed 0 is what the disk holds, seed 1 what the tests write */
+static inline uint8_t atasim_pattern(uint32_t lba, uint16_t i, uint8_t seed)
+{
+	return (uint8_t)(lba * 13 + (lba >> 8) + i * (2 * seed + 1) + (i >> 8) + seed * 0x5a);
+}
+
+#ifdef __AVR__
+/* report the end of a test to the simulator */
+void atasim_done(uint8_t test, uint8_t fails);
+#endif
+
+#endif /* ATASIM_H */
@@ -0,0 +1,8 @@
+/* the breakpoint atasim watches, in a file of its own so that no
+   optimisation can drop the call */
+#include "atasim.h"
+
+void atasim_done(uint8_t test, uint8_t fails)
+{
+	__asm__ __volatile__ ("" : : "r" (test), "r" (fails));
+}
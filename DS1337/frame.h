@@ -0,0 +1,38 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <inttypes.h>
+
+/*
+ * Binary frames for the UART link.
+ *
+ * A frame is  type | payload | crc16 low | crc16 high , COBS encoded and
+ * terminated by a 0x00 byte. The CRC is CRC-16/MCRF4XX (reflected 0x1021,
+ * initial 0xffff, as avr-libc _crc_ccitt_update) over type and payload.
+ * A receiver resynchronises on the next 0x00 after a damaged frame.
+ */
+
+/* accelerometer samples, n * { int16 x, int16 y, int16 z } little endian */
+#define FRAME_TYPE_ACCEL      0x01
+/* file contents, uint32 offset little endian followed by the data */
+#define FRAME_TYPE_FILE_DATA  0x02
+/* end of file, uint32 file size little endian */
+#define FRAME_TYPE_FILE_END   0x03
+
+/* largest payload a receiver has to accept */
+#define FRAME_MAX_PAYLOAD     255
+
+/* number of payload parts frame_send() accepts */
+#define FRAME_MAX_PARTS       4
+
+struct frame_part
+{
+	const void* data;
+	uint8_t length;
+};
+
+/* encode and send one frame through put(), reading the payload directly
+   from the given parts without assembling the frame in RAM */
+void frame_send(uint8_t type, const struct frame_part* parts, uint8_t count, void (*put)(uint8_t));
+
+#endif /* FRAME_H*/
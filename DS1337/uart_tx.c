@@ -0,0 +1,78 @@
+#include "uart_tx.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#define UART_TX_BUFFER_MASK (UART_TX_BUFFER_SIZE - 1)
+
+#if (UART_TX_BUFFER_SIZE & UART_TX_BUFFER_MASK) || (UART_TX_BUFFER_SIZE > 256)
+#error "UART_TX_BUFFER_SIZE must be a power of 2 up to 256"
+#endif
+
+#if defined(UDR0)
+#define UART_TX_DATA    UDR0
+#define UART_TX_CONTROL UCSR0B
+#define UART_TX_UDRIE   UDRIE0
+#else
+#define UART_TX_DATA    UDR
+#define UART_TX_CONTROL UCSRB
+#define UART_TX_UDRIE   UDRIE
+#endif
+
+#if defined(USART0_UDRE_vect)
+#define UART_TX_VECT    USART0_UDRE_vect
+#else
+#define UART_TX_VECT    USART_UDRE_vect
+#endif
+
+static volatile uint8_t tx_buf[UART_TX_BUFFER_SIZE];
+static volatile uint8_t tx_head;
+static volatile uint8_t tx_tail;
+volatile uint8_t uart_tx_dropped;
+
+uint8_t uart_tx_put(uint8_t data)
+{
+	uint8_t sreg = SREG;
+	uint8_t head;
+
+	cli();
+	head = (tx_head + 1) & UART_TX_BUFFER_MASK;
+	if (head == tx_tail)
+	{
+		SREG = sreg;
+		return 0;
+	}
+	tx_buf[tx_head] = data;
+	tx_head = head;
+	UART_TX_CONTROL |= (1<<UART_TX_UDRIE);
+	SREG = sreg;
+	return 1;
+}
+
+void uart_tx_putc(uint8_t data)
+{
+	if (SREG & (1<<SREG_I))
+	{
+		while (!uart_tx_put(data));
+	}
+	else if (!uart_tx_put(data) && uart_tx_dropped != 0xFF)
+		uart_tx_dropped++;
+}
+
+void uart_tx_puts(const char* s)
+{
+	while (*s)
+		uart_tx_putc(*s++);
+}
+
+ISR(UART_TX_VECT)
+{
+	uint8_t tail = tx_tail;
+
+	if (tx_head != tail)
+	{
+		UART_TX_DATA = tx_buf[tail];
+		tx_tail = (tail + 1) & UART_TX_BUFFER_MASK;
+	}
+	else
+		UART_TX_CONTROL &= ~(1<<UART_TX_UDRIE);
+}
@@ -0,0 +1,21 @@
+/* flash and RAM are the same on the host */
+#ifndef BENCH_AVR_PGMSPACE_H
+#define BENCH_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_byte_near(addr) pgm_read_byte(addr)
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+
+#define strcmp_P strcmp
+#define strlen_P strlen
+#define memcpy_P memcpy
+
+#endif
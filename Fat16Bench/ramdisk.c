@@ -0,0 +1,100 @@
+#include <string.h>
+
+#include "ramdisk.h"
+
+#define RESERVED_BLOCKS 1
+#define FAT_COPIES 2
+#define ROOT_ENTRIES 512
+
+uint8_t ramdisk[RAMDISK_MAX_BLOCKS * 512];
+struct ramdisk_counts ramdisk_counts;
+
+static uint32_t fat_start;
+static uint32_t fat_end;
+
+static void put_u16(uint8_t* p, uint16_t value)
+{
+	p[0] = value & 0xff;
+	p[1] = value >> 8;
+}
+
+static void put_u32(uint8_t* p, uint32_t value)
+{
+	put_u16(p, value & 0xffff);
+	put_u16(p + 2, value >> 16);
+}
+
+void ramdisk_format(uint32_t blocks, uint8_t sectors_per_cluster)
+{
+	uint8_t* bs = ramdisk;
+	uint32_t clusters = blocks / sectors_per_cluster;
+	uint16_t fat_blocks = ((clusters + 2) * 2 + 511) / 512;
+	uint8_t i;
+
+	memset(ramdisk, 0, blocks * 512);
+	memset(&ramdisk_counts, 0, sizeof(ramdisk_counts));
+
+	memcpy(bs, "\xeb\x3c\x90" "MSDOS5.0", 11);
+	put_u16(bs + 11, 512);
+	bs[13] = sectors_per_cluster;
+	put_u16(bs + 14, RESERVED_BLOCKS);
+	bs[16] = FAT_COPIES;
+	put_u16(bs + 17, ROOT_ENTRIES);
+	if (blocks < 0x10000)
+		put_u16(bs + 19, blocks);
+	else
+		put_u32(bs + 32, blocks);
+	bs[21] = 0xf8;
+	put_u16(bs + 22, fat_blocks);
+	put_u16(bs + 24, 63);
+	put_u16(bs + 26, 255);
+	memcpy(bs + 0x36, "FAT16   ", 8);
+	bs[510] = 0x55;
+	bs[511] = 0xaa;
+
+	fat_start = RESERVED_BLOCKS * 512UL;
+	fat_end = fat_start + FAT_COPIES * fat_blocks * 512UL;
+	for (i = 0; i < FAT_COPIES; i++)
+	{
+		/* media byte and end of chain for the two reserved clusters */
+		put_u16(ramdisk + fat_start + i * fat_blocks * 512UL, 0xfff8);
+		put_u16(ramdisk + fat_start + i * fat_blocks * 512UL + 2, 0xffff);
+	}
+}
+
+uint8_t ramdisk_read(uint32_t offset, uint8_t* buffer, uint16_t length)
+{
+	if (offset + length > sizeof(ramdisk))
+		return 0;
+	ramdisk_counts.reads++;
+	if (offset >= fat_start && offset < fat_end)
+		ramdisk_counts.fat_reads++;
+	memcpy(buffer, ramdisk + offset, length);
+	return 1;
+}
+
+uint8_t ramdisk_read_interval(uint32_t offset, uint8_t* buffer, uint16_t interval, uint16_t length, device_read_callback_t callback, void* p)
+{
+	if (!buffer || interval == 0 || length < interval || !callback)
+		return 0;
+
+	while (length >= interval)
+	{
+		if (!ramdisk_read(offset, buffer, interval))
+			return 0;
+		if (!callback(buffer, offset, p))
+			break;
+		offset += interval;
+		length -= interval;
+	}
+	return 1;
+}
+
+uint8_t ramdisk_write(uint32_t offset, const uint8_t* buffer, uint16_t length)
+{
+	if (offset + length > sizeof(ramdisk))
+		return 0;
+	ramdisk_counts.writes++;
+	memcpy(ramdisk + offset, buffer, length);
+	return 1;
+}
@@ -0,0 +1,31 @@
+/*
+ * RAM disk holding a freshly formatted FAT16 "superfloppy" (no MBR), with
+ * the device callbacks of partition.h and counters for every access.
+ */
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include <stdint.h>
+
+#include "partition.h"
+
+#define RAMDISK_MAX_BLOCKS 32768UL
+
+struct ramdisk_counts
+{
+	unsigned long reads;      /* device_read calls, including those of read_interval */
+	unsigned long fat_reads;  /* the ones that started inside a FAT copy */
+	unsigned long writes;     /* device_write calls */
+};
+
+extern uint8_t ramdisk[RAMDISK_MAX_BLOCKS * 512];
+extern struct ramdisk_counts ramdisk_counts;
+
+/* blocks must give at least 4085 clusters, or it is no FAT16 */
+void ramdisk_format(uint32_t blocks, uint8_t sectors_per_cluster);
+
+uint8_t ramdisk_read(uint32_t offset, uint8_t* buffer, uint16_t length);
+uint8_t ramdisk_read_interval(uint32_t offset, uint8_t* buffer, uint16_t interval, uint16_t length, device_read_callback_t callback, void* p);
+uint8_t ramdisk_write(uint32_t offset, const uint8_t* buffer, uint16_t length);
+
+#endif
@@ -0,0 +1,233 @@
+/*
+ * seekbench - FAT reads caused by random seeks into fragmented fat16 files.
+ *
+ * usage: seekbench [-n calls] [-m fat_reads] [-w]
+ *
+ * Formats a 4 MB RAM disk with one sector per cluster and writes four
+ * 40000 byte files in turns, so that each one ends up in pieces: a.bin
+ * and b.bin in 8 runs of 5000 bytes, c.bin and d.bin in 58 runs of 700
+ * bytes. Then a, b and c get -n calls of a random fat16_seek_file() plus
+ * fat16_read_file() of up to 1000 bytes, first through the handle that
+ * wrote them, then after being reopened from the directory. Every read
+ * is compared with what was written. -w stops after the first round, for
+ * copies of fat16.c that cannot look files up by name.
+ *
+ * The exit status is 1 on a data mismatch, and with -m when the files
+ * that fit into the default map (a.bin and b.bin) needed more than that
+ * many FAT reads in the last round.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fat16.h"
+#include "ramdisk.h"
+
+#define DISK_BLOCKS 8192
+#define FILE_COUNT 4
+#define FILE_SIZE 40000
+#define READ_MAX 1000
+
+static const char* const names[FILE_COUNT] = { "a.bin", "b.bin", "c.bin", "d.bin" };
+static uint8_t data[FILE_COUNT][FILE_SIZE];
+static unsigned long mismatches;
+
+static void fail(const char* what)
+{
+	printf("%s failed\n", what);
+	exit(1);
+}
+
+static void write_pieces(struct fat16_file_struct* fd, const uint8_t* buffer, int16_t length)
+{
+	if (fat16_write_file(fd, buffer, length) != length)
+		fail("fat16_write_file");
+}
+
+/* returns the FAT reads of the calls */
+static unsigned long seek_and_read(const char* how, struct fat16_file_struct* fd, int file, int calls)
+{
+	struct ramdisk_counts start = ramdisk_counts;
+	uint8_t buffer[READ_MAX];
+	int i;
+
+	srand(file + 1);
+	for (i = 0; i < calls; i++)
+	{
+		uint32_t pos = rand() % FILE_SIZE;
+		uint16_t length = 1 + rand() % READ_MAX;
+		int32_t offset = pos;
+		int16_t expect = pos + length > FILE_SIZE ? FILE_SIZE - pos : length;
+
+		if (!fat16_seek_file(fd, &offset, FAT16_SEEK_SET) ||
+		    fat16_read_file(fd, buffer, length) != expect ||
+		    memcmp(buffer, data[file] + pos, expect))
+		{
+			if (mismatches++ < 5)
+				printf("%s: %s mismatch at %u+%u\n", names[file], how, pos, length);
+		}
+	}
+
+	printf("%s %-8s %d seek+read: fat reads %7lu, device reads %7lu\n", names[file], how, calls,
+	       ramdisk_counts.fat_reads - start.fat_reads, ramdisk_counts.reads - start.reads);
+	return ramdisk_counts.fat_reads - start.fat_reads;
+}
+
+int main(int argc, char** argv)
+{
+	struct partition_struct* partition;
+	struct fat16_fs_struct* fs;
+	struct fat16_dir_struct* dd;
+	struct fat16_dir_entry_struct entry;
+	struct fat16_file_struct* fd[FILE_COUNT];
+	int calls = 3000;
+	long max_fat_reads = -1;
+	int written_only = 0;
+	unsigned long fat_reads;
+	int file;
+	int pos;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:m:w")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			calls = atoi(optarg);
+			break;
+		case 'm':
+			max_fat_reads = atol(optarg);
+			break;
+		case 'w':
+			written_only = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n calls] [-m fat_reads] [-w]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	ramdisk_format(DISK_BLOCKS, 1);
+	partition = partition_open(ramdisk_read, ramdisk_read_interval, ramdisk_write, -1);
+	if (!partition)
+		fail("partition_open");
+	fs = fat16_open(partition);
+	if (!fs)
+		fail("fat16_open");
+	if (!fat16_get_dir_entry_of_path(fs, "/", &entry))
+		fail("fat16_get_dir_entry_of_path");
+	dd = fat16_open_dir(fs, &entry);
+	if (!dd)
+		fail("fat16_open_dir");
+
+	srand(FILE_COUNT);
+	for (file = 0; file < FILE_COUNT; file++)
+	{
+		for (pos = 0; pos < FILE_SIZE; pos++)
+			data[file][pos] = rand();
+		if (!fat16_create_file(dd, names[file], &entry))
+			fail("fat16_create_file");
+		fd[file] = fat16_open_file(fs, &entry);
+		if (!fd[file])
+			fail("fat16_open_file");
+	}
+	for (pos = 0; pos < FILE_SIZE; pos += 5000)
+	{
+		write_pieces(fd[0], data[0] + pos, 5000);
+		write_pieces(fd[1], data[1] + pos, 5000);
+	}
+	for (pos = 0; pos < FILE_SIZE; pos += 700)
+	{
+		int16_t length = FILE_SIZE - pos < 700 ? FILE_SIZE - pos : 700;
+		write_pieces(fd[2], data[2] + pos, length);
+		write_pieces(fd[3], data[3] + pos, length);
+	}
+
+	fat_reads = 0;
+	for (file = 0; file < 3; file++)
+	{
+		if (file < 2)
+			fat_reads += seek_and_read("written", fd[file], file, calls);
+		else
+			seek_and_read("written", fd[file], file, calls);
+	}
+	for (file = 0; file < FILE_COUNT; file++)
+		fat16_close_file(fd[file]);
+	if (written_only)
+		goto done;
+
+	fat_reads = 0;
+	for (file = 0; file < 3; file++)
+	{
+		char path[16];
+		struct ramdisk_counts start = ramdisk_counts;
+
+		sprintf(path, "/%s", names[file]);
+		if (!fat16_get_dir_entry_of_path(fs, path, &entry) || entry.file_size != FILE_SIZE)
+			fail("reopening");
+		fd[file] = fat16_open_file(fs, &entry);
+		if (!fd[file])
+			fail("fat16_open_file");
+		printf("%s open:    fat reads %lu\n", names[file], ramdisk_counts.fat_reads - start.fat_reads);
+		if (file < 2)
+			fat_reads += seek_and_read("reopened", fd[file], file, calls);
+		else
+			seek_and_read("reopened", fd[file], file, calls);
+		fat16_close_file(fd[file]);
+	}
+
+	/* the map follows appending and shrinking */
+	if (!fat16_get_dir_entry_of_path(fs, "/a.bin", &entry))
+		fail("reopening");
+	fd[0] = fat16_open_file(fs, &entry);
+	if (!fd[0])
+		fail("fat16_open_file");
+	{
+		static uint8_t more[5000];
+		uint8_t buffer[6000];
+		int32_t offset = 0;
+
+		for (pos = 0; pos < (int)sizeof(more); pos++)
+			more[pos] = pos * 7;
+		if (!fat16_seek_file(fd[0], &offset, FAT16_SEEK_END))
+			fail("fat16_seek_file");
+		write_pieces(fd[0], more, sizeof(more));
+		offset = FILE_SIZE - 1000;
+		if (!fat16_seek_file(fd[0], &offset, FAT16_SEEK_SET) ||
+		    fat16_read_file(fd[0], buffer, 6000) != 6000 ||
+		    memcmp(buffer, data[0] + FILE_SIZE - 1000, 1000) || memcmp(buffer + 1000, more, 5000))
+		{
+			printf("a.bin: mismatch after appending\n");
+			mismatches++;
+		}
+		if (!fat16_resize_file(fd[0], 20000))
+			fail("fat16_resize_file");
+		offset = 19000;
+		if (!fat16_seek_file(fd[0], &offset, FAT16_SEEK_SET) ||
+		    fat16_read_file(fd[0], buffer, 6000) != 1000 ||
+		    memcmp(buffer, data[0] + 19000, 1000))
+		{
+			printf("a.bin: mismatch after shrinking\n");
+			mismatches++;
+		}
+	}
+	fat16_close_file(fd[0]);
+
+done:
+	fat16_close_dir(dd);
+	fat16_close(fs);
+	partition_close(partition);
+
+	if (mismatches)
+	{
+		printf("%lu mismatches\n", mismatches);
+		return 1;
+	}
+	if (max_fat_reads >= 0 && fat_reads > (unsigned long)max_fat_reads)
+	{
+		printf("%lu FAT reads for a.bin and b.bin, more than %ld\n", fat_reads, max_fat_reads);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,260 @@
+/*
+ * framedecode - host side decoder for the COBS + CRC16 frames sent by
+ * frame_send() (see frame.h).
+ *
+ * usage: framedecode [-b baud] [-o file] [input]
+ *
+ * Reads from input (a file or a serial device, default stdin), prints
+ * accelerometer samples one per line and writes FRAME_TYPE_FILE_DATA
+ * frames to the file given with -o. Frames with a bad CRC are reported
+ * on stderr and skipped. Bytes outside frames, e.g. the text prompt,
+ * only cost the frame they run into.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "frame.h"
+
+/* type + payload + crc */
+#define FRAME_MAX_DECODED (1 + FRAME_MAX_PAYLOAD * FRAME_MAX_PARTS + 2)
+/* worst case COBS overhead is one byte per 254 */
+#define FRAME_MAX_ENCODED (FRAME_MAX_DECODED + FRAME_MAX_DECODED / 254 + 1)
+
+static FILE* out_file;
+static unsigned long frames_ok;
+static unsigned long frames_bad;
+
+static uint16_t crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+	data ^= crc & 0xff;
+	data ^= data << 4;
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+static uint32_t get_u32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* returns the decoded length or -1 if the frame is malformed or does not
+   fit into size bytes */
+static int cobs_decode(const uint8_t* in, int length, uint8_t* out, int size)
+{
+	int i = 0;
+	int n = 0;
+
+	while (i < length)
+	{
+		int code = in[i++];
+		if (code == 0 || i + code - 1 > length || n + code - 1 > size)
+			return -1;
+		memcpy(out + n, in + i, code - 1);
+		n += code - 1;
+		i += code - 1;
+		if (code < 0xff && i < length)
+		{
+			if (n == size)
+				return -1;
+			out[n++] = 0;
+		}
+	}
+	return n;
+}
+
+static void handle_frame(const uint8_t* data, int length)
+{
+	uint16_t crc = 0xffff;
+	int i;
+
+	if (length < 3)
+	{
+		frames_bad++;
+		fprintf(stderr, "short frame (%d bytes)\n", length);
+		return;
+	}
+	for (i = 0; i < length - 2; i++)
+		crc = crc_ccitt_update(crc, data[i]);
+	if ((crc & 0xff) != data[length - 2] || (crc >> 8) != data[length - 1])
+	{
+		frames_bad++;
+		fprintf(stderr, "crc error in frame of type 0x%02x\n", data[0]);
+		return;
+	}
+	frames_ok++;
+
+	const uint8_t* payload = data + 1;
+	int payload_length = length - 3;
+
+	switch (data[0])
+	{
+	case FRAME_TYPE_ACCEL:
+		for (i = 0; i + 6 <= payload_length; i += 6)
+			printf("%d %d %d\n",
+			       (int16_t)(payload[i] | (payload[i + 1] << 8)),
+			       (int16_t)(payload[i + 2] | (payload[i + 3] << 8)),
+			       (int16_t)(payload[i + 4] | (payload[i + 5] << 8)));
+		break;
+	case FRAME_TYPE_FILE_DATA:
+		if (payload_length < 4)
+			break;
+		if (out_file)
+		{
+			fseek(out_file, get_u32(payload), SEEK_SET);
+			fwrite(payload + 4, 1, payload_length - 4, out_file);
+		}
+		else
+			printf("file data at %lu, %d bytes\n", (unsigned long)get_u32(payload), payload_length - 4);
+		break;
+	case FRAME_TYPE_FILE_END:
+		if (payload_length < 4)
+			break;
+		printf("file end, %lu bytes\n", (unsigned long)get_u32(payload));
+		if (out_file)
+		{
+			fflush(out_file);
+			if (ftruncate(fileno(out_file), get_u32(payload)) != 0)
+				perror("ftruncate");
+		}
+		break;
+	default:
+		printf("type 0x%02x:", data[0]);
+		for (i = 0; i < payload_length; i++)
+			printf(" %02x", payload[i]);
+		printf("\n");
+		break;
+	}
+	fflush(stdout);
+}
+
+static speed_t baud_constant(long baud)
+{
+	switch (baud)
+	{
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+#ifdef B500000
+	case 500000: return B500000;
+#endif
+#ifdef B1000000
+	case 1000000: return B1000000;
+#endif
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	static uint8_t encoded[FRAME_MAX_ENCODED];
+	static uint8_t decoded[FRAME_MAX_DECODED];
+	uint8_t chunk[256];
+	long baud = 9600;
+	int length = 0;
+	int overflow = 0;
+	int fd = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:o:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'b':
+			baud = strtol(optarg, NULL, 10);
+			break;
+		case 'o':
+			out_file = fopen(optarg, "w+b");
+			if (!out_file)
+			{
+				perror(optarg);
+				return 1;
+			}
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-b baud] [-o file] [input]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind < argc)
+	{
+		fd = open(argv[optind], O_RDONLY | O_NOCTTY);
+		if (fd < 0)
+		{
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+
+	if (isatty(fd))
+	{
+		struct termios tio;
+		speed_t speed = baud_constant(baud);
+
+		if (!speed)
+		{
+			fprintf(stderr, "unsupported baud rate %ld\n", baud);
+			return 1;
+		}
+		tcgetattr(fd, &tio);
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, speed);
+		cfsetospeed(&tio, speed);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+
+	while (1)
+	{
+		ssize_t n = read(fd, chunk, sizeof(chunk));
+		ssize_t i;
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+
+		for (i = 0; i < n; i++)
+		{
+			if (chunk[i] != 0)
+			{
+				if (length < (int)sizeof(encoded))
+					encoded[length++] = chunk[i];
+				else
+					overflow = 1;
+				continue;
+			}
+
+			/* delimiter, decode what was collected since the last one */
+			if (overflow)
+			{
+				frames_bad++;
+				fprintf(stderr, "frame too long\n");
+			}
+			else if (length > 0)
+			{
+				int decoded_length = cobs_decode(encoded, length, decoded, sizeof(decoded));
+				if (decoded_length < 0)
+				{
+					frames_bad++;
+					fprintf(stderr, "malformed frame\n");
+				}
+				else
+					handle_frame(decoded, decoded_length);
+			}
+			length = 0;
+			overflow = 0;
+		}
+	}
+
+	if (out_file)
+		fclose(out_file);
+	fprintf(stderr, "%lu frames, %lu errors\n", frames_ok, frames_bad);
+	return frames_bad ? 2 : 0;
+}
@@ -36,12 +36,26 @@ struct fat16_fs_struct
     struct fat16_header_struct header;
 };
 
+struct fat16_cluster_run_struct
+{
+    uint16_t cluster;
+    uint16_t count;
+};
+
 struct fat16_file_struct
 {
     struct fat16_fs_struct* fs;
     struct fat16_dir_entry_struct dir_entry;
     uint32_t pos;
     uint16_t pos_cluster;
+#if FAT16_CLUSTER_MAP_RUNS
+    struct fat16_cluster_run_struct cluster_map[FAT16_CLUSTER_MAP_RUNS];
+    uint8_t cluster_map_runs;
+    uint8_t cluster_map_complete;
+#endif
+#if FAT16_DELAYED_SIZE_UPDATE
+    uint8_t size_dirty;
+#endif
 };
 
 struct fat16_dir_struct
@@ -65,6 +79,12 @@ static uint8_t fat16_read_sub_dir_entry(const struct fat16_fs_struct* fs, uint16
 static uint8_t fat16_dir_entry_seek_callback(uint8_t* buffer, uint32_t offset, void* p);
 static uint8_t fat16_dir_entry_read_callback(uint8_t* buffer, uint32_t offset, void* p);
 static uint16_t fat16_get_next_cluster(const struct fat16_fs_struct* fs, uint16_t cluster_num);
+static uint16_t fat16_get_file_cluster(const struct fat16_file_struct* fd, uint16_t cluster_index);
+static uint16_t fat16_get_next_file_cluster(const struct fat16_file_struct* fd, uint16_t cluster_num);
+#if FAT16_CLUSTER_MAP_RUNS
+static void fat16_build_cluster_map(struct fat16_file_struct* fd);
+static void fat16_append_cluster_map(struct fat16_file_struct* fd, uint16_t cluster_num);
+#endif
 static uint16_t fat16_append_clusters(const struct fat16_fs_struct* fs, uint16_t cluster_num, uint16_t count);
 static uint8_t fat16_free_clusters(const struct fat16_fs_struct* fs, uint16_t cluster_num);
 static uint8_t fat16_write_dir_entry(const struct fat16_fs_struct* fs, const struct fat16_dir_entry_struct* dir_entry);
@@ -442,6 +462,133 @@ uint16_t fat16_get_next_cluster(const struct fat16_fs_struct* fs, uint16_t clust
     return cluster_num;
 }
 
+uint16_t fat16_get_file_cluster(const struct fat16_file_struct* fd, uint16_t cluster_index)
+{
+    uint16_t cluster_num = fd->dir_entry.cluster;
+
+#if FAT16_CLUSTER_MAP_RUNS
+    const struct fat16_cluster_run_struct* run = fd->cluster_map;
+    uint8_t i;
+    for(i = 0; i < fd->cluster_map_runs; ++i, ++run)
+    {
+        if(cluster_index < run->count)
+            return run->cluster + cluster_index;
+
+        cluster_index -= run->count;
+        cluster_num = run->cluster + run->count - 1;
+    }
+
+    if(fd->cluster_map_runs)
+    {
+        if(fd->cluster_map_complete)
+            return 0;
+
+        /* continue from the last mapped cluster */
+        ++cluster_index;
+    }
+#endif
+
+    while(cluster_index-- > 0 && cluster_num)
+        cluster_num = fat16_get_next_cluster(fd->fs, cluster_num);
+
+    return cluster_num;
+}
+
+uint16_t fat16_get_next_file_cluster(const struct fat16_file_struct* fd, uint16_t cluster_num)
+{
+#if FAT16_CLUSTER_MAP_RUNS
+    const struct fat16_cluster_run_struct* run = fd->cluster_map;
+    uint8_t i;
+    for(i = 0; i < fd->cluster_map_runs; ++i, ++run)
+    {
+        if(cluster_num < run->cluster || cluster_num - run->cluster >= run->count)
+            continue;
+
+        if(cluster_num - run->cluster + 1 < run->count)
+            return cluster_num + 1;
+        if(i + 1 < fd->cluster_map_runs)
+            return run[1].cluster;
+        if(fd->cluster_map_complete)
+            return 0;
+        break;
+    }
+#endif
+
+    return fat16_get_next_cluster(fd->fs, cluster_num);
+}
+
+#if FAT16_CLUSTER_MAP_RUNS
+void fat16_build_cluster_map(struct fat16_file_struct* fd)
+{
+    struct fat16_cluster_run_struct* run = fd->cluster_map;
+    uint16_t cluster_num = fd->dir_entry.cluster;
+    uint16_t chunk_first = 0;
+    uint8_t chunk[32];
+
+    fd->cluster_map_runs = 0;
+    fd->cluster_map_complete = 0;
+
+    while(cluster_num)
+    {
+        /* extend the current run or start a new one */
+        if(fd->cluster_map_runs && cluster_num == run->cluster + run->count)
+        {
+            ++run->count;
+        }
+        else
+        {
+            if(fd->cluster_map_runs == FAT16_CLUSTER_MAP_RUNS)
+                return;
+
+            run = &fd->cluster_map[fd->cluster_map_runs++];
+            run->cluster = cluster_num;
+            run->count = 1;
+        }
+
+        /* read the next part of the fat if the entry is not in memory */
+        if(!chunk_first || cluster_num < chunk_first || cluster_num >= chunk_first + sizeof(chunk) / 2)
+        {
+            if(!fd->fs->partition->device_read(fd->fs->header.fat_offset + 2 * (uint32_t) cluster_num, chunk, sizeof(chunk)))
+                return;
+            chunk_first = cluster_num;
+        }
+
+        uint8_t* fat_entry = &chunk[2 * (cluster_num - chunk_first)];
+        cluster_num = ((uint16_t) fat_entry[0]) |
+                      ((uint16_t) fat_entry[1] << 8);
+
+        /* free, reserved, bad and last cluster marks end the chain */
+        if(cluster_num < 2 || cluster_num >= FAT16_CLUSTER_RESERVED_MIN)
+            cluster_num = 0;
+    }
+
+    fd->cluster_map_complete = 1;
+}
+
+void fat16_append_cluster_map(struct fat16_file_struct* fd, uint16_t cluster_num)
+{
+    if(!cluster_num || !fd->cluster_map_complete)
+        return;
+
+    struct fat16_cluster_run_struct* run = &fd->cluster_map[fd->cluster_map_runs];
+    if(fd->cluster_map_runs && cluster_num == run[-1].cluster + run[-1].count)
+    {
+        ++run[-1].count;
+    }
+    else if(fd->cluster_map_runs < FAT16_CLUSTER_MAP_RUNS)
+    {
+        run->cluster = cluster_num;
+        run->count = 1;
+        ++fd->cluster_map_runs;
+    }
+    else
+    {
+        /* the end of the chain is not mapped anymore */
+        fd->cluster_map_complete = 0;
+    }
+}
+#endif
+
 /**
  * \ingroup fat16_fs
  * Appends a new cluster chain to an existing one.
@@ -609,6 +756,12 @@ struct fat16_file_struct* fat16_open_file(struct fat16_fs_struct* fs, const stru
     fd->fs = fs;
     fd->pos = 0;
     fd->pos_cluster = dir_entry->cluster;
+#if FAT16_CLUSTER_MAP_RUNS
+    fat16_build_cluster_map(fd);
+#endif
+#if FAT16_DELAYED_SIZE_UPDATE
+    fd->size_dirty = 0;
+#endif
 
     return fd;
 }
@@ -617,13 +770,55 @@ struct fat16_file_struct* fat16_open_file(struct fat16_fs_struct* fs, const stru
  * \ingroup fat16_file
  * Closes a file.
  *
+ * With FAT16_DELAYED_SIZE_UPDATE a pending size change is written
+ * to the directory entry first.
+ *
  * \param[in] fd The file handle of the file to close.
  * \see fat16_open_file
  */
 void fat16_close_file(struct fat16_file_struct* fd)
 {
     if(fd)
+    {
+#if FAT16_DELAYED_SIZE_UPDATE
+        fat16_sync_file(fd);
+#endif
         free(fd);
+    }
+}
+
+/**
+ * \ingroup fat16_file
+ * Writes the file size to the directory entry.
+ *
+ * With FAT16_DELAYED_SIZE_UPDATE, fat16_write_file() only updates
+ * the size in memory, so that appending a block costs one block
+ * write instead of three. Call this from time to time to make the
+ * data written so far visible on the card. Without the option the
+ * directory entry is always current and this does nothing.
+ *
+ * \note The block may still sit in the write buffer of the device,
+ *       call sd_raw_sync() afterwards.
+ *
+ * \param[in] fd The file handle of the file to sync.
+ * \returns 0 on failure, 1 on success.
+ * \see fat16_write_file
+ */
+uint8_t fat16_sync_file(struct fat16_file_struct* fd)
+{
+    if(!fd)
+        return 0;
+
+#if FAT16_DELAYED_SIZE_UPDATE
+    if(fd->size_dirty)
+    {
+        if(!fat16_write_dir_entry(fd->fs, &fd->dir_entry))
+            return 0;
+        fd->size_dirty = 0;
+    }
+#endif
+
+    return 1;
 }
 
 /**
@@ -670,14 +865,9 @@ int16_t fat16_read_file(struct fat16_file_struct* fd, uint8_t* buffer, uint16_t
 
         if(fd->pos)
         {
-            uint32_t pos = fd->pos;
-            while(pos >= cluster_size)
-            {
-                pos -= cluster_size;
-                cluster_num = fat16_get_next_cluster(fd->fs, cluster_num);
-                if(!cluster_num)
-                    return -1;
-            }
+            cluster_num = fat16_get_file_cluster(fd, fd->pos / cluster_size);
+            if(!cluster_num)
+                return -1;
         }
     }
     
@@ -703,7 +893,7 @@ int16_t fat16_read_file(struct fat16_file_struct* fd, uint8_t* buffer, uint16_t
         if(first_cluster_offset + copy_length >= cluster_size)
         {
             /* we are on a cluster boundary, so get the next cluster */
-            if((cluster_num = fat16_get_next_cluster(fd->fs, cluster_num)))
+            if((cluster_num = fat16_get_next_file_cluster(fd, cluster_num)))
             {
                 first_cluster_offset = 0;
             }
@@ -731,7 +921,7 @@ int16_t fat16_read_file(struct fat16_file_struct* fd, uint8_t* buffer, uint16_t
  * \param[in] buffer The buffer from which to read the data to be written.
  * \param[in] buffer_len The amount of data to write.
  * \returns The number of bytes written, 0 on disk full, or -1 on failure.
- * \see fat16_read_file
+ * \see fat16_read_file, fat16_sync_file
  */
 int16_t fat16_write_file(struct fat16_file_struct* fd, const uint8_t* buffer, uint16_t buffer_len)
 {
@@ -760,6 +950,9 @@ int16_t fat16_write_file(struct fat16_file_struct* fd, const uint8_t* buffer, ui
                 fd->dir_entry.cluster = cluster_num = fat16_append_clusters(fd->fs, 0, 1);
                 if(!cluster_num)
                     return -1;
+#if FAT16_CLUSTER_MAP_RUNS
+                fat16_append_cluster_map(fd, cluster_num);
+#endif
             }
             else
             {
@@ -769,20 +962,18 @@ int16_t fat16_write_file(struct fat16_file_struct* fd, const uint8_t* buffer, ui
 
         if(fd->pos)
         {
-            uint32_t pos = fd->pos;
-            uint16_t cluster_num_next;
-            while(pos >= cluster_size)
+            uint16_t cluster_index = fd->pos / cluster_size;
+            cluster_num = fat16_get_file_cluster(fd, cluster_index);
+            if(!cluster_num && fd->pos % cluster_size == 0)
             {
-                pos -= cluster_size;
-                cluster_num_next = fat16_get_next_cluster(fd->fs, cluster_num);
-                if(!cluster_num_next && pos == 0)
-                    /* the file exactly ends on a cluster boundary, and we append to it */
-                    cluster_num_next = fat16_append_clusters(fd->fs, cluster_num, 1);
-                if(!cluster_num_next)
-                    return -1;
-
-                cluster_num = cluster_num_next;
+                /* the file exactly ends on a cluster boundary, and we append to it */
+                cluster_num = fat16_append_clusters(fd->fs, fat16_get_file_cluster(fd, cluster_index - 1), 1);
+#if FAT16_CLUSTER_MAP_RUNS
+                fat16_append_cluster_map(fd, cluster_num);
+#endif
             }
+            if(!cluster_num)
+                return -1;
         }
     }
     
@@ -808,10 +999,15 @@ int16_t fat16_write_file(struct fat16_file_struct* fd, const uint8_t* buffer, ui
         if(first_cluster_offset + write_length >= cluster_size)
         {
             /* we are on a cluster boundary, so get the next cluster */
-            uint16_t cluster_num_next = fat16_get_next_cluster(fd->fs, cluster_num);
+            uint16_t cluster_num_next = fat16_get_next_file_cluster(fd, cluster_num);
             if(!cluster_num_next && buffer_left > 0)
+            {
                 /* we reached the last cluster, append a new one */
                 cluster_num_next = fat16_append_clusters(fd->fs, cluster_num, 1);
+#if FAT16_CLUSTER_MAP_RUNS
+                fat16_append_cluster_map(fd, cluster_num_next);
+#endif
+            }
             if(!cluster_num_next)
             {
                 fd->pos_cluster = 0;
@@ -829,6 +1025,11 @@ int16_t fat16_write_file(struct fat16_file_struct* fd, const uint8_t* buffer, ui
     /* update directory entry */
     if(fd->pos > fd->dir_entry.file_size)
     {
+#if FAT16_DELAYED_SIZE_UPDATE
+        /* written by fat16_sync_file() or fat16_close_file() */
+        fd->dir_entry.file_size = fd->pos;
+        fd->size_dirty = 1;
+#else
         uint32_t size_old = fd->dir_entry.file_size;
 
         /* update file size */
@@ -843,6 +1044,7 @@ int16_t fat16_write_file(struct fat16_file_struct* fd, const uint8_t* buffer, ui
             buffer_left = fd->pos - size_old;
             fd->pos = size_old;
         }
+#endif
     }
 
     return buffer_len - buffer_left;
@@ -1005,8 +1207,15 @@ uint8_t fat16_resize_file(struct fat16_file_struct* fd, uint32_t size)
     fd->dir_entry.file_size = size;
     if(size == 0)
         fd->dir_entry.cluster = 0;
+#if FAT16_CLUSTER_MAP_RUNS
+    /* the cluster chain changed */
+    fat16_build_cluster_map(fd);
+#endif
     if(!fat16_write_dir_entry(fd->fs, &fd->dir_entry))
         return 0;
+#if FAT16_DELAYED_SIZE_UPDATE
+    fd->size_dirty = 0;
+#endif
 
     return 1;
 }
@@ -3,6 +3,10 @@
 
 #include <stdint.h>
 #define FAT16_WRITE_SUPPORT 1
+#define FAT16_CLUSTER_MAP_RUNS 8
+#ifndef FAT16_DELAYED_SIZE_UPDATE
+#define FAT16_DELAYED_SIZE_UPDATE 1
+#endif
 
 /**
  * \addtogroup fat16
@@ -73,6 +77,7 @@ void fat16_close(struct fat16_fs_struct* fs);
 
 struct fat16_file_struct* fat16_open_file(struct fat16_fs_struct* fs, const struct fat16_dir_entry_struct* dir_entry);
 void fat16_close_file(struct fat16_file_struct* fd);
+uint8_t fat16_sync_file(struct fat16_file_struct* fd);
 int16_t fat16_read_file(struct fat16_file_struct* fd, uint8_t* buffer, uint16_t buffer_len);
 int16_t fat16_write_file(struct fat16_file_struct* fd, const uint8_t* buffer, uint16_t buffer_len);
 uint8_t fat16_seek_file(struct fat16_file_struct* fd, int32_t* offset, uint8_t whence);
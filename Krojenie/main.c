@@ -1,60 +1,99 @@
+#ifndef F_CPU
+#define F_CPU 8000000UL  // 8 MHz
+#endif
+#ifndef USART_BAUDRATE
+#define USART_BAUDRATE 9600
+#endif
+
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <stdlib.h>
 #include "fat16.h"
 #include "partition.h"
 #include "sd_raw.h"
 #include "sd_raw_config.h"
+#include "sdlog.h"
 #include <inttypes.h>
+#include "uart_tx.h"
+#include "baud.h"
 
-#define F_CPU 8000000UL  // 8 MHz
-#define USART_BAUDRATE 9600
-#define BAUD_PRESCALE (((F_CPU / (USART_BAUDRATE * 16UL))) - 1)
 
+void USART_Init(void)
+{
+	UBRR0H = (unsigned char)(BAUD_UBRR>>8);
+	UBRR0L = (unsigned char)BAUD_UBRR;
+	UCSR0A = (BAUD_U2X<<U2X0);
+	UCSR0B = (1<<RXEN0)|(1<<TXEN0)|(1<<RXCIE0);
+	UCSR0C = (1<<USBS0)|(3<<UCSZ00);
 
-void uart_Send(uint8_t u8Data)
+}
+
+void strSend(char* msg)
 {
-	while((UCSRA &(1<<UDRE)) == 0);
-	UDR = u8Data;
+	uart_tx_puts(msg);
 }
 
-void USART_Init(void)
+void Timer0_Init(void)
 {
-	UBRR0H = (unsigned char)(BAUD_PRESCALE>>8);
-	UBRR0L = (unsigned char)BAUD_PRESCALE;
-	UCSR0B = (1<<RXEN0)|(1<<TXEN0)|(1<<RXCIE0);
-	UCSR0C = (1<<URSEL)|(1<<USBS0)|(3<<UCSZ00);
+	TCCR0B = (1<<CS02)|(1<<CS00); // F_CPU/1024, przepelnienie co 32,8 ms przy 8 MHz
+	TIMSK0 |= (1<<TOIE0);
+}
+
+void statusSend(uint16_t plik)
+{
+	struct sdlog_stats stats;
+	char liczba[6];
 
+	sdlog_get_stats(&stats, 1);
+	strSend("log ");
+	strSend(utoa(plik, liczba, 10));
+	strSend(" fe ");
+	strSend(utoa(stats.frame, liczba, 10));
+	strSend(" dor ");
+	strSend(utoa(stats.overrun, liczba, 10));
+	strSend(" drop ");
+	strSend(utoa(stats.dropped, liczba, 10));
+	strSend("\r\n");
 }
 
-void strSend(char* msg)
+ISR(USART0_RX_vect)
 {
-	uint8_t j=0;
-		while(*(msg + j) != 0)
-		{
-			uart_Send(*(msg + j));
-			j++;
-		}
+	uint8_t status = UCSR0A; // FE i DOR trzeba odczytac przed UDR0
+	sdlog_rx(UDR0, status & (1<<FE0), status & (1<<DOR0));
 }
 
-ISR(USART_RXC_vect)
+ISR(TIMER0_OVF_vect)
 {
-	uint8_t dane = UDR;
-	uart_Send(dane);
+	sdlog_tick();
 }
 
 int main(void){
+	uint16_t plik = 0;
 
 	DDRB |= (1<<PB0)|(1<<PB1);
 	PORTB &= ~((1<<PB0)|(1<<PB1));
 
 	cli();
 	USART_Init(); //Inicjalizacja komunikacji USART
+	Timer0_Init(); //takt dla zapisu niepelnego bufora i zapisu rozmiaru pliku
 	sei(); // odblokowanie przerwan globalnych SET INTERRUPTS
 
 	if(sd_raw_init()) PORTB |= (1<<PB0); //niebieska
 	if(sd_raw_available()) PORTB |= (1<<PB1); //czerwona
 
+	// przerwanie odbioru zapelnia jeden bufor, petla zapisuje drugi na karte
+	if(sdlog_open()){
+		while(sdlog_task()){
+			if(plik != sdlog_file_number()){ // nowy plik, liczniki bledow z poprzedniego
+				statusSend(plik);
+				plik = sdlog_file_number();
+			}
+		}
+	}
+	PORTB &= ~(1<<PB0); // niebieska gasnie: zapis zatrzymany
+	statusSend(plik);
+
 	while(1){
 	}
 return 0;
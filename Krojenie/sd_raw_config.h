@@ -54,7 +54,9 @@
     #define configure_pin_ss() DDRB |= (1 << DDB2)
     #define configure_pin_miso() DDRB &= ~(1 << DDB4)
 #elif defined(__AVR_ATmega16__) || \
-      defined(__AVR_ATmega32__)
+      defined(__AVR_ATmega32__) || \
+      defined(__AVR_ATmega324A__) || \
+      defined(__AVR_ATmega644__)
     #define configure_pin_mosi() DDRB |= (1 << DDB5)
     #define configure_pin_sck() DDRB |= (1 << DDB7)
     #define configure_pin_ss() DDRB |= (1 << DDB4)
@@ -0,0 +1,228 @@
+#include "sdlog.h"
+#include <avr/interrupt.h>
+#include <string.h>
+#include "fat16.h"
+#include "partition.h"
+#include "sd_raw.h"
+
+#define SDLOG_BUF_MASK (SDLOG_BUF_SIZE - 1)
+
+uint8_t sdlog_buf[2][SDLOG_BUF_SIZE];
+volatile uint8_t sdlog_fill;
+volatile uint16_t sdlog_pos;
+volatile uint16_t sdlog_limit = SDLOG_BUF_SIZE;
+volatile uint16_t sdlog_ready;
+volatile uint8_t sdlog_idle;
+volatile uint16_t sdlog_ticks;
+volatile struct sdlog_stats sdlog_stats;
+
+static struct fat16_fs_struct* fs;
+static struct fat16_dir_struct* dd;
+static struct fat16_file_struct* fd;
+static uint32_t file_pos;
+static uint16_t file_number;
+static uint8_t file_dirty;
+static uint16_t commit_ticks;
+
+/* "LOGnnnnn.TXT", returns the number or 0 for other names */
+static uint16_t sdlog_parse_name(const char* name)
+{
+	uint16_t number = 0;
+	uint8_t i;
+
+	if (strncmp(name, "LOG", 3))
+		return 0;
+	for (i = 3; i < 8; i++)
+	{
+		if (name[i] < '0' || name[i] > '9')
+			return 0;
+		number = number * 10 + (name[i] - '0');
+	}
+	if (strcmp(name + 8, ".TXT"))
+		return 0;
+	return number;
+}
+
+static void sdlog_make_name(char* name, uint16_t number)
+{
+	uint8_t i;
+
+	strcpy(name, "LOG00000.TXT");
+	for (i = 7; number; i--)
+	{
+		name[i] = '0' + number % 10;
+		number /= 10;
+	}
+}
+
+static uint16_t sdlog_now(void)
+{
+	uint8_t sreg = SREG;
+	uint16_t ticks;
+
+	cli();
+	ticks = sdlog_ticks;
+	SREG = sreg;
+	return ticks;
+}
+
+static uint8_t sdlog_commit(void)
+{
+	file_dirty = 0;
+	commit_ticks = sdlog_now();
+	return fat16_sync_file(fd) && sd_raw_sync();
+}
+
+/* stop logging after a card error, sdlog_task() returns 0 from now on */
+static uint8_t sdlog_stop(void)
+{
+	if (fd)
+	{
+		fat16_close_file(fd);
+		fd = 0;
+	}
+	return 0;
+}
+
+static uint8_t sdlog_open_next(void)
+{
+	struct fat16_dir_entry_struct entry;
+	char name[13];
+
+	if (fd)
+	{
+		/* writes the final size */
+		fat16_close_file(fd);
+		fd = 0;
+		if (!sd_raw_sync())
+			return 0;
+	}
+
+	/* 65535 files are the end */
+	if (!++file_number)
+		return 0;
+	sdlog_make_name(name, file_number);
+	if (!fat16_create_file(dd, name, &entry))
+		return 0;
+	fd = fat16_open_file(fs, &entry);
+	if (!fd)
+		return 0;
+
+	/* the number is above every existing log, so the file is new and
+	   the buffer boundaries stay aligned to sectors */
+	file_pos = 0;
+	file_dirty = 0;
+	commit_ticks = sdlog_now();
+	return 1;
+}
+
+uint8_t sdlog_open(void)
+{
+	struct partition_struct* partition;
+	struct fat16_dir_entry_struct entry;
+	uint16_t number;
+
+	partition = partition_open(sd_raw_read, sd_raw_read_interval, sd_raw_write, 0);
+	if (!partition)
+	{
+		/* no MBR, the card is formatted as a "superfloppy" */
+		partition = partition_open(sd_raw_read, sd_raw_read_interval, sd_raw_write, -1);
+		if (!partition)
+			return 0;
+	}
+
+	fs = fat16_open(partition);
+	if (!fs)
+		return 0;
+	if (!fat16_get_dir_entry_of_path(fs, "/", &entry))
+		return 0;
+	dd = fat16_open_dir(fs, &entry);
+	if (!dd)
+		return 0;
+
+	/* continue after the highest number on the card */
+	file_number = 0;
+	while (fat16_read_dir(dd, &entry))
+	{
+		number = sdlog_parse_name(entry.long_name);
+		if (number > file_number)
+			file_number = number;
+	}
+
+	return sdlog_open_next();
+}
+
+uint8_t sdlog_task(void)
+{
+	uint8_t sreg;
+	uint8_t idle;
+	uint16_t len;
+	uint16_t ticks;
+
+	if (!fd)
+		return 0;
+
+	sreg = SREG;
+	cli();
+	len = sdlog_ready;
+	idle = sdlog_idle >= SDLOG_IDLE_TICKS;
+	if (!len && sdlog_pos && idle)
+	{
+		/* the line went quiet, take the partly filled buffer and make the
+		   next one end on a buffer boundary of the file again */
+		len = sdlog_pos;
+		sdlog_swap(len, SDLOG_BUF_SIZE - ((file_pos + len) & SDLOG_BUF_MASK));
+	}
+	ticks = sdlog_ticks;
+	SREG = sreg;
+
+	if (len)
+	{
+		/* sdlog_fill does not change while a buffer is ready */
+		if (fat16_write_file(fd, sdlog_buf[sdlog_fill ^ 1], len) != (int16_t)len)
+			return sdlog_stop();
+		file_pos += len;
+		file_dirty = 1;
+
+		sreg = SREG;
+		cli();
+		sdlog_ready = 0;
+		if (sdlog_pos == sdlog_limit)
+			/* the other buffer filled up while the card was busy */
+			sdlog_swap(sdlog_pos, SDLOG_BUF_SIZE);
+		SREG = sreg;
+	}
+
+	/* make the data visible once the line is quiet, and now and then while it is not */
+	if (file_dirty && (idle || (uint16_t)(ticks - commit_ticks) >= SDLOG_COMMIT_TICKS))
+	{
+		if (!sdlog_commit())
+			return sdlog_stop();
+	}
+
+	/* only rotate on a buffer boundary, the buffer being filled then
+	   starts the new file at offset 0 without breaking the alignment */
+	if (file_pos >= SDLOG_FILE_SIZE && !(file_pos & SDLOG_BUF_MASK))
+	{
+		if (!sdlog_open_next())
+			return 0;
+	}
+
+	return 1;
+}
+
+uint16_t sdlog_file_number(void)
+{
+	return file_number;
+}
+
+void sdlog_get_stats(struct sdlog_stats* stats, uint8_t reset)
+{
+	uint8_t sreg = SREG;
+
+	cli();
+	memcpy(stats, (const void*)&sdlog_stats, sizeof(*stats));
+	if (reset)
+		memset((void*)&sdlog_stats, 0, sizeof(sdlog_stats));
+	SREG = sreg;
+}
@@ -0,0 +1,115 @@
+#ifndef SDLOG_H
+#define SDLOG_H
+
+#include <inttypes.h>
+#include <avr/io.h>
+
+/* sd_raw's 512 byte block, the buffers, the fat16 handles on the heap and
+   the stack take 2 KB of RAM, the code about 14 KB of flash */
+#if RAMEND < 0x800
+#error "sdlog needs 2 KB of RAM and 16 KB of flash, e.g. an ATmega32 or ATmega324A"
+#endif
+
+/* size of each of the two receive buffers, power of 2 up to one sector;
+   2 x 512 leaves no room for the stack on a 2 KB part. At 115200 baud a
+   buffer fills in 22 ms; when the card takes longer than that for a
+   buffer, FAT updates included, bytes are dropped */
+#ifndef SDLOG_BUF_SIZE
+#define SDLOG_BUF_SIZE 256
+#endif
+
+/* the next file is started once a file has reached this size */
+#ifndef SDLOG_FILE_SIZE
+#define SDLOG_FILE_SIZE 1048576UL
+#endif
+
+/* sdlog_tick() periods without data before a partly filled buffer is
+   written and the file size committed, 15 x 32.8 ms = 0.5 s */
+#ifndef SDLOG_IDLE_TICKS
+#define SDLOG_IDLE_TICKS 15
+#endif
+
+/* sdlog_tick() periods between size commits while data keeps coming */
+#ifndef SDLOG_COMMIT_TICKS
+#define SDLOG_COMMIT_TICKS 150
+#endif
+
+#if (SDLOG_BUF_SIZE & (SDLOG_BUF_SIZE - 1)) || (SDLOG_BUF_SIZE > 512)
+#error "SDLOG_BUF_SIZE must be a power of 2 up to 512"
+#endif
+
+struct sdlog_stats
+{
+	uint16_t frame;     /* bytes received with a framing error */
+	uint16_t overrun;   /* bytes lost in the USART before the interrupt ran */
+	uint16_t dropped;   /* bytes lost because both buffers were full */
+};
+
+/* shared with the receive interrupt, only touch them through the functions below */
+extern uint8_t sdlog_buf[2][SDLOG_BUF_SIZE];
+extern volatile uint8_t sdlog_fill;      /* buffer being filled by the interrupt */
+extern volatile uint16_t sdlog_pos;      /* bytes in it */
+extern volatile uint16_t sdlog_limit;    /* buffers are swapped at this fill level */
+extern volatile uint16_t sdlog_ready;    /* bytes waiting in the other buffer, 0 when it is free */
+extern volatile uint8_t sdlog_idle;
+extern volatile uint16_t sdlog_ticks;
+extern volatile struct sdlog_stats sdlog_stats;
+
+/* hand the filled buffer to the main loop, interrupts must be disabled */
+static inline void sdlog_swap(uint16_t len, uint16_t limit)
+{
+	sdlog_ready = len;
+	sdlog_fill ^= 1;
+	sdlog_pos = 0;
+	sdlog_limit = limit;
+}
+
+/* store one received byte, call from the USART receive interrupt with
+   the FE and DOR bits read from the status register before the data */
+static inline void sdlog_rx(uint8_t data, uint8_t frame_error, uint8_t overrun)
+{
+	uint16_t pos = sdlog_pos;
+
+	if (frame_error)
+		sdlog_stats.frame++;
+	if (overrun)
+		sdlog_stats.overrun++;
+	sdlog_idle = 0;
+
+	if (pos == sdlog_limit)
+	{
+		/* both buffers full, the card is still busy with the other one */
+		if (sdlog_stats.dropped != 0xFFFF)
+			sdlog_stats.dropped++;
+		return;
+	}
+	sdlog_buf[sdlog_fill][pos++] = data;
+	if (pos == sdlog_limit && !sdlog_ready)
+		sdlog_swap(pos, SDLOG_BUF_SIZE);
+	else
+		sdlog_pos = pos;
+}
+
+/* call every 32.8 ms, e.g. from the timer 0 overflow at F_CPU/1024 and 8 MHz */
+static inline void sdlog_tick(void)
+{
+	if (sdlog_idle != 0xFF)
+		sdlog_idle++;
+	sdlog_ticks++;
+}
+
+/* open the file system and create the next LOGnnnnn.TXT in the root directory,
+   the card must already be initialised; returns 0 on failure */
+uint8_t sdlog_open(void);
+
+/* write a ready buffer, commit the size and start the next file when due;
+   call from the main loop, returns 0 once logging has stopped on a card error */
+uint8_t sdlog_task(void);
+
+/* number of the file being written, changes when a new file is started */
+uint16_t sdlog_file_number(void);
+
+/* copy the error counters, non-zero reset clears them afterwards */
+void sdlog_get_stats(struct sdlog_stats* stats, uint8_t reset);
+
+#endif /* SDLOG_H */
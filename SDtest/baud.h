@@ -0,0 +1,73 @@
+/*
+ * baud.h
+ *
+ * Compile time UBRR calculation. Define F_CPU and USART_BAUDRATE before
+ * including it. Both normal (16x) and double speed (U2X, 8x) mode are
+ * tried and the one closer to USART_BAUDRATE is used, normal mode on a
+ * tie since it samples each bit more often. The build stops if the best
+ * error is above BAUD_TOLERANCE.
+ *
+ * Results:
+ *   BAUD_UBRR    value for UBRRH:UBRRL
+ *   BAUD_U2X     1 if U2X has to be set in UCSRA
+ *   BAUD_ERROR   rate error in 0.01 %
+ *   BAUD_SELECT  UBRR with bit 15 set for U2X, the format uart_init()
+ *                of the interrupt uart library takes
+ *
+ * At 8 MHz 9600 (0.16 %), 38400 (0.16 %), 250k, 500k and 1M (all exact)
+ * pass, 57600 and 115200 do not. At 16 MHz 2M works as well.
+ */
+#ifndef BAUD_H_
+#define BAUD_H_
+
+#ifndef F_CPU
+#error "baud.h: F_CPU not defined"
+#endif
+#ifndef USART_BAUDRATE
+#error "baud.h: USART_BAUDRATE not defined"
+#endif
+
+/* allowed error in 0.01 % */
+#ifndef BAUD_TOLERANCE
+#define BAUD_TOLERANCE 200
+#endif
+
+/* rounded UBRR + 1 for both modes */
+#define BAUD_DIV_1X (((F_CPU) + 8UL * (USART_BAUDRATE)) / (16UL * (USART_BAUDRATE)))
+#define BAUD_DIV_2X (((F_CPU) + 4UL * (USART_BAUDRATE)) / (8UL * (USART_BAUDRATE)))
+
+#define BAUD_RATE_1X ((F_CPU) / (16UL * BAUD_DIV_1X))
+#define BAUD_RATE_2X ((F_CPU) / (8UL * BAUD_DIV_2X))
+
+#define BAUD_DIFF(rate) ((rate) > (USART_BAUDRATE) ? (rate) - (USART_BAUDRATE) : (USART_BAUDRATE) - (rate))
+
+/* UBRR is 12 bits, a divider out of range counts as 100 % error */
+#if BAUD_DIV_1X < 1 || BAUD_DIV_1X > 4096
+#define BAUD_ERROR_1X 10000UL
+#else
+#define BAUD_ERROR_1X (BAUD_DIFF(BAUD_RATE_1X) * 10000UL / (USART_BAUDRATE))
+#endif
+
+#if BAUD_DIV_2X < 1 || BAUD_DIV_2X > 4096
+#define BAUD_ERROR_2X 10000UL
+#else
+#define BAUD_ERROR_2X (BAUD_DIFF(BAUD_RATE_2X) * 10000UL / (USART_BAUDRATE))
+#endif
+
+#if BAUD_ERROR_2X < BAUD_ERROR_1X
+#define BAUD_U2X 1
+#define BAUD_UBRR (BAUD_DIV_2X - 1)
+#define BAUD_ERROR BAUD_ERROR_2X
+#define BAUD_SELECT (BAUD_UBRR | 0x8000)
+#else
+#define BAUD_U2X 0
+#define BAUD_UBRR (BAUD_DIV_1X - 1)
+#define BAUD_ERROR BAUD_ERROR_1X
+#define BAUD_SELECT BAUD_UBRR
+#endif
+
+#if BAUD_ERROR > BAUD_TOLERANCE
+#error "baud.h: USART_BAUDRATE can not be reached from F_CPU within BAUD_TOLERANCE"
+#endif
+
+#endif /* BAUD_H_ */
@@ -1,3 +1,10 @@
+#ifndef F_CPU
+#define F_CPU 8000000UL  // 8 MHz
+#endif
+#ifndef USART_BAUDRATE
+#define USART_BAUDRATE 9600
+#endif
+
 #include <avr/io.h>
 #include <util/delay.h>
 #include <avr/interrupt.h>
@@ -5,7 +12,6 @@
 #include <inttypes.h>
 #include <stdio.h>
 
-#define xtalCpu 8000000L
 //
 //#define CS (1<<PB2)
 //#define MOSI (1<<PB3)
@@ -15,11 +21,8 @@
 //#define CS_ENABLE() (PORTB &= ~CS)
 //#define CS_DISABLE() (PORTB |= CS)
 
-//#define F_CPU 8000000UL  // 8 MHz
-//#define USART_BAUDRATE 9600
-//#define BAUD_PRESCALE (((F_CPU / (USART_BAUDRATE * 16UL))) - 1)
-
 #include "uart.h"
+#include "baud.h"
 
 volatile uint16_t TDelay = 100; //Zmienna obs�ugiwna w przerwaniach
 char * komunikat = "Test zapisania na karcie SD";
@@ -78,7 +81,6 @@ ISR(INT0_vect) // Interrupt PD2
 ////	uartSend('\r');
 ////	uartSend('\n');
 	uart0_puts("nooo!");
-	uart0_flush();
 }
 
 
@@ -93,14 +95,14 @@ int main(void){
 //	GICR |=(1<<INT0); //uaktywnienie INT0 w rejestrz GICR s.46 datasheet
 //	MCUCR |=(1<<ISC01); //ustawienie INT0 na zbocze opadajace s.65 datasheet
 	//USART_Init(); //Inicjalizacja komunikacji USART
-	uart0_init(9600);
+	uart0_init(BAUD_SELECT);
 
 	sei(); // odblokowanie przerwan globalnych SET INTERRUPTS
 
 
 	while(1){
 		uart0_putc('R');
-		uart0_flush();
+		uart0_tx_drain();
 		_delay_ms(100);
 	}
 return 0;
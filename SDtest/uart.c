@@ -140,6 +140,9 @@ Date        Description
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <string.h>
+#include <util/atomic.h>
 #include "uart.h"
 
 /*
@@ -157,6 +160,52 @@ Date        Description
 #define UART_TX2_BUFFER_MASK ( UART_TX2_BUFFER_SIZE - 1)
 #define UART_TX3_BUFFER_MASK ( UART_TX3_BUFFER_SIZE - 1)
 
+/*
+ * Ringbuffer indices are 8 bit unless USARTn_LARGE_BUFFER is defined.
+ * 16-bit indices shared with an ISR are not read or written atomically
+ * by the CPU, so the functions below access them inside UARTn_ATOMIC.
+ * With 8-bit indices UARTn_ATOMIC is empty and no interrupt is blocked.
+ *
+ * Receive ISR cycles on an ATmega32 with 128 byte buffers, including
+ * interrupt entry, prologue, epilogue and reti, as run by UartSim
+ * (make -C UartSim isr, which also writes the listings). Measured on
+ * a build by the LLVM AVR backend, avr-gcc -Os differs by a few cycles:
+ *   8-bit indices                          92 cycles
+ *   16-bit indices (USARTn_LARGE_BUFFER)   99 cycles
+ *   8-bit indices, USARTn_RTSCTS          107 cycles
+ *   8-bit indices, USARTn_XONXOFF         112 cycles
+ * The transmit ISR takes 52-64 cycles, 65-81 with 16-bit indices.
+ * At 1 Mbaud and 16 MHz one character takes 160 cycles.
+ */
+#if defined( USART0_LARGE_BUFFER )
+	#define UART0_INDEX_T  uint16_t
+	#define UART0_ATOMIC   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#else
+	#define UART0_INDEX_T  uint8_t
+	#define UART0_ATOMIC
+#endif
+#if defined( USART1_LARGE_BUFFER )
+	#define UART1_INDEX_T  uint16_t
+	#define UART1_ATOMIC   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#else
+	#define UART1_INDEX_T  uint8_t
+	#define UART1_ATOMIC
+#endif
+#if defined( USART2_LARGE_BUFFER )
+	#define UART2_INDEX_T  uint16_t
+	#define UART2_ATOMIC   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#else
+	#define UART2_INDEX_T  uint8_t
+	#define UART2_ATOMIC
+#endif
+#if defined( USART3_LARGE_BUFFER )
+	#define UART3_INDEX_T  uint16_t
+	#define UART3_ATOMIC   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#else
+	#define UART3_INDEX_T  uint8_t
+	#define UART3_ATOMIC
+#endif
+
 #if ( UART_RX0_BUFFER_SIZE & UART_RX0_BUFFER_MASK )
 	#error RX0 buffer size is not a power of 2
 #endif
@@ -391,6 +440,35 @@ Date        Description
 	#error "no UART definition for MCU available"
 #endif
 
+/* transmit complete flag in UARTn_STATUS, cleared by writing a one to it */
+#if defined( ATMEGA_USART0 )
+	#define UART0_TXC      TXC0
+#else
+	#define UART0_TXC      TXC
+#endif
+#define UART1_TXC      TXC1
+#define UART2_TXC      TXC2
+#define UART3_TXC      TXC3
+
+/* receive error flags in UARTn_STATUS */
+#if defined( ATMEGA_USART0 )
+	#define UART0_FE       FE0
+	#define UART0_DOR      DOR0
+#else
+	#define UART0_FE       FE
+	#define UART0_DOR      DOR
+#endif
+#define UART1_FE       FE1
+#define UART1_DOR      DOR1
+#define UART2_FE       FE2
+#define UART2_DOR      DOR2
+#define UART3_FE       FE3
+#define UART3_DOR      DOR3
+
+/* DDRx and PINx sit just below PORTx on all AVRs this library supports */
+#define UART_DDR(port) (*(&(port) - 1))
+#define UART_PIN(port) (*(&(port) - 2))
+
 /*
  *  Module global variables
  */
@@ -400,18 +478,22 @@ Date        Description
 		static volatile uint8_t UART_TxBuf[UART_TX0_BUFFER_SIZE];
 		static volatile uint8_t UART_RxBuf[UART_RX0_BUFFER_SIZE];
 		
-		#if defined( USART0_LARGE_BUFFER )
-			static volatile uint16_t UART_TxHead;
-			static volatile uint16_t UART_TxTail;
-			static volatile uint16_t UART_RxHead;
-			static volatile uint16_t UART_RxTail;
-			static volatile uint8_t UART_LastRxError;
-		#else
-			static volatile uint8_t UART_TxHead;
-			static volatile uint8_t UART_TxTail;
-			static volatile uint8_t UART_RxHead;
-			static volatile uint8_t UART_RxTail;
-			static volatile uint8_t UART_LastRxError;
+		static volatile UART0_INDEX_T UART_TxHead;
+		static volatile UART0_INDEX_T UART_TxTail;
+		static volatile UART0_INDEX_T UART_RxHead;
+		static volatile UART0_INDEX_T UART_RxTail;
+		static volatile uint8_t UART_LastRxError;
+		static volatile uint8_t UART_TxPending;
+		static volatile struct uart_stats UART_Stats;
+		#if defined( USART0_RTSCTS ) || defined( USART0_XONXOFF )
+			static volatile uint8_t UART_RxHeld;
+		#endif
+		#if defined( USART0_XONXOFF )
+			static volatile uint8_t UART_TxXoff;
+			static volatile uint8_t UART_TxFlowChar;
+		#endif
+		#if defined( UART_TX_EMPTY_CALLBACK )
+			static void (* volatile UART_TxEmptyCallback)(void);
 		#endif
 		
 	#endif
@@ -422,19 +504,23 @@ Date        Description
 		static volatile uint8_t UART1_TxBuf[UART_TX1_BUFFER_SIZE];
 		static volatile uint8_t UART1_RxBuf[UART_RX1_BUFFER_SIZE];
 		
-		#if defined( USART1_LARGE_BUFFER )
-			static volatile uint16_t UART1_TxHead;
-			static volatile uint16_t UART1_TxTail;
-			static volatile uint16_t UART1_RxHead;
-			static volatile uint16_t UART1_RxTail;
-			static volatile uint8_t UART1_LastRxError;
-		#else
-			static volatile uint8_t UART1_TxHead;
-			static volatile uint8_t UART1_TxTail;
-			static volatile uint8_t UART1_RxHead;
-			static volatile uint8_t UART1_RxTail;
-			static volatile uint8_t UART1_LastRxError;
-		#endif		
+		static volatile UART1_INDEX_T UART1_TxHead;
+		static volatile UART1_INDEX_T UART1_TxTail;
+		static volatile UART1_INDEX_T UART1_RxHead;
+		static volatile UART1_INDEX_T UART1_RxTail;
+		static volatile uint8_t UART1_LastRxError;
+		static volatile uint8_t UART1_TxPending;
+		static volatile struct uart_stats UART1_Stats;
+		#if defined( USART1_RTSCTS ) || defined( USART1_XONXOFF )
+			static volatile uint8_t UART1_RxHeld;
+		#endif
+		#if defined( USART1_XONXOFF )
+			static volatile uint8_t UART1_TxXoff;
+			static volatile uint8_t UART1_TxFlowChar;
+		#endif
+		#if defined( UART_TX_EMPTY_CALLBACK )
+			static void (* volatile UART1_TxEmptyCallback)(void);
+		#endif
 	#endif
 #endif
 
@@ -443,19 +529,23 @@ Date        Description
 		static volatile uint8_t UART2_TxBuf[UART_TX2_BUFFER_SIZE];
 		static volatile uint8_t UART2_RxBuf[UART_RX2_BUFFER_SIZE];
 
-		#if defined( USART2_LARGE_BUFFER )
-			static volatile uint16_t UART2_TxHead;
-			static volatile uint16_t UART2_TxTail;
-			static volatile uint16_t UART2_RxHead;
-			static volatile uint16_t UART2_RxTail;
-			static volatile uint8_t UART2_LastRxError;
-		#else
-			static volatile uint8_t UART2_TxHead;
-			static volatile uint8_t UART2_TxTail;
-			static volatile uint8_t UART2_RxHead;
-			static volatile uint8_t UART2_RxTail;
-			static volatile uint8_t UART2_LastRxError;
-		#endif		
+		static volatile UART2_INDEX_T UART2_TxHead;
+		static volatile UART2_INDEX_T UART2_TxTail;
+		static volatile UART2_INDEX_T UART2_RxHead;
+		static volatile UART2_INDEX_T UART2_RxTail;
+		static volatile uint8_t UART2_LastRxError;
+		static volatile uint8_t UART2_TxPending;
+		static volatile struct uart_stats UART2_Stats;
+		#if defined( USART2_RTSCTS ) || defined( USART2_XONXOFF )
+			static volatile uint8_t UART2_RxHeld;
+		#endif
+		#if defined( USART2_XONXOFF )
+			static volatile uint8_t UART2_TxXoff;
+			static volatile uint8_t UART2_TxFlowChar;
+		#endif
+		#if defined( UART_TX_EMPTY_CALLBACK )
+			static void (* volatile UART2_TxEmptyCallback)(void);
+		#endif
 	#endif
 #endif
 
@@ -464,18 +554,22 @@ Date        Description
 		static volatile uint8_t UART3_TxBuf[UART_TX3_BUFFER_SIZE];
 		static volatile uint8_t UART3_RxBuf[UART_RX3_BUFFER_SIZE];
 
-		#if defined( USART3_LARGE_BUFFER )
-			static volatile uint16_t UART3_TxHead;
-			static volatile uint16_t UART3_TxTail;
-			static volatile uint16_t UART3_RxHead;
-			static volatile uint16_t UART3_RxTail;
-			static volatile uint8_t UART3_LastRxError;
-		#else
-			static volatile uint8_t UART3_TxHead;
-			static volatile uint8_t UART3_TxTail;
-			static volatile uint8_t UART3_RxHead;
-			static volatile uint8_t UART3_RxTail;
-			static volatile uint8_t UART3_LastRxError;
+		static volatile UART3_INDEX_T UART3_TxHead;
+		static volatile UART3_INDEX_T UART3_TxTail;
+		static volatile UART3_INDEX_T UART3_RxHead;
+		static volatile UART3_INDEX_T UART3_RxTail;
+		static volatile uint8_t UART3_LastRxError;
+		static volatile uint8_t UART3_TxPending;
+		static volatile struct uart_stats UART3_Stats;
+		#if defined( USART3_RTSCTS ) || defined( USART3_XONXOFF )
+			static volatile uint8_t UART3_RxHeld;
+		#endif
+		#if defined( USART3_XONXOFF )
+			static volatile uint8_t UART3_TxXoff;
+			static volatile uint8_t UART3_TxFlowChar;
+		#endif
+		#if defined( UART_TX_EMPTY_CALLBACK )
+			static void (* volatile UART3_TxEmptyCallback)(void);
 		#endif
 
 	#endif
@@ -489,7 +583,7 @@ Function: UART Receive Complete interrupt
 Purpose:  called when the UART has received a character
 **************************************************************************/
 {
-    uint16_t tmphead;
+    UART0_INDEX_T tmphead;
     uint8_t data;
     uint8_t usr;
     uint8_t lastRxError;
@@ -508,6 +602,31 @@ Purpose:  called when the UART has received a character
 #elif defined ( ATMEGA_UART )
     lastRxError = (usr & (_BV(FE)|_BV(DOR)) );
 #endif
+    if ( lastRxError ) {
+        if ( usr & _BV(UART0_FE) ) {
+            UART_Stats.frame++;
+        }
+        if ( usr & _BV(UART0_DOR) ) {
+            UART_Stats.overrun++;
+        }
+    }
+
+#if defined( USART0_XONXOFF )
+    /* flow control characters from the peer are not stored */
+    if ( data == UART_XOFF ) {
+        UART_TxXoff = 1;
+        UART_LastRxError = lastRxError;
+        return;
+    }
+    if ( data == UART_XON ) {
+        UART_TxXoff = 0;
+        if ( UART_TxHead != UART_TxTail ) {
+            UART0_CONTROL |= _BV(UART0_UDRIE);
+        }
+        UART_LastRxError = lastRxError;
+        return;
+    }
+#endif
         
     /* calculate buffer index */ 
     tmphead = ( UART_RxHead + 1) & UART_RX0_BUFFER_MASK;
@@ -515,11 +634,25 @@ Purpose:  called when the UART has received a character
     if ( tmphead == UART_RxTail ) {
         /* error: receive buffer overflow */
         lastRxError = UART_BUFFER_OVERFLOW >> 8;
+        UART_Stats.overflow++;
     } else {
         /* store new index */
         UART_RxHead = tmphead;
         /* store received data in buffer */
         UART_RxBuf[tmphead] = data;
+#if defined( USART0_RTSCTS ) || defined( USART0_XONXOFF )
+        if ( !UART_RxHeld && ((tmphead - UART_RxTail) & UART_RX0_BUFFER_MASK) >= UART_RX0_HIGH_WATERMARK ) {
+            /* ask the peer to pause before the ringbuffer overflows */
+            UART_RxHeld = 1;
+#if defined( USART0_RTSCTS )
+            UART0_RTS_PORT |= _BV(UART0_RTS_BIT);
+#endif
+#if defined( USART0_XONXOFF )
+            UART_TxFlowChar = UART_XOFF;
+            UART0_CONTROL |= _BV(UART0_UDRIE);
+#endif
+        }
+#endif
     }
     UART_LastRxError = lastRxError;   
 }
@@ -531,7 +664,29 @@ Function: UART Data Register Empty interrupt
 Purpose:  called when the UART is ready to transmit the next byte
 **************************************************************************/
 {
-    uint16_t tmptail;
+    UART0_INDEX_T tmptail;
+
+#if defined( USART0_XONXOFF )
+    if ( UART_TxFlowChar ) {
+        /* XON/XOFF go out ahead of the buffered data */
+        UART0_DATA = UART_TxFlowChar;
+        UART_TxFlowChar = 0;
+        UART0_STATUS |= _BV(UART0_TXC);
+        return;
+    }
+    if ( UART_TxXoff ) {
+        /* peer sent XOFF, its XON in the receive interrupt restarts us */
+        UART0_CONTROL &= ~_BV(UART0_UDRIE);
+        return;
+    }
+#endif
+#if defined( USART0_RTSCTS )
+    if ( UART_PIN(UART0_CTS_PORT) & _BV(UART0_CTS_BIT) ) {
+        /* CTS high, peer not ready: stop until uart0_tx_resume() or a write */
+        UART0_CONTROL &= ~_BV(UART0_UDRIE);
+        return;
+    }
+#endif
 
     if ( UART_TxHead != UART_TxTail) {
         /* calculate and store new buffer index */
@@ -539,9 +694,16 @@ Purpose:  called when the UART is ready to transmit the next byte
         UART_TxTail = tmptail;
         /* get one byte from buffer and write it to UART */
         UART0_DATA = UART_TxBuf[tmptail];  /* start transmission */
+        /* TXC is set again once this byte and the ones after it are sent */
+        UART0_STATUS |= _BV(UART0_TXC);
     } else {
         /* tx buffer empty, disable UDRE interrupt */
         UART0_CONTROL &= ~_BV(UART0_UDRIE);
+#if defined( UART_TX_EMPTY_CALLBACK )
+        if ( UART_TxEmptyCallback ) {
+            UART_TxEmptyCallback();
+        }
+#endif
     }
 }
 
@@ -558,6 +720,21 @@ void uart0_init(uint16_t baudrate)
 	UART_TxTail = 0;
 	UART_RxHead = 0;
 	UART_RxTail = 0;
+#if defined( USART0_RTSCTS ) || defined( USART0_XONXOFF )
+	UART_RxHeld = 0;
+#endif
+#if defined( USART0_XONXOFF )
+	UART_TxXoff = 0;
+	UART_TxFlowChar = 0;
+#endif
+#if defined( USART0_RTSCTS )
+	/* RTS low: ready to receive. CTS is an input with pull-up, so an
+	   unconnected CTS holds the transmitter */
+	UART0_RTS_PORT &= ~_BV(UART0_RTS_BIT);
+	UART_DDR(UART0_RTS_PORT) |= _BV(UART0_RTS_BIT);
+	UART_DDR(UART0_CTS_PORT) &= ~_BV(UART0_CTS_BIT);
+	UART0_CTS_PORT |= _BV(UART0_CTS_BIT);
+#endif
 
 #if defined( AT90_UART )
 	/* set baud rate */
@@ -621,6 +798,31 @@ void uart0_init(uint16_t baudrate)
 } /* uart0_init */
 
 
+#if defined( USART0_RTSCTS ) || defined( USART0_XONXOFF )
+/*************************************************************************
+Function: uart0_rx_release()
+Purpose:  let the peer send again once the receive ringbuffer has been
+          read down to UART_RX0_LOW_WATERMARK
+Input:    None
+Returns:  None
+**************************************************************************/
+static void uart0_rx_release(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if ( UART_RxHeld && ((UART_RxHead - UART_RxTail) & UART_RX0_BUFFER_MASK) <= UART_RX0_LOW_WATERMARK ) {
+			UART_RxHeld = 0;
+#if defined( USART0_RTSCTS )
+			UART0_RTS_PORT &= ~_BV(UART0_RTS_BIT);
+#endif
+#if defined( USART0_XONXOFF )
+			UART_TxFlowChar = UART_XON;
+			UART0_CONTROL |= _BV(UART0_UDRIE);
+#endif
+		}
+	}
+} /* uart0_rx_release */
+#endif
+
 /*************************************************************************
 Function: uart0_getc()
 Purpose:  return byte from ringbuffer
@@ -629,20 +831,31 @@ Returns:  lower byte:  received byte from ringbuffer
 **************************************************************************/
 uint16_t uart0_getc(void)
 {
-	uint16_t tmptail;
+	UART0_INDEX_T tmphead;
+	UART0_INDEX_T tmptail;
 	uint8_t data;
 
-	if ( UART_RxHead == UART_RxTail ) {
+	UART0_ATOMIC {
+		tmphead = UART_RxHead;
+	}
+	if ( tmphead == UART_RxTail ) {
 		return UART_NO_DATA;   /* no data available */
 	}
 
-	/* calculate /store buffer index */
+	/* calculate buffer index */
 	tmptail = (UART_RxTail + 1) & UART_RX0_BUFFER_MASK;
-	UART_RxTail = tmptail;
 
 	/* get data from receive buffer */
 	data = UART_RxBuf[tmptail];
 
+	/* store buffer index */
+	UART0_ATOMIC {
+		UART_RxTail = tmptail;
+	}
+#if defined( USART0_RTSCTS ) || defined( USART0_XONXOFF )
+	uart0_rx_release();
+#endif
+
 	return (UART_LastRxError << 8) + data;
 
 } /* uart0_getc */
@@ -658,10 +871,14 @@ Returns:  lower byte:  next byte in ring buffer
 **************************************************************************/
 uint16_t uart0_peek(void)
 {
-	uint16_t tmptail;
+	UART0_INDEX_T tmphead;
+	UART0_INDEX_T tmptail;
 	uint8_t data;
 
-	if ( UART_RxHead == UART_RxTail ) {
+	UART0_ATOMIC {
+		tmphead = UART_RxHead;
+	}
+	if ( tmphead == UART_RxTail ) {
 		return UART_NO_DATA;   /* no data available */
 	}
 
@@ -682,19 +899,29 @@ Returns:  none
 **************************************************************************/
 void uart0_putc(uint8_t data)
 {
-	uint16_t tmphead;
+	UART0_INDEX_T tmphead;
+	UART0_INDEX_T tmptail;
 
 	tmphead  = (UART_TxHead + 1) & UART_TX0_BUFFER_MASK;
 
-	while ( tmphead == UART_TxTail ) {
-		;/* wait for free space in buffer */
-	}
+	do {
+		UART0_ATOMIC {
+			tmptail = UART_TxTail;
+		}
+		if ( tmphead == tmptail ) {
+			/* buffer full: the transmit interrupt may have stopped on CTS, restart it */
+			UART0_CONTROL |= _BV(UART0_UDRIE);
+		}
+	} while ( tmphead == tmptail );	/* wait for free space in buffer */
 
 	UART_TxBuf[tmphead] = data;
-	UART_TxHead = tmphead;
+	UART0_ATOMIC {
+		UART_TxHead = tmphead;
+	}
 
 	/* enable UDRE interrupt */
 	UART0_CONTROL    |= _BV(UART0_UDRIE);
+	UART_TxPending = 1;
 
 } /* uart0_putc */
 
@@ -731,6 +958,117 @@ void uart0_puts_p(const char *progmem_s )
 } /* uart0_puts_p */
 
 
+/*************************************************************************
+Function: uart0_write()
+Purpose:  copy a block of bytes to the transmit ringbuffer
+Input:    buffer and number of bytes to be transmitted
+Returns:  number of bytes copied, less than n only with UART_NONBLOCKING
+          when the ringbuffer is full
+**************************************************************************/
+uint16_t uart0_write(const void *buf, uint16_t n)
+{
+	const uint8_t *src = (const uint8_t *)buf;
+	uint16_t done = 0;
+	UART0_INDEX_T head;
+	uint16_t count;
+	uint16_t len;
+
+	while ( done < n ) {
+		UART0_ATOMIC {
+			count = (UART_TxTail - UART_TxHead - 1) & UART_TX0_BUFFER_MASK;
+		}
+		if ( count == 0 ) {
+#if defined( UART_NONBLOCKING )
+			break;
+#else
+			/* wait for free space in buffer, restarting the transmit interrupt if it stopped on CTS */
+			UART0_CONTROL |= _BV(UART0_UDRIE);
+			continue;
+#endif
+		}
+		if ( count > n - done ) {
+			count = n - done;
+		}
+
+		/* at most two segments: up to the end of the buffer, then from its start */
+		head = (UART_TxHead + 1) & UART_TX0_BUFFER_MASK;
+		len = UART_TX0_BUFFER_SIZE - head;
+		if ( len > count ) {
+			len = count;
+		}
+		memcpy((uint8_t *)&UART_TxBuf[head], src, len);
+		memcpy((uint8_t *)UART_TxBuf, src + len, count - len);
+		src  += count;
+		done += count;
+
+		/* publish the new head once, then enable UDRE interrupt */
+		UART0_ATOMIC {
+			UART_TxHead = (head + count - 1) & UART_TX0_BUFFER_MASK;
+		}
+		UART0_CONTROL    |= _BV(UART0_UDRIE);
+		UART_TxPending = 1;
+	}
+
+	return done;
+
+} /* uart0_write */
+
+
+/*************************************************************************
+Function: uart0_read()
+Purpose:  copy a block of received bytes from the receive ringbuffer
+Input:    buffer and number of bytes to be read
+Returns:  number of bytes copied, less than n only with UART_NONBLOCKING
+          when the ringbuffer runs empty
+**************************************************************************/
+uint16_t uart0_read(void *buf, uint16_t n)
+{
+	uint8_t *dst = (uint8_t *)buf;
+	uint16_t done = 0;
+	UART0_INDEX_T tail;
+	uint16_t count;
+	uint16_t len;
+
+	while ( done < n ) {
+		UART0_ATOMIC {
+			count = (UART_RxHead - UART_RxTail) & UART_RX0_BUFFER_MASK;
+		}
+		if ( count == 0 ) {
+#if defined( UART_NONBLOCKING )
+			break;
+#else
+			continue;	/* wait for received data */
+#endif
+		}
+		if ( count > n - done ) {
+			count = n - done;
+		}
+
+		/* at most two segments: up to the end of the buffer, then from its start */
+		tail = (UART_RxTail + 1) & UART_RX0_BUFFER_MASK;
+		len = UART_RX0_BUFFER_SIZE - tail;
+		if ( len > count ) {
+			len = count;
+		}
+		memcpy(dst, (const uint8_t *)&UART_RxBuf[tail], len);
+		memcpy(dst + len, (const uint8_t *)UART_RxBuf, count - len);
+		dst  += count;
+		done += count;
+
+		/* release the space to the receive interrupt once */
+		UART0_ATOMIC {
+			UART_RxTail = (tail + count - 1) & UART_RX0_BUFFER_MASK;
+		}
+#if defined( USART0_RTSCTS ) || defined( USART0_XONXOFF )
+		uart0_rx_release();
+#endif
+	}
+
+	return done;
+
+} /* uart0_read */
+
+
 
 /*************************************************************************
 Function: uart0_available()
@@ -740,7 +1078,12 @@ Returns:  Integer number of bytes in the receive buffer
 **************************************************************************/
 uint16_t uart0_available(void)
 {
-	return (UART_RX0_BUFFER_SIZE + UART_RxHead - UART_RxTail) & UART_RX0_BUFFER_MASK;
+	uint16_t count;
+
+	UART0_ATOMIC {
+		count = (UART_RX0_BUFFER_SIZE + UART_RxHead - UART_RxTail) & UART_RX0_BUFFER_MASK;
+	}
+	return count;
 } /* uart0_available */
 
 /*************************************************************************
@@ -751,9 +1094,124 @@ Returns:  None
 **************************************************************************/
 void uart0_flush(void)
 {
-	UART_RxHead = UART_RxTail;
+	/* the receive interrupt owns the head, so move the tail up to it */
+	UART0_ATOMIC {
+		UART_RxTail = UART_RxHead;
+	}
+#if defined( USART0_RTSCTS ) || defined( USART0_XONXOFF )
+	uart0_rx_release();
+#endif
 } /* uart0_flush */
 
+
+/*************************************************************************
+Function: uart0_tx_space()
+Purpose:  Determine the free space in the transmit buffer
+Input:    None
+Returns:  Number of bytes that can be buffered without waiting
+**************************************************************************/
+uint16_t uart0_tx_space(void)
+{
+	uint16_t count;
+
+	UART0_ATOMIC {
+		count = (UART_TxTail - UART_TxHead - 1) & UART_TX0_BUFFER_MASK;
+	}
+	return count;
+} /* uart0_tx_space */
+
+
+/*************************************************************************
+Function: uart0_tx_drain()
+Purpose:  Wait until all buffered bytes have left the transmitter.
+          The CPU sleeps in idle mode while the ringbuffer empties and
+          then polls TXC for the last byte. Must be called with interrupts
+          enabled, selects SLEEP_MODE_IDLE.
+Input:    None
+Returns:  None
+**************************************************************************/
+void uart0_tx_drain(void)
+{
+	if ( !UART_TxPending ) {
+		return;
+	}
+
+	/* UDRE interrupt disables itself once the ringbuffer is empty */
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	while ( (UART0_CONTROL & _BV(UART0_UDRIE)) || UART_TxHead != UART_TxTail ) {
+		if ( !(UART0_CONTROL & _BV(UART0_UDRIE)) ) {
+			/* held by flow control, poll until the peer is ready again */
+			UART0_CONTROL |= _BV(UART0_UDRIE);
+			sei();
+			cli();
+			continue;
+		}
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		cli();
+	}
+	sei();
+
+	/* last byte is still shifting out until TXC is set */
+	while ( !(UART0_STATUS & _BV(UART0_TXC)) ) {
+		;
+	}
+	UART_TxPending = 0;
+} /* uart0_tx_drain */
+
+
+/*************************************************************************
+Function: uart0_tx_resume()
+Purpose:  Restart transmission held back by CTS. The transmit interrupt
+          stops while CTS is high; call this from a timer or pin change
+          interrupt once CTS may be low again. Writing restarts it as well.
+Input:    None
+Returns:  None
+**************************************************************************/
+void uart0_tx_resume(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if ( UART_TxHead != UART_TxTail ) {
+			UART0_CONTROL |= _BV(UART0_UDRIE);
+		}
+	}
+} /* uart0_tx_resume */
+
+
+/*************************************************************************
+Function: uart0_stats()
+Purpose:  Copy the receive error counters
+Input:    structure to fill, non-zero reset to clear the counters
+Returns:  None
+**************************************************************************/
+void uart0_stats(struct uart_stats *stats, uint8_t reset)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		*stats = UART_Stats;
+		if ( reset ) {
+			memset((void *)&UART_Stats, 0, sizeof(UART_Stats));
+		}
+	}
+} /* uart0_stats */
+
+
+#if defined( UART_TX_EMPTY_CALLBACK )
+/*************************************************************************
+Function: uart0_tx_empty_callback()
+Purpose:  Register a function called from the UDRE interrupt when the
+          transmit ringbuffer runs empty, NULL to remove it
+Input:    callback function
+Returns:  None
+**************************************************************************/
+void uart0_tx_empty_callback(void (*callback)(void))
+{
+	UART_TxEmptyCallback = callback;
+} /* uart0_tx_empty_callback */
+#endif
+
 #endif
 
 #if defined( USART1_ENABLED )
@@ -769,7 +1227,7 @@ Function: UART1 Receive Complete interrupt
 Purpose:  called when the UART1 has received a character
 **************************************************************************/
 {
-	uint16_t tmphead;
+	UART1_INDEX_T tmphead;
 	uint8_t data;
 	uint8_t usr;
 	uint8_t lastRxError;
@@ -780,6 +1238,31 @@ Purpose:  called when the UART1 has received a character
 
 	/* */
 	lastRxError = (usr & (_BV(FE1)|_BV(DOR1)) );
+	if ( lastRxError ) {
+		if ( usr & _BV(UART1_FE) ) {
+			UART1_Stats.frame++;
+		}
+		if ( usr & _BV(UART1_DOR) ) {
+			UART1_Stats.overrun++;
+		}
+	}
+
+#if defined( USART1_XONXOFF )
+	/* flow control characters from the peer are not stored */
+	if ( data == UART_XOFF ) {
+		UART1_TxXoff = 1;
+		UART1_LastRxError = lastRxError;
+		return;
+	}
+	if ( data == UART_XON ) {
+		UART1_TxXoff = 0;
+		if ( UART1_TxHead != UART1_TxTail ) {
+			UART1_CONTROL |= _BV(UART1_UDRIE);
+		}
+		UART1_LastRxError = lastRxError;
+		return;
+	}
+#endif
 
 	/* calculate buffer index */
 	tmphead = ( UART1_RxHead + 1) & UART_RX1_BUFFER_MASK;
@@ -787,11 +1270,25 @@ Purpose:  called when the UART1 has received a character
 	if ( tmphead == UART1_RxTail ) {
 		/* error: receive buffer overflow */
 		lastRxError = UART_BUFFER_OVERFLOW >> 8;
+		UART1_Stats.overflow++;
 	} else {
 		/* store new index */
 		UART1_RxHead = tmphead;
 		/* store received data in buffer */
 		UART1_RxBuf[tmphead] = data;
+#if defined( USART1_RTSCTS ) || defined( USART1_XONXOFF )
+		if ( !UART1_RxHeld && ((tmphead - UART1_RxTail) & UART_RX1_BUFFER_MASK) >= UART_RX1_HIGH_WATERMARK ) {
+			/* ask the peer to pause before the ringbuffer overflows */
+			UART1_RxHeld = 1;
+#if defined( USART1_RTSCTS )
+			UART1_RTS_PORT |= _BV(UART1_RTS_BIT);
+#endif
+#if defined( USART1_XONXOFF )
+			UART1_TxFlowChar = UART_XOFF;
+			UART1_CONTROL |= _BV(UART1_UDRIE);
+#endif
+		}
+#endif
 	}
 	UART1_LastRxError = lastRxError;
 }
@@ -803,7 +1300,29 @@ Function: UART1 Data Register Empty interrupt
 Purpose:  called when the UART1 is ready to transmit the next byte
 **************************************************************************/
 {
-	uint16_t tmptail;
+	UART1_INDEX_T tmptail;
+
+#if defined( USART1_XONXOFF )
+	if ( UART1_TxFlowChar ) {
+		/* XON/XOFF go out ahead of the buffered data */
+		UART1_DATA = UART1_TxFlowChar;
+		UART1_TxFlowChar = 0;
+		UART1_STATUS |= _BV(UART1_TXC);
+		return;
+	}
+	if ( UART1_TxXoff ) {
+		/* peer sent XOFF, its XON in the receive interrupt restarts us */
+		UART1_CONTROL &= ~_BV(UART1_UDRIE);
+		return;
+	}
+#endif
+#if defined( USART1_RTSCTS )
+	if ( UART_PIN(UART1_CTS_PORT) & _BV(UART1_CTS_BIT) ) {
+		/* CTS high, peer not ready: stop until uart1_tx_resume() or a write */
+		UART1_CONTROL &= ~_BV(UART1_UDRIE);
+		return;
+	}
+#endif
 
 	if ( UART1_TxHead != UART1_TxTail) {
 		/* calculate and store new buffer index */
@@ -811,9 +1330,16 @@ Purpose:  called when the UART1 is ready to transmit the next byte
 		UART1_TxTail = tmptail;
 		/* get one byte from buffer and write it to UART */
 		UART1_DATA = UART1_TxBuf[tmptail];  /* start transmission */
+		/* TXC is set again once this byte and the ones after it are sent */
+		UART1_STATUS |= _BV(UART1_TXC);
 	} else {
 		/* tx buffer empty, disable UDRE interrupt */
 		UART1_CONTROL &= ~_BV(UART1_UDRIE);
+#if defined( UART_TX_EMPTY_CALLBACK )
+		if ( UART1_TxEmptyCallback ) {
+			UART1_TxEmptyCallback();
+		}
+#endif
 	}
 }
 
@@ -830,6 +1356,21 @@ void uart1_init(uint16_t baudrate)
 	UART1_TxTail = 0;
 	UART1_RxHead = 0;
 	UART1_RxTail = 0;
+#if defined( USART1_RTSCTS ) || defined( USART1_XONXOFF )
+	UART1_RxHeld = 0;
+#endif
+#if defined( USART1_XONXOFF )
+	UART1_TxXoff = 0;
+	UART1_TxFlowChar = 0;
+#endif
+#if defined( USART1_RTSCTS )
+	/* RTS low: ready to receive. CTS is an input with pull-up, so an
+	   unconnected CTS holds the transmitter */
+	UART1_RTS_PORT &= ~_BV(UART1_RTS_BIT);
+	UART_DDR(UART1_RTS_PORT) |= _BV(UART1_RTS_BIT);
+	UART_DDR(UART1_CTS_PORT) &= ~_BV(UART1_CTS_BIT);
+	UART1_CTS_PORT |= _BV(UART1_CTS_BIT);
+#endif
 
 	/* Set baud rate */
 	if ( baudrate & 0x8000 ) {
@@ -851,6 +1392,31 @@ void uart1_init(uint16_t baudrate)
 } /* uart_init */
 
 
+#if defined( USART1_RTSCTS ) || defined( USART1_XONXOFF )
+/*************************************************************************
+Function: uart1_rx_release()
+Purpose:  let the peer send again once the receive ringbuffer has been
+          read down to UART_RX1_LOW_WATERMARK
+Input:    None
+Returns:  None
+**************************************************************************/
+static void uart1_rx_release(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if ( UART1_RxHeld && ((UART1_RxHead - UART1_RxTail) & UART_RX1_BUFFER_MASK) <= UART_RX1_LOW_WATERMARK ) {
+			UART1_RxHeld = 0;
+#if defined( USART1_RTSCTS )
+			UART1_RTS_PORT &= ~_BV(UART1_RTS_BIT);
+#endif
+#if defined( USART1_XONXOFF )
+			UART1_TxFlowChar = UART_XON;
+			UART1_CONTROL |= _BV(UART1_UDRIE);
+#endif
+		}
+	}
+} /* uart1_rx_release */
+#endif
+
 /*************************************************************************
 Function: uart1_getc()
 Purpose:  return byte from ringbuffer
@@ -859,20 +1425,31 @@ Returns:  lower byte:  received byte from ringbuffer
 **************************************************************************/
 uint16_t uart1_getc(void)
 {
-	uint16_t tmptail;
+	UART1_INDEX_T tmphead;
+	UART1_INDEX_T tmptail;
 	uint8_t data;
 
-	if ( UART1_RxHead == UART1_RxTail ) {
+	UART1_ATOMIC {
+		tmphead = UART1_RxHead;
+	}
+	if ( tmphead == UART1_RxTail ) {
 		return UART_NO_DATA;   /* no data available */
 	}
 
-	/* calculate /store buffer index */
+	/* calculate buffer index */
 	tmptail = (UART1_RxTail + 1) & UART_RX1_BUFFER_MASK;
-	UART1_RxTail = tmptail;
 
 	/* get data from receive buffer */
 	data = UART1_RxBuf[tmptail];
 
+	/* store buffer index */
+	UART1_ATOMIC {
+		UART1_RxTail = tmptail;
+	}
+#if defined( USART1_RTSCTS ) || defined( USART1_XONXOFF )
+	uart1_rx_release();
+#endif
+
 	return (UART1_LastRxError << 8) + data;
 
 } /* uart1_getc */
@@ -888,10 +1465,14 @@ Returns:  lower byte:  next byte in ring buffer
 **************************************************************************/
 uint16_t uart1_peek(void)
 {
-	uint16_t tmptail;
+	UART1_INDEX_T tmphead;
+	UART1_INDEX_T tmptail;
 	uint8_t data;
 
-	if ( UART1_RxHead == UART1_RxTail ) {
+	UART1_ATOMIC {
+		tmphead = UART1_RxHead;
+	}
+	if ( tmphead == UART1_RxTail ) {
 		return UART_NO_DATA;   /* no data available */
 	}
 
@@ -912,19 +1493,29 @@ Returns:  none
 **************************************************************************/
 void uart1_putc(uint8_t data)
 {
-	uint16_t tmphead;
+	UART1_INDEX_T tmphead;
+	UART1_INDEX_T tmptail;
 
 	tmphead  = (UART1_TxHead + 1) & UART_TX1_BUFFER_MASK;
 
-	while ( tmphead == UART1_TxTail ) {
-		;/* wait for free space in buffer */
-	}
+	do {
+		UART1_ATOMIC {
+			tmptail = UART1_TxTail;
+		}
+		if ( tmphead == tmptail ) {
+			/* buffer full: the transmit interrupt may have stopped on CTS, restart it */
+			UART1_CONTROL |= _BV(UART1_UDRIE);
+		}
+	} while ( tmphead == tmptail );	/* wait for free space in buffer */
 
 	UART1_TxBuf[tmphead] = data;
-	UART1_TxHead = tmphead;
+	UART1_ATOMIC {
+		UART1_TxHead = tmphead;
+	}
 
 	/* enable UDRE interrupt */
 	UART1_CONTROL    |= _BV(UART1_UDRIE);
+	UART1_TxPending = 1;
 
 } /* uart1_putc */
 
@@ -961,6 +1552,117 @@ void uart1_puts_p(const char *progmem_s )
 } /* uart1_puts_p */
 
 
+/*************************************************************************
+Function: uart1_write()
+Purpose:  copy a block of bytes to the transmit ringbuffer
+Input:    buffer and number of bytes to be transmitted
+Returns:  number of bytes copied, less than n only with UART_NONBLOCKING
+          when the ringbuffer is full
+**************************************************************************/
+uint16_t uart1_write(const void *buf, uint16_t n)
+{
+	const uint8_t *src = (const uint8_t *)buf;
+	uint16_t done = 0;
+	UART1_INDEX_T head;
+	uint16_t count;
+	uint16_t len;
+
+	while ( done < n ) {
+		UART1_ATOMIC {
+			count = (UART1_TxTail - UART1_TxHead - 1) & UART_TX1_BUFFER_MASK;
+		}
+		if ( count == 0 ) {
+#if defined( UART_NONBLOCKING )
+			break;
+#else
+			/* wait for free space in buffer, restarting the transmit interrupt if it stopped on CTS */
+			UART1_CONTROL |= _BV(UART1_UDRIE);
+			continue;
+#endif
+		}
+		if ( count > n - done ) {
+			count = n - done;
+		}
+
+		/* at most two segments: up to the end of the buffer, then from its start */
+		head = (UART1_TxHead + 1) & UART_TX1_BUFFER_MASK;
+		len = UART_TX1_BUFFER_SIZE - head;
+		if ( len > count ) {
+			len = count;
+		}
+		memcpy((uint8_t *)&UART1_TxBuf[head], src, len);
+		memcpy((uint8_t *)UART1_TxBuf, src + len, count - len);
+		src  += count;
+		done += count;
+
+		/* publish the new head once, then enable UDRE interrupt */
+		UART1_ATOMIC {
+			UART1_TxHead = (head + count - 1) & UART_TX1_BUFFER_MASK;
+		}
+		UART1_CONTROL    |= _BV(UART1_UDRIE);
+		UART1_TxPending = 1;
+	}
+
+	return done;
+
+} /* uart1_write */
+
+
+/*************************************************************************
+Function: uart1_read()
+Purpose:  copy a block of received bytes from the receive ringbuffer
+Input:    buffer and number of bytes to be read
+Returns:  number of bytes copied, less than n only with UART_NONBLOCKING
+          when the ringbuffer runs empty
+**************************************************************************/
+uint16_t uart1_read(void *buf, uint16_t n)
+{
+	uint8_t *dst = (uint8_t *)buf;
+	uint16_t done = 0;
+	UART1_INDEX_T tail;
+	uint16_t count;
+	uint16_t len;
+
+	while ( done < n ) {
+		UART1_ATOMIC {
+			count = (UART1_RxHead - UART1_RxTail) & UART_RX1_BUFFER_MASK;
+		}
+		if ( count == 0 ) {
+#if defined( UART_NONBLOCKING )
+			break;
+#else
+			continue;	/* wait for received data */
+#endif
+		}
+		if ( count > n - done ) {
+			count = n - done;
+		}
+
+		/* at most two segments: up to the end of the buffer, then from its start */
+		tail = (UART1_RxTail + 1) & UART_RX1_BUFFER_MASK;
+		len = UART_RX1_BUFFER_SIZE - tail;
+		if ( len > count ) {
+			len = count;
+		}
+		memcpy(dst, (const uint8_t *)&UART1_RxBuf[tail], len);
+		memcpy(dst + len, (const uint8_t *)UART1_RxBuf, count - len);
+		dst  += count;
+		done += count;
+
+		/* release the space to the receive interrupt once */
+		UART1_ATOMIC {
+			UART1_RxTail = (tail + count - 1) & UART_RX1_BUFFER_MASK;
+		}
+#if defined( USART1_RTSCTS ) || defined( USART1_XONXOFF )
+		uart1_rx_release();
+#endif
+	}
+
+	return done;
+
+} /* uart1_read */
+
+
 
 /*************************************************************************
 Function: uart1_available()
@@ -970,7 +1672,12 @@ Returns:  Integer number of bytes in the receive buffer
 **************************************************************************/
 uint16_t uart1_available(void)
 {
-	return (UART_RX1_BUFFER_SIZE + UART1_RxHead - UART1_RxTail) & UART_RX1_BUFFER_MASK;
+	uint16_t count;
+
+	UART1_ATOMIC {
+		count = (UART_RX1_BUFFER_SIZE + UART1_RxHead - UART1_RxTail) & UART_RX1_BUFFER_MASK;
+	}
+	return count;
 } /* uart1_available */
 
 
@@ -983,9 +1690,124 @@ Returns:  None
 **************************************************************************/
 void uart1_flush(void)
 {
-	UART1_RxHead = UART1_RxTail;
+	/* the receive interrupt owns the head, so move the tail up to it */
+	UART1_ATOMIC {
+		UART1_RxTail = UART1_RxHead;
+	}
+#if defined( USART1_RTSCTS ) || defined( USART1_XONXOFF )
+	uart1_rx_release();
+#endif
 } /* uart1_flush */
 
+
+/*************************************************************************
+Function: uart1_tx_space()
+Purpose:  Determine the free space in the transmit buffer
+Input:    None
+Returns:  Number of bytes that can be buffered without waiting
+**************************************************************************/
+uint16_t uart1_tx_space(void)
+{
+	uint16_t count;
+
+	UART1_ATOMIC {
+		count = (UART1_TxTail - UART1_TxHead - 1) & UART_TX1_BUFFER_MASK;
+	}
+	return count;
+} /* uart1_tx_space */
+
+
+/*************************************************************************
+Function: uart1_tx_drain()
+Purpose:  Wait until all buffered bytes have left the transmitter.
+          The CPU sleeps in idle mode while the ringbuffer empties and
+          then polls TXC for the last byte. Must be called with interrupts
+          enabled, selects SLEEP_MODE_IDLE.
+Input:    None
+Returns:  None
+**************************************************************************/
+void uart1_tx_drain(void)
+{
+	if ( !UART1_TxPending ) {
+		return;
+	}
+
+	/* UDRE interrupt disables itself once the ringbuffer is empty */
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	while ( (UART1_CONTROL & _BV(UART1_UDRIE)) || UART1_TxHead != UART1_TxTail ) {
+		if ( !(UART1_CONTROL & _BV(UART1_UDRIE)) ) {
+			/* held by flow control, poll until the peer is ready again */
+			UART1_CONTROL |= _BV(UART1_UDRIE);
+			sei();
+			cli();
+			continue;
+		}
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		cli();
+	}
+	sei();
+
+	/* last byte is still shifting out until TXC is set */
+	while ( !(UART1_STATUS & _BV(UART1_TXC)) ) {
+		;
+	}
+	UART1_TxPending = 0;
+} /* uart1_tx_drain */
+
+
+/*************************************************************************
+Function: uart1_tx_resume()
+Purpose:  Restart transmission held back by CTS. The transmit interrupt
+          stops while CTS is high; call this from a timer or pin change
+          interrupt once CTS may be low again. Writing restarts it as well.
+Input:    None
+Returns:  None
+**************************************************************************/
+void uart1_tx_resume(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if ( UART1_TxHead != UART1_TxTail ) {
+			UART1_CONTROL |= _BV(UART1_UDRIE);
+		}
+	}
+} /* uart1_tx_resume */
+
+
+/*************************************************************************
+Function: uart1_stats()
+Purpose:  Copy the receive error counters
+Input:    structure to fill, non-zero reset to clear the counters
+Returns:  None
+**************************************************************************/
+void uart1_stats(struct uart_stats *stats, uint8_t reset)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		*stats = UART1_Stats;
+		if ( reset ) {
+			memset((void *)&UART1_Stats, 0, sizeof(UART1_Stats));
+		}
+	}
+} /* uart1_stats */
+
+
+#if defined( UART_TX_EMPTY_CALLBACK )
+/*************************************************************************
+Function: uart1_tx_empty_callback()
+Purpose:  Register a function called from the UDRE interrupt when the
+          transmit ringbuffer runs empty, NULL to remove it
+Input:    callback function
+Returns:  None
+**************************************************************************/
+void uart1_tx_empty_callback(void (*callback)(void))
+{
+	UART1_TxEmptyCallback = callback;
+} /* uart1_tx_empty_callback */
+#endif
+
 #endif
 
 #endif /* defined( USART1_ENABLED ) */
@@ -1003,7 +1825,7 @@ Function: UART2 Receive Complete interrupt
 Purpose:  called when the UART2 has received a character
 **************************************************************************/
 {
-	uint16_t tmphead;
+	UART2_INDEX_T tmphead;
 	uint8_t data;
 	uint8_t usr;
 	uint8_t lastRxError;
@@ -1015,6 +1837,31 @@ Purpose:  called when the UART2 has received a character
 
 	/* */
 	lastRxError = (usr & (_BV(FE2)|_BV(DOR2)) );
+	if ( lastRxError ) {
+		if ( usr & _BV(UART2_FE) ) {
+			UART2_Stats.frame++;
+		}
+		if ( usr & _BV(UART2_DOR) ) {
+			UART2_Stats.overrun++;
+		}
+	}
+
+#if defined( USART2_XONXOFF )
+	/* flow control characters from the peer are not stored */
+	if ( data == UART_XOFF ) {
+		UART2_TxXoff = 1;
+		UART2_LastRxError = lastRxError;
+		return;
+	}
+	if ( data == UART_XON ) {
+		UART2_TxXoff = 0;
+		if ( UART2_TxHead != UART2_TxTail ) {
+			UART2_CONTROL |= _BV(UART2_UDRIE);
+		}
+		UART2_LastRxError = lastRxError;
+		return;
+	}
+#endif
 
 	/* calculate buffer index */
 	tmphead = ( UART2_RxHead + 1) & UART_RX2_BUFFER_MASK;
@@ -1022,11 +1869,25 @@ Purpose:  called when the UART2 has received a character
 	if ( tmphead == UART2_RxTail ) {
 		/* error: receive buffer overflow */
 		lastRxError = UART_BUFFER_OVERFLOW >> 8;
+		UART2_Stats.overflow++;
 	} else {
 		/* store new index */
 		UART2_RxHead = tmphead;
 		/* store received data in buffer */
 		UART2_RxBuf[tmphead] = data;
+#if defined( USART2_RTSCTS ) || defined( USART2_XONXOFF )
+		if ( !UART2_RxHeld && ((tmphead - UART2_RxTail) & UART_RX2_BUFFER_MASK) >= UART_RX2_HIGH_WATERMARK ) {
+			/* ask the peer to pause before the ringbuffer overflows */
+			UART2_RxHeld = 1;
+#if defined( USART2_RTSCTS )
+			UART2_RTS_PORT |= _BV(UART2_RTS_BIT);
+#endif
+#if defined( USART2_XONXOFF )
+			UART2_TxFlowChar = UART_XOFF;
+			UART2_CONTROL |= _BV(UART2_UDRIE);
+#endif
+		}
+#endif
 	}
 	UART2_LastRxError = lastRxError;
 }
@@ -1038,7 +1899,29 @@ Function: UART2 Data Register Empty interrupt
 Purpose:  called when the UART2 is ready to transmit the next byte
 **************************************************************************/
 {
-	uint16_t tmptail;
+	UART2_INDEX_T tmptail;
+
+#if defined( USART2_XONXOFF )
+	if ( UART2_TxFlowChar ) {
+		/* XON/XOFF go out ahead of the buffered data */
+		UART2_DATA = UART2_TxFlowChar;
+		UART2_TxFlowChar = 0;
+		UART2_STATUS |= _BV(UART2_TXC);
+		return;
+	}
+	if ( UART2_TxXoff ) {
+		/* peer sent XOFF, its XON in the receive interrupt restarts us */
+		UART2_CONTROL &= ~_BV(UART2_UDRIE);
+		return;
+	}
+#endif
+#if defined( USART2_RTSCTS )
+	if ( UART_PIN(UART2_CTS_PORT) & _BV(UART2_CTS_BIT) ) {
+		/* CTS high, peer not ready: stop until uart2_tx_resume() or a write */
+		UART2_CONTROL &= ~_BV(UART2_UDRIE);
+		return;
+	}
+#endif
 
 
 	if ( UART2_TxHead != UART2_TxTail) {
@@ -1047,9 +1930,16 @@ Purpose:  called when the UART2 is ready to transmit the next byte
 		UART2_TxTail = tmptail;
 		/* get one byte from buffer and write it to UART */
 		UART2_DATA = UART2_TxBuf[tmptail];  /* start transmission */
+		/* TXC is set again once this byte and the ones after it are sent */
+		UART2_STATUS |= _BV(UART2_TXC);
 	} else {
 		/* tx buffer empty, disable UDRE interrupt */
 		UART2_CONTROL &= ~_BV(UART2_UDRIE);
+#if defined( UART_TX_EMPTY_CALLBACK )
+		if ( UART2_TxEmptyCallback ) {
+			UART2_TxEmptyCallback();
+		}
+#endif
 	}
 }
 
@@ -1066,6 +1956,21 @@ void uart2_init(uint16_t baudrate)
 	UART2_TxTail = 0;
 	UART2_RxHead = 0;
 	UART2_RxTail = 0;
+#if defined( USART2_RTSCTS ) || defined( USART2_XONXOFF )
+	UART2_RxHeld = 0;
+#endif
+#if defined( USART2_XONXOFF )
+	UART2_TxXoff = 0;
+	UART2_TxFlowChar = 0;
+#endif
+#if defined( USART2_RTSCTS )
+	/* RTS low: ready to receive. CTS is an input with pull-up, so an
+	   unconnected CTS holds the transmitter */
+	UART2_RTS_PORT &= ~_BV(UART2_RTS_BIT);
+	UART_DDR(UART2_RTS_PORT) |= _BV(UART2_RTS_BIT);
+	UART_DDR(UART2_CTS_PORT) &= ~_BV(UART2_CTS_BIT);
+	UART2_CTS_PORT |= _BV(UART2_CTS_BIT);
+#endif
 
 
 	/* Set baud rate */
@@ -1088,6 +1993,31 @@ void uart2_init(uint16_t baudrate)
 } /* uart_init */
 
 
+#if defined( USART2_RTSCTS ) || defined( USART2_XONXOFF )
+/*************************************************************************
+Function: uart2_rx_release()
+Purpose:  let the peer send again once the receive ringbuffer has been
+          read down to UART_RX2_LOW_WATERMARK
+Input:    None
+Returns:  None
+**************************************************************************/
+static void uart2_rx_release(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if ( UART2_RxHeld && ((UART2_RxHead - UART2_RxTail) & UART_RX2_BUFFER_MASK) <= UART_RX2_LOW_WATERMARK ) {
+			UART2_RxHeld = 0;
+#if defined( USART2_RTSCTS )
+			UART2_RTS_PORT &= ~_BV(UART2_RTS_BIT);
+#endif
+#if defined( USART2_XONXOFF )
+			UART2_TxFlowChar = UART_XON;
+			UART2_CONTROL |= _BV(UART2_UDRIE);
+#endif
+		}
+	}
+} /* uart2_rx_release */
+#endif
+
 /*************************************************************************
 Function: uart2_getc()
 Purpose:  return byte from ringbuffer
@@ -1096,20 +2026,31 @@ Returns:  lower byte:  received byte from ringbuffer
 **************************************************************************/
 uint16_t uart2_getc(void)
 {
-	uint16_t tmptail;
+	UART2_INDEX_T tmphead;
+	UART2_INDEX_T tmptail;
 	uint8_t data;
 
-	if ( UART2_RxHead == UART2_RxTail ) {
+	UART2_ATOMIC {
+		tmphead = UART2_RxHead;
+	}
+	if ( tmphead == UART2_RxTail ) {
 		return UART_NO_DATA;   /* no data available */
 	}
 
-	/* calculate /store buffer index */
+	/* calculate buffer index */
 	tmptail = (UART2_RxTail + 1) & UART_RX2_BUFFER_MASK;
-	UART2_RxTail = tmptail;
 
 	/* get data from receive buffer */
 	data = UART2_RxBuf[tmptail];
 
+	/* store buffer index */
+	UART2_ATOMIC {
+		UART2_RxTail = tmptail;
+	}
+#if defined( USART2_RTSCTS ) || defined( USART2_XONXOFF )
+	uart2_rx_release();
+#endif
+
 	return (UART2_LastRxError << 8) + data;
 
 } /* uart2_getc */
@@ -1125,11 +2066,14 @@ Returns:  lower byte:  next byte in ring buffer
 **************************************************************************/
 uint16_t uart2_peek(void)
 {
-	uint16_t tmptail;
+	UART2_INDEX_T tmphead;
+	UART2_INDEX_T tmptail;
 	uint8_t data;
 
-
-	if ( UART2_RxHead == UART2_RxTail ) {
+	UART2_ATOMIC {
+		tmphead = UART2_RxHead;
+	}
+	if ( tmphead == UART2_RxTail ) {
 		return UART_NO_DATA;   /* no data available */
 	}
 
@@ -1150,20 +2094,29 @@ Returns:  none
 **************************************************************************/
 void uart2_putc(uint8_t data)
 {
-	uint16_t tmphead;
-
+	UART2_INDEX_T tmphead;
+	UART2_INDEX_T tmptail;
 
 	tmphead  = (UART2_TxHead + 1) & UART_TX2_BUFFER_MASK;
 
-	while ( tmphead == UART2_TxTail ) {
-		;/* wait for free space in buffer */
-	}
+	do {
+		UART2_ATOMIC {
+			tmptail = UART2_TxTail;
+		}
+		if ( tmphead == tmptail ) {
+			/* buffer full: the transmit interrupt may have stopped on CTS, restart it */
+			UART2_CONTROL |= _BV(UART2_UDRIE);
+		}
+	} while ( tmphead == tmptail );	/* wait for free space in buffer */
 
 	UART2_TxBuf[tmphead] = data;
-	UART2_TxHead = tmphead;
+	UART2_ATOMIC {
+		UART2_TxHead = tmphead;
+	}
 
 	/* enable UDRE interrupt */
 	UART2_CONTROL    |= _BV(UART2_UDRIE);
+	UART2_TxPending = 1;
 
 } /* uart2_putc */
 
@@ -1199,6 +2152,117 @@ void uart2_puts_p(const char *progmem_s )
 } /* uart2_puts_p */
 
 
+/*************************************************************************
+Function: uart2_write()
+Purpose:  copy a block of bytes to the transmit ringbuffer
+Input:    buffer and number of bytes to be transmitted
+Returns:  number of bytes copied, less than n only with UART_NONBLOCKING
+          when the ringbuffer is full
+**************************************************************************/
+uint16_t uart2_write(const void *buf, uint16_t n)
+{
+	const uint8_t *src = (const uint8_t *)buf;
+	uint16_t done = 0;
+	UART2_INDEX_T head;
+	uint16_t count;
+	uint16_t len;
+
+	while ( done < n ) {
+		UART2_ATOMIC {
+			count = (UART2_TxTail - UART2_TxHead - 1) & UART_TX2_BUFFER_MASK;
+		}
+		if ( count == 0 ) {
+#if defined( UART_NONBLOCKING )
+			break;
+#else
+			/* wait for free space in buffer, restarting the transmit interrupt if it stopped on CTS */
+			UART2_CONTROL |= _BV(UART2_UDRIE);
+			continue;
+#endif
+		}
+		if ( count > n - done ) {
+			count = n - done;
+		}
+
+		/* at most two segments: up to the end of the buffer, then from its start */
+		head = (UART2_TxHead + 1) & UART_TX2_BUFFER_MASK;
+		len = UART_TX2_BUFFER_SIZE - head;
+		if ( len > count ) {
+			len = count;
+		}
+		memcpy((uint8_t *)&UART2_TxBuf[head], src, len);
+		memcpy((uint8_t *)UART2_TxBuf, src + len, count - len);
+		src  += count;
+		done += count;
+
+		/* publish the new head once, then enable UDRE interrupt */
+		UART2_ATOMIC {
+			UART2_TxHead = (head + count - 1) & UART_TX2_BUFFER_MASK;
+		}
+		UART2_CONTROL    |= _BV(UART2_UDRIE);
+		UART2_TxPending = 1;
+	}
+
+	return done;
+
+} /* uart2_write */
+
+
+/*************************************************************************
+Function: uart2_read()
+Purpose:  copy a block of received bytes from the receive ringbuffer
+Input:    buffer and number of bytes to be read
+Returns:  number of bytes copied, less than n only with UART_NONBLOCKING
+          when the ringbuffer runs empty
+**************************************************************************/
+uint16_t uart2_read(void *buf, uint16_t n)
+{
+	uint8_t *dst = (uint8_t *)buf;
+	uint16_t done = 0;
+	UART2_INDEX_T tail;
+	uint16_t count;
+	uint16_t len;
+
+	while ( done < n ) {
+		UART2_ATOMIC {
+			count = (UART2_RxHead - UART2_RxTail) & UART_RX2_BUFFER_MASK;
+		}
+		if ( count == 0 ) {
+#if defined( UART_NONBLOCKING )
+			break;
+#else
+			continue;	/* wait for received data */
+#endif
+		}
+		if ( count > n - done ) {
+			count = n - done;
+		}
+
+		/* at most two segments: up to the end of the buffer, then from its start */
+		tail = (UART2_RxTail + 1) & UART_RX2_BUFFER_MASK;
+		len = UART_RX2_BUFFER_SIZE - tail;
+		if ( len > count ) {
+			len = count;
+		}
+		memcpy(dst, (const uint8_t *)&UART2_RxBuf[tail], len);
+		memcpy(dst + len, (const uint8_t *)UART2_RxBuf, count - len);
+		dst  += count;
+		done += count;
+
+		/* release the space to the receive interrupt once */
+		UART2_ATOMIC {
+			UART2_RxTail = (tail + count - 1) & UART_RX2_BUFFER_MASK;
+		}
+#if defined( USART2_RTSCTS ) || defined( USART2_XONXOFF )
+		uart2_rx_release();
+#endif
+	}
+
+	return done;
+
+} /* uart2_read */
+
+
 
 /*************************************************************************
 Function: uart2_available()
@@ -1208,7 +2272,12 @@ Returns:  Integer number of bytes in the receive buffer
 **************************************************************************/
 uint16_t uart2_available(void)
 {
-	return (UART_RX2_BUFFER_SIZE + UART2_RxHead - UART2_RxTail) & UART_RX2_BUFFER_MASK;
+	uint16_t count;
+
+	UART2_ATOMIC {
+		count = (UART_RX2_BUFFER_SIZE + UART2_RxHead - UART2_RxTail) & UART_RX2_BUFFER_MASK;
+	}
+	return count;
 } /* uart2_available */
 
 
@@ -1221,9 +2290,124 @@ Returns:  None
 **************************************************************************/
 void uart2_flush(void)
 {
-	UART2_RxHead = UART2_RxTail;
+	/* the receive interrupt owns the head, so move the tail up to it */
+	UART2_ATOMIC {
+		UART2_RxTail = UART2_RxHead;
+	}
+#if defined( USART2_RTSCTS ) || defined( USART2_XONXOFF )
+	uart2_rx_release();
+#endif
 } /* uart2_flush */
 
+
+/*************************************************************************
+Function: uart2_tx_space()
+Purpose:  Determine the free space in the transmit buffer
+Input:    None
+Returns:  Number of bytes that can be buffered without waiting
+**************************************************************************/
+uint16_t uart2_tx_space(void)
+{
+	uint16_t count;
+
+	UART2_ATOMIC {
+		count = (UART2_TxTail - UART2_TxHead - 1) & UART_TX2_BUFFER_MASK;
+	}
+	return count;
+} /* uart2_tx_space */
+
+
+/*************************************************************************
+Function: uart2_tx_drain()
+Purpose:  Wait until all buffered bytes have left the transmitter.
+          The CPU sleeps in idle mode while the ringbuffer empties and
+          then polls TXC for the last byte. Must be called with interrupts
+          enabled, selects SLEEP_MODE_IDLE.
+Input:    None
+Returns:  None
+**************************************************************************/
+void uart2_tx_drain(void)
+{
+	if ( !UART2_TxPending ) {
+		return;
+	}
+
+	/* UDRE interrupt disables itself once the ringbuffer is empty */
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	while ( (UART2_CONTROL & _BV(UART2_UDRIE)) || UART2_TxHead != UART2_TxTail ) {
+		if ( !(UART2_CONTROL & _BV(UART2_UDRIE)) ) {
+			/* held by flow control, poll until the peer is ready again */
+			UART2_CONTROL |= _BV(UART2_UDRIE);
+			sei();
+			cli();
+			continue;
+		}
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		cli();
+	}
+	sei();
+
+	/* last byte is still shifting out until TXC is set */
+	while ( !(UART2_STATUS & _BV(UART2_TXC)) ) {
+		;
+	}
+	UART2_TxPending = 0;
+} /* uart2_tx_drain */
+
+
+/*************************************************************************
+Function: uart2_tx_resume()
+Purpose:  Restart transmission held back by CTS. The transmit interrupt
+          stops while CTS is high; call this from a timer or pin change
+          interrupt once CTS may be low again. Writing restarts it as well.
+Input:    None
+Returns:  None
+**************************************************************************/
+void uart2_tx_resume(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if ( UART2_TxHead != UART2_TxTail ) {
+			UART2_CONTROL |= _BV(UART2_UDRIE);
+		}
+	}
+} /* uart2_tx_resume */
+
+
+/*************************************************************************
+Function: uart2_stats()
+Purpose:  Copy the receive error counters
+Input:    structure to fill, non-zero reset to clear the counters
+Returns:  None
+**************************************************************************/
+void uart2_stats(struct uart_stats *stats, uint8_t reset)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		*stats = UART2_Stats;
+		if ( reset ) {
+			memset((void *)&UART2_Stats, 0, sizeof(UART2_Stats));
+		}
+	}
+} /* uart2_stats */
+
+
+#if defined( UART_TX_EMPTY_CALLBACK )
+/*************************************************************************
+Function: uart2_tx_empty_callback()
+Purpose:  Register a function called from the UDRE interrupt when the
+          transmit ringbuffer runs empty, NULL to remove it
+Input:    callback function
+Returns:  None
+**************************************************************************/
+void uart2_tx_empty_callback(void (*callback)(void))
+{
+	UART2_TxEmptyCallback = callback;
+} /* uart2_tx_empty_callback */
+#endif
+
 #endif
 
 #endif /* defined( USART2_ENABLED ) */
@@ -1241,7 +2425,7 @@ Function: UART3 Receive Complete interrupt
 Purpose:  called when the UART3 has received a character
 **************************************************************************/
 {
-	uint16_t tmphead;
+	UART3_INDEX_T tmphead;
 	uint8_t data;
 	uint8_t usr;
 	uint8_t lastRxError;
@@ -1253,6 +2437,31 @@ Purpose:  called when the UART3 has received a character
 
 	/* */
 	lastRxError = (usr & (_BV(FE3)|_BV(DOR3)) );
+	if ( lastRxError ) {
+		if ( usr & _BV(UART3_FE) ) {
+			UART3_Stats.frame++;
+		}
+		if ( usr & _BV(UART3_DOR) ) {
+			UART3_Stats.overrun++;
+		}
+	}
+
+#if defined( USART3_XONXOFF )
+	/* flow control characters from the peer are not stored */
+	if ( data == UART_XOFF ) {
+		UART3_TxXoff = 1;
+		UART3_LastRxError = lastRxError;
+		return;
+	}
+	if ( data == UART_XON ) {
+		UART3_TxXoff = 0;
+		if ( UART3_TxHead != UART3_TxTail ) {
+			UART3_CONTROL |= _BV(UART3_UDRIE);
+		}
+		UART3_LastRxError = lastRxError;
+		return;
+	}
+#endif
 
 	/* calculate buffer index */
 	tmphead = ( UART3_RxHead + 1) & UART_RX3_BUFFER_MASK;
@@ -1260,11 +2469,25 @@ Purpose:  called when the UART3 has received a character
 	if ( tmphead == UART3_RxTail ) {
 		/* error: receive buffer overflow */
 		lastRxError = UART_BUFFER_OVERFLOW >> 8;
+		UART3_Stats.overflow++;
 	} else {
 		/* store new index */
 		UART3_RxHead = tmphead;
 		/* store received data in buffer */
 		UART3_RxBuf[tmphead] = data;
+#if defined( USART3_RTSCTS ) || defined( USART3_XONXOFF )
+		if ( !UART3_RxHeld && ((tmphead - UART3_RxTail) & UART_RX3_BUFFER_MASK) >= UART_RX3_HIGH_WATERMARK ) {
+			/* ask the peer to pause before the ringbuffer overflows */
+			UART3_RxHeld = 1;
+#if defined( USART3_RTSCTS )
+			UART3_RTS_PORT |= _BV(UART3_RTS_BIT);
+#endif
+#if defined( USART3_XONXOFF )
+			UART3_TxFlowChar = UART_XOFF;
+			UART3_CONTROL |= _BV(UART3_UDRIE);
+#endif
+		}
+#endif
 	}
 	UART3_LastRxError = lastRxError;
 }
@@ -1276,7 +2499,29 @@ Function: UART3 Data Register Empty interrupt
 Purpose:  called when the UART3 is ready to transmit the next byte
 **************************************************************************/
 {
-	uint16_t tmptail;
+	UART3_INDEX_T tmptail;
+
+#if defined( USART3_XONXOFF )
+	if ( UART3_TxFlowChar ) {
+		/* XON/XOFF go out ahead of the buffered data */
+		UART3_DATA = UART3_TxFlowChar;
+		UART3_TxFlowChar = 0;
+		UART3_STATUS |= _BV(UART3_TXC);
+		return;
+	}
+	if ( UART3_TxXoff ) {
+		/* peer sent XOFF, its XON in the receive interrupt restarts us */
+		UART3_CONTROL &= ~_BV(UART3_UDRIE);
+		return;
+	}
+#endif
+#if defined( USART3_RTSCTS )
+	if ( UART_PIN(UART3_CTS_PORT) & _BV(UART3_CTS_BIT) ) {
+		/* CTS high, peer not ready: stop until uart3_tx_resume() or a write */
+		UART3_CONTROL &= ~_BV(UART3_UDRIE);
+		return;
+	}
+#endif
 
 
 	if ( UART3_TxHead != UART3_TxTail) {
@@ -1285,9 +2530,16 @@ Purpose:  called when the UART3 is ready to transmit the next byte
 		UART3_TxTail = tmptail;
 		/* get one byte from buffer and write it to UART */
 		UART3_DATA = UART3_TxBuf[tmptail];  /* start transmission */
+		/* TXC is set again once this byte and the ones after it are sent */
+		UART3_STATUS |= _BV(UART3_TXC);
 	} else {
 		/* tx buffer empty, disable UDRE interrupt */
 		UART3_CONTROL &= ~_BV(UART3_UDRIE);
+#if defined( UART_TX_EMPTY_CALLBACK )
+		if ( UART3_TxEmptyCallback ) {
+			UART3_TxEmptyCallback();
+		}
+#endif
 	}
 }
 
@@ -1304,6 +2556,21 @@ void uart3_init(uint16_t baudrate)
 	UART3_TxTail = 0;
 	UART3_RxHead = 0;
 	UART3_RxTail = 0;
+#if defined( USART3_RTSCTS ) || defined( USART3_XONXOFF )
+	UART3_RxHeld = 0;
+#endif
+#if defined( USART3_XONXOFF )
+	UART3_TxXoff = 0;
+	UART3_TxFlowChar = 0;
+#endif
+#if defined( USART3_RTSCTS )
+	/* RTS low: ready to receive. CTS is an input with pull-up, so an
+	   unconnected CTS holds the transmitter */
+	UART3_RTS_PORT &= ~_BV(UART3_RTS_BIT);
+	UART_DDR(UART3_RTS_PORT) |= _BV(UART3_RTS_BIT);
+	UART_DDR(UART3_CTS_PORT) &= ~_BV(UART3_CTS_BIT);
+	UART3_CTS_PORT |= _BV(UART3_CTS_BIT);
+#endif
 
 	/* Set baud rate */
 	if ( baudrate & 0x8000 ) {
@@ -1325,6 +2592,31 @@ void uart3_init(uint16_t baudrate)
 } /* uart_init */
 
 
+#if defined( USART3_RTSCTS ) || defined( USART3_XONXOFF )
+/*************************************************************************
+Function: uart3_rx_release()
+Purpose:  let the peer send again once the receive ringbuffer has been
+          read down to UART_RX3_LOW_WATERMARK
+Input:    None
+Returns:  None
+**************************************************************************/
+static void uart3_rx_release(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if ( UART3_RxHeld && ((UART3_RxHead - UART3_RxTail) & UART_RX3_BUFFER_MASK) <= UART_RX3_LOW_WATERMARK ) {
+			UART3_RxHeld = 0;
+#if defined( USART3_RTSCTS )
+			UART3_RTS_PORT &= ~_BV(UART3_RTS_BIT);
+#endif
+#if defined( USART3_XONXOFF )
+			UART3_TxFlowChar = UART_XON;
+			UART3_CONTROL |= _BV(UART3_UDRIE);
+#endif
+		}
+	}
+} /* uart3_rx_release */
+#endif
+
 /*************************************************************************
 Function: uart3_getc()
 Purpose:  return byte from ringbuffer
@@ -1333,20 +2625,31 @@ Returns:  lower byte:  received byte from ringbuffer
 **************************************************************************/
 uint16_t uart3_getc(void)
 {
-	uint16_t tmptail;
+	UART3_INDEX_T tmphead;
+	UART3_INDEX_T tmptail;
 	uint8_t data;
 
-	if ( UART3_RxHead == UART3_RxTail ) {
+	UART3_ATOMIC {
+		tmphead = UART3_RxHead;
+	}
+	if ( tmphead == UART3_RxTail ) {
 		return UART_NO_DATA;   /* no data available */
 	}
 
-	/* calculate /store buffer index */
+	/* calculate buffer index */
 	tmptail = (UART3_RxTail + 1) & UART_RX3_BUFFER_MASK;
-	UART3_RxTail = tmptail;
 
 	/* get data from receive buffer */
 	data = UART3_RxBuf[tmptail];
 
+	/* store buffer index */
+	UART3_ATOMIC {
+		UART3_RxTail = tmptail;
+	}
+#if defined( USART3_RTSCTS ) || defined( USART3_XONXOFF )
+	uart3_rx_release();
+#endif
+
 	return (UART3_LastRxError << 8) + data;
 
 } /* uart3_getc */
@@ -1362,10 +2665,14 @@ Returns:  lower byte:  next byte in ring buffer
 **************************************************************************/
 uint16_t uart3_peek(void)
 {
-	uint16_t tmptail;
+	UART3_INDEX_T tmphead;
+	UART3_INDEX_T tmptail;
 	uint8_t data;
 
-	if ( UART3_RxHead == UART3_RxTail ) {
+	UART3_ATOMIC {
+		tmphead = UART3_RxHead;
+	}
+	if ( tmphead == UART3_RxTail ) {
 		return UART_NO_DATA;   /* no data available */
 	}
 
@@ -1386,20 +2693,29 @@ Returns:  none
 **************************************************************************/
 void uart3_putc(uint8_t data)
 {
-	uint16_t tmphead;
-
+	UART3_INDEX_T tmphead;
+	UART3_INDEX_T tmptail;
 
 	tmphead  = (UART3_TxHead + 1) & UART_TX3_BUFFER_MASK;
 
-	while ( tmphead == UART3_TxTail ) {
-		;/* wait for free space in buffer */
-	}
+	do {
+		UART3_ATOMIC {
+			tmptail = UART3_TxTail;
+		}
+		if ( tmphead == tmptail ) {
+			/* buffer full: the transmit interrupt may have stopped on CTS, restart it */
+			UART3_CONTROL |= _BV(UART3_UDRIE);
+		}
+	} while ( tmphead == tmptail );	/* wait for free space in buffer */
 
 	UART3_TxBuf[tmphead] = data;
-	UART3_TxHead = tmphead;
+	UART3_ATOMIC {
+		UART3_TxHead = tmphead;
+	}
 
 	/* enable UDRE interrupt */
 	UART3_CONTROL    |= _BV(UART3_UDRIE);
+	UART3_TxPending = 1;
 
 } /* uart3_putc */
 
@@ -1436,6 +2752,117 @@ void uart3_puts_p(const char *progmem_s )
 } /* uart3_puts_p */
 
 
+/*************************************************************************
+Function: uart3_write()
+Purpose:  copy a block of bytes to the transmit ringbuffer
+Input:    buffer and number of bytes to be transmitted
+Returns:  number of bytes copied, less than n only with UART_NONBLOCKING
+          when the ringbuffer is full
+**************************************************************************/
+uint16_t uart3_write(const void *buf, uint16_t n)
+{
+	const uint8_t *src = (const uint8_t *)buf;
+	uint16_t done = 0;
+	UART3_INDEX_T head;
+	uint16_t count;
+	uint16_t len;
+
+	while ( done < n ) {
+		UART3_ATOMIC {
+			count = (UART3_TxTail - UART3_TxHead - 1) & UART_TX3_BUFFER_MASK;
+		}
+		if ( count == 0 ) {
+#if defined( UART_NONBLOCKING )
+			break;
+#else
+			/* wait for free space in buffer, restarting the transmit interrupt if it stopped on CTS */
+			UART3_CONTROL |= _BV(UART3_UDRIE);
+			continue;
+#endif
+		}
+		if ( count > n - done ) {
+			count = n - done;
+		}
+
+		/* at most two segments: up to the end of the buffer, then from its start */
+		head = (UART3_TxHead + 1) & UART_TX3_BUFFER_MASK;
+		len = UART_TX3_BUFFER_SIZE - head;
+		if ( len > count ) {
+			len = count;
+		}
+		memcpy((uint8_t *)&UART3_TxBuf[head], src, len);
+		memcpy((uint8_t *)UART3_TxBuf, src + len, count - len);
+		src  += count;
+		done += count;
+
+		/* publish the new head once, then enable UDRE interrupt */
+		UART3_ATOMIC {
+			UART3_TxHead = (head + count - 1) & UART_TX3_BUFFER_MASK;
+		}
+		UART3_CONTROL    |= _BV(UART3_UDRIE);
+		UART3_TxPending = 1;
+	}
+
+	return done;
+
+} /* uart3_write */
+
+
+/*************************************************************************
+Function: uart3_read()
+Purpose:  copy a block of received bytes from the receive ringbuffer
+Input:    buffer and number of bytes to be read
+Returns:  number of bytes copied, less than n only with UART_NONBLOCKING
+          when the ringbuffer runs empty
+**************************************************************************/
+uint16_t uart3_read(void *buf, uint16_t n)
+{
+	uint8_t *dst = (uint8_t *)buf;
+	uint16_t done = 0;
+	UART3_INDEX_T tail;
+	uint16_t count;
+	uint16_t len;
+
+	while ( done < n ) {
+		UART3_ATOMIC {
+			count = (UART3_RxHead - UART3_RxTail) & UART_RX3_BUFFER_MASK;
+		}
+		if ( count == 0 ) {
+#if defined( UART_NONBLOCKING )
+			break;
+#else
+			continue;	/* wait for received data */
+#endif
+		}
+		if ( count > n - done ) {
+			count = n - done;
+		}
+
+		/* at most two segments: up to the end of the buffer, then from its start */
+		tail = (UART3_RxTail + 1) & UART_RX3_BUFFER_MASK;
+		len = UART_RX3_BUFFER_SIZE - tail;
+		if ( len > count ) {
+			len = count;
+		}
+		memcpy(dst, (const uint8_t *)&UART3_RxBuf[tail], len);
+		memcpy(dst + len, (const uint8_t *)UART3_RxBuf, count - len);
+		dst  += count;
+		done += count;
+
+		/* release the space to the receive interrupt once */
+		UART3_ATOMIC {
+			UART3_RxTail = (tail + count - 1) & UART_RX3_BUFFER_MASK;
+		}
+#if defined( USART3_RTSCTS ) || defined( USART3_XONXOFF )
+		uart3_rx_release();
+#endif
+	}
+
+	return done;
+
+} /* uart3_read */
+
+
 
 /*************************************************************************
 Function: uart3_available()
@@ -1445,7 +2872,12 @@ Returns:  Integer number of bytes in the receive buffer
 **************************************************************************/
 uint16_t uart3_available(void)
 {
-	return (UART_RX3_BUFFER_SIZE + UART3_RxHead - UART3_RxTail) & UART_RX3_BUFFER_MASK;
+	uint16_t count;
+
+	UART3_ATOMIC {
+		count = (UART_RX3_BUFFER_SIZE + UART3_RxHead - UART3_RxTail) & UART_RX3_BUFFER_MASK;
+	}
+	return count;
 } /* uart3_available */
 
 
@@ -1458,9 +2890,124 @@ Returns:  None
 **************************************************************************/
 void uart3_flush(void)
 {
-	UART3_RxHead = UART3_RxTail;
+	/* the receive interrupt owns the head, so move the tail up to it */
+	UART3_ATOMIC {
+		UART3_RxTail = UART3_RxHead;
+	}
+#if defined( USART3_RTSCTS ) || defined( USART3_XONXOFF )
+	uart3_rx_release();
+#endif
 } /* uart3_flush */
 
+
+/*************************************************************************
+Function: uart3_tx_space()
+Purpose:  Determine the free space in the transmit buffer
+Input:    None
+Returns:  Number of bytes that can be buffered without waiting
+**************************************************************************/
+uint16_t uart3_tx_space(void)
+{
+	uint16_t count;
+
+	UART3_ATOMIC {
+		count = (UART3_TxTail - UART3_TxHead - 1) & UART_TX3_BUFFER_MASK;
+	}
+	return count;
+} /* uart3_tx_space */
+
+
+/*************************************************************************
+Function: uart3_tx_drain()
+Purpose:  Wait until all buffered bytes have left the transmitter.
+          The CPU sleeps in idle mode while the ringbuffer empties and
+          then polls TXC for the last byte. Must be called with interrupts
+          enabled, selects SLEEP_MODE_IDLE.
+Input:    None
+Returns:  None
+**************************************************************************/
+void uart3_tx_drain(void)
+{
+	if ( !UART3_TxPending ) {
+		return;
+	}
+
+	/* UDRE interrupt disables itself once the ringbuffer is empty */
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	while ( (UART3_CONTROL & _BV(UART3_UDRIE)) || UART3_TxHead != UART3_TxTail ) {
+		if ( !(UART3_CONTROL & _BV(UART3_UDRIE)) ) {
+			/* held by flow control, poll until the peer is ready again */
+			UART3_CONTROL |= _BV(UART3_UDRIE);
+			sei();
+			cli();
+			continue;
+		}
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		cli();
+	}
+	sei();
+
+	/* last byte is still shifting out until TXC is set */
+	while ( !(UART3_STATUS & _BV(UART3_TXC)) ) {
+		;
+	}
+	UART3_TxPending = 0;
+} /* uart3_tx_drain */
+
+
+/*************************************************************************
+Function: uart3_tx_resume()
+Purpose:  Restart transmission held back by CTS. The transmit interrupt
+          stops while CTS is high; call this from a timer or pin change
+          interrupt once CTS may be low again. Writing restarts it as well.
+Input:    None
+Returns:  None
+**************************************************************************/
+void uart3_tx_resume(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if ( UART3_TxHead != UART3_TxTail ) {
+			UART3_CONTROL |= _BV(UART3_UDRIE);
+		}
+	}
+} /* uart3_tx_resume */
+
+
+/*************************************************************************
+Function: uart3_stats()
+Purpose:  Copy the receive error counters
+Input:    structure to fill, non-zero reset to clear the counters
+Returns:  None
+**************************************************************************/
+void uart3_stats(struct uart_stats *stats, uint8_t reset)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		*stats = UART3_Stats;
+		if ( reset ) {
+			memset((void *)&UART3_Stats, 0, sizeof(UART3_Stats));
+		}
+	}
+} /* uart3_stats */
+
+
+#if defined( UART_TX_EMPTY_CALLBACK )
+/*************************************************************************
+Function: uart3_tx_empty_callback()
+Purpose:  Register a function called from the UDRE interrupt when the
+          transmit ringbuffer runs empty, NULL to remove it
+Input:    callback function
+Returns:  None
+**************************************************************************/
+void uart3_tx_empty_callback(void (*callback)(void))
+{
+	UART3_TxEmptyCallback = callback;
+} /* uart3_tx_empty_callback */
+#endif
+
 #endif
 
 #endif /* defined( USART3_ENABLED ) */
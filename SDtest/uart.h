@@ -119,6 +119,29 @@ Date        Description
 //#define USART2_ENABLED 
 //#define USART3_ENABLED
 
+/* Let uartN_write() and uartN_read() return a partial count instead of
+   waiting for the ringbuffer */
+//#define UART_NONBLOCKING
+
+/* Flow control, per USART (shown for USART0):
+   USART0_RTSCTS   RTS output goes high when the receive ringbuffer holds
+                   UART_RX0_HIGH_WATERMARK bytes and low again once it has
+                   been read down to UART_RX0_LOW_WATERMARK. While the CTS
+                   input is high nothing is transmitted.
+   USART0_XONXOFF  Same watermarks, but XOFF/XON are sent in band, and a
+                   received XOFF stops the transmitter until XON. These two
+                   bytes are not stored, so only use it for text. */
+//#define USART0_RTSCTS
+//#define UART0_RTS_PORT PORTD
+//#define UART0_RTS_BIT  PD6
+//#define UART0_CTS_PORT PORTD
+//#define UART0_CTS_BIT  PD7
+//#define USART0_XONXOFF
+
+/* Enable uartN_tx_empty_callback(). Off by default because calling through
+   a pointer makes the UDRE interrupt save all call-clobbered registers */
+//#define UART_TX_EMPTY_CALLBACK
+
 /* Set size of receive and transmit buffers */
 
 #ifndef UART_RX0_BUFFER_SIZE
@@ -147,21 +170,77 @@ Date        Description
 	#define UART_TX3_BUFFER_SIZE 128 /**< Size of the circular transmit buffer, must be power of 2 */
 #endif
 
+/* Flow control watermarks in bytes, also used by XON/XOFF. The peer may
+   still send a few bytes after RTS or XOFF, keep some room above HIGH */
+
+#ifndef UART_RX0_HIGH_WATERMARK
+	#define UART_RX0_HIGH_WATERMARK (UART_RX0_BUFFER_SIZE * 3 / 4) /**< Receive level that stops the peer with flow control */
+#endif
+#ifndef UART_RX0_LOW_WATERMARK
+	#define UART_RX0_LOW_WATERMARK (UART_RX0_BUFFER_SIZE / 4) /**< Receive level that lets it send again */
+#endif
+#ifndef UART_RX1_HIGH_WATERMARK
+	#define UART_RX1_HIGH_WATERMARK (UART_RX1_BUFFER_SIZE * 3 / 4) /**< Receive level that stops the peer with flow control */
+#endif
+#ifndef UART_RX1_LOW_WATERMARK
+	#define UART_RX1_LOW_WATERMARK (UART_RX1_BUFFER_SIZE / 4) /**< Receive level that lets it send again */
+#endif
+#ifndef UART_RX2_HIGH_WATERMARK
+	#define UART_RX2_HIGH_WATERMARK (UART_RX2_BUFFER_SIZE * 3 / 4) /**< Receive level that stops the peer with flow control */
+#endif
+#ifndef UART_RX2_LOW_WATERMARK
+	#define UART_RX2_LOW_WATERMARK (UART_RX2_BUFFER_SIZE / 4) /**< Receive level that lets it send again */
+#endif
+#ifndef UART_RX3_HIGH_WATERMARK
+	#define UART_RX3_HIGH_WATERMARK (UART_RX3_BUFFER_SIZE * 3 / 4) /**< Receive level that stops the peer with flow control */
+#endif
+#ifndef UART_RX3_LOW_WATERMARK
+	#define UART_RX3_LOW_WATERMARK (UART_RX3_BUFFER_SIZE / 4) /**< Receive level that lets it send again */
+#endif
+
+#if (UART_RX0_LOW_WATERMARK >= UART_RX0_HIGH_WATERMARK || UART_RX0_HIGH_WATERMARK >= UART_RX0_BUFFER_SIZE)
+	#error "UART_RX0 watermarks must be low < high < buffer size"
+#endif
+#if defined( USART0_RTSCTS ) && !( defined( UART0_RTS_PORT ) && defined( UART0_RTS_BIT ) && defined( UART0_CTS_PORT ) && defined( UART0_CTS_BIT ) )
+	#error "USART0_RTSCTS needs UART0_RTS_PORT, UART0_RTS_BIT, UART0_CTS_PORT and UART0_CTS_BIT"
+#endif
+
+#if (UART_RX1_LOW_WATERMARK >= UART_RX1_HIGH_WATERMARK || UART_RX1_HIGH_WATERMARK >= UART_RX1_BUFFER_SIZE)
+	#error "UART_RX1 watermarks must be low < high < buffer size"
+#endif
+#if defined( USART1_RTSCTS ) && !( defined( UART1_RTS_PORT ) && defined( UART1_RTS_BIT ) && defined( UART1_CTS_PORT ) && defined( UART1_CTS_BIT ) )
+	#error "USART1_RTSCTS needs UART1_RTS_PORT, UART1_RTS_BIT, UART1_CTS_PORT and UART1_CTS_BIT"
+#endif
+
+#if (UART_RX2_LOW_WATERMARK >= UART_RX2_HIGH_WATERMARK || UART_RX2_HIGH_WATERMARK >= UART_RX2_BUFFER_SIZE)
+	#error "UART_RX2 watermarks must be low < high < buffer size"
+#endif
+#if defined( USART2_RTSCTS ) && !( defined( UART2_RTS_PORT ) && defined( UART2_RTS_BIT ) && defined( UART2_CTS_PORT ) && defined( UART2_CTS_BIT ) )
+	#error "USART2_RTSCTS needs UART2_RTS_PORT, UART2_RTS_BIT, UART2_CTS_PORT and UART2_CTS_BIT"
+#endif
+
+#if (UART_RX3_LOW_WATERMARK >= UART_RX3_HIGH_WATERMARK || UART_RX3_HIGH_WATERMARK >= UART_RX3_BUFFER_SIZE)
+	#error "UART_RX3 watermarks must be low < high < buffer size"
+#endif
+#if defined( USART3_RTSCTS ) && !( defined( UART3_RTS_PORT ) && defined( UART3_RTS_BIT ) && defined( UART3_CTS_PORT ) && defined( UART3_CTS_BIT ) )
+	#error "USART3_RTSCTS needs UART3_RTS_PORT, UART3_RTS_BIT, UART3_CTS_PORT and UART3_CTS_BIT"
+#endif
+
 /* Check buffer sizes are not too large for 8-bit positioning */
 
-#if (UART_RX0_BUFFER_SIZE > 256 & !defined(USART0_LARGE_BUFFER))
+#if ((UART_RX0_BUFFER_SIZE > 256 || UART_TX0_BUFFER_SIZE > 256) && !defined(USART0_LARGE_BUFFER))
 	#error "Buffer too large, please use -DUSART0_LARGE_BUFFER switch in compiler options"
 #endif
 
-#if (UART_RX1_BUFFER_SIZE > 256 & !defined(USART1_LARGE_BUFFER))
+#if ((UART_RX1_BUFFER_SIZE > 256 || UART_TX1_BUFFER_SIZE > 256) && !defined(USART1_LARGE_BUFFER))
 	#error "Buffer too large, please use -DUSART1_LARGE_BUFFER switch in compiler options"
 #endif
 
-#if (UART_RX2_BUFFER_SIZE > 256 & !defined(USART2_LARGE_BUFFER))
+#if ((UART_RX2_BUFFER_SIZE > 256 || UART_TX2_BUFFER_SIZE > 256) && !defined(USART2_LARGE_BUFFER))
 	#error "Buffer too large, please use -DUSART2_LARGE_BUFFER switch in compiler options"
 #endif
 
-#if (UART_RX3_BUFFER_SIZE > 256 & !defined(USART3_LARGE_BUFFER))
+#if ((UART_RX3_BUFFER_SIZE > 256 || UART_TX3_BUFFER_SIZE > 256) && !defined(USART3_LARGE_BUFFER))
 	#error "Buffer too large, please use -DUSART3_LARGE_BUFFER switch in compiler options"
 #endif
 
@@ -221,6 +300,17 @@ Date        Description
 #define UART_BUFFER_OVERFLOW  0x0200              /**< receive ringbuffer overflow */
 #define UART_NO_DATA          0x0100              /**< no receive data available   */
 
+#define UART_XON              0x11                /**< resume, sent and understood with USARTn_XONXOFF */
+#define UART_XOFF             0x13                /**< pause, sent and understood with USARTn_XONXOFF  */
+
+/** @brief  Receive error counters, see uart0_stats() */
+struct uart_stats
+{
+	uint16_t frame;     /**< characters received with a framing error */
+	uint16_t overrun;   /**< characters lost in the UART before the receive interrupt ran */
+	uint16_t overflow;  /**< characters dropped because the receive ringbuffer was full */
+};
+
 /* Macros, to allow use of legacy names */
 
 #define uart_init(b)      uart0_init(b)
@@ -230,6 +320,12 @@ Date        Description
 #define uart_puts_p(s)    uart0_puts_p(s)
 #define uart_available()  uart0_available()
 #define uart_flush()      uart0_flush()
+#define uart_write(b,n)   uart0_write(b,n)
+#define uart_read(b,n)    uart0_read(b,n)
+#define uart_tx_space()   uart0_tx_space()
+#define uart_tx_drain()   uart0_tx_drain()
+#define uart_tx_resume()  uart0_tx_resume()
+#define uart_stats(s,r)   uart0_stats(s,r)
 
 /*
 ** function prototypes
@@ -346,9 +442,86 @@ extern uint16_t uart0_available(void);
 
 /**
  *  @brief   Flush bytes waiting in receive buffer
+ *
+ *  Only discards received data, use uart0_tx_drain() to wait for the
+ *  transmitter.
  */
 extern void uart0_flush(void);
 
+/**
+ *  @brief   Return number of bytes that fit into the transmit buffer
+ *  @return  free space in the transmit buffer
+ */
+extern uint16_t uart0_tx_space(void);
+
+/**
+ *  @brief   Wait until all buffered bytes have been transmitted
+ *
+ *  Sleeps in SLEEP_MODE_IDLE while the transmit buffer empties, then waits
+ *  for the transmit complete flag of the last byte. Afterwards the baudrate
+ *  may be changed or the MCU put into a deeper sleep mode.
+ *  Must not be called from an interrupt handler.
+ */
+extern void uart0_tx_drain(void);
+
+/**
+ *  @brief   Restart transmission held back by CTS
+ *
+ *  With USART0_RTSCTS the transmit interrupt stops while CTS is high.
+ *  Writes restart it, also while they wait for space in a full buffer.
+ *  Call this from a timer or a pin change interrupt on CTS to continue
+ *  without writing new data. Does nothing when the buffer is empty.
+ */
+extern void uart0_tx_resume(void);
+
+/**
+ *  @brief   Read the receive error counters
+ *
+ *  The counters keep running while UART_BUFFER_OVERFLOW and the other
+ *  error bits of uart0_getc() only report the state of the last byte.
+ *
+ *  @param   stats filled with the current counts
+ *  @param   reset non-zero to clear the counters afterwards
+ */
+extern void uart0_stats(struct uart_stats *stats, uint8_t reset);
+
+/**
+ *  @brief   Set function called when the transmit buffer runs empty
+ *
+ *  The callback runs inside the UDRE interrupt handler.
+ *  Only available if UART_TX_EMPTY_CALLBACK is defined.
+ *
+ *  @param   callback function to call, NULL to remove it
+ */
+extern void uart0_tx_empty_callback(void (*callback)(void));
+
+/**
+ *  @brief   Put a block of bytes to ringbuffer for transmitting via UART
+ *
+ *  The data is copied in at most two contiguous segments and the new
+ *  ringbuffer head is published once per copy, so the transmit interrupt
+ *  is enabled once instead of once per byte.
+ *  Blocks until all bytes are buffered unless UART_NONBLOCKING is defined.
+ *
+ *  @param   buf data to be transmitted
+ *  @param   n   number of bytes
+ *  @return  number of bytes buffered
+ */
+extern uint16_t uart0_write(const void *buf, uint16_t n);
+
+/**
+ *  @brief   Get a block of bytes from the receive ringbuffer
+ *
+ *  Copies in at most two contiguous segments and releases the space once.
+ *  Blocks until n bytes were received unless UART_NONBLOCKING is defined.
+ *  Receive errors are not reported, use uart0_getc() to check them.
+ *
+ *  @param   buf buffer for the received data
+ *  @param   n   number of bytes
+ *  @return  number of bytes copied
+ */
+extern uint16_t uart0_read(void *buf, uint16_t n);
+
 
 /** @brief  Initialize USART1 (only available on selected ATmegas) @see uart_init */
 extern void uart1_init(uint16_t baudrate);
@@ -368,6 +541,20 @@ extern void uart1_puts_p(const char *s );
 extern uint16_t uart1_available(void);
 /** @brief   Flush bytes waiting in receive buffer */
 extern void uart1_flush(void);
+/** @brief   Put a block of bytes to ringbuffer for transmitting via USART1 @see uart0_write */
+extern uint16_t uart1_write(const void *buf, uint16_t n);
+/** @brief   Get a block of bytes from the USART1 receive ringbuffer @see uart0_read */
+extern uint16_t uart1_read(void *buf, uint16_t n);
+/** @brief   Return number of bytes that fit into the USART1 transmit buffer @see uart0_tx_space */
+extern uint16_t uart1_tx_space(void);
+/** @brief   Wait until all buffered bytes have been transmitted via USART1 @see uart0_tx_drain */
+extern void uart1_tx_drain(void);
+/** @brief   Restart transmission via USART1 held back by CTS @see uart0_tx_resume */
+extern void uart1_tx_resume(void);
+/** @brief   Read the USART1 receive error counters @see uart0_stats */
+extern void uart1_stats(struct uart_stats *stats, uint8_t reset);
+/** @brief   Set function called when the USART1 transmit buffer runs empty @see uart0_tx_empty_callback */
+extern void uart1_tx_empty_callback(void (*callback)(void));
 
 
 /** @brief  Initialize USART2 (only available on selected ATmegas) @see uart_init */
@@ -388,6 +575,20 @@ extern void uart2_puts_p(const char *s );
 extern uint16_t uart2_available(void);
 /** @brief   Flush bytes waiting in receive buffer */
 extern void uart2_flush(void);
+/** @brief   Put a block of bytes to ringbuffer for transmitting via USART2 @see uart0_write */
+extern uint16_t uart2_write(const void *buf, uint16_t n);
+/** @brief   Get a block of bytes from the USART2 receive ringbuffer @see uart0_read */
+extern uint16_t uart2_read(void *buf, uint16_t n);
+/** @brief   Return number of bytes that fit into the USART2 transmit buffer @see uart0_tx_space */
+extern uint16_t uart2_tx_space(void);
+/** @brief   Wait until all buffered bytes have been transmitted via USART2 @see uart0_tx_drain */
+extern void uart2_tx_drain(void);
+/** @brief   Restart transmission via USART2 held back by CTS @see uart0_tx_resume */
+extern void uart2_tx_resume(void);
+/** @brief   Read the USART2 receive error counters @see uart0_stats */
+extern void uart2_stats(struct uart_stats *stats, uint8_t reset);
+/** @brief   Set function called when the USART2 transmit buffer runs empty @see uart0_tx_empty_callback */
+extern void uart2_tx_empty_callback(void (*callback)(void));
 
 
 /** @brief  Initialize USART3 (only available on selected ATmegas) @see uart_init */
@@ -408,6 +609,20 @@ extern void uart3_puts_p(const char *s );
 extern uint16_t uart3_available(void);
 /** @brief   Flush bytes waiting in receive buffer */
 extern void uart3_flush(void);
+/** @brief   Put a block of bytes to ringbuffer for transmitting via USART3 @see uart0_write */
+extern uint16_t uart3_write(const void *buf, uint16_t n);
+/** @brief   Get a block of bytes from the USART3 receive ringbuffer @see uart0_read */
+extern uint16_t uart3_read(void *buf, uint16_t n);
+/** @brief   Return number of bytes that fit into the USART3 transmit buffer @see uart0_tx_space */
+extern uint16_t uart3_tx_space(void);
+/** @brief   Wait until all buffered bytes have been transmitted via USART3 @see uart0_tx_drain */
+extern void uart3_tx_drain(void);
+/** @brief   Restart transmission via USART3 held back by CTS @see uart0_tx_resume */
+extern void uart3_tx_resume(void);
+/** @brief   Read the USART3 receive error counters @see uart0_stats */
+extern void uart3_stats(struct uart_stats *stats, uint8_t reset);
+/** @brief   Set function called when the USART3 transmit buffer runs empty @see uart0_tx_empty_callback */
+extern void uart3_tx_empty_callback(void (*callback)(void));
 
 /**@}*/
 
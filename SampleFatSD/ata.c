@@ -32,6 +32,67 @@
 typeDriveInfo ataDriveInfo;		// drive information
 
 
+// PIO data transfer loops
+// One word costs ATA_WORD_CYCLES cpu cycles without delays: cbi (2), in/out (2),
+// ld/st (4) and sbi (2). cbi and sbi move the strobe at the end of their second
+// cycle and an in sees the pin as it was half a cycle before (input synchronizer):
+// - read: ATA_READ_NOPS between cbi and the first in put the sample t2 - t5 after
+//   DIOR- falls at least, when the drive has the data on the bus,
+// - write: DIOW- is low for ATA_WRITE_NOPS and the sbi, so for t2 at least,
+// and ATA_RECOVERY_NOPS are added only if the word is still shorter than t0.
+// All of it is evaluated by the preprocessor, modes with the same delays share a loop.
+// e.g. 16MHz: read mode 0 = 3 NOPs, modes 1..4 = 2 NOPs; write mode 0 = 1 NOP,
+// modes 1..4 none; never a recovery NOP (mode 0 read: 13 cycles, 812ns)
+#define ATA_WORD_CYCLES				10
+#define ATA_NS_TO_CYCLES(ns)		(((ns) * (F_CPU / 1000UL) + 999999UL) / 1000000UL)
+#define ATA_READ_NOPS(m)			(((ATA_PIO##m##_T2 - ATA_PIO##m##_T5) * (F_CPU / 1000UL) * 2UL + 1000000UL + 1999999UL) / 2000000UL)
+#define ATA_WRITE_NOPS(m)			((ATA_NS_TO_CYCLES(ATA_PIO##m##_T2) > 2) ? (ATA_NS_TO_CYCLES(ATA_PIO##m##_T2) - 2) : 0)
+#define ATA_RECOVERY_NOPS(m, n)		((ATA_NS_TO_CYCLES(ATA_PIO##m##_T0) > ATA_WORD_CYCLES + (n)) ? \
+									 (ATA_NS_TO_CYCLES(ATA_PIO##m##_T0) - ATA_WORD_CYCLES - (n)) : 0)
+#define ATA_SAME_READ(a, b)			(ATA_READ_NOPS(a) == ATA_READ_NOPS(b) && \
+									 ATA_RECOVERY_NOPS(a, ATA_READ_NOPS(a)) == ATA_RECOVERY_NOPS(b, ATA_READ_NOPS(b)))
+#define ATA_SAME_WRITE(a, b)		(ATA_WRITE_NOPS(a) == ATA_WRITE_NOPS(b) && \
+									 ATA_RECOVERY_NOPS(a, ATA_WRITE_NOPS(a)) == ATA_RECOVERY_NOPS(b, ATA_WRITE_NOPS(b)))
+
+// n NOPs, n is a constant so the compiler removes the unused ones (up to 8)
+#define ATA_NOPS(n)		do {											\
+							if ((n) > 0) __asm volatile ("NOP");		\
+							if ((n) > 1) __asm volatile ("NOP");		\
+							if ((n) > 2) __asm volatile ("NOP");		\
+							if ((n) > 3) __asm volatile ("NOP");		\
+							if ((n) > 4) __asm volatile ("NOP");		\
+							if ((n) > 5) __asm volatile ("NOP");		\
+							if ((n) > 6) __asm volatile ("NOP");		\
+							if ((n) > 7) __asm volatile ("NOP");		\
+						} while (0)
+
+#define ATA_READ_WORD(m)		cbi(PORT_IDE_RD, PIN_IDE_RD);			\
+								ATA_NOPS(ATA_READ_NOPS(m));				\
+								*(Buffer++)= PIN_DATAL;					\
+								*(Buffer++)= PIN_DATAH;					\
+								sbi(PORT_IDE_RD, PIN_IDE_RD);			\
+								ATA_NOPS(ATA_RECOVERY_NOPS(m, ATA_READ_NOPS(m)))
+
+#define ATA_WRITE_WORD(m)		PORT_DATAL= *(Buffer++);				\
+								PORT_DATAH= *(Buffer++);				\
+								cbi(PORT_IDE_WR, PIN_IDE_WR);			\
+								ATA_NOPS(ATA_WRITE_NOPS(m));			\
+								sbi(PORT_IDE_WR, PIN_IDE_WR);			\
+								ATA_NOPS(ATA_RECOVERY_NOPS(m, ATA_WRITE_NOPS(m)))
+
+// 8 words (16 bytes) unrolled per loop, then the remaining words one by one
+#define ATA_TRANSFER_LOOP(WORD, m)										\
+	for (i= numBytes >> 4; i; i--)										\
+	{																	\
+		WORD(m); WORD(m); WORD(m); WORD(m);								\
+		WORD(m); WORD(m); WORD(m); WORD(m);								\
+	}																	\
+	for (i= (numBytes & 0x0F) >> 1; i; i--)								\
+	{																	\
+		WORD(m);														\
+	}
+
+
 //*****************************************************************************
 // Function: ataInit
 // Parameters: none
@@ -82,7 +143,7 @@ void ataInit(void)
 	ataDriveInfo.cylinders =		*( ((unsigned int*) buffer) + ATA_IDENT_CYLINDERS );
 	ataDriveInfo.heads =			*( ((unsigned int*) buffer) + ATA_IDENT_HEADS );
 	ataDriveInfo.sectors =			*( ((unsigned int*) buffer) + ATA_IDENT_SECTORS );
-	ataDriveInfo.LBAsupport =		*( ((unsigned int*) buffer) + ATA_IDENT_FIELDVALID );
+	ataDriveInfo.LBAsupport =		(*( ((unsigned int*) buffer) + ATA_IDENT_CAPABILITIES ) & 0x0200) != 0;
 	ataDriveInfo.sizeinsectors =	*( (unsigned long*) (buffer + ATA_IDENT_LBASECTORS*2) );
 	// copy model string
 	for(i=0; i<40; i+=2)
@@ -100,6 +161,45 @@ void ataInit(void)
 		// calculate drive size
 		ataDriveInfo.sizeinsectors = (unsigned long) ataDriveInfo.cylinders*ataDriveInfo.heads*ataDriveInfo.sectors;
 	}
+
+	// select the fastest PIO mode supported by drive and hardware
+	ataDriveInfo.pioMode = *( ((unsigned int*) buffer) + ATA_IDENT_PIOTIMING ) >> 8;
+	if (ataDriveInfo.pioMode > 2)
+		ataDriveInfo.pioMode = 0;
+	if (*( ((unsigned int*) buffer) + ATA_IDENT_FIELDVALID ) & 0x02)	// word 64 is valid
+	{
+		if (*( ((unsigned int*) buffer) + ATA_IDENT_PIOMODES ) & 0x02)
+			ataDriveInfo.pioMode = 4;
+		else if (*( ((unsigned int*) buffer) + ATA_IDENT_PIOMODES ) & 0x01)
+			ataDriveInfo.pioMode = 3;
+	}
+	if (ataDriveInfo.pioMode > ATA_PIO_MAX_MODE)
+		ataDriveInfo.pioMode = ATA_PIO_MAX_MODE;
+
+	i = ataDriveInfo.pioMode;
+	ataDriveInfo.pioMode = 0;		// mode 0 until the drive accepts the new one
+	ataStatusWait(ATA_SR_BSY, ATA_SR_BSY);
+	ataDriveSelect(DRIVE0);
+	ataWriteByte(ATA_REG_ERROR, ATA_FEAT_XFER_MODE);		// features register
+	ataWriteByte(ATA_REG_SECCOUNT, ATA_XFER_MODE_PIO | i);
+	ataWriteByte(ATA_REG_CMDSTATUS1, ATA_CMD_SET_FEATURES);
+	if (!(ataStatusWait(ATA_SR_BSY, ATA_SR_BSY) & ATA_SR_ERR))
+		ataDriveInfo.pioMode = i;
+
+	// set the biggest DRQ block (power of 2) for READ/WRITE MULTIPLE
+	i = *( ((unsigned int*) buffer) + ATA_IDENT_MAXMULTIPLE ) & 0xFF;
+	ataDriveInfo.multipleSectors = ATA_MAX_MULTIPLE;
+	while (ataDriveInfo.multipleSectors > i)
+		ataDriveInfo.multipleSectors >>= 1;
+	if (ataDriveInfo.multipleSectors)
+	{
+		ataStatusWait(ATA_SR_BSY, ATA_SR_BSY);
+		ataDriveSelect(DRIVE0);
+		ataWriteByte(ATA_REG_SECCOUNT, ataDriveInfo.multipleSectors);
+		ataWriteByte(ATA_REG_CMDSTATUS1, ATA_CMD_SET_MULTIPLE);
+		if (ataStatusWait(ATA_SR_BSY, ATA_SR_BSY) & ATA_SR_ERR)
+			ataDriveInfo.multipleSectors = 0;		// drive refused it, use READ/WRITE SECTORS
+	}
 }
 
 
@@ -143,7 +243,8 @@ void ataSetDrivePowerMode(unsigned char DriveNo, unsigned char mode, unsigned ch
 // Parameters: Buffer, numBytes
 // Returns: none
 //
-// Description: The Buffer will be filled with the readed data
+// Description: The Buffer will be filled with the readed data, with the timing
+//              of the PIO mode in ataDriveInfo.pioMode
 //*****************************************************************************
 void ataReadDataBuffer(unsigned char *Buffer, unsigned short numBytes)
 {
@@ -156,14 +257,34 @@ void ataReadDataBuffer(unsigned char *Buffer, unsigned short numBytes)
 	PORT_ADDR = PORT_ADDR & 0xe0; 		// Clear the lower 5 bits of the address line
 	PORT_ADDR = PORT_ADDR | (ATA_REG_DATA & 0x1f); 	// Assert the address Line
 
-	for (i=0; i< numBytes; i+=2)
+	switch (ataDriveInfo.pioMode)
 	{
-		cbi(PORT_IDE_RD, PIN_IDE_RD);
-	  	__asm volatile ("NOP");
-	  	__asm volatile ("NOP");
-	  	*(Buffer++)= PIN_DATAL;
-	  	*(Buffer++)= PIN_DATAH;
-		sbi(PORT_IDE_RD, PIN_IDE_RD);
+	#if ATA_PIO_MAX_MODE >= 4
+		case 4:
+		#if !ATA_SAME_READ(4, 3)
+			ATA_TRANSFER_LOOP(ATA_READ_WORD, 4); break;
+		#endif
+	#endif
+	#if ATA_PIO_MAX_MODE >= 3
+		case 3:
+		#if !ATA_SAME_READ(3, 2)
+			ATA_TRANSFER_LOOP(ATA_READ_WORD, 3); break;
+		#endif
+	#endif
+	#if ATA_PIO_MAX_MODE >= 2
+		case 2:
+		#if !ATA_SAME_READ(2, 1)
+			ATA_TRANSFER_LOOP(ATA_READ_WORD, 2); break;
+		#endif
+	#endif
+	#if ATA_PIO_MAX_MODE >= 1
+		case 1:
+		#if !ATA_SAME_READ(1, 0)
+			ATA_TRANSFER_LOOP(ATA_READ_WORD, 1); break;
+		#endif
+	#endif
+		default:
+			ATA_TRANSFER_LOOP(ATA_READ_WORD, 0); break;
 	}
 }
 
@@ -175,7 +296,8 @@ void ataReadDataBuffer(unsigned char *Buffer, unsigned short numBytes)
 // Parameters: Buffer, numBytes
 // Returns: none
 //
-// Description: The entire Buffer will be pulled out to the ata dispositive
+// Description: The entire Buffer will be pulled out to the ata dispositive, with
+//              the timing of the PIO mode in ataDriveInfo.pioMode
 //*****************************************************************************
 void ataWriteDataBuffer(unsigned char *Buffer, unsigned short numBytes)
 {
@@ -186,14 +308,34 @@ void ataWriteDataBuffer(unsigned char *Buffer, unsigned short numBytes)
 	PORT_ADDR = PORT_ADDR & 0xe0; 		// Clear the lower 5 bits of the address line
 	PORT_ADDR = PORT_ADDR | (ATA_REG_DATA & 0x1f); 	// Assert the address Line
 
-	for (i=0; i< numBytes; i+=2)
+	switch (ataDriveInfo.pioMode)
 	{
-	  	PORT_DATAL= *(Buffer++);
-	  	PORT_DATAH= *(Buffer++);
-	  	cbi(PORT_IDE_WR, PIN_IDE_WR);
-	  	__asm volatile ("NOP");
-	  	__asm volatile ("NOP");
-		sbi(PORT_IDE_WR, PIN_IDE_WR);
+	#if ATA_PIO_MAX_MODE >= 4
+		case 4:
+		#if !ATA_SAME_WRITE(4, 3)
+			ATA_TRANSFER_LOOP(ATA_WRITE_WORD, 4); break;
+		#endif
+	#endif
+	#if ATA_PIO_MAX_MODE >= 3
+		case 3:
+		#if !ATA_SAME_WRITE(3, 2)
+			ATA_TRANSFER_LOOP(ATA_WRITE_WORD, 3); break;
+		#endif
+	#endif
+	#if ATA_PIO_MAX_MODE >= 2
+		case 2:
+		#if !ATA_SAME_WRITE(2, 1)
+			ATA_TRANSFER_LOOP(ATA_WRITE_WORD, 2); break;
+		#endif
+	#endif
+	#if ATA_PIO_MAX_MODE >= 1
+		case 1:
+		#if !ATA_SAME_WRITE(1, 0)
+			ATA_TRANSFER_LOOP(ATA_WRITE_WORD, 1); break;
+		#endif
+	#endif
+		default:
+			ATA_TRANSFER_LOOP(ATA_WRITE_WORD, 0); break;
 	}
 }
 #endif
@@ -451,6 +593,167 @@ unsigned char ataWriteSectors(	unsigned char Drive,
 ////////////////////
 
 
+//*****************************************************************************
+// Function: ataSelectSectors
+// Parameters: Driver, lba, count
+// Returns: none
+//
+// Description: Write the address of the first sector (LBA or translated CHS)
+//              and the number of sectors to the task file registers
+//*****************************************************************************
+void ataSelectSectors(	unsigned char Drive,
+						unsigned long lba,
+						unsigned char count)
+{
+	unsigned int cyl, head, sect;
+
+	// check if drive supports native LBA mode
+	if(ataDriveInfo.LBAsupport)
+	{
+		sect = (int) ( lba & 0x000000ffL );
+		lba = lba >> 8;
+		cyl = (int) ( lba & 0x0000ffff );
+		lba = lba >> 16;
+		head = ( (int) ( lba & 0x0fL ) ) | ATA_HEAD_USE_LBA;
+	}
+	else
+	{
+		// drive required CHS access
+		// convert LBA to pseudo CHS
+		// remember to offset the sector count by one
+		sect = (unsigned char) (lba % ataDriveInfo.sectors)+1;
+		lba = lba / ataDriveInfo.sectors;
+		head = (unsigned char) (lba % ataDriveInfo.heads);
+		lba = lba / ataDriveInfo.heads;
+		cyl = (unsigned short) lba;
+	}
+
+	ataWriteByte(ATA_REG_HDDEVSEL, 0xA0+(Drive ? 0x10:00)+head); // LBA or CHS mode/Drive/Head
+	ataWriteByte(ATA_REG_CYLHI, cyl>>8);  		// MSB of track
+	ataWriteByte(ATA_REG_CYLLO, cyl);     		// LSB of track
+  	ataWriteByte(ATA_REG_STARTSEC, sect);    	// sector
+	ataWriteByte(ATA_REG_SECCOUNT, count);		// # of sectors
+}
+
+
+//*****************************************************************************
+// Function: ataReadSectorsN
+// Parameters: Driver, lba, count, Buffer
+// Returns: on Suscefull returns 0, the result errors otherwise.
+//
+// Description: Read count Sectors (count*512 Bytes) from the ata dispositive
+//              with one command. With READ MULTIPLE the drive interrupts
+//              (DRQ) once every ataDriveInfo.multipleSectors sectors
+//*****************************************************************************
+unsigned char ataReadSectorsN(	unsigned char Drive,
+								unsigned long lba,
+								unsigned char count,
+								unsigned char *Buffer)
+{
+	unsigned char temp, block;
+
+	if (count == 0)
+		return 0;
+
+	// Wait for drive to be ready
+	ataStatusWait(ATA_SR_BSY, ATA_SR_BSY);
+
+	ataSelectSectors(Drive, lba, count);
+
+	// Issue read command
+	if (ataDriveInfo.multipleSectors)
+		ataWriteByte(ATA_REG_CMDSTATUS1, ATA_CMD_READ_MULTIPLE);
+	else
+		ataWriteByte(ATA_REG_CMDSTATUS1, ATA_CMD_READNR);
+
+	block = 1;
+	while (count)
+	{
+		if (ataDriveInfo.multipleSectors)
+			block = (count < ataDriveInfo.multipleSectors) ? count : ataDriveInfo.multipleSectors;
+
+		// Wait for drive to be ready
+		temp = ataStatusWait(ATA_SR_BSY, ATA_SR_BSY);
+		if (temp & ATA_SR_ERR)
+			return 1;
+
+		// Wait for drive to request data transfer
+		ataStatusWait(ATA_SR_DRQ, 0);
+
+		// read one DRQ block from drive
+		ataReadDataBuffer(Buffer, (unsigned short)block * 512);
+		Buffer += (unsigned short)block * 512;
+		count -= block;
+	}
+
+	// Return the error bit from the status register...
+	temp = ataReadByte(ATA_REG_CMDSTATUS1);	// read status register
+
+	return (temp & ATA_SR_ERR) ? 1:0;
+}
+
+
+////////////////////
+#ifndef ATA_READ_ONLY
+//*****************************************************************************
+// Function: ataWriteSectorsN
+// Parameters: Driver, lba, count, Buffer
+// Returns: on Suscefull returns 0, the result errors otherwise.
+//
+// Description: Write count Sectors (count*512 Bytes) to the ata dispositive
+//              with one command, using WRITE MULTIPLE when supported
+//*****************************************************************************
+unsigned char ataWriteSectorsN(	unsigned char Drive,
+								unsigned long lba,
+								unsigned char count,
+								unsigned char *Buffer)
+{
+	unsigned char temp, block;
+
+	if (count == 0)
+		return 0;
+
+	// Wait for drive to be ready
+	ataStatusWait(ATA_SR_BSY, ATA_SR_BSY);
+
+	ataSelectSectors(Drive, lba, count);
+
+	// Issue write command
+	if (ataDriveInfo.multipleSectors)
+		ataWriteByte(ATA_REG_CMDSTATUS1, ATA_CMD_WRITE_MULTIPLE);
+	else
+		ataWriteByte(ATA_REG_CMDSTATUS1, ATA_CMD_WRITENR);
+
+	block = 1;
+	while (count)
+	{
+		if (ataDriveInfo.multipleSectors)
+			block = (count < ataDriveInfo.multipleSectors) ? count : ataDriveInfo.multipleSectors;
+
+		// Wait for drive to be ready
+		temp = ataStatusWait(ATA_SR_BSY, ATA_SR_BSY);
+		if (temp & ATA_SR_ERR)
+			return 1;
+
+		// Wait for drive to request data transfer
+		ataStatusWait(ATA_SR_DRQ, 0);
+
+		// write one DRQ block to drive
+		ataWriteDataBuffer(Buffer, (unsigned short)block * 512);
+		Buffer += (unsigned short)block * 512;
+		count -= block;
+	}
+
+	// Wait for drive to finish write
+	temp = ataStatusWait(ATA_SR_BSY, ATA_SR_BSY);
+
+	// Return the error bit from the status register...
+	return (temp & ATA_SR_ERR) ? 1:0;
+}
+#endif
+////////////////////
+
+
 //*****************************************************************************
 // Function: ataDriveSelect
 // Parameters: Drive Number
@@ -59,6 +59,14 @@
 #define ATA_CMD_READNR			0x21
 #define ATA_CMD_WRITE			0x30
 #define ATA_CMD_WRITENR			0x31
+#define ATA_CMD_READ_MULTIPLE	0xC4	// read sectors, one DRQ block of several sectors
+#define ATA_CMD_WRITE_MULTIPLE	0xC5	// write sectors, one DRQ block of several sectors
+#define ATA_CMD_SET_MULTIPLE	0xC6	// set the DRQ block size (sector count register)
+#define ATA_CMD_SET_FEATURES	0xEF	// set features (subcommand in the features/error register)
+
+// SET FEATURES subcommands
+#define ATA_FEAT_XFER_MODE		0x03	// set transfer mode (mode in the sector count register)
+#define ATA_XFER_MODE_PIO		0x08	// PIO flow control transfer mode x (0x08 + x)
 #define ATA_CMD_IDENTIFY		0xEC
 #define ATA_CMD_RECALIBRATE		0x10
 #define ATA_CMD_SPINDOWN		0xE0	// spin down disk immediately
@@ -83,7 +91,11 @@
 #define ATA_IDENT_SECTORS		6		// number of sectors per track
 #define ATA_IDENT_SERIAL		10		// drive model name (20 characters)
 #define ATA_IDENT_MODEL			27		// drive model name (40 characters)
+#define ATA_IDENT_MAXMULTIPLE	47		// bits 7:0 maximum number of sectors per DRQ block of READ/WRITE MULTIPLE
+#define ATA_IDENT_CAPABILITIES	49		// bit 9: LBA supported
+#define ATA_IDENT_PIOTIMING		51		// bits 15:8 PIO data transfer cycle timing mode (0..2)
 #define ATA_IDENT_FIELDVALID	53		// indicates field validity of higher words (bit0: words54-58, bit1: words 64-70)
+#define ATA_IDENT_PIOMODES		64		// advanced PIO modes supported (bit0: mode 3, bit1: mode 4)
 #define ATA_IDENT_LBASECTORS	60		// number of sectors in LBA translation mode
 
 // drive mode defines (for ataSetDrivePowerMode() )
@@ -92,6 +104,27 @@
 #define ATA_DISKMODE_SETTIMEOUT	2
 #define ATA_DISKMODE_SLEEP		3
 
+// maximum number of sectors per DRQ block asked with SET MULTIPLE MODE
+#define ATA_MAX_MULTIPLE		16
+
+// PIO data transfer timings (ns): t0 minimum cycle time, t2 minimum DIOR-/DIOW-
+// pulse width (16 bit), t5 minimum read data setup before DIOR- rises, for PIO modes 0..4
+#define ATA_PIO0_T0		600
+#define ATA_PIO0_T2		165
+#define ATA_PIO0_T5		50
+#define ATA_PIO1_T0		383
+#define ATA_PIO1_T2		125
+#define ATA_PIO1_T5		35
+#define ATA_PIO2_T0		240
+#define ATA_PIO2_T2		100
+#define ATA_PIO2_T5		20
+#define ATA_PIO3_T0		180
+#define ATA_PIO3_T2		80
+#define ATA_PIO3_T5		20
+#define ATA_PIO4_T0		120
+#define ATA_PIO4_T2		70
+#define ATA_PIO4_T5		20
+
 // typedefs
 // drive info structure
 typedef struct
@@ -101,6 +134,8 @@ typedef struct
 	unsigned char sectors;
 	unsigned long sizeinsectors;
 	unsigned char LBAsupport;
+	unsigned char multipleSectors;	// sectors per DRQ block set with SET MULTIPLE MODE, 0 if not supported
+	unsigned char pioMode;			// PIO mode used by ataReadDataBuffer/ataWriteDataBuffer
 	char model[41];
 } typeDriveInfo;
 
@@ -169,5 +204,23 @@ unsigned char   ataWriteSectors        (unsigned char Drive,
 #endif
 ////////////////////
 
+// read and write routines for more than one sector (one command for count sectors)
+//   uses READ/WRITE MULTIPLE when the drive supports it
+void            ataSelectSectors       (unsigned char Drive,
+										unsigned long lba,
+										unsigned char count);
+unsigned char   ataReadSectorsN        (unsigned char Drive,
+										unsigned long lba,
+										unsigned char count,
+										unsigned char *Buffer);
+////////////////////
+#ifndef ATA_READ_ONLY
+unsigned char   ataWriteSectorsN       (unsigned char Drive,
+										unsigned long lba,
+										unsigned char count,
+										unsigned char *Buffer);
+#endif
+////////////////////
+
 
 #endif
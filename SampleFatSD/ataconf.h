@@ -25,6 +25,14 @@
 
 //#define ATA_READ_ONLY // only uncomment this line if you don't need to use read routines
 
+// Fastest PIO mode (0..4) used for the data transfers, the drive mode read from
+// IDENTIFY is limited to it and only the transfer loops up to this mode are compiled.
+// PIO modes 3 and 4 need IORDY flow control, which isn't wired in this hardware,
+// so only change it to 3 or 4 with drives that never stretch a cycle with IORDY.
+#ifndef ATA_PIO_MAX_MODE
+#define ATA_PIO_MAX_MODE	2
+#endif
+
 
 // constants
 unsigned char SECTOR_BUFFER_ADDR[512];
@@ -22,6 +22,7 @@
 #include <avr/io.h>
 #include <avr/pgmspace.h>
 #include <string.h>
+#include <ctype.h>
 
 
 #include "ata.h"
@@ -44,10 +45,26 @@ unsigned long FirstFATSector;				// First FAT Sector Address
 unsigned long FirstFAT2Sector;				// First FAT2 Sector Address
 unsigned long FirstDirCluster;				// First Directory (Data) Cluster Address
 unsigned long FatInCache = 0xFFFFFFFF;		// Address of the FAT Cluster in FatCache
+unsigned char FatCacheDirty;				// TRUE if FatCache was changed and not written to the FATs yet
+unsigned char NumFATs;						// Number of FAT copies
+unsigned long FreeClusters;					// Free clusters count (0xFFFFFFFF if unknown), kept for FSInfo
+unsigned long NextFreeCluster;				// Last allocated cluster, FSInfo hint for the next free one
+unsigned char FSInfoDirty;					// TRUE if FreeClusters or NextFreeCluster must be written to FSInfo
+#if FAT_FULL_MAP_BYTES
+unsigned char FatFullMap[FAT_FULL_MAP_BYTES];	// one bit for each group of FAT sectors without free clusters
+unsigned char FatGroupShift;				// log2 of the number of FAT sectors in a group of FatFullMap
+#endif
 unsigned long FatSectors;					// Number of FAT Sectors
 unsigned long currentDirCluster;			// Actual Dir Cluster Number
 unsigned long NumClusters;					// ATA Dispositive Cluster Numbers
+unsigned long MaxCluster;					// Last valid cluster number of the partition
 unsigned long SectorInCache = 0xFFFFFFFF;	// Address of the Sector Cluster in SectorBuffer
+TDIR LfnStart;								// first winentry of the direntry found by fatFindEntry
+unsigned char LfnEntries;					// number of its winentries, 0 if it has no long name
+#if FAT_NAME_CACHE_SIZE
+TNAMECACHE NameCache[FAT_NAME_CACHE_SIZE];	// directories found by fatFindDir
+unsigned char NameCacheNext;				// next NameCache entry to be replaced
+#endif
 
 
 
@@ -117,8 +134,10 @@ unsigned char fatInit(void)
 	}
 	SectorsPerCluster	= bpb->bpbSecPerClust;
 	FirstFATSector		= bpb->bpbResSectors + PartInfo.prStartLBA;
-	FatSectors			= bpb->bpbBigFATsecs;
+	FatSectors			= bpb->bpbFATsecs ? bpb->bpbFATsecs : bpb->bpbBigFATsecs;
 	NumClusters			= ataGetSizeInSectors()/(bpb->bpbSecPerClust);
+	MaxCluster			= ((bpb->bpbSectors ? bpb->bpbSectors : bpb->bpbHugeSectors) - (FirstDataSector - PartInfo.prStartLBA))
+						  / bpb->bpbSecPerClust + 1;
 
 	// initialize Volume Label
 	memcpy(&VolLabel, bpb->bpbVolLabel, 11);
@@ -154,8 +173,44 @@ unsigned char fatInit(void)
 	else
 		FirstFAT2Sector=FirstFATSector+bpb->bpbFATsecs;
 	FSInfo=bpb->bpbFSInfo+PartInfo.prStartLBA;
+	NumFATs= bpb->bpbFATs;
 
 	currentDirCluster= FirstDirCluster;
+	fatNameCacheClear();
+	FatInCache= 0xFFFFFFFF;
+	FatCacheDirty= FALSE;
+	FSInfoDirty= FALSE;
+
+	// get the free clusters count and the next free cluster hint from FSInfo
+	FreeClusters= 0xFFFFFFFF;
+	NextFreeCluster= CLUST_FIRST;
+	if (Fat32Enabled)
+	{
+		struct fsinfo *fsi= (struct fsinfo *)SectorBuffer;
+
+		ataReadSectors( DRIVE0, FSInfo, SectorBuffer, &SectorInCache);
+		if ((memcmp(fsi->fsisig1, "RRaA", 4) == 0) && (memcmp(fsi->fsisig2, "rrAa", 4) == 0))
+		{
+			FreeClusters= *((unsigned long *)fsi->fsinfree);
+			if (FreeClusters > MaxCluster-1)
+				FreeClusters= 0xFFFFFFFF;
+			NextFreeCluster= *((unsigned long *)fsi->fsinxtfree);
+			if ((NextFreeCluster < CLUST_FIRST) || (NextFreeCluster > MaxCluster))
+				NextFreeCluster= CLUST_FIRST;
+		}
+	}
+
+	////////////////////
+	#ifndef ATA_READ_ONLY
+	#if FAT_FULL_MAP_BYTES
+	// group the FAT sectors so that FatFullMap covers the whole FAT
+	FatGroupShift= 0;
+	while ((FatSectors >> FatGroupShift) >= FAT_FULL_MAP_BYTES*8)
+		FatGroupShift++;
+	memset(FatFullMap, 0, FAT_FULL_MAP_BYTES);
+	#endif
+	#endif
+	////////////////////
 
 	return TRUE;
 }
@@ -198,11 +253,11 @@ unsigned long fatNextCluster(unsigned long cluster)
 	offset = fatOffset % BYTES_PER_SECTOR;
 
 	// if we don't already have this FAT chunk loaded, go get it
-	ataReadSectors( DRIVE0, sector, (unsigned char*)FAT_CACHE_ADDR, &FatInCache);
+	fatLoadFatSector(sector);
 
 
 	// read the nextCluster value
-	nextCluster = (*((unsigned long*) &((char*)FAT_CACHE_ADDR)[offset])) & fatMask;
+	nextCluster = (*((unsigned long*) &FatCache[offset])) & fatMask;
 
 	// check to see if we're at the end of the chain
 	if (nextCluster == (CLUST_EOFE & fatMask))
@@ -213,6 +268,87 @@ unsigned long fatNextCluster(unsigned long cluster)
 
 
 
+//*****************************************************************************
+// Function: fatLoadFatSector
+// Parameters: FAT sector address
+// Returns: none
+//
+// Description: Load a FAT sector in FatCache, if it isn't there yet. A changed
+//              FAT sector in FatCache is written back to the FATs before
+//*****************************************************************************
+void fatLoadFatSector(unsigned long sector)
+{
+	if (sector == FatInCache)
+		return;
+	////////////////////
+	#ifndef ATA_READ_ONLY
+	fatFlushFatCache();
+	#endif
+	////////////////////
+	ataReadSectors( DRIVE0, sector, FatCache, &FatInCache);
+}
+
+
+
+////////////////////
+#ifndef ATA_READ_ONLY
+//*****************************************************************************
+// Function: fatFlushFatCache
+// Parameters: none
+// Returns: none
+//
+// Description: Write FatCache to the FAT sector in all the FATs (FAT1, FAT2),
+//              if it was changed since it was read
+//*****************************************************************************
+void fatFlushFatCache(void)
+{
+	unsigned char i;
+
+	if (!FatCacheDirty)
+		return;
+	for (i=0; i < NumFATs; i++)
+		ataWriteSectors( DRIVE0, FatInCache + i*(FirstFAT2Sector-FirstFATSector), FatCache);
+	FatCacheDirty= FALSE;
+}
+#endif
+////////////////////
+
+
+
+////////////////////
+#ifndef ATA_READ_ONLY
+//*****************************************************************************
+// Function: fatSync
+// Parameters: none
+// Returns: TRUE if the file system is up to date in the ata dispositive,
+//          FALSE if the FSInfo sector isn't valid
+//
+// Description: Write the changed FAT sector and the free clusters count and
+//              next free cluster hint to FSInfo. Called when a file is closed
+//              and after directory changes, and before the drive is powered off
+//*****************************************************************************
+unsigned char fatSync(void)
+{
+	struct fsinfo *fsi= (struct fsinfo *)FatCache;
+
+	fatFlushFatCache();
+	if (!Fat32Enabled || !FSInfoDirty)
+		return TRUE;
+
+	ataReadSectors( DRIVE0, FSInfo, FatCache, &FatInCache); // Read FSInfo, FatCache is clean now
+	if ((memcmp(fsi->fsisig1, "RRaA", 4) != 0) || (memcmp(fsi->fsisig2, "rrAa", 4) != 0))
+		return FALSE;
+	*((unsigned long *)fsi->fsinfree)= FreeClusters;
+	*((unsigned long *)fsi->fsinxtfree)= NextFreeCluster;
+	ataWriteSectors( DRIVE0, FSInfo, FatCache);
+	FSInfoDirty= FALSE;
+	return TRUE;
+}
+#endif
+////////////////////
+
+
+
 //*****************************************************************************
 // Function: fatClusterSize
 // Parameters: none
@@ -344,61 +480,485 @@ unsigned char *fatDir(unsigned long cluster, unsigned long offset)
 
 
 
+//*****************************************************************************
+// Function: fatDirOpen
+// Parameters: address of the TDIR struct, first cluster of the directory
+// Returns: none
+//
+// Description: set the directory cursor at the first direntry of the directory
+//              started in cluster. Cluster 0 is the root directory
+//*****************************************************************************
+void fatDirOpen(TDIR *dir, unsigned long cluster)
+{
+	if (cluster == 0)
+		cluster= FirstDirCluster;
+	dir->cluster= cluster;
+	dir->sector= fatClustToSect(cluster);
+	dir->sectorInCluster= 0;
+	dir->index= 0;
+}
+
+
+
+//*****************************************************************************
+// Function: fatDirNext
+// Parameters: address of the TDIR struct
+// Returns: On SUSCEFULL returns the next direntry of the directory, inside
+//          SectorBuffer, otherwise returns NULL (no more clusters)
+//
+// Description: advance the directory cursor one direntry. The cluster chain is
+//              followed only when the cursor crosses a cluster boundary, so
+//              walking a whole directory costs one FAT lookup per cluster.
+//              The sector is read again (if SectorBuffer was reused) on every
+//              call, so the caller can use SectorBuffer between calls, and
+//              SectorInCache holds the sector of the returned direntry
+//*****************************************************************************
+struct direntry *fatDirNext(TDIR *dir)
+{
+	if (dir->cluster == 0)
+		return NULL;
+
+	if (dir->index == FAT_DIRENTRIES_PER_SECTOR)
+	{
+		dir->index= 0;
+		dir->sector++;
+		if (++dir->sectorInCluster == SectorsPerCluster)	// Next Sector is in next Cluster
+		{
+			dir->cluster= fatNextCluster(dir->cluster);
+			if (dir->cluster == 0)
+				return NULL;
+			dir->sector= fatClustToSect(dir->cluster);
+			dir->sectorInCluster= 0;
+		}
+	}
+
+	ataReadSectors( DRIVE0, dir->sector, SectorBuffer, &SectorInCache);
+	return ((struct direntry *) SectorBuffer) + dir->index++;
+}
+
+
+
 //*****************************************************************************
 // Function: fatGetFileInfo
-// Parameters: address of direntry struct, short name of the file
+// Parameters: address of direntry struct, path of the file
 // Returns: On SUSCEFULL, return the direntry struct filled out with the file info,
 //          otherwise returns NULL;
 //
-// Description: return the direntry struct of a short name file given
-//              this function will search for a filename only in the current
-//              directory, given by currentDirCluster
+// Description: return the direntry struct of a file given by its path, ex:
+//              "readme.txt", "dir1\Long file name.txt", "\dir1\dir2\file.txt"
+//              (see fatWalkPath). The names can be short (8.3) or long names.
+//              The returned pointer is the direntry inside SectorBuffer, and
+//              SectorInCache is its sector
 //*****************************************************************************
 struct direntry *fatGetFileInfo(struct direntry *rde, char *shortName)
 {
-	unsigned long sector=0, cluster;
+	unsigned long cluster;
+	char *name;
+
+	name= fatWalkPath(shortName, &cluster);
+	if ((name == NULL) || (*name == '\0'))
+		return NULL;
+
+	return fatFindEntry(rde, cluster, name, strlen(name));
+}
+
+
+//*****************************************************************************
+// Function: fatFindEntry
+// Parameters: address of direntry struct, first cluster of the directory,
+//             name (not need to be ended by '\0') and its length
+// Returns: On SUSCEFULL, return the direntry struct filled out with the file info,
+//          otherwise returns NULL;
+//
+// Description: search a name in one directory, with a single pass on its
+//              direntries. The name is compared (without case) with the long
+//              name of each direntry, made by the winentries before it, and
+//              with its short name if the name is a valid 8.3 name.
+//              The returned pointer is the direntry inside SectorBuffer, and
+//              SectorInCache is its sector. LfnStart and LfnEntries tell
+//              where the winentries of the found direntry are (see
+//              fatRemoveLfn)
+//*****************************************************************************
+struct direntry *fatFindEntry(struct direntry *rde, unsigned long cluster, char *name, unsigned char length)
+{
 	struct direntry *de;
-	int index, isetor;
-	char Name[12];
+	struct winentry *we;
+	TDIR dir;
+	char shortName[13];
+	unsigned char lfnNext=0xFF, lfnSum=0, lfnMatch=FALSE, lfnCount=0, seq;
+	unsigned int offset;
 
-	strncpy(Name, shortName,12);
-	Name[11]='\0';
-	fatNormalize(Name); // adjust the name to the FAT format
+	LfnEntries= 0;
 
-	cluster= currentDirCluster;	// start the search in the current cluster
-	do
+	// the 8.3 direntry name to search, if the name can be a short name
+	shortName[0]= '\0';
+	if (fatIsShortName(name, length))
+	{
+		memcpy(shortName, name, length);
+		shortName[length]= '\0';
+		fatNormalize(shortName); // adjust the name to the FAT format
+	}
+
+	fatDirOpen(&dir, cluster);
+	while ((de= fatDirNext(&dir)) != NULL)
 	{
-		for (isetor=0; isetor< SectorsPerCluster; isetor++)		// clusters
+		if (*de->deName == SLOT_EMPTY)
+			return NULL;		// there is no more direntries
+		if (*de->deName == SLOT_DELETED)
 		{
-			// read dir data
-			sector = fatClustToSect(cluster) + (unsigned long)isetor;
-			ataReadSectors( DRIVE0, sector, SectorBuffer, &SectorInCache);
-			de = (struct direntry *) SectorBuffer;
+			lfnNext= 0xFF;
+			continue;
+		}
 
-			for (index=1; index<=FAT_DIRENTRIES_PER_SECTOR; index++)
+		// the long name winentries are before the direntry, from the last part to the first
+		if (de->deAttributes == ATTR_LONG_FILENAME)
+		{
+			we= (struct winentry *)de;
+			seq= we->weCnt & WIN_CNT;
+			if (we->weCnt & WIN_LAST)
 			{
-				if (*de->deName == 0x00)
-				{
-					return NULL;		// there is no more direntries
-				}
-				if((*de->deName != SLOT_DELETED) && (de->deAttributes != ATTR_LONG_FILENAME))
-				{
-					if (strncmp(de->deName, Name, 11) == 0)
-					{
-						memcpy(rde, de, DIRENTRY_SIZE);
-						return(de);
-					}
-				}
-				de++;
-			}	// end of sector
-		}	// end of cluster
-		cluster= fatNextCluster(cluster);
-	}while  (sector < FirstFATSector+FatSectors); // end of FatDirentries
+				lfnNext= seq;
+				lfnSum= we->weChksum;
+				lfnMatch= TRUE;
+				lfnCount= seq;
+				LfnStart= dir;		// the cursor is already past this winentry
+				LfnStart.index--;
+			}
+			if ((seq == 0) || (seq != lfnNext) || (we->weChksum != lfnSum))
+			{
+				lfnNext= 0xFF;	// not a valid long name
+				continue;
+			}
+			offset= (unsigned int)(seq-1) * WIN_CHARS;
+			if (lfnMatch)
+				lfnMatch= (offset <= length) && fatLfnCompare(we, name+offset, length-offset);
+			lfnNext--;
+			continue;
+		}
+
+		if (((lfnNext == 0) && lfnMatch && (lfnSum == fatLfnChecksum(de->deName))) ||
+			((shortName[0] != '\0') && (strncmp(de->deName, shortName, 11) == 0)))
+		{
+			// the long name belongs to it also when the short name matched
+			if ((lfnNext == 0) && (lfnSum == fatLfnChecksum(de->deName)))
+				LfnEntries= lfnCount;
+			memcpy(rde, de, DIRENTRY_SIZE);
+			return(de);
+		}
+		lfnNext= 0xFF;
+	}
 
 	return NULL;
 }
 
 
+//*****************************************************************************
+// Function: fatDirNextName
+// Parameters: address of the TDIR struct, buffer to the name, size of the buffer
+// Returns: On SUSCEFULL returns the next file or directory direntry of the
+//          directory, inside SectorBuffer, otherwise returns NULL
+//
+// Description: like fatDirNext, but skip the deleted and the long name
+//              direntries, and put in name the long name of the returned
+//              direntry, or its short name ("NAME.EXT") if it has no long
+//              name. Long names longer than size-1 are truncated, and their
+//              characters out of ASCII are changed to '?'. The size must be
+//              at least 13, to the short names
+//*****************************************************************************
+struct direntry *fatDirNextName(TDIR *dir, char *name, unsigned char size)
+{
+	struct direntry *de;
+	struct winentry *we;
+	unsigned char lfnNext=0xFF, lfnSum=0, seq, k;
+	unsigned int c, offset;
+
+	while ((de= fatDirNext(dir)) != NULL)
+	{
+		if (*de->deName == SLOT_EMPTY)
+			return NULL;		// there is no more direntries
+		if (*de->deName == SLOT_DELETED)
+		{
+			lfnNext= 0xFF;
+			continue;
+		}
+
+		if (de->deAttributes == ATTR_LONG_FILENAME)
+		{
+			we= (struct winentry *)de;
+			seq= we->weCnt & WIN_CNT;
+			if (we->weCnt & WIN_LAST)
+			{
+				lfnNext= seq;
+				lfnSum= we->weChksum;
+			}
+			if ((seq == 0) || (seq != lfnNext) || (we->weChksum != lfnSum))
+			{
+				lfnNext= 0xFF;	// not a valid long name
+				continue;
+			}
+			offset= (unsigned int)(seq-1) * WIN_CHARS;
+			for (k=0; k<WIN_CHARS; k++)
+			{
+				c= fatLfnChar(we, k);
+				if (c == 0x0000)	// end of the name
+					break;
+				if (offset+k < size-1)
+					name[offset+k]= (c < 0x80) ? c : '?';
+			}
+			if (we->weCnt & WIN_LAST)
+				name[(offset+k < size-1) ? offset+k : size-1]= '\0';
+			lfnNext--;
+			continue;
+		}
+
+		// without a long name, use the short name
+		if ((lfnNext != 0) || (lfnSum != fatLfnChecksum(de->deName)))
+			fatGetShortName(de, name);
+		return de;
+	}
+	return NULL;
+}
+
+
+//*****************************************************************************
+// Function: fatGetShortName
+// Parameters: direntry, buffer to the name (13 bytes)
+// Returns: none
+//
+// Description: Write the 8.3 name of the direntry as "NAME.EXT", in lower
+//              case if the direntry says so (deLowerCase)
+//*****************************************************************************
+void fatGetShortName(struct direntry *de, char *name)
+{
+	unsigned char k, d=0;
+
+	for (k=0; (k<8) && (de->deName[k] != ' '); k++)
+		name[d++]= (de->deLowerCase & LCASE_BASE) ? tolower(de->deName[k]) : de->deName[k];
+	if (de->deName[8] != ' ')
+		name[d++]= '.';		// there is an extension
+	for (k=8; (k<11) && (de->deName[k] != ' '); k++)
+		name[d++]= (de->deLowerCase & LCASE_EXT) ? tolower(de->deName[k]) : de->deName[k];
+	name[d]= '\0';
+	if (*de->deName == SLOT_E5)
+		*name= (char)SLOT_DELETED;
+}
+
+
+//*****************************************************************************
+// Function: fatLfnChar
+// Parameters: long name winentry, character index (0 to WIN_CHARS-1)
+// Returns: the UCS-2 character
+//
+// Description: return one of the 13 characters of a long name winentry
+//*****************************************************************************
+unsigned int fatLfnChar(struct winentry *we, unsigned char index)
+{
+	unsigned char *c;
+
+	if (index < 5)
+		c= &we->wePart1[index*2];
+	else if (index < 11)
+		c= &we->wePart2[(index-5)*2];
+	else
+		c= &we->wePart3[(index-11)*2];
+	return (c[0] + ((unsigned int)c[1] << 8));
+}
+
+
+//*****************************************************************************
+// Function: fatLfnCompare
+// Parameters: long name winentry, part of the name from the winentry position
+//             and its length
+// Returns: TRUE if the winentry characters are the same of the name (without
+//          case), otherwise FALSE
+//
+// Description: compare one long name winentry with its part of a name. The
+//              name must end at the end of the winentry (or its '\0') only
+//              if it is the last part of the long name (WIN_LAST)
+//*****************************************************************************
+unsigned char fatLfnCompare(struct winentry *we, char *name, unsigned int length)
+{
+	unsigned char k;
+	unsigned int c;
+
+	for (k=0; k<WIN_CHARS; k++)
+	{
+		c= fatLfnChar(we, k);
+		if (k == length)			// end of the name
+			return (c == 0x0000);
+		if ((c == 0x0000) || (c >= 0x80) || (toupper(c) != toupper(name[k])))
+			return FALSE;
+	}
+	return ((we->weCnt & WIN_LAST) == 0) || (length == WIN_CHARS);
+}
+
+
+//*****************************************************************************
+// Function: fatLfnChecksum
+// Parameters: 11 characters of the direntry name
+// Returns: the checksum of the short name
+//
+// Description: calculate the short name checksum saved in its long name
+//              winentries, a long name with other checksum isn't of this file
+//*****************************************************************************
+unsigned char fatLfnChecksum(unsigned char *shortName)
+{
+	unsigned char sum=0, i;
+
+	for (i=0; i<11; i++)
+		sum= ((sum & 1) ? 0x80 : 0) + (sum >> 1) + shortName[i];
+	return sum;
+}
+
+
+//*****************************************************************************
+// Function: fatIsShortName
+// Parameters: name (not need to be ended by '\0') and its length
+// Returns: TRUE if the name can be written as a 8.3 direntry name
+//
+// Description: check the 8.3 format, "." and ".." are also short names
+//*****************************************************************************
+unsigned char fatIsShortName(char *name, unsigned char length)
+{
+	unsigned char i, base=0, ext=0, dot=FALSE;
+
+	if ((length == 1 || length == 2) && (strncmp(name, "..", length) == 0))
+		return TRUE;
+
+	for (i=0; i<length; i++)
+	{
+		if (name[i] == '.')
+		{
+			if (dot)
+				return FALSE;
+			dot= TRUE;
+		}
+		else if ((name[i] == ' ') || ((unsigned char)name[i] < 0x20))
+			return FALSE;
+		else if (dot)
+			ext++;
+		else
+			base++;
+	}
+	return ((base >= 1) && (base <= 8) && (ext <= 3));
+}
+
+
+//*****************************************************************************
+// Function: fatWalkPath
+// Parameters: path, address to the cluster of the last directory of the path
+// Returns: On SUSCEFULL returns the last name of the path (a pointer inside
+//          path), otherwise returns NULL
+//
+// Description: Follow the directories of the path, separated by '\' or '/',
+//              until its last name. A path started with a separator starts in
+//              the root directory, otherwise in the current directory.
+//              Each directory level costs one directory search, or none if it
+//              is in the NameCache (see fatFindDir)
+//*****************************************************************************
+char *fatWalkPath(char *path, unsigned long *cluster)
+{
+	char *next;
+
+	*cluster= currentDirCluster;
+	if ((*path == '\\') || (*path == '/'))
+		*cluster= FirstDirCluster;
+
+	while (TRUE)
+	{
+		while ((*path == '\\') || (*path == '/'))
+			path++;
+		for (next= path; (*next != '\0') && (*next != '\\') && (*next != '/'); next++)
+			;
+		if (next - path > WIN_MAXLEN)
+			return NULL;
+		if (*next == '\0')
+			return path;		// the last name
+		*cluster= fatFindDir(*cluster, path, next - path);
+		if (*cluster == 0)
+			return NULL;
+		path= next;
+	}
+}
+
+
+//*****************************************************************************
+// Function: fatFindDir
+// Parameters: first cluster of the directory, name of the subdirectory (not
+//             need to be ended by '\0') and its length
+// Returns: the first cluster of the subdirectory, or 0 if it was not found
+//
+// Description: search a subdirectory. The names up to FAT_NAME_CACHE_LEN
+//              characters found are kept in NameCache, so the same directory
+//              is not searched again
+//*****************************************************************************
+unsigned long fatFindDir(unsigned long cluster, char *name, unsigned char length)
+{
+	struct direntry de;
+	unsigned long dirCluster;
+	#if FAT_NAME_CACHE_SIZE
+	TNAMECACHE *nc;
+	unsigned char i, k;
+
+	for (i=0; (i<FAT_NAME_CACHE_SIZE) && (length <= FAT_NAME_CACHE_LEN); i++)
+	{
+		nc= &NameCache[i];
+		if ((nc->cluster == 0) || (nc->parent != cluster) || (nc->name[length] != '\0'))
+			continue;
+		for (k=0; (k < length) && (nc->name[k] == toupper(name[k])); k++)
+			;
+		if (k == length)
+			return nc->cluster;
+	}
+	#endif
+
+	if (fatFindEntry(&de, cluster, name, length) == NULL)
+		return 0;
+	if ((de.deAttributes & ATTR_DIRECTORY) != ATTR_DIRECTORY)
+		return 0;
+
+	dirCluster= (de.deStartCluster) + ((unsigned long)de.deHighClust<<16);
+	if (dirCluster == 0)		// ".." of a directory in the root directory
+		dirCluster= FirstDirCluster;
+
+	#if FAT_NAME_CACHE_SIZE
+	if (length <= FAT_NAME_CACHE_LEN)
+	{
+		nc= &NameCache[NameCacheNext];
+		if (++NameCacheNext == FAT_NAME_CACHE_SIZE)
+			NameCacheNext= 0;
+		nc->parent= cluster;
+		nc->cluster= dirCluster;
+		for (k=0; k<length; k++)
+			nc->name[k]= toupper(name[k]);
+		nc->name[length]= '\0';
+	}
+	#endif
+
+	return dirCluster;
+}
+
+
+//*****************************************************************************
+// Function: fatNameCacheClear
+// Parameters: none
+// Returns: none
+//
+// Description: forget the directories in NameCache, must be called when a
+//              directory is removed or renamed
+//*****************************************************************************
+void fatNameCacheClear(void)
+{
+	#if FAT_NAME_CACHE_SIZE
+	unsigned char i;
+
+	for (i=0; i<FAT_NAME_CACHE_SIZE; i++)
+		NameCache[i].cluster= 0;
+	NameCacheNext= 0;
+	#endif
+}
+
+
 //*****************************************************************************
 // Function: fatGetVolLavel
 // Parameters: none
@@ -417,28 +977,32 @@ char* fatGetVolLabel(void)
 // Parameters: path
 // Returns: On SUSCEFULL returns TRUE, otherwise returns FALSE
 //
-// Description: Change the current directory. Only one level path
-//              ex: cd \test
-//              cd \test\test2  IS INVALID, use cd \test cd\test2 instead
+// Description: Change the current directory, the path can have many levels
+//              ex: cd test
+//                  cd \test\test2
+//                  cd ..\test3
 //*****************************************************************************
 unsigned char fatCddir(char *path)
 {
-	struct direntry de;
+	unsigned long cluster;
+	char *name;
 
 	// if the path doesn't exist return FALSE
-	if (fatGetFileInfo(&de, path) == NULL)
+	name= fatWalkPath(path, &cluster);
+	if (name == NULL)
 		return FALSE;
 
-	// if the path is a directory
-	if ((de.deAttributes & ATTR_DIRECTORY) == ATTR_DIRECTORY)
+	// the path can end with a separator ("\" is the root directory)
+	if (*name != '\0')
 	{
-		// change the current dir cluster to the path information
-		currentDirCluster= (de.deStartCluster) + ((unsigned long)de.deHighClust<<16);
-		if (currentDirCluster == 0)
-			currentDirCluster = 2;
-		return TRUE;
+		cluster= fatFindDir(cluster, name, strlen(name));
+		if (cluster == 0)		// it doesn't exist or it isn't a directory
+			return FALSE;
 	}
-	return FALSE;
+
+	// change the current dir cluster to the path information
+	currentDirCluster= cluster;
+	return TRUE;
 }
 
 
@@ -449,24 +1013,30 @@ unsigned char fatCddir(char *path)
 // Parameters: path
 // Returns: TRUE if the path was created, otherwise FALSE
 //
-// Description: Create a new directory on the current directory
+// Description: Create a new directory. The path can have many levels, the
+//              new directory is created in the last one, with a short (8.3) name
 //*****************************************************************************
 unsigned char fatMkdir(char *path)
 {
 	struct direntry *de, rde;
-	unsigned long freeCluster, newDirEntrySector, lastCluster;
+	unsigned long freeCluster, newDirEntrySector, lastCluster, dirCluster;
 	unsigned int i, date, time;
-	char string[12];
+	char string[13], *name;
 	TTime t;
 
+	// find the directory where the new one will be created
+	name= fatWalkPath(path, &dirCluster);
+	if ((name == NULL) || !fatIsShortName(name, strlen(name)))
+		return FALSE;
+
 	// if the file already exist
-	if (fatGetFileInfo(&rde, path) != NULL)
+	if (fatFindEntry(&rde, dirCluster, name, strlen(name)) != NULL)
 	{
 		return FALSE;
 	}
 
 	// Find a free direntry, returns a pointer to the direntry struct inside SectorBuffer,
-	de=fatNextFreeDirEntry(currentDirCluster);
+	de=fatNextFreeDirEntry(dirCluster);
 
 	// Saves the sector address of this new DirEntry to write it back to the ATA dispositive
 	newDirEntrySector= SectorInCache;
@@ -480,7 +1050,7 @@ unsigned char fatMkdir(char *path)
 		if (freeCluster == 0)				// is the disk is full
 			return (FALSE);					//		return ERROR
 
-		lastCluster= fatLastCluster(currentDirCluster);	// find the last cluster of the current dir
+		lastCluster= fatLastCluster(dirCluster);		// find the last cluster of the dir
 		fatWrite(lastCluster, freeCluster);				// creates a connection between the last cluster of the current directory and the new cluster created
 		fatWriteEOC(freeCluster);						// mark the new cluster with an END OF CLUSTER mark
 		memset (SectorBuffer, '\0', BYTES_PER_SECTOR); 	// fill the SectorBuffer with ZEROS to informate to the FAT that don't have more direntries after this one that we are creating
@@ -498,8 +1068,7 @@ unsigned char fatMkdir(char *path)
 	freeCluster=fatNextFreeCluster(0);
 
 	// fill the direntry
-	strcpy(string, path);
-	string[11]='\0';
+	strcpy(string, name);
 	fatNormalize(string);
 
 	fatGetCurTime(&t);
@@ -560,12 +1129,12 @@ unsigned char fatMkdir(char *path)
 	de->deCDate[1]=(unsigned char)((date&0xFF00)>>8);
 	de->deADate[0]=de->deCDate[0];     	// access date
 	de->deADate[1]=de->deCDate[1];     	// access date
-	de->deHighClust= (currentDirCluster>>16); // high bytes of cluster number
+	de->deHighClust= (dirCluster>>16); 	// high bytes of cluster number
 	de->deMTime[0]=de->deCTime[0];     	// last update time
 	de->deMTime[1]=de->deCTime[1];     	// last update time
 	de->deMDate[0]=de->deCDate[0];     	// last update date
 	de->deMDate[1]=de->deCDate[1];     	// last update date
-	de->deStartCluster= currentDirCluster; // starting cluster of file
+	de->deStartCluster= dirCluster; 	// starting cluster of file
 	de->deFileSize=0;  					// size of file in bytes
 	de++;
 
@@ -590,6 +1159,7 @@ unsigned char fatMkdir(char *path)
 
 	// mark the cluster with the content off the new directory created with an END OF CLUSTER mark
 	fatWriteEOC(freeCluster);
+	fatSync();
 	return TRUE;
 }
 #endif
@@ -605,23 +1175,29 @@ unsigned char fatMkdir(char *path)
 // Returns: A TFILE struct filled with the created file information, or NULL
 //          if an error has ocurred
 //
-// Description: Create a file and open it in the current directory
+// Description: Create a file and open it. The path can have many levels, the
+//              file is created in the last one, with a short (8.3) name
 //*****************************************************************************
 TFILE* fatFcreate(char *shortName)
 {
 	struct direntry *de, rde;
-	unsigned long freeCluster, newDirEntrySector, lastCluster;
+	unsigned long freeCluster, newDirEntrySector, lastCluster, dirCluster;
 	unsigned int date, time;
-	char string[12];
+	char string[13], *name;
 	TTime t;
 
+	// find the directory where the file will be created
+	name= fatWalkPath(shortName, &dirCluster);
+	if ((name == NULL) || !fatIsShortName(name, strlen(name)))
+		return NULL;
+
 	// if the file already exist
-	if (fatGetFileInfo(&rde, shortName) != NULL)
+	if (fatFindEntry(&rde, dirCluster, name, strlen(name)) != NULL)
 		return NULL;
 
 
 	// Find a free direntry, returns a pointer to the direntry struct inside SectorBuffer,
-	de=fatNextFreeDirEntry(currentDirCluster);
+	de=fatNextFreeDirEntry(dirCluster);
 
 	// Saves the sector address of this new DirEntry to write it back to the ATA dispositive
 	newDirEntrySector= SectorInCache;
@@ -636,7 +1212,7 @@ TFILE* fatFcreate(char *shortName)
 			return (FALSE);		// returns ERROR
 
 
-		lastCluster= fatLastCluster(currentDirCluster);	// find the last cluster of the current dir
+		lastCluster= fatLastCluster(dirCluster);		// find the last cluster of the dir
 		fatWrite(lastCluster, freeCluster);				// creates a connection between the last cluster of the current directory and the new cluster created
 		fatWriteEOC(freeCluster);						// mark the new cluster with an END OF CLUSTER mark
 		memset (SectorBuffer, '\0', BYTES_PER_SECTOR); 	// fill the SectorBuffer with ZEROS to informate to the FAT that don't have more direntries after this one that we are creating
@@ -649,8 +1225,7 @@ TFILE* fatFcreate(char *shortName)
 	freeCluster=fatNextFreeCluster(0);
 
 	// fill with file data information
-	strcpy(string, shortName);
-	string[11]='\0';
+	strcpy(string, name);
 	fatNormalize(string);
 
 
@@ -697,29 +1272,39 @@ TFILE* fatFcreate(char *shortName)
 // Parameters: old name, new name
 // Returns: TRUE if the name was chanched, otherwise FALSE
 //
-// Description: Change the name of a directory or file
+// Description: Change the name of a directory or file. The old name can be a
+//              path, the new name is only the name (8.3) in the same directory.
+//              A long name of the old entry is removed, its checksum would no
+//              longer match the new short name
 //*****************************************************************************
 unsigned char fatRename(char *oldShortName, char *newShortName)
 {
 	struct direntry *de, rde;
-	char string[12];
+	unsigned long dirCluster;
+	char string[13], *name;
+
+	// the new name is in the same directory, and it is a short (8.3) name
+	name= fatWalkPath(oldShortName, &dirCluster);
+	if ((name == NULL) || !fatIsShortName(newShortName, strlen(newShortName)))
+		return FALSE;
 
 	// if the new file name already exist
-	de=fatGetFileInfo(&rde, newShortName);
+	de=fatFindEntry(&rde, dirCluster, newShortName, strlen(newShortName));
 	if (de != NULL)
 		return FALSE;
 
 	// if the file don't exist
-	de=fatGetFileInfo(&rde, oldShortName);
+	de=fatFindEntry(&rde, dirCluster, name, strlen(name));
 	if (de == NULL)
 		return FALSE;
 
 
 	strcpy(string, newShortName);
-	string[11]='\0';
 	fatNormalize(string);
 	memcpy(de->deName, string, 11);
 	ataWriteSectors( DRIVE0, SectorInCache, SectorBuffer);
+	fatRemoveLfn();
+	fatNameCacheClear();
 	return TRUE;
 
 }
@@ -734,12 +1319,12 @@ unsigned char fatRename(char *oldShortName, char *newShortName)
 // Parameters: File or Directory short name
 // Returns: TRUE if the file was removed, otherwise FALSE
 //
-// Description: remove a file or directory
+// Description: remove a file or directory, and the winentries of its long name
 //*****************************************************************************
 unsigned char fatRemove(char *shortName)
 {
 	struct direntry *de, rde;
-	unsigned long CurrentDirCluster, NextCluster, fileSector;
+	unsigned long CurrentDirCluster, fileSector;
 
 
 	de=fatGetFileInfo(&rde, shortName);	// get file information
@@ -766,13 +1351,12 @@ unsigned char fatRemove(char *shortName)
 
 	// write the direntry back to the ATA dispositive
 	ataWriteSectors( DRIVE0, SectorInCache, SectorBuffer);
+	fatRemoveLfn();
+	fatNameCacheClear();
 
 	// erase fat table
-	do{
-		NextCluster=fatNextCluster(CurrentDirCluster);
-		fatWrite(CurrentDirCluster,CLUST_FREE);	// free the current dir cluster
-		CurrentDirCluster=NextCluster;
-	}while( NextCluster != 0 );
+	fatFreeChain(CurrentDirCluster);
+	fatSync();
 
 	//file erased
 	return TRUE;
@@ -781,10 +1365,44 @@ unsigned char fatRemove(char *shortName)
 ////////////////////
 
 
+////////////////////
+#ifndef ATA_READ_ONLY
+//*****************************************************************************
+// Function: fatRemoveLfn
+// Parameters: none
+// Returns: none
+//
+// Description: mark as deleted the winentries of the direntry last found by
+//              fatFindEntry (LfnStart, LfnEntries). They can go on in the next
+//              sector or cluster; each sector is written once
+//*****************************************************************************
+void fatRemoveLfn(void)
+{
+	struct direntry *de;
+	TDIR dir;
+	unsigned char n;
+
+	dir= LfnStart;
+	for (n=0; n<LfnEntries; n++)
+	{
+		if ((de= fatDirNext(&dir)) == NULL)
+			break;
+		*de->deName= SLOT_DELETED;
+
+		// write the sector before fatDirNext reads the next one
+		if ((n == LfnEntries-1) || (dir.index == FAT_DIRENTRIES_PER_SECTOR))
+			ataWriteSectors( DRIVE0, dir.sector, SectorBuffer);
+	}
+	LfnEntries= 0;
+}
+#endif
+////////////////////
+
+
 
 //*****************************************************************************
 // Function: fatFopen
-// Parameters: File or Directory short name
+// Parameters: File or Directory path (short or long names, see fatGetFileInfo)
 // Returns: A TFILE struct filled with the opened file information, or NULL
 //          if an error has ocurred
 //
@@ -794,14 +1412,22 @@ unsigned char fatRemove(char *shortName)
 //*****************************************************************************
 TFILE* fatFopen(char *shortName)
 {
+	struct direntry *de;
+
 	// if the file don't exist
-	if (fatGetFileInfo(&File.de, shortName) == NULL)
+	if ((de= fatGetFileInfo(&File.de, shortName)) == NULL)
 		return NULL;
 
-	File.currentSector = fatClustToSect(((unsigned long)File.de.deHighClust << 16) + File.de.deStartCluster);
+	// where the direntry is, to update it in fatFclose
+	File.dirSector= SectorInCache;
+	File.dirEntry= de - (struct direntry *) SectorBuffer;
+
+	File.currentCluster = ((unsigned long)File.de.deHighClust << 16) + File.de.deStartCluster;
+	File.currentSector = fatClustToSect(File.currentCluster);
 	File.buffer=SectorBuffer;
 	File.bytePointer=0;
 	File.sectorHasChanged=FALSE;
+	fatFseekInit(&File);
 	ataReadSectors( DRIVE0, File.currentSector, File.buffer, &SectorInCache); // read the first file sector
 
 	return (&File);
@@ -816,11 +1442,11 @@ TFILE* fatFopen(char *shortName)
 // Returns: TRUE if the file was corrected closed, and FALSE otherwise
 //
 // Description: write current file to the FAT file system
-//              refresh the file size
+//              refresh the file size, the FATs and FSInfo
 //*****************************************************************************
 unsigned char fatFclose(TFILE *fp)
 {
-	struct direntry *de, rde;
+	struct direntry *de;
 	unsigned long fileSize;
 	unsigned int date, time;
 	TTime t;
@@ -829,8 +1455,9 @@ unsigned char fatFclose(TFILE *fp)
 	fp->bytePointer=0;
 	if (fatFflush(fp))
 	{
-		if ((de=fatGetFileInfo(&rde, fp->de.deName)) == NULL) // if the file don't exist
-			return FALSE;
+		// read the direntry of the file
+		ataReadSectors( DRIVE0, fp->dirSector, SectorBuffer, &SectorInCache);
+		de= ((struct direntry *) SectorBuffer) + fp->dirEntry;
 		de->deFileSize= fileSize; // refresh the file size
 		fatGetCurTime(&t);
 		time= (unsigned int)((t.hour)<<DT_HOURS_SHIFT) + ((t.minutes)<<DT_MINUTES_SHIFT) + ((t.seconds)>>DT_2SECONDS_SHIFT);		// create time
@@ -845,18 +1472,7 @@ unsigned char fatFclose(TFILE *fp)
 
 		ataWriteSectors( DRIVE0, SectorInCache, SectorBuffer);
 
-
-		ataReadSectors( DRIVE0, FSInfo, SectorBuffer, &SectorInCache); // Read FSInfo
-		((struct fsinfo *)SectorBuffer)->fsinfree[0]=0xFF; // change to Operation System don't to try to correct this field and the FAT
-		((struct fsinfo *)SectorBuffer)->fsinfree[1]=0xFF;
-		((struct fsinfo *)SectorBuffer)->fsinfree[2]=0xFF;
-		((struct fsinfo *)SectorBuffer)->fsinfree[3]=0xFF;
-
-		((struct fsinfo *)SectorBuffer)->fsinxtfree[0]=0xFF;
-		((struct fsinfo *)SectorBuffer)->fsinxtfree[1]=0xFF;
-		((struct fsinfo *)SectorBuffer)->fsinxtfree[2]=0xFF;
-		((struct fsinfo *)SectorBuffer)->fsinxtfree[3]=0xFF;
-		ataWriteSectors( DRIVE0, SectorInCache, SectorBuffer);
+		fatSync();	// write the file clusters to the FATs and update FSInfo
 		return(TRUE);
 	}
 	return (FALSE);
@@ -897,35 +1513,62 @@ unsigned char fatFflush(TFILE *fp)
 //              Modes: SEEK_CUR: from the current position of the file pointer;
 //                     SEEK_SET: from the beggining of the file
 //                     SEEK_END: from the end of file to back.
+//              The cluster chain is followed from the current cluster when
+//              going forward, and from the nearest seekTable entry when going
+//              back, so a seek never walks the whole chain again.
+//              The position can't be after the end of the file.
 //*****************************************************************************
 unsigned int fatFseek(TFILE *fp, unsigned long offSet, unsigned char mode)
 {
-
-	unsigned long numClusters, curCluster, numSector;
+	unsigned long bytePointer, position, index, cluster;
+	unsigned char i;
 
 	// calculate the new byte pointer
 	switch (mode)
 	{
-		case SEEK_END: fp->bytePointer= fp->de.deFileSize - offSet;	break;
-		case SEEK_SET: fp->bytePointer= offSet;                     break;
-		case SEEK_CUR: fp->bytePointer= fp->bytePointer + offSet;   break;
+		case SEEK_END: bytePointer= fp->de.deFileSize - offSet;	break;
+		case SEEK_SET: bytePointer= offSet;                     break;
+		case SEEK_CUR: bytePointer= fp->bytePointer + offSet;   break;
 		default: return FALSE;
 	}
+	if (bytePointer > fp->de.deFileSize)	// no cluster to go
+		return FALSE;
 
-	// calculate the current file cluster
-	curCluster=((unsigned long)fp->de.deHighClust<<16)+(fp->de.deStartCluster);
-	numClusters=fp->bytePointer/(BYTES_PER_SECTOR*SectorsPerCluster);
-	numSector=(fp->bytePointer/BYTES_PER_SECTOR)%SectorsPerCluster;
+	////////////////////
+	#ifndef ATA_READ_ONLY
+	fatFflush(fp);		// the buffer will be used by other sector
+	#endif
+	////////////////////
+
+	// At a sector boundary the sector in memory is still the one of the last byte
+	// (the next fatFread/fatFwrite goes to the next sector)
+	position= bytePointer;
+	if ((position != 0) && ((position % BYTES_PER_SECTOR) == 0))
+		position--;
+	index= position / ((unsigned long)BYTES_PER_SECTOR * SectorsPerCluster);
+
+	// going back: restart from the nearest known cluster before the new position
+	if (index < fp->clusterIndex)
+	{
+		i= (index >> fp->seekShift) < FAT_SEEK_TABLE_SIZE ? (index >> fp->seekShift) : FAT_SEEK_TABLE_SIZE-1;
+		while (fp->seekTable[i] == 0)	// seekTable[0] is the first cluster
+			i--;
+		fp->currentCluster= fp->seekTable[i];
+		fp->clusterIndex= (unsigned long)i << fp->seekShift;
+	}
 
-	// calculate the cluster address of the new byte pointer
-	while (numClusters > 0)
+	// going forward: only the clusters between the old and the new position are read
+	while (fp->clusterIndex < index)
 	{
-		curCluster=fatNextCluster(curCluster);
-		numClusters--;
+		cluster= fatNextCluster(fp->currentCluster);
+		if (cluster == 0)		// broken cluster chain
+			return FALSE;
+		fatFsetCluster(fp, cluster);
 	}
 
 	// calculate the Sector address of the new byte pointer
-	fp->currentSector=fatClustToSect(curCluster) + numSector;
+	fp->bytePointer= bytePointer;
+	fp->currentSector= fatClustToSect(fp->currentCluster) + (position / BYTES_PER_SECTOR) % SectorsPerCluster;
 
 	// read that sector
 	ataReadSectors( DRIVE0, fp->currentSector, fp->buffer, &SectorInCache);
@@ -934,6 +1577,52 @@ unsigned int fatFseek(TFILE *fp, unsigned long offSet, unsigned char mode)
 }
 
 
+//*****************************************************************************
+// Function: fatFseekInit
+// Parameters: TFILE struct of the file opened at the first cluster
+// Returns: none
+//
+// Description: Clear the seek table of a file just opened and choose the
+//              distance between its entries, so that the whole cluster chain
+//              fits in FAT_SEEK_TABLE_SIZE entries
+//*****************************************************************************
+void fatFseekInit(TFILE *fp)
+{
+	unsigned long clusters;
+	unsigned char i;
+
+	clusters= fp->de.deFileSize / ((unsigned long)BYTES_PER_SECTOR * SectorsPerCluster);
+	fp->seekShift= 0;
+	while ((clusters >> fp->seekShift) >= FAT_SEEK_TABLE_SIZE)
+		fp->seekShift++;
+
+	for (i=1; i<FAT_SEEK_TABLE_SIZE; i++)
+		fp->seekTable[i]= 0;
+	fp->seekTable[0]= fp->currentCluster;
+	fp->clusterIndex= 0;
+}
+
+
+//*****************************************************************************
+// Function: fatFsetCluster
+// Parameters: TFILE struct of the file opened, next cluster of the chain
+// Returns: none
+//
+// Description: Move the file to the next cluster of its chain, keeping the
+//              cluster index and the seek table
+//*****************************************************************************
+void fatFsetCluster(TFILE *fp, unsigned long cluster)
+{
+	unsigned long entry;
+
+	fp->currentCluster= cluster;
+	fp->clusterIndex++;
+	entry= fp->clusterIndex >> fp->seekShift;
+	if ((entry < FAT_SEEK_TABLE_SIZE) && ((entry << fp->seekShift) == fp->clusterIndex))
+		fp->seekTable[entry]= cluster;
+}
+
+
 //*****************************************************************************
 // Function: fatFgetc
 // Parameters: TFILE struct of the file opened
@@ -943,37 +1632,160 @@ unsigned int fatFseek(TFILE *fp, unsigned long offSet, unsigned char mode)
 //*****************************************************************************
 char fatFgetc(TFILE *fp)
 {
-	unsigned int bufferPointer;
+	char c;
+
+	if (fatFread(fp, (unsigned char *)&c, 1) != 1)	// if is the end of file
+		return 0;
+	return c;
+}
+
+
+
+//*****************************************************************************
+// Function: fatFread
+// Parameters: TFILE struct of the file opened, destination buffer, number of bytes
+// Returns: the number of bytes read, less than count at the end of file
+//
+// Description: Read count bytes from the file, and actualize the byte pointer.
+//              Whole sectors are read from the ata dispositive straight into
+//              the destination buffer, with one multi-sector command for each
+//              contiguous run, only partial sectors go through fp->buffer
+//*****************************************************************************
+unsigned int fatFread(TFILE *fp, unsigned char *buffer, unsigned int count)
+{
+	unsigned int bufferPointer, n, done=0;
+	unsigned long sector;
 
 	if (fatFeof(fp))	// if is the end of file
 		return 0;
+	if ((unsigned long)count > fp->de.deFileSize - fp->bytePointer)
+		count= fp->de.deFileSize - fp->bytePointer;
+
+	while (done < count)
+	{
+		bufferPointer= fp->bytePointer & 0x001FF; // equal (fp->bytePointer % 512)
+
+		if ((bufferPointer == 0) && (fp->bytePointer != 0))	// the byte pointer is in the next sector
+		{
+			////////////////////
+			#ifndef ATA_READ_ONLY
+			fatFflush(fp);
+			#endif
+			////////////////////
+			if (!fatFnextSector(fp, FALSE))
+				break;
+
+			if (count - done >= BYTES_PER_SECTOR)	// whole sectors, read them straight to the caller
+			{
+				sector= fp->currentSector;
+				n= fatFsectorRun(fp, (count - done) / BYTES_PER_SECTOR, FALSE);
+				ataReadSectorsN( DRIVE0, sector, n, buffer + done);
+				fp->bytePointer+= (unsigned long)n * BYTES_PER_SECTOR;
+				done+= n * BYTES_PER_SECTOR;
+				continue;
+			}
+			ataReadSectors( DRIVE0, fp->currentSector, fp->buffer, &SectorInCache);
+		}
 
+		n= BYTES_PER_SECTOR - bufferPointer;
+		if (n > count - done)
+			n= count - done;
+		memcpy(buffer + done, fp->buffer + bufferPointer, n);
+		fp->bytePointer+= n;
+		done+= n;
+	}
+	return done;
+}
 
-	bufferPointer= fp->bytePointer & 0x001FF; // equal (fp->bytePointer % 512)
-	fp->bytePointer++;
 
 
-	if ((fp->bytePointer == 1) || (bufferPointer != 0))
+//*****************************************************************************
+// Function: fatFnextSector
+// Parameters: TFILE struct of the file opened, TRUE to allocate a new cluster
+//             at the end of the file
+// Returns: On SUSCEFULL returns TRUE, FALSE at the end of the cluster chain
+//          (or if the disk is full)
+//
+// Description: Move fp->currentSector to the next sector of the file. The FAT
+//              is only read when the next sector is in the next cluster
+//              (fp->currentCluster).
+//              The sector is not read to fp->buffer
+//*****************************************************************************
+unsigned char fatFnextSector(TFILE *fp, unsigned char allocate)
+{
+	unsigned long cluster, nextCluster;
+
+	// Next Sector is in current Cluster
+	cluster= fp->currentCluster;
+	if ((fp->currentSector + 1 - fatClustToSect(cluster)) < SectorsPerCluster)
 	{
-		return(fp->buffer[bufferPointer]);
+		fp->currentSector++;
+		return TRUE;
 	}
-	else
+
+	// Next Sector is in next Cluster
+	nextCluster= fatNextCluster(cluster);
+	if (nextCluster == 0)	// end of the cluster chain
 	{
-		// Next Sector is in current Cluster
-		if (fatSectToClust(fp->currentSector) == fatSectToClust(fp->currentSector+1))
+		////////////////////
+		#ifndef ATA_READ_ONLY
+		if (allocate)
 		{
-			fp->currentSector++;
+			nextCluster=fatNextFreeCluster(cluster);	// keep the file contiguous
+			if (nextCluster == 0)		// if disk is full
+				return (FALSE);
+			fatWrite(cluster, nextCluster);
+			fatWriteEOC(nextCluster);
 		}
-		else // Next Sector is in next Cluster
-		{
-			unsigned long cluster;
+		#endif
+		////////////////////
+		if (nextCluster == 0)
+			return FALSE;
+	}
+	fatFsetCluster(fp, nextCluster);
+	fp->currentSector= fatClustToSect(nextCluster);
+	return TRUE;
+}
+
 
-			cluster= fatNextCluster(fatSectToClust(fp->currentSector));
-			fp->currentSector= fatClustToSect(cluster);
+
+//*****************************************************************************
+// Function: fatFsectorRun
+// Parameters: TFILE struct of the file opened, maximum number of sectors,
+//             TRUE to allocate new clusters at the end of the file
+// Returns: the number of contiguous sectors (1 at least) starting in
+//          fp->currentSector
+//
+// Description: Extend a run of sectors starting in fp->currentSector for as long
+//              as the next sector of the file follows it on the disk, that is,
+//              inside a cluster and across consecutive clusters. fp->currentSector
+//              is left in the last sector of the run
+//*****************************************************************************
+unsigned char fatFsectorRun(TFILE *fp, unsigned int maxSectors, unsigned char allocate)
+{
+	unsigned char sectors=1;
+	unsigned long sector, cluster, clusterIndex;
+
+	if (maxSectors > 255)	// limit of the sector count register
+		maxSectors= 255;
+
+	while (sectors < maxSectors)
+	{
+		sector= fp->currentSector;
+		cluster= fp->currentCluster;
+		clusterIndex= fp->clusterIndex;
+		if (!fatFnextSector(fp, allocate))
+			break;
+		if (fp->currentSector != sector+1)	// next cluster isn't the following one
+		{
+			fp->currentSector= sector;
+			fp->currentCluster= cluster;
+			fp->clusterIndex= clusterIndex;
+			break;
 		}
-		ataReadSectors( DRIVE0, fp->currentSector, fp->buffer, &SectorInCache);
-		return(fp->buffer[bufferPointer]);
+		sectors++;
 	}
+	return sectors;
 }
 
 
@@ -989,57 +1801,73 @@ char fatFgetc(TFILE *fp)
 //*****************************************************************************
 unsigned char fatFputc(TFILE *fp, char c)
 {
-	unsigned int bufferPointer;
-	unsigned long freeCluster;
+	if (fatFwrite(fp, (unsigned char *)&c, 1) != 1)	// if disk is full
+		return (FALSE);
+	return (TRUE);
+}
+#endif
+////////////////////
 
-	bufferPointer= fp->bytePointer & 0x001FF; // equal (fp->bytePointer % 512)
-	fp->bytePointer++;
 
+////////////////////
+#ifndef ATA_READ_ONLY
+//*****************************************************************************
+// Function: fatFwrite
+// Parameters: TFILE struct of the file opened, source buffer, number of bytes
+// Returns: the number of bytes written, less than count if the disk is full
+//
+// Description: Write count bytes to the file, and actualize the byte pointer
+//              and the file size. Whole sectors are written from the source
+//              buffer straight to the ata dispositive, with one multi-sector
+//              command for each contiguous run, only partial sectors go
+//              through fp->buffer. New clusters are allocated as needed
+//*****************************************************************************
+unsigned int fatFwrite(TFILE *fp, unsigned char *buffer, unsigned int count)
+{
+	unsigned int bufferPointer, n, done=0;
+	unsigned long sector;
 
-	if ((fp->bytePointer != 1) && (bufferPointer == 0))	// if we need to allocate a new sector to the file
+	while (done < count)
 	{
-		ataWriteSectors(DRIVE0, fp->currentSector, fp->buffer);
+		bufferPointer= fp->bytePointer & 0x001FF; // equal (fp->bytePointer % 512)
 
-		if(fp->de.deFileSize>fp->bytePointer)	// sector already exist
+		if ((bufferPointer == 0) && (fp->bytePointer != 0))	// if we need the next sector of the file
 		{
-			// Next Sector is in current Cluster
-			if (fatSectToClust(fp->currentSector) == fatSectToClust(fp->currentSector+1))
+			fatFflush(fp);
+			if (!fatFnextSector(fp, TRUE))	// if disk is full
+				break;
+
+			if (count - done >= BYTES_PER_SECTOR)	// whole sectors, write them straight from the caller
 			{
-				fp->currentSector++;
+				sector= fp->currentSector;
+				n= fatFsectorRun(fp, (count - done) / BYTES_PER_SECTOR, TRUE);
+				ataWriteSectorsN( DRIVE0, sector, n, buffer + done);
+				if ((SectorInCache >= sector) && (SectorInCache <= fp->currentSector))
+					SectorInCache= 0xFFFFFFFF;
+				fp->bytePointer+= (unsigned long)n * BYTES_PER_SECTOR;
+				done+= n * BYTES_PER_SECTOR;
+				if(fp->bytePointer>fp->de.deFileSize)
+					fp->de.deFileSize=fp->bytePointer;
+				continue;
 			}
-			else // Next Sector is in next Cluster
-			{
-				unsigned long cluster;
 
-				cluster= fatNextCluster(fatSectToClust(fp->currentSector));
-				fp->currentSector= fatClustToSect(cluster);
-			}
-			ataReadSectors( DRIVE0, fp->currentSector, fp->buffer, &SectorInCache);
+			if (fp->de.deFileSize > fp->bytePointer)	// sector already has file data
+				ataReadSectors( DRIVE0, fp->currentSector, fp->buffer, &SectorInCache);
+			else										// sector isn't used yet
+				SectorInCache= fp->currentSector;
 		}
-		else 	// sector isnt used or the cluster isnt allocated
-		{
 
-			if (fatSectToClust(fp->currentSector) == fatSectToClust(fp->currentSector+1))//the next sector is in current cluster
-			{
-				fp->currentSector++;
-			}
-			else
-			{
-				freeCluster=fatNextFreeCluster(0);
-				if (freeCluster == 0)		// if disk is full
-					return (FALSE);
-				fatWrite(fatSectToClust(fp->currentSector), freeCluster);
-				fatWriteEOC(freeCluster);
-				fp->currentSector=fatClustToSect(freeCluster);
-			}
-		}
+		n= BYTES_PER_SECTOR - bufferPointer;
+		if (n > count - done)
+			n= count - done;
+		memcpy(fp->buffer + bufferPointer, buffer + done, n);
+		fp->sectorHasChanged=TRUE;
+		fp->bytePointer+= n;
+		done+= n;
+		if(fp->bytePointer>fp->de.deFileSize)
+			fp->de.deFileSize=fp->bytePointer;
 	}
-	fp->buffer[bufferPointer]=c;
-	fp->sectorHasChanged=TRUE;
-	if(fp->bytePointer>fp->de.deFileSize)
-		fp->de.deFileSize=fp->bytePointer;
-
-	return (TRUE);
+	return done;
 }
 #endif
 ////////////////////
@@ -1115,8 +1943,8 @@ void fatNormalize(char *str_dest)
 	for (; d<11; d++)			// complete the three caracters extension file name with spaces
 		str_dest[d]= ' ';
 
-	strupr(str_dest);
 	str_dest[11]='\0';
+	strupr(str_dest);
 }
 
 
@@ -1149,28 +1977,15 @@ unsigned long fatGetCurDirCluster(void)
 //*****************************************************************************
 struct direntry *fatNextFreeDirEntry(unsigned long cluster)
 {
-	unsigned int s,index=0;
-	unsigned long sector;
 	struct direntry *de;
+	TDIR dir;
 
-	do
+	fatDirOpen(&dir, cluster);
+	while ((de= fatDirNext(&dir)) != NULL)
 	{
-		sector = fatClustToSect(cluster);
-		for(s=0; s< SectorsPerCluster ; s++)
-		{
-			ataReadSectors(DRIVE0, sector+s, SectorBuffer, &SectorInCache);
-			de = (struct direntry *) SectorBuffer;
-			for (index=0; index<FAT_DIRENTRIES_PER_SECTOR; index++)
-			{
-				if((*de->deName == SLOT_DELETED) || (*de->deName == 0x00))
-					return(de);
-				de++;
-			}
-		}
-		cluster=fatNextCluster(cluster);
-		if (cluster == 0)
-			return NULL;
-    }while  (cluster <  NumClusters ); // end of FatDirentries
+		if((*de->deName == SLOT_DELETED) || (*de->deName == 0x00))
+			return(de);
+	}
  	return NULL;
 }
 #endif
@@ -1181,51 +1996,95 @@ struct direntry *fatNextFreeDirEntry(unsigned long cluster)
 #ifndef ATA_READ_ONLY
 //*****************************************************************************
 // Function: fatNextFreeCluster
-// Parameters: start cluster
+// Parameters: start cluster, 0 to start in the next free cluster hint
 // Returns: On SUSCEFULL returns the next free cluster found, 0 otherwise
 //
-// Description: Returns the first free cluster found in Fat table.
-//              If goes until the end of the FAT table and don't found a free cluster.
-//              return 0.
+// Description: Returns the first free cluster found in Fat table after the
+//              start cluster. Files pass their last cluster, so they grow in
+//              contiguous clusters, other allocations start in NextFreeCluster
+//              (from FSInfo and then the last allocated cluster), so a filling
+//              disk isn't scanned again from the first FAT sector each time.
+//              The search goes to the end of the FAT and then wraps around
+//              to the start cluster. With FAT_FULL_MAP_BYTES the groups of FAT
+//              sectors found without free clusters are skipped, until a
+//              cluster in the group is freed.
+//              If don't found a free cluster, return 0.
 //*****************************************************************************
 unsigned long fatNextFreeCluster(unsigned long cluster)
 {
-	unsigned int index;
-	unsigned long sector;
+	unsigned int index, perSector;
+	unsigned long sector, end, scanStart;
 	unsigned long *fat32Buffer;
 	unsigned int *fat16Buffer;
+	unsigned char pass;
+
+	if (FreeClusters == 0)		// disk is full
+		return 0;
 
 	fat32Buffer= (unsigned long *)FatCache;
 	fat16Buffer= (unsigned int *)FatCache;
 
 	if (Fat32Enabled)
-		sector= (cluster>>7) + FirstFATSector;// 128 structures of 4 bytes each as a pointer to a cluster
+		perSector= FAT32_STRUCTS_PER_SECTOR;	// 128 structures of 4 bytes each as a pointer to a cluster
 	else
-		sector= (cluster>>8) + FirstFATSector;// 256 structures of 2 bytes each as a pointer to a cluster
+		perSector= FAT16_STRUCTS_PER_SECTOR;	// 256 structures of 2 bytes each as a pointer to a cluster
 
-	index=0;
-	do
+	if ((cluster < CLUST_FIRST) || (cluster > MaxCluster))
+		cluster= NextFreeCluster;
+	if ((cluster < CLUST_FIRST) || (cluster > MaxCluster))
+		cluster= CLUST_FIRST;
+
+	// first pass from cluster to the end of the FAT, second pass from the start of the FAT to cluster
+	scanStart= cluster;
+	end= MaxCluster;
+	for (pass=0; pass<2; pass++)
 	{
-		ataReadSectors( DRIVE0, sector, FatCache, &FatInCache);
-		if (Fat32Enabled)
+		while (cluster <= end)
 		{
-			for (index=0; index < FAT32_STRUCTS_PER_SECTOR; index++) //Read all Cluster
+			sector= cluster / perSector;	// FAT sector, from the start of the FAT
+
+			#if FAT_FULL_MAP_BYTES
+			if (FatFullMap[(sector>>FatGroupShift)>>3] & (1<<((sector>>FatGroupShift)&7)))
 			{
-				if ((fat32Buffer[index]&FAT32_MASK) == 0x00000000)
-					return (index + ((sector - FirstFATSector)*FAT32_STRUCTS_PER_SECTOR));
+				// no free cluster in this group of FAT sectors, go to the next group
+				cluster= ((sector>>FatGroupShift)+1) * perSector << FatGroupShift;
+				continue;
 			}
-		}
-		else //FAT16
-		{
-			for (index=0; index < FAT16_STRUCTS_PER_SECTOR; index++) //Read all Cluster
+			#endif
+
+			fatLoadFatSector(FirstFATSector + sector);
+			for (index= cluster % perSector; (index < perSector) && (cluster <= end); index++, cluster++)
+			{
+				if (Fat32Enabled)
+				{
+					if ((fat32Buffer[index]&FAT32_MASK) == 0x00000000)
+						return (cluster);
+				}
+				else //FAT16
+				{
+					if ((fat16Buffer[index]&FAT16_MASK) == 0x0000)
+						return (cluster);
+				}
+			}
+
+			#if FAT_FULL_MAP_BYTES
+			// the last sector of a group, and all the group was scanned (in this pass, or after
+			// scanStart in the first pass), so there is no free cluster in the group
+			if ((((sector+1) & ((1<<FatGroupShift)-1)) == 0) || (cluster > MaxCluster))
 			{
-				if ((fat16Buffer[index]&FAT16_MASK) == 0x0000)
-					return (index + ((sector - FirstFATSector)*FAT16_STRUCTS_PER_SECTOR));
+				index= 0;
+				if ((((sector>>FatGroupShift) * perSector) << FatGroupShift) >= scanStart)
+					index= 1;
+				if (((sector>>FatGroupShift) == 0) && (scanStart == CLUST_FIRST))	// clusters 0 and 1 are reserved
+					index= 1;
+				if (index)
+					FatFullMap[(sector>>FatGroupShift)>>3] |= (1<<((sector>>FatGroupShift)&7));
 			}
+			#endif
 		}
-		sector++;
-    }
-	while  (sector < FirstFATSector+FatSectors); // end of FatDirentries
+		end= scanStart - 1;
+		scanStart= cluster= CLUST_FIRST;
+	}
  	return 0;
 }
 #endif
@@ -1257,12 +2116,13 @@ void fatWriteEOC(unsigned long cluster)
 // Parameters: cluster, data to write
 // Returns: none
 //
-// Description: Write the data in FAT in cluster position
+// Description: Write the data in FAT in cluster position. Only FatCache is
+//              changed, fatFlushFatCache writes it to the FATs
 //*****************************************************************************
 void fatWrite(unsigned long cluster, unsigned long data)
 {
 	unsigned int offset;
-	unsigned long *Fat32CacheLong, sector;
+	unsigned long *Fat32CacheLong, sector, oldData;
 	unsigned int  *Fat16CacheInt;
 
 	// calculate offset of the our entry within that FAT sector
@@ -1274,22 +2134,46 @@ void fatWrite(unsigned long cluster, unsigned long data)
 	// read the FAT sector, with has information abou the cluster that we are interested in.
 	sector= fatTableClustToSect(cluster);
 
-	ataReadSectors( DRIVE0,	sector, FatCache, &FatInCache);
+	fatLoadFatSector(sector);
 
 	// write the data to Fat Cache
 	if (Fat32Enabled)
 	{
+		data&= FAT32_MASK;
 		Fat32CacheLong= (unsigned long *)FatCache;
-		Fat32CacheLong[offset]= (Fat32CacheLong[offset]&(~FAT32_MASK)) | (data&FAT32_MASK);
+		oldData= Fat32CacheLong[offset]&FAT32_MASK;
+		Fat32CacheLong[offset]= (Fat32CacheLong[offset]&(~FAT32_MASK)) | data;
 	}
 	else
 	{
+		data&= FAT16_MASK;
 		Fat16CacheInt= (unsigned int *)FatCache;
-		Fat16CacheInt[offset]= (Fat16CacheInt[offset]&(~FAT16_MASK)) | (data&FAT16_MASK);
+		oldData= Fat16CacheInt[offset]&FAT16_MASK;
+		Fat16CacheInt[offset]= (Fat16CacheInt[offset]&(~FAT16_MASK)) | data;
+	}
+	// Fat Cache is written to the HardDisk (FAT1 and FAT2) by fatFlushFatCache
+	FatCacheDirty= TRUE;
+
+	// keep the free clusters count and the next free cluster hint
+	if ((oldData == CLUST_FREE) && (data != CLUST_FREE))		// cluster allocated
+	{
+		if (FreeClusters != 0xFFFFFFFF)
+			FreeClusters--;
+		NextFreeCluster= cluster;
+		FSInfoDirty= TRUE;
+	}
+	else if ((oldData != CLUST_FREE) && (data == CLUST_FREE))	// cluster freed
+	{
+		if (FreeClusters != 0xFFFFFFFF)
+			FreeClusters++;
+		if (cluster < NextFreeCluster)
+			NextFreeCluster= cluster;
+		FSInfoDirty= TRUE;
+		#if FAT_FULL_MAP_BYTES
+		sector-= FirstFATSector;
+		FatFullMap[(sector>>FatGroupShift)>>3] &= ~(1<<((sector>>FatGroupShift)&7));
+		#endif
 	}
-	// write Fat Cache in the HardDisk
-	ataWriteSectors( DRIVE0, sector, FatCache);	// FAT1
-	ataWriteSectors( DRIVE0, sector+(FirstFAT2Sector-FirstFATSector), FatCache); // FAT2
 }
 #endif
 ////////////////////
@@ -1360,30 +2244,20 @@ unsigned long fatLastCluster(unsigned long cluster)
 unsigned char fatDirectoryIsEmpty(unsigned long DirCluster)
 {
 	struct direntry *de;
-	unsigned long sector;
+	TDIR dir;
 
-	do
+	fatDirOpen(&dir, DirCluster);	// read directory clusters
+	while ((de= fatDirNext(&dir)) != NULL)
 	{
-		sector=fatClustToSect(DirCluster);	//r ead directory clusters
-		for (unsigned long isector=0; isector < SectorsPerCluster ;isector++)	// read one cluster
+		if	(*de->deName != '.' )
 		{
-			ataReadSectors( DRIVE0, sector + isector, SectorBuffer, &SectorInCache);
-			de= (struct direntry *)SectorBuffer;
-			for (int index=0; index<FAT_DIRENTRIES_PER_SECTOR; index++)	// read one sector
-			{
-				if	(*de->deName != '.' )
-				{
-					if ( *de->deName == SLOT_EMPTY )
-						return TRUE;
-					if ( *de->deName != SLOT_DELETED)
-						return FALSE;
-				}
-				// If goes until here it's because de->Name is equal '.' or is equal SLOT_DELETED
-				de++;
-			}
+			if ( *de->deName == SLOT_EMPTY )
+				return TRUE;
+			if ( *de->deName != SLOT_DELETED)
+				return FALSE;
 		}
-		DirCluster=fatNextCluster(DirCluster);
-	}while ( DirCluster != 0 );
+		// If goes until here it's because de->Name is equal '.' or is equal SLOT_DELETED
+	}
 	// if goes until here it's because the all file (directory) is filled with SLOT_DELETED
 	return  TRUE;
 }
@@ -1398,31 +2272,94 @@ unsigned char fatDirectoryIsEmpty(unsigned long DirCluster)
 // Parameters: none
 // Returns: none
 //
-// Description: Remove all files in currentDirCluster
+// Description: Remove all files and directories (with their contents) in
+//              currentDirCluster, in one pass on the directory (see
+//              fatRemoveTree)
 //*****************************************************************************
 void fatRemoveAll(void)
 {
-	unsigned long offset=0;
-	struct direntry *de = 0;	// avoid compiler warning by initializing
-	int index;
+	fatRemoveTree(currentDirCluster);
+	fatNameCacheClear();
+	fatSync();		// write the freed clusters to the FATs and update FSInfo
+}
+
 
-	for (offset=0; ; offset++)
+//*****************************************************************************
+// Function: fatRemoveTree
+// Parameters: first cluster of the directory
+// Returns: none
+//
+// Description: Remove all files and directories in the directory, and all
+//              the directories inside it. The direntries (and long name
+//              winentries) are marked as deleted in SectorBuffer, and each
+//              directory sector is written once, when the search leaves it.
+//              The cluster chains are freed in FatCache, that is written only
+//              when other FAT sector is needed (or by fatSync)
+//*****************************************************************************
+void fatRemoveTree(unsigned long cluster)
+{
+	struct direntry *de;
+	TDIR dir;
+	unsigned long firstCluster;
+	unsigned char changed=FALSE;
+
+	fatDirOpen(&dir, cluster);
+	while (TRUE)
 	{
-		de = (struct direntry *) fatDir(currentDirCluster, offset);
-		if (de == NULL)
-			return;
-		for (index=0; index<FAT_DIRENTRIES_PER_SECTOR; index++)
+		// write the sector before fatDirNext reads the next one
+		if (changed && (dir.index == FAT_DIRENTRIES_PER_SECTOR))
+		{
+			ataWriteSectors( DRIVE0, dir.sector, SectorBuffer);
+			changed= FALSE;
+		}
+
+		de= fatDirNext(&dir);
+		if ((de == NULL) || (*de->deName == SLOT_EMPTY))
+			break;		// there is no more direntries
+		if ((*de->deName == SLOT_DELETED) || (*de->deName == '.'))
+			continue;
+		if (((de->deAttributes & ATTR_VOLUME) == ATTR_VOLUME) && (de->deAttributes != ATTR_LONG_FILENAME))
+			continue;	// keep the volume label
+
+		*de->deName= SLOT_DELETED;
+		changed= TRUE;
+		if (de->deAttributes == ATTR_LONG_FILENAME)
+			continue;
+
+		firstCluster= ((unsigned long)de->deHighClust << 16) + de->deStartCluster;
+		if ((de->deAttributes & ATTR_DIRECTORY) == ATTR_DIRECTORY)
 		{
+			// SectorBuffer will be used by the directory contents
+			ataWriteSectors( DRIVE0, dir.sector, SectorBuffer);
+			changed= FALSE;
+			fatRemoveTree(firstCluster);
+		}
+		fatFreeChain(firstCluster);
+	}
+
+	if (changed)
+		ataWriteSectors( DRIVE0, dir.sector, SectorBuffer);
+}
 
-			if (*de->deName == SLOT_EMPTY)
-				return;		// there is no more direntries
 
-			if (( de->deAttributes & ATTR_VOLUME ) != ATTR_VOLUME)
-				if ((*de->deName != SLOT_DELETED) && (*de->deName != '.'))
-					fatRemove(de->deName);
-			de++;
-		}	// end of sector
-	}	// end of cluster
+//*****************************************************************************
+// Function: fatFreeChain
+// Parameters: first cluster of the chain
+// Returns: none
+//
+// Description: Mark all the clusters of the chain as free. Cluster 0 (an
+//              empty file) has no chain
+//*****************************************************************************
+void fatFreeChain(unsigned long cluster)
+{
+	unsigned long nextCluster;
+
+	while ((cluster >= CLUST_FIRST) && (cluster <= MaxCluster))
+	{
+		nextCluster= fatNextCluster(cluster);
+		fatWrite(cluster, CLUST_FREE);
+		cluster= nextCluster;
+	}
 }
 #endif
 ////////////////////
@@ -231,16 +231,45 @@ struct direntry {
 };
 
 
+// Number of clusters of the file chain remembered in TFILE to seek backwards
+// (the clusters at the positions 0, 1<<seekShift, 2<<seekShift, ...)
+#define FAT_SEEK_TABLE_SIZE		8
+
 // Internal structure of a FILE, used in the program, not writed in FAT
 typedef struct{
 	struct direntry	de;					// Information about the file opened
-	unsigned int	currentSector;  	// Actual sector address in memory
+	unsigned long	currentSector;  	// Actual sector address in memory
 	unsigned char  *buffer;				// buffer pointer to memory (cache sector)
 	unsigned long	bytePointer;		// byte pointer to the actual byte (divide by 512 to find the current buffer position)
 	unsigned char	sectorHasChanged;	// TRUE if the sector in memory has changed and needs to be write before a close file or change in sector
+	unsigned long	currentCluster;		// cluster of currentSector
+	unsigned long	clusterIndex;		// position of currentCluster in the file cluster chain (0 = first cluster)
+	unsigned long	seekTable[FAT_SEEK_TABLE_SIZE];	// known clusters of the chain, 0 if not walked yet
+	unsigned char	seekShift;			// clusters between seekTable entries = 1<<seekShift
+	unsigned long	dirSector;			// sector of the file direntry
+	unsigned char	dirEntry;			// index of the file direntry in dirSector
 }TFILE;
 
 
+// Directory cursor, walks the entries of a directory without restarting
+// the cluster chain from the first cluster for every sector
+typedef struct{
+	unsigned long	cluster;			// Current cluster of the directory (0 after the last one)
+	unsigned long	sector;				// Address of the current directory sector
+	unsigned int	sectorInCluster;	// Current sector inside the cluster
+	unsigned char	index;				// Next direntry inside the current sector
+}TDIR;
+
+
+// Directory found by a path search, kept to not search it again
+#define FAT_NAME_CACHE_LEN		12	// longer names are not kept
+typedef struct{
+	unsigned long	parent;				// first cluster of the directory where it was found
+	unsigned long	cluster;			// first cluster of the directory (0 = empty entry)
+	char			name[FAT_NAME_CACHE_LEN+1];	// name in upper case
+}TNAMECACHE;
+
+
 // number of directory entries in one sector
 #define DIRENTRIES_PER_SECTOR	0x10
 
@@ -270,11 +299,24 @@ struct winentry {
 unsigned char      fatInit               (void);
 unsigned int       fatClusterSize        (void);
 unsigned long      fatNextCluster        (unsigned long cluster);
+void               fatLoadFatSector      (unsigned long sector);
 unsigned long      fatGetFirstDirCluster (void);
 unsigned long      fatClustToSect        (unsigned long clust);
 unsigned long      fatSectToClust        (unsigned long sect);
 unsigned char     *fatDir                (unsigned long cluster, unsigned long offset);
+void               fatDirOpen            (TDIR *dir, unsigned long cluster);
+struct direntry   *fatDirNext            (TDIR *dir);
+struct direntry   *fatDirNextName        (TDIR *dir, char *name, unsigned char size);
 struct direntry   *fatGetFileInfo        (struct direntry *rde, char *shortName);
+void               fatGetShortName       (struct direntry *de, char *name);
+struct direntry   *fatFindEntry          (struct direntry *rde, unsigned long cluster, char *name, unsigned char length);
+unsigned int       fatLfnChar            (struct winentry *we, unsigned char index);
+unsigned char      fatLfnCompare         (struct winentry *we, char *name, unsigned int length);
+unsigned char      fatLfnChecksum        (unsigned char *shortName);
+unsigned char      fatIsShortName        (char *name, unsigned char length);
+char              *fatWalkPath           (char *path, unsigned long *cluster);
+unsigned long      fatFindDir            (unsigned long cluster, char *name, unsigned char length);
+void               fatNameCacheClear     (void);
 char              *fatGetVolLabel        (void);
 struct partrecord *fatGetPartInfo        (void);
 unsigned int       fatGetSecPerClust     (void);
@@ -285,7 +327,12 @@ unsigned long      fatGetNumClusters     (void);
 unsigned char      fatCddir              (char *path);
 TFILE             *fatFopen              (char *shortName);
 char               fatFgetc              (TFILE *fp);
+unsigned int       fatFread              (TFILE *fp, unsigned char *buffer, unsigned int count);
+unsigned char      fatFnextSector        (TFILE *fp, unsigned char allocate);
+unsigned char      fatFsectorRun         (TFILE *fp, unsigned int maxSectors, unsigned char allocate);
 unsigned int       fatFseek              (TFILE *fp, unsigned long offSet, unsigned char mode);
+void               fatFseekInit          (TFILE *fp);
+void               fatFsetCluster        (TFILE *fp, unsigned long cluster);
 unsigned char      fatFeof               (TFILE *fp);
 void               fatNormalize          (char *string);
 unsigned long      fatGetCurDirCluster   (void);
@@ -294,10 +341,14 @@ unsigned long      fatGetCurDirCluster   (void);
 unsigned char      fatMkdir              (char *path);
 unsigned char      fatRename             (char *oldShortName, char *newShortName);
 unsigned char      fatRemove             (char *shortName);
+void               fatRemoveLfn          (void);
 TFILE             *fatFcreate            (char *shortName);
 unsigned char      fatFclose             (TFILE *fp);
 unsigned char      fatFflush             (TFILE *fp);
+void               fatFlushFatCache      (void);
+unsigned char      fatSync               (void);
 unsigned char      fatFputc              (TFILE *fp, char c);
+unsigned int       fatFwrite             (TFILE *fp, unsigned char *buffer, unsigned int count);
 struct direntry   *fatNextFreeDirEntry   (unsigned long cluster);
 unsigned long      fatNextFreeCluster    (unsigned long startSector);
 void               fatWriteEOC           (unsigned long cluster);
@@ -306,6 +357,8 @@ unsigned long      fatTableClustToSect   (unsigned long cluster);
 unsigned long      fatLastCluster        (unsigned long cluster);
 unsigned char      fatDirectoryIsEmpty   (unsigned long DirCluster);
 void               fatRemoveAll          (void);
+void               fatRemoveTree         (unsigned long cluster);
+void               fatFreeChain          (unsigned long cluster);
 #endif
 ////////////////////
 #endif
@@ -36,4 +36,14 @@
 unsigned char FAT_CACHE_ADDR[512];
 //#define FAT_CACHE_SIZE				0x0200
 
+// Size in bytes of the RAM map of FAT sectors without free clusters, used by
+// fatNextFreeCluster to skip them (one bit for each group of FAT sectors, the
+// groups grow with the FAT size). 0 to don't use the map.
+#define FAT_FULL_MAP_BYTES			32
+
+// Number of directories kept by the path search (fatFindDir), so the levels of
+// a path already walked are not searched again. Each entry uses 21 bytes of RAM.
+// 0 to don't use the cache.
+#define FAT_NAME_CACHE_SIZE			4
+
 #endif
@@ -27,6 +27,11 @@
 #include "ata.h"
 #include "fattime.h"
 
+#define USART_BAUDRATE 115200
+// 115200 from 16 MHz is 2.1 % off in either mode, accepted here
+#define BAUD_TOLERANCE 220
+#include "baud.h"
+
 void mcuInit		(void);
 void dir_serial		(unsigned long cluster);
 void print_hd_info	(void);
@@ -222,49 +227,33 @@ int main(void)
 //*****************************************************************************
 void dir_serial(unsigned long cluster)
 {
-	unsigned long offset=0;
-	struct direntry *de = 0;	// avoid compiler warning by initializing
-	int index, aux;
+	TDIR dir;
+	struct direntry *de;
+	char name[32];
 	unsigned char day, month, year, hour, minutes, seconds;
 	unsigned int time, date;
 
 	printf("Vol Label: %s\r\n", fatGetVolLabel());
-	for (offset=0; ; offset++)
+	fatDirOpen(&dir, cluster);
+	while ((de= fatDirNextName(&dir, name, sizeof(name))) != NULL)
 	{
-		de = (struct direntry *) fatDir(cluster, offset);
-		if (de == NULL)
-			return;
-		for (index=0; index<16; index++) // 16 direntries
-		{
-
-			if (*de->deName == SLOT_EMPTY)
-				return;		// there is no more direntries
-			if((*de->deName != SLOT_DELETED) && (de->deAttributes != ATTR_LONG_FILENAME))
-			{
-				for (aux=0; aux<8; aux++)
-					uart_putc(de->deName[aux]);
-				printf(".");
-				for (aux=8; aux<11; aux++)
-					uart_putc(de->deName[aux]);
-				printf(" atrib: ");
-				printf("%02x", de->deAttributes);
-				printf(" cluster: ");
-				printf("%04X", de->deStartCluster);
-				date= de->deCDate[0] + (de->deCDate[1] << 8);
-				time= de->deCTime[0] + (de->deCTime[1] << 8);
-				day=(date&DD_DAY_MASK)>>DD_DAY_SHIFT;
-				month=(date&DD_MONTH_MASK)>>DD_MONTH_SHIFT;
-				year=(date&DD_YEAR_MASK)>>DD_YEAR_SHIFT;
-				hour=(time&DT_HOURS_MASK)>>DT_HOURS_SHIFT;
-				minutes=(time&DT_MINUTES_MASK)>>DT_MINUTES_SHIFT;
-				seconds=(time&DT_2SECONDS_MASK)<<DT_2SECONDS_SHIFT;
-				printf("\t%02d/%02d/%04d", month, day, year+1980);
-				printf(" %02d:%02d:%02d", hour, minutes, seconds);
-				printf("\r\n");
-			}
-			de++;
-		}	// end of sector
-	}	// end of cluster
+		printf("%-31s", name);
+		printf(" atrib: ");
+		printf("%02x", de->deAttributes);
+		printf(" cluster: ");
+		printf("%04X", de->deStartCluster);
+		date= de->deCDate[0] + (de->deCDate[1] << 8);
+		time= de->deCTime[0] + (de->deCTime[1] << 8);
+		day=(date&DD_DAY_MASK)>>DD_DAY_SHIFT;
+		month=(date&DD_MONTH_MASK)>>DD_MONTH_SHIFT;
+		year=(date&DD_YEAR_MASK)>>DD_YEAR_SHIFT;
+		hour=(time&DT_HOURS_MASK)>>DT_HOURS_SHIFT;
+		minutes=(time&DT_MINUTES_MASK)>>DT_MINUTES_SHIFT;
+		seconds=(time&DT_2SECONDS_MASK)<<DT_2SECONDS_SHIFT;
+		printf("\t%02d/%02d/%04d", month, day, year+1980);
+		printf(" %02d:%02d:%02d", hour, minutes, seconds);
+		printf("\r\n");
+	}
 }
 
 
@@ -446,12 +435,12 @@ void mcuInit(void)
 	// USART0 Receiver: Off
 	// USART0 Transmitter: On
 	// USART0 Mode: Asynchronous
-	// USART0 Baud rate: 57600 (double speed = 115200)
-	UCSR0A=0x02;
+	// USART0 Baud rate: USART_BAUDRATE, UBRR and U2X from baud.h
+	UCSR0A=(BAUD_U2X<<U2X0);
 	UCSR0B=0x08;
 	UCSR0C=0x06;
-	UBRR0H=0x00;
-	UBRR0L=0x10;
+	UBRR0H=(unsigned char)(BAUD_UBRR>>8);
+	UBRR0L=(unsigned char)BAUD_UBRR;
 
 
 	// Analog Comparator initialization
@@ -11,7 +11,13 @@
 
 //Link to the Post: http://www.dharmanitech.com/2009/01/sd-card-interfacing-with-atmega8-fat32.html
 
+#ifndef F_CPU
 #define F_CPU 8000000UL       //freq 8 MHz
+#endif
+#ifndef USART_BAUDRATE
+#define USART_BAUDRATE 9600
+#endif
+
 #include <avr/io.h>
 #include <avr/pgmspace.h>
 #include <avr/interrupt.h>
@@ -20,6 +26,7 @@
 #include "SD_routines.h"
 #include "UART_routines.h"
 #include "FAT32.h"
+#include "baud.h"
 
 volatile unsigned long startBlock;
 volatile unsigned long totalBlocks;
@@ -28,9 +35,6 @@ volatile unsigned long firstDataSector, rootCluster, totalClusters;
 volatile unsigned int  bytesPerSector, sectorPerCluster, reservedSectorCount;
 
 
-#define F_CPU 8000000UL  // 8 MHz
-#define USART_BAUDRATE 9600
-#define BAUD_PRESCALE (((F_CPU / (USART_BAUDRATE * 16UL))) - 1)
 #define ENG_SIG_TAB_SIZE 16
 
 
@@ -51,8 +55,9 @@ DDRD  = 0x7F;
 // parity: Disabled
 void uart0_init(void)
 {
-	UBRRH = (unsigned char)(BAUD_PRESCALE>>8);
-	UBRRL = (unsigned char)BAUD_PRESCALE;
+	UBRRH = (unsigned char)(BAUD_UBRR>>8);
+	UBRRL = (unsigned char)BAUD_UBRR;
+	UCSRA = (BAUD_U2X<<U2X);
 	UCSRB = (1<<RXEN)|(1<<TXEN)|(1<<RXCIE);
 	UCSRC = (1<<URSEL)|(1<<USBS)|(3<<UCSZ0);
 }
@@ -0,0 +1,30 @@
+#ifndef FMT_H
+#define FMT_H
+
+#include <inttypes.h>
+
+/*
+ * Number formatting for the UART output without division.
+ *
+ * Every function writes its digits through put(), e.g. uart_tx_putc to go
+ * straight into the TX ring, so no string buffer is needed. Decimal uses
+ * repeated subtraction of powers of ten, hex a nibble table; neither
+ * pulls in the libgcc division routines.
+ */
+
+void fmt_hex8(uint8_t b, void (*put)(uint8_t));
+void fmt_hex16(uint16_t w, void (*put)(uint8_t));
+void fmt_hex32(uint32_t dw, void (*put)(uint8_t));
+
+void fmt_dec16(uint16_t w, void (*put)(uint8_t));
+void fmt_dec32(uint32_t dw, void (*put)(uint8_t));
+void fmt_int16(int16_t w, void (*put)(uint8_t));
+
+#ifdef FMT_BENCHMARK
+/* times the formatters against the division based loops they replace
+   with Timer1 at clk/1 and prints the cycle counts through put();
+   takes over Timer1 while it runs */
+void fmt_benchmark(void (*put)(uint8_t));
+#endif
+
+#endif /* FMT_H */
@@ -1,3 +1,10 @@
+#ifndef F_CPU
+#define F_CPU 8000000UL  // 8 MHz
+#endif
+#ifndef USART_BAUDRATE
+#define USART_BAUDRATE 9600
+#endif
+
 #include <avr/io.h>
 #include <util/delay.h>
 #include <avr/interrupt.h>
@@ -6,26 +13,24 @@
 #include <stdio.h>
 
 #include "i2c.h"
+#include "uart_tx.h"
+#include "fmt.h"
+#include "frame.h"
+#include "baud.h"
 
-#define F_CPU 8000000UL  // 8 MHz
-#define USART_BAUDRATE 9600
-#define BAUD_PRESCALE (((F_CPU / (USART_BAUDRATE * 16UL))) - 1)
 #define ENG_SIG_TAB_SIZE 16
+#define ACCEL_SAMPLES 8 // probek w jednej ramce binarnej
 
 char * komunikat = "Test!";
 volatile uint8_t i = 0;
+volatile uint8_t binary = 0; // 1 - ramki COBS zamiast tekstu
 
 
-void uart_Send(uint8_t u8Data)
-{
-	while((UCSRA &(1<<UDRE)) == 0);
-	UDR = u8Data;
-}
-
 void USART_Init(void)
 {
-	UBRRH = (unsigned char)(BAUD_PRESCALE>>8);
-	UBRRL = (unsigned char)BAUD_PRESCALE;
+	UBRRH = (unsigned char)(BAUD_UBRR>>8);
+	UBRRL = (unsigned char)BAUD_UBRR;
+	UCSRA = (BAUD_U2X<<U2X);
 	UCSRB = (1<<RXEN)|(1<<TXEN)|(1<<RXCIE);
 	UCSRC = (1<<URSEL)|(1<<USBS)|(3<<UCSZ0);
 
@@ -33,18 +38,18 @@ void USART_Init(void)
 
 void strSend(char* msg)
 {
-	uint8_t j=0;
-		while(*(msg + j) != 0)
-		{
-			uart_Send(*(msg + j));
-			j++;
-		}
+	uart_tx_puts(msg);
 }
 
 ISR(USART_RXC_vect)
 {
 	uint8_t dane = UDR;
-	uart_Send(dane);
+	if (dane == 'b')
+		binary = 1;
+	else if (dane == 'a')
+		binary = 0;
+	if (!binary)
+		uart_tx_putc(dane);
 }
 
 ISR(INT0_vect) // Interrupt PD2
@@ -52,7 +57,7 @@ ISR(INT0_vect) // Interrupt PD2
 i=0;
 	while(*(komunikat + i) != 0)
 	{
-		uart_Send(*(komunikat + i));
+		uart_tx_putc(*(komunikat + i));
 		i++;
 	}
 }
@@ -71,13 +76,12 @@ void beginTransmission(uint8_t devAddr, uint8_t isWriting)
 void checkRegister(uint8_t devAddr, uint8_t regAddr)
 {
 	uint8_t buff;
-	char ptr [16]="0xwwww";
 	beginTransmission(devAddr, 1);
 	i2c_write(regAddr);
 	beginTransmission(devAddr, 0);
 	buff = i2c_read(0);
-	itoa(buff, ptr+2, 16);
-	strSend(ptr);
+	uart_tx_puts("0x");
+	fmt_hex8(buff, uart_tx_putc);
 	i2c_stop();
 }
 void setRegister(uint8_t devAddr, uint8_t regAddr, uint8_t data)
@@ -109,7 +113,9 @@ int main(void){
 
 	uint16_t cos = 18;
 	setRegister(addr, 0x2D,  0x08);
-	char wynik[16];
+	uint8_t samples[ACCEL_SAMPLES][6];
+	uint8_t n = 0;
+	struct frame_part part = {samples, sizeof(samples)};
 
 	while(1){
 
@@ -118,15 +124,29 @@ int main(void){
 		i2c_write(0x32);
 		i2c_start();
 		i2c_write(readAddr);
+		if (binary)
+		{
+			// X0 X1 Y0 Y1 Z0 Z1, wysylane po ACCEL_SAMPLES probek
+			for(i=0;i<5;i++)
+				samples[n][i] = i2c_read(1);
+			samples[n][5] = i2c_read(0);
+			i2c_stop();
+			if (++n == ACCEL_SAMPLES)
+			{
+				frame_send(FRAME_TYPE_ACCEL, &part, 1, uart_tx_putc);
+				n = 0;
+			}
+			_delay_ms(10);
+			continue;
+		}
 		for(i=0;i<5;i++)
 		{
 			cos = i2c_read(1);
-			itoa(cos, wynik, 10);
 			switch(i)
 			{
-			case 0: strSend("\rPozycja: X-"); strSend(wynik); break;
-			case 2: strSend(" Y-"); strSend(wynik); break;
-			case 4: strSend(" Z-"); strSend(wynik); break;
+			case 0: strSend("\rPozycja: X-"); fmt_dec16(cos, uart_tx_putc); break;
+			case 2: strSend(" Y-"); fmt_dec16(cos, uart_tx_putc); break;
+			case 4: strSend(" Z-"); fmt_dec16(cos, uart_tx_putc); break;
 			}
 		}
 		i2c_read(0);
@@ -1,10 +1,15 @@
+#ifndef F_CPU
+#define F_CPU 8000000UL  // 8 MHz
+#endif
+#ifndef USART_BAUDRATE
+#define USART_BAUDRATE 9600
+#endif
+
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <inttypes.h>
+#include "baud.h"
 
-#define F_CPU 8000000UL  // 8 MHz
-#define USART_BAUDRATE 9600
-#define BAUD_PRESCALE (((F_CPU / (USART_BAUDRATE * 16UL))) - 1)
 #define ENG_SIG_TAB_SIZE 16
 
 
@@ -17,8 +22,9 @@ void uart_Send(uint8_t u8Data)
 
 void USART_Init(void)
 {
-	UBRRH = (unsigned char)(BAUD_PRESCALE>>8);
-	UBRRL = (unsigned char)BAUD_PRESCALE;
+	UBRRH = (unsigned char)(BAUD_UBRR>>8);
+	UBRRL = (unsigned char)BAUD_UBRR;
+	UCSRA = (BAUD_U2X<<U2X);
 	UCSRB = (1<<RXEN)|(1<<TXEN)|(1<<RXCIE);
 	UCSRC = (1<<URSEL)|(1<<USBS)|(3<<UCSZ0);
 
@@ -0,0 +1,40 @@
+/* SDtest/uart.c: Peter Fleury's interrupt driven driver with ringbuffers,
+   built with the USART0_* options the Makefile passes */
+#include "../SDtest/uart.c"
+#include "../SDtest/baud.h"
+#include "sim.h"
+
+struct sim_info sim_info = {
+	(uint16_t)&UART_RxHead, (uint16_t)&UART_RxTail, UART_RX0_BUFFER_SIZE,
+	(uint16_t)&UART_TxHead, (uint16_t)&UART_TxTail, UART_TX0_BUFFER_SIZE,
+	sizeof(UART_RxHead),
+	(uint16_t)&UART_Stats.overflow,
+#if defined( USART0_RTSCTS )
+	(uint16_t)&UART0_RTS_PORT, _BV(UART0_RTS_BIT),
+	(uint16_t)&UART_PIN(UART0_CTS_PORT), _BV(UART0_CTS_BIT),
+#else
+	0, 0, 0, 0,
+#endif
+#if defined( USART0_XONXOFF )
+	1,
+#else
+	0,
+#endif
+};
+
+int main(void)
+{
+	uint16_t c;
+
+	uart0_init(BAUD_SELECT);
+	sei();
+	for (;;)
+	{
+		c = uart0_getc();
+		if (!(c & UART_NO_DATA))
+		{
+			sim_deliver(c);
+			uart0_putc(c);
+		}
+	}
+}
@@ -0,0 +1,22 @@
+/* m32SD/fmt.c with its benchmark, the output goes straight into UDR for
+   fmtbench; the other copies of fmt.c are the same code */
+#include <avr/io.h>
+#include <avr/sleep.h>
+
+#include "../m32SD/fmt.c"
+
+static void put(uint8_t c)
+{
+	UDR = c;
+}
+
+int main(void)
+{
+	fmt_benchmark(put);
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_enable();
+	sleep_cpu();
+	for (;;)
+	{
+	}
+}
@@ -0,0 +1,18 @@
+/* m32SD/UART_routines.c: polled, no buffering beyond the USART itself */
+#include "../m32SD/UART_routines.h"
+#include "sim.h"
+
+struct sim_info sim_info;
+
+int main(void)
+{
+	unsigned char c;
+
+	uart0_init();
+	for (;;)
+	{
+		c = receiveByte();
+		sim_deliver(c);
+		transmitByte(c);
+	}
+}
@@ -0,0 +1,21 @@
+/* sd-reader_source_20120612/uart.c: polled, sleeps in uart_getc() until RXC */
+#include <avr/interrupt.h>
+
+#include "../sd-reader_source_20120612/uart.h"
+#include "sim.h"
+
+struct sim_info sim_info;
+
+int main(void)
+{
+	uint8_t c;
+
+	uart_init();
+	sei();
+	for (;;)
+	{
+		c = uart_getc();
+		sim_deliver(c);
+		uart_putc(c);
+	}
+}
@@ -0,0 +1,857 @@
+/*
+ * avr - the core behind uartsim, see avr.h.
+ *
+ * Cycle counts follow the instruction set summary of the ATmega8 and
+ * ATmega32 data sheets: every LD/ST/PUSH/POP takes 2 cycles, LPM 3,
+ * CALL 4, RCALL/ICALL 3, RET/RETI 4, an interrupt 4 plus the vector's
+ * jump and 4 more when it wakes the core from sleep.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "avr.h"
+
+#define EM_AVR 83
+#define PT_LOAD 1
+#define SHT_SYMTAB 2
+#define DATA_OFFSET 0x800000UL
+
+#define MCUCR 0x55
+
+const struct avr_mcu* avr_mcu;
+uint64_t avr_cycles;
+uint16_t avr_pc;
+uint8_t avr_mem[0x10000];
+int avr_sleeping;
+int avr_depth;
+uint16_t avr_sp_min;
+
+static const struct avr_mcu mcus[] = {
+	/* name, flash, ramend, vector words, TIMER0_OVF, SPI_STC, USART_RXC, USART_UDRE, USART_TXC, SE in MCUCR */
+	{ "atmega8", 8192, 0x45f, 1, 9, 10, 11, 12, 13, 0x80 },
+	{ "atmega32", 32768, 0x85f, 2, 11, 12, 13, 14, 15, 0x80 },
+	/* USART0; only the lower 64 KB of flash, there is no RAMPZ */
+	{ "atmega128", 65536, 0x10ff, 2, 16, 17, 18, 19, 20, 0x20 },
+};
+
+static uint16_t flash[0x8000];
+static uint8_t* elf;
+static long elf_size;
+static const uint8_t* symtab;
+static uint32_t symtab_size;
+static const char* strtab;
+static avr_read_hook read_hooks[0x100];
+static avr_write_hook write_hooks[0x100];
+static avr_irq_hook irq_pending;
+static avr_ack_hook irq_ack;
+/* SEI and RETI let one more instruction run before an interrupt */
+static int irq_hold;
+
+static uint32_t get16(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+	return get16(p) | (get16(p + 2) << 16);
+}
+
+static void fatal(const char* what)
+{
+	fprintf(stderr, "avr: %s at pc 0x%04x after %llu cycles\n", what, avr_pc * 2,
+	        (unsigned long long)avr_cycles);
+	exit(2);
+}
+
+const struct avr_mcu* avr_find_mcu(const char* name)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof(mcus) / sizeof(mcus[0]); i++)
+		if (!strcmp(mcus[i].name, name))
+			return &mcus[i];
+	return NULL;
+}
+
+void avr_load(const struct avr_mcu* mcu, const char* path)
+{
+	FILE* f = fopen(path, "rb");
+	uint32_t phoff;
+	uint32_t shoff;
+	unsigned phnum;
+	unsigned shnum;
+	unsigned i;
+
+	if (!f)
+	{
+		perror(path);
+		exit(2);
+	}
+	fseek(f, 0, SEEK_END);
+	elf_size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	elf = (uint8_t*)malloc(elf_size);
+	if (!elf || fread(elf, 1, elf_size, f) != (size_t)elf_size)
+	{
+		perror(path);
+		exit(2);
+	}
+	fclose(f);
+
+	if (elf_size < 52 || memcmp(elf, "\177ELF\1\1", 6) || get16(elf + 18) != EM_AVR)
+	{
+		fprintf(stderr, "%s: not a 32 bit little endian AVR ELF file\n", path);
+		exit(2);
+	}
+	avr_mcu = mcu;
+	phoff = get32(elf + 28);
+	shoff = get32(elf + 32);
+	phnum = get16(elf + 44);
+	shnum = get16(elf + 48);
+
+	/* flash holds .text and the initial values of .data at their load address */
+	for (i = 0; i < phnum; i++)
+	{
+		const uint8_t* ph = elf + phoff + i * 32;
+		uint32_t offset = get32(ph + 4);
+		uint32_t paddr = get32(ph + 12);
+		uint32_t filesz = get32(ph + 16);
+
+		if (get32(ph) != PT_LOAD || !filesz || paddr >= DATA_OFFSET)
+			continue;
+		if (paddr + filesz > mcu->flash || offset + filesz > (uint32_t)elf_size)
+		{
+			fprintf(stderr, "%s: does not fit into the %lu bytes of flash of the %s\n",
+			        path, (unsigned long)mcu->flash, mcu->name);
+			exit(2);
+		}
+		for (uint32_t n = 0; n < filesz; n++)
+		{
+			uint16_t* w = &flash[(paddr + n) / 2];
+			if ((paddr + n) & 1)
+				*w = (*w & 0x00ff) | (elf[offset + n] << 8);
+			else
+				*w = (*w & 0xff00) | elf[offset + n];
+		}
+	}
+
+	for (i = 0; i < shnum; i++)
+	{
+		const uint8_t* sh = elf + shoff + i * 40;
+		if (get32(sh + 4) == SHT_SYMTAB)
+		{
+			const uint8_t* link = elf + shoff + get32(sh + 24) * 40;
+			symtab = elf + get32(sh + 16);
+			symtab_size = get32(sh + 20);
+			strtab = (const char*)elf + get32(link + 16);
+		}
+	}
+	avr_reset();
+}
+
+uint32_t avr_symbol(const char* name)
+{
+	uint32_t i;
+
+	for (i = 0; i + 16 <= symtab_size; i += 16)
+	{
+		if (!strcmp(strtab + get32(symtab + i), name))
+		{
+			uint32_t value = get32(symtab + i + 4);
+			return value >= DATA_OFFSET ? value - DATA_OFFSET : value;
+		}
+	}
+	return AVR_NO_SYMBOL;
+}
+
+void avr_hook(uint16_t addr, avr_read_hook read, avr_write_hook write)
+{
+	read_hooks[addr] = read;
+	write_hooks[addr] = write;
+}
+
+void avr_irq_hooks(avr_irq_hook pending, avr_ack_hook ack)
+{
+	irq_pending = pending;
+	irq_ack = ack;
+}
+
+void avr_reset(void)
+{
+	memset(avr_mem, 0, sizeof(avr_mem));
+	avr_pc = 0;
+	avr_sleeping = 0;
+	avr_depth = 0;
+	avr_sp_min = 0xffff;
+	irq_hold = 0;
+}
+
+uint8_t avr_read(uint16_t addr)
+{
+	if (addr < 0x100 && read_hooks[addr])
+		return read_hooks[addr](addr);
+	if (addr > avr_mcu->ramend)
+		fatal("read above RAMEND");
+	return avr_mem[addr];
+}
+
+void avr_write(uint16_t addr, uint8_t value)
+{
+	if (addr < 0x100 && write_hooks[addr])
+	{
+		write_hooks[addr](addr, value);
+		return;
+	}
+	if (addr > avr_mcu->ramend)
+		fatal("write above RAMEND");
+	avr_mem[addr] = value;
+	/* avr-gcc writes SPH first, a new stack pointer is complete with SPL */
+	if (addr == AVR_SPL && avr_sp() < avr_sp_min)
+		avr_sp_min = avr_sp();
+}
+
+uint16_t avr_read16(uint16_t addr)
+{
+	return avr_mem[addr] | (avr_mem[addr + 1] << 8);
+}
+
+/* ---- helpers for the instructions */
+
+#define R avr_mem
+#define SREG avr_mem[AVR_SREG]
+
+static void push(uint8_t value)
+{
+	uint16_t sp = avr_sp();
+
+	if (sp > avr_mcu->ramend || sp < 0x60)
+		fatal("stack pointer outside SRAM");
+	avr_mem[sp--] = value;
+	avr_mem[AVR_SPL] = sp & 0xff;
+	avr_mem[AVR_SPH] = sp >> 8;
+	if (sp < avr_sp_min)
+		avr_sp_min = sp;
+}
+
+static uint8_t pop(void)
+{
+	uint16_t sp = avr_sp() + 1;
+
+	avr_mem[AVR_SPL] = sp & 0xff;
+	avr_mem[AVR_SPH] = sp >> 8;
+	return avr_mem[sp];
+}
+
+static void push_pc(uint16_t pc)
+{
+	push(pc & 0xff);
+	push(pc >> 8);
+}
+
+static uint16_t pop_pc(void)
+{
+	uint16_t hi = pop();
+
+	return (hi << 8) | pop();
+}
+
+static void flags(uint8_t mask, uint8_t value)
+{
+	SREG = (SREG & ~mask) | (value & mask);
+}
+
+static uint8_t nzs(uint8_t r, uint8_t v)
+{
+	uint8_t f = v ? AVR_V : 0;
+
+	if (r & 0x80)
+		f |= AVR_N;
+	if (!r)
+		f |= AVR_Z;
+	if (!(f & AVR_N) != !(f & AVR_V))
+		f |= AVR_S;
+	return f;
+}
+
+static uint8_t do_add(uint8_t d, uint8_t r, uint8_t carry)
+{
+	uint8_t res = d + r + carry;
+	uint8_t c = (d & r) | (r & ~res) | (~res & d);
+	uint8_t v = ((d & r & ~res) | (~d & ~r & res)) & 0x80;
+
+	flags(AVR_H | AVR_S | AVR_V | AVR_N | AVR_Z | AVR_C,
+	      nzs(res, v) | ((c & 0x08) ? AVR_H : 0) | ((c & 0x80) ? AVR_C : 0));
+	return res;
+}
+
+/* keep_z: SBC, SBCI and CPC only clear Z, so multi-byte compares work */
+static uint8_t do_sub(uint8_t d, uint8_t r, uint8_t carry, int keep_z)
+{
+	uint8_t res = d - r - carry;
+	uint8_t c = (~d & r) | (r & res) | (res & ~d);
+	uint8_t v = ((d & ~r & ~res) | (~d & r & res)) & 0x80;
+	uint8_t f = nzs(res, v) | ((c & 0x08) ? AVR_H : 0) | ((c & 0x80) ? AVR_C : 0);
+
+	if (keep_z && !(SREG & AVR_Z))
+		f &= ~AVR_Z;
+	flags(AVR_H | AVR_S | AVR_V | AVR_N | AVR_Z | AVR_C, f);
+	return res;
+}
+
+static uint8_t do_logic(uint8_t res)
+{
+	flags(AVR_S | AVR_V | AVR_N | AVR_Z, nzs(res, 0));
+	return res;
+}
+
+static void set_product(uint16_t p, int carry)
+{
+	R[0] = p & 0xff;
+	R[1] = p >> 8;
+	flags(AVR_Z | AVR_C, (p ? 0 : AVR_Z) | (carry ? AVR_C : 0));
+}
+
+static uint16_t reg16(unsigned r)
+{
+	return R[r] | (R[r + 1] << 8);
+}
+
+static void set_reg16(unsigned r, uint16_t value)
+{
+	R[r] = value & 0xff;
+	R[r + 1] = value >> 8;
+}
+
+/* words taken by the instruction at pc, for the skip instructions */
+static unsigned words(uint16_t pc)
+{
+	uint16_t op = flash[pc & 0x7fff];
+
+	/* LDS, STS, JMP, CALL */
+	if ((op & 0xfc0f) == 0x9000 || (op & 0xfe0c) == 0x940c)
+		return 2;
+	return 1;
+}
+
+static unsigned skip(int cond)
+{
+	if (!cond)
+		return 1;
+	unsigned w = words(avr_pc);
+	avr_pc += w;
+	return 1 + w;
+}
+
+/* LD/ST through X, Y or Z with the pointer mode in the low bits of op */
+static uint16_t pointer(unsigned r, unsigned mode)
+{
+	uint16_t p = reg16(r);
+
+	if (mode == 1)
+		set_reg16(r, p + 1);
+	else if (mode == 2)
+		set_reg16(r, --p);
+	return p;
+}
+
+int avr_irq_allowed(void)
+{
+	return (SREG & AVR_I) && !irq_hold;
+}
+
+void avr_skip(uint64_t cycles)
+{
+	avr_cycles += cycles;
+	irq_hold = 0;
+}
+
+static unsigned interrupt(uint8_t vector)
+{
+	unsigned cycles = 4;
+
+	if (avr_sleeping)
+	{
+		avr_sleeping = 0;
+		cycles += 4;
+	}
+	irq_ack(vector);
+	push_pc(avr_pc);
+	SREG &= ~AVR_I;
+	avr_pc = vector * avr_mcu->vector_words;
+	avr_depth++;
+	return cycles;
+}
+
+unsigned avr_step(void)
+{
+	uint16_t op;
+	unsigned d;
+	unsigned r;
+	unsigned cycles = 1;
+	int hold = 0;
+
+	if (avr_irq_allowed())
+	{
+		uint8_t vector = irq_pending();
+		if (vector)
+		{
+			cycles = interrupt(vector);
+			avr_cycles += cycles;
+			return cycles;
+		}
+	}
+	irq_hold = 0;
+	if (avr_sleeping)
+		return 0;
+
+	op = flash[avr_pc & 0x7fff];
+	avr_pc++;
+	d = (op >> 4) & 0x1f;
+	r = (op & 0x0f) | ((op >> 5) & 0x10);
+
+	switch (op >> 12)
+	{
+	case 0x0:
+		switch ((op >> 10) & 3)
+		{
+		case 0:
+			if (op == 0x0000)
+				break;
+			switch ((op >> 8) & 3)
+			{
+			case 1: /* MOVW */
+				set_reg16(((op >> 4) & 0x0f) * 2, reg16((op & 0x0f) * 2));
+				break;
+			case 2: /* MULS */
+			{
+				int16_t p = (int8_t)R[16 + ((op >> 4) & 0x0f)] * (int8_t)R[16 + (op & 0x0f)];
+				set_product(p, p & 0x8000);
+				cycles = 2;
+				break;
+			}
+			case 3:
+			{
+				uint8_t a = R[16 + ((op >> 4) & 7)];
+				uint8_t b = R[16 + (op & 7)];
+				uint16_t p;
+
+				switch (op & 0x88)
+				{
+				case 0x00: /* MULSU */
+					p = (int8_t)a * b;
+					set_product(p, p & 0x8000);
+					break;
+				case 0x08: /* FMUL */
+					p = a * b;
+					set_product(p << 1, p & 0x8000);
+					break;
+				case 0x80: /* FMULS */
+					p = (int8_t)a * (int8_t)b;
+					set_product(p << 1, p & 0x8000);
+					break;
+				default: /* FMULSU */
+					p = (int8_t)a * b;
+					set_product(p << 1, p & 0x8000);
+					break;
+				}
+				cycles = 2;
+				break;
+			}
+			default:
+				fatal("unknown instruction");
+			}
+			break;
+		case 1: /* CPC */
+			do_sub(R[d], R[r], SREG & AVR_C, 1);
+			break;
+		case 2: /* SBC */
+			R[d] = do_sub(R[d], R[r], SREG & AVR_C, 1);
+			break;
+		case 3: /* ADD */
+			R[d] = do_add(R[d], R[r], 0);
+			break;
+		}
+		break;
+	case 0x1:
+		switch ((op >> 10) & 3)
+		{
+		case 0: /* CPSE */
+			cycles = skip(R[d] == R[r]);
+			break;
+		case 1: /* CP */
+			do_sub(R[d], R[r], 0, 0);
+			break;
+		case 2: /* SUB */
+			R[d] = do_sub(R[d], R[r], 0, 0);
+			break;
+		case 3: /* ADC */
+			R[d] = do_add(R[d], R[r], SREG & AVR_C);
+			break;
+		}
+		break;
+	case 0x2:
+		switch ((op >> 10) & 3)
+		{
+		case 0: /* AND */
+			R[d] = do_logic(R[d] & R[r]);
+			break;
+		case 1: /* EOR */
+			R[d] = do_logic(R[d] ^ R[r]);
+			break;
+		case 2: /* OR */
+			R[d] = do_logic(R[d] | R[r]);
+			break;
+		case 3: /* MOV */
+			R[d] = R[r];
+			break;
+		}
+		break;
+	case 0x3: /* CPI */
+	case 0x4: /* SBCI */
+	case 0x5: /* SUBI */
+	case 0x6: /* ORI */
+	case 0x7: /* ANDI */
+	{
+		uint8_t k = (op & 0x0f) | ((op >> 4) & 0xf0);
+		d = 16 + ((op >> 4) & 0x0f);
+		switch (op >> 12)
+		{
+		case 0x3:
+			do_sub(R[d], k, 0, 0);
+			break;
+		case 0x4:
+			R[d] = do_sub(R[d], k, SREG & AVR_C, 1);
+			break;
+		case 0x5:
+			R[d] = do_sub(R[d], k, 0, 0);
+			break;
+		case 0x6:
+			R[d] = do_logic(R[d] | k);
+			break;
+		default:
+			R[d] = do_logic(R[d] & k);
+			break;
+		}
+		break;
+	}
+	case 0x8:
+	case 0xa: /* LDD/STD Y+q, Z+q */
+	{
+		unsigned q = (op & 7) | ((op >> 7) & 0x18) | ((op >> 8) & 0x20);
+		uint16_t addr = reg16((op & 0x08) ? 28 : 30) + q;
+
+		if (op & 0x0200)
+			avr_write(addr, R[d]);
+		else
+			R[d] = avr_read(addr);
+		cycles = 2;
+		break;
+	}
+	case 0x9:
+		if ((op & 0x0c00) == 0x0000)
+		{
+			/* loads and stores, PUSH and POP */
+			int store = op & 0x0200;
+			uint16_t addr;
+
+			cycles = 2;
+			switch (op & 0x0f)
+			{
+			case 0x0: /* LDS, STS */
+				addr = flash[avr_pc & 0x7fff];
+				avr_pc++;
+				break;
+			case 0x1:
+			case 0x2:
+				addr = pointer(30, op & 3);
+				break;
+			case 0x9:
+			case 0xa:
+				addr = pointer(28, op & 3);
+				break;
+			case 0xc:
+			case 0xd:
+			case 0xe:
+				addr = pointer(26, op & 3);
+				break;
+			case 0x4: /* LPM Rd, Z */
+			case 0x5: /* LPM Rd, Z+ */
+				if (store)
+					fatal("unknown instruction");
+				addr = pointer(30, op & 1);
+				R[d] = (addr & 1) ? flash[addr >> 1] >> 8 : flash[addr >> 1] & 0xff;
+				cycles = 3;
+				goto done;
+			case 0xf:
+				if (store)
+					push(R[d]);
+				else
+					R[d] = pop();
+				goto done;
+			default:
+				fatal("unknown instruction");
+				return 0;
+			}
+			if (store)
+				avr_write(addr, R[d]);
+			else
+				R[d] = avr_read(addr);
+			break;
+		}
+		if ((op & 0x0e00) == 0x0400)
+		{
+			if ((op & 0x0f) < 8 && (op & 0x0f) != 4)
+			{
+				uint8_t v = R[d];
+				uint8_t c;
+				switch (op & 0x0f)
+				{
+				case 0x0: /* COM */
+					R[d] = do_logic(~v);
+					SREG |= AVR_C;
+					break;
+				case 0x1: /* NEG */
+					R[d] = do_sub(0, v, 0, 0);
+					break;
+				case 0x2: /* SWAP */
+					R[d] = (v << 4) | (v >> 4);
+					break;
+				case 0x3: /* INC */
+					R[d] = ++v;
+					flags(AVR_S | AVR_V | AVR_N | AVR_Z, nzs(v, v == 0x80));
+					break;
+				case 0x5: /* ASR */
+				case 0x6: /* LSR */
+				case 0x7: /* ROR */
+					c = v & 1;
+					if ((op & 0x0f) == 0x5)
+						v = (v >> 1) | (v & 0x80);
+					else if ((op & 0x0f) == 0x6)
+						v >>= 1;
+					else
+						v = (v >> 1) | ((SREG & AVR_C) << 7);
+					R[d] = v;
+					flags(AVR_S | AVR_V | AVR_N | AVR_Z | AVR_C,
+					      nzs(v, !(v & 0x80) != !c) | c);
+					break;
+				}
+				break;
+			}
+			switch (op & 0x0f)
+			{
+			case 0xa: /* DEC */
+			{
+				uint8_t v = --R[d];
+				flags(AVR_S | AVR_V | AVR_N | AVR_Z, nzs(v, v == 0x7f));
+				break;
+			}
+			case 0x8:
+				if (!(op & 0x0100))
+				{
+					/* BSET, BCLR: SEI, CLI, SEC, ... */
+					uint8_t bit = 1 << ((op >> 4) & 7);
+					if (op & 0x80)
+						SREG &= ~bit;
+					else
+					{
+						if (bit == AVR_I && !(SREG & AVR_I))
+							hold = 1;
+						SREG |= bit;
+					}
+					break;
+				}
+				switch ((op >> 4) & 0x0f)
+				{
+				case 0x0: /* RET */
+					avr_pc = pop_pc();
+					cycles = 4;
+					break;
+				case 0x1: /* RETI */
+					avr_pc = pop_pc();
+					SREG |= AVR_I;
+					if (avr_depth)
+						avr_depth--;
+					hold = 1;
+					cycles = 4;
+					break;
+				case 0x8: /* SLEEP */
+					if (avr_read(MCUCR) & avr_mcu->mcucr_se)
+						avr_sleeping = 1;
+					break;
+				case 0x9: /* BREAK */
+				case 0xa: /* WDR */
+					break;
+				case 0xc: /* LPM r0, Z */
+				{
+					uint16_t addr = reg16(30);
+					R[0] = (addr & 1) ? flash[addr >> 1] >> 8 : flash[addr >> 1] & 0xff;
+					cycles = 3;
+					break;
+				}
+				default:
+					fatal("unknown instruction");
+				}
+				break;
+			case 0x9:
+				if (op == 0x9409) /* IJMP */
+				{
+					avr_pc = reg16(30);
+					cycles = 2;
+				}
+				else if (op == 0x9509) /* ICALL */
+				{
+					push_pc(avr_pc);
+					avr_pc = reg16(30);
+					cycles = 3;
+				}
+				else
+					fatal("unknown instruction");
+				break;
+			case 0xc: /* JMP */
+			case 0xd:
+			case 0xe: /* CALL */
+			case 0xf:
+			{
+				uint16_t k = flash[avr_pc & 0x7fff];
+				avr_pc++;
+				if (op & 0x01f1)
+					fatal("jump beyond 128 KB");
+				if (op & 0x0002)
+				{
+					push_pc(avr_pc);
+					cycles = 4;
+				}
+				else
+					cycles = 3;
+				avr_pc = k;
+				break;
+			}
+			default:
+				fatal("unknown instruction");
+			}
+			break;
+		}
+		if ((op & 0x0e00) == 0x0600)
+		{
+			/* ADIW, SBIW */
+			unsigned rd = 24 + ((op >> 3) & 6);
+			uint8_t k = (op & 0x0f) | ((op >> 2) & 0x30);
+			uint16_t v = reg16(rd);
+			uint16_t res = (op & 0x0100) ? v - k : v + k;
+			int c;
+			int ov;
+
+			if (op & 0x0100)
+			{
+				ov = (v & 0x8000) && !(res & 0x8000);
+				c = (res & 0x8000) && !(v & 0x8000);
+			}
+			else
+			{
+				ov = !(v & 0x8000) && (res & 0x8000);
+				c = !(res & 0x8000) && (v & 0x8000);
+			}
+			set_reg16(rd, res);
+			flags(AVR_S | AVR_V | AVR_N | AVR_Z | AVR_C,
+			      (nzs(res >> 8, ov) & ~AVR_Z) | (res ? 0 : AVR_Z) | (c ? AVR_C : 0));
+			cycles = 2;
+			break;
+		}
+		if ((op & 0x0c00) == 0x0800)
+		{
+			/* CBI, SBIC, SBI, SBIS on the lower 32 I/O registers */
+			uint16_t addr = 0x20 + ((op >> 3) & 0x1f);
+			uint8_t bit = 1 << (op & 7);
+
+			switch ((op >> 8) & 3)
+			{
+			case 0:
+				avr_write(addr, avr_read(addr) & ~bit);
+				cycles = 2;
+				break;
+			case 1:
+				cycles = skip(!(avr_read(addr) & bit));
+				break;
+			case 2:
+				avr_write(addr, avr_read(addr) | bit);
+				cycles = 2;
+				break;
+			case 3:
+				cycles = skip(avr_read(addr) & bit);
+				break;
+			}
+			break;
+		}
+		/* MUL */
+		set_product(R[d] * R[r], (R[d] * R[r]) & 0x8000);
+		cycles = 2;
+		break;
+	case 0xb: /* IN, OUT */
+	{
+		uint16_t addr = 0x20 + ((op & 0x0f) | ((op >> 5) & 0x30));
+
+		if (op & 0x0800)
+			avr_write(addr, R[d]);
+		else
+			R[d] = avr_read(addr);
+		break;
+	}
+	case 0xc: /* RJMP */
+	case 0xd: /* RCALL */
+	{
+		int16_t k = (int16_t)(op << 4) >> 4;
+		if (op & 0x1000)
+		{
+			push_pc(avr_pc);
+			cycles = 3;
+		}
+		else
+			cycles = 2;
+		avr_pc += k;
+		break;
+	}
+	case 0xe: /* LDI */
+		R[16 + ((op >> 4) & 0x0f)] = (op & 0x0f) | ((op >> 4) & 0xf0);
+		break;
+	case 0xf:
+		if (!(op & 0x0800))
+		{
+			/* BRBS, BRBC */
+			int set = !(SREG & (1 << (op & 7))) == !!(op & 0x0400);
+			if (set)
+			{
+				avr_pc += (int8_t)((op >> 2) & 0xfe) >> 1;
+				cycles = 2;
+			}
+		}
+		else if (!(op & 0x0008))
+		{
+			uint8_t bit = 1 << (op & 7);
+			switch ((op >> 9) & 3)
+			{
+			case 0: /* BLD */
+				R[d] = (SREG & AVR_T) ? R[d] | bit : R[d] & ~bit;
+				break;
+			case 1: /* BST */
+				flags(AVR_T, (R[d] & bit) ? AVR_T : 0);
+				break;
+			case 2: /* SBRC */
+				cycles = skip(!(R[d] & bit));
+				break;
+			case 3: /* SBRS */
+				cycles = skip(R[d] & bit);
+				break;
+			}
+		}
+		else
+			fatal("unknown instruction");
+		break;
+	}
+
+done:
+	irq_hold = hold;
+	avr_cycles += cycles;
+	return cycles;
+}
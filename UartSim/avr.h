@@ -0,0 +1,87 @@
+/*
+ * Instruction level model of a classic megaAVR core (ATmega8, ATmega32,
+ * ATmega128): up to 64 KB of flash, 16 bit PC, no EIND or RAMPZ. It runs the flash
+ * image of an ELF file built by avr-gcc and counts cycles the way the
+ * instruction set manual gives them for these parts.
+ *
+ * The I/O space is plain memory unless the peripheral model hooks an
+ * address. SREG and SP belong to the core.
+ */
+#ifndef AVR_CORE_H
+#define AVR_CORE_H
+
+#include <stdint.h>
+
+#define AVR_NO_SYMBOL 0xffffffffUL
+
+/* data addresses of the core registers */
+#define AVR_SPL 0x5d
+#define AVR_SPH 0x5e
+#define AVR_SREG 0x5f
+
+/* SREG */
+#define AVR_C 0x01
+#define AVR_Z 0x02
+#define AVR_N 0x04
+#define AVR_V 0x08
+#define AVR_S 0x10
+#define AVR_H 0x20
+#define AVR_T 0x40
+#define AVR_I 0x80
+
+struct avr_mcu
+{
+	const char* name;
+	uint32_t flash;        /* bytes */
+	uint16_t ramend;
+	uint8_t vector_words;  /* 1: RJMP table, 2: JMP table */
+	uint8_t vect_timer0_ovf;
+	uint8_t vect_spi;
+	uint8_t vect_rxc;
+	uint8_t vect_udre;
+	uint8_t vect_txc;
+	uint8_t mcucr_se;      /* sleep enable bit */
+};
+
+typedef uint8_t (*avr_read_hook)(uint16_t addr);
+typedef void (*avr_write_hook)(uint16_t addr, uint8_t value);
+/* the lowest pending vector number, 0 if there is none */
+typedef uint8_t (*avr_irq_hook)(void);
+/* called when a vector is taken, clears flags the hardware clears there */
+typedef void (*avr_ack_hook)(uint8_t vector);
+
+extern const struct avr_mcu* avr_mcu;
+extern uint64_t avr_cycles;
+extern uint16_t avr_pc;         /* word address */
+extern uint8_t avr_mem[0x10000];
+extern int avr_sleeping;
+extern int avr_depth;           /* interrupt handlers entered and not left with RETI */
+extern uint16_t avr_sp_min;     /* lowest SP seen */
+
+const struct avr_mcu* avr_find_mcu(const char* name);
+/* loads the flash image and the symbols, exits on errors */
+void avr_load(const struct avr_mcu* mcu, const char* path);
+/* symbol value with the 0x800000 data offset removed, AVR_NO_SYMBOL if missing */
+uint32_t avr_symbol(const char* name);
+void avr_hook(uint16_t addr, avr_read_hook read, avr_write_hook write);
+void avr_irq_hooks(avr_irq_hook pending, avr_ack_hook ack);
+void avr_reset(void);
+
+/* runs one instruction, or takes an interrupt; returns the cycles it took */
+unsigned avr_step(void);
+/* the instruction to run next may be interrupted */
+int avr_irq_allowed(void);
+/* the main line spends cycles in code that is not modelled, the way a
+   stall of the bench does; interrupts are not held back afterwards */
+void avr_skip(uint64_t cycles);
+
+uint8_t avr_read(uint16_t addr);
+void avr_write(uint16_t addr, uint8_t value);
+uint16_t avr_read16(uint16_t addr);
+
+static inline uint16_t avr_sp(void)
+{
+	return avr_mem[AVR_SPL] | (avr_mem[AVR_SPH] << 8);
+}
+
+#endif /* AVR_CORE_H */
@@ -0,0 +1,147 @@
+/*
+ * fmtbench - runs fmt_benchmark() of fmt.c on the core in avr.cpp.
+ *
+ * usage: fmtbench [-M mcu] program.elf
+ *
+ * program.elf is app_fmt.c built with avr-gcc and -DFMT_BENCHMARK. It
+ * sends what fmt_benchmark() prints to UDR and goes to sleep when it is
+ * done. Timer 1 counts at clk/1 the way fmt_benchmark() sets it up, the
+ * 16 bit accesses to TCNT1 go through the TEMP register as on the part.
+ * The output is copied to stdout.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "avr.h"
+
+/* data addresses, the same on the ATmega8 and ATmega32 */
+#define UDR 0x2c
+#define TCNT1L 0x4c
+#define TCNT1H 0x4d
+#define TCCR1B 0x4e
+
+#define CS1_MASK 0x07
+#define CS1_CLK 0x01
+
+static uint64_t t1_base;     /* avr_cycles at which TCNT1 was 0 */
+static uint16_t t1_stopped;  /* TCNT1 while the timer does not run */
+static uint8_t t1_temp;
+
+static int t1_running(void)
+{
+	return (avr_mem[TCCR1B] & CS1_MASK) == CS1_CLK;
+}
+
+static uint16_t t1_count(void)
+{
+	return t1_running() ? (uint16_t)(avr_cycles - t1_base) : t1_stopped;
+}
+
+static void t1_set(uint16_t value)
+{
+	t1_stopped = value;
+	t1_base = avr_cycles - value;
+}
+
+static uint8_t tcnt1_read(uint16_t addr)
+{
+	uint16_t count = t1_count();
+
+	/* the low byte latches the high byte */
+	if (addr == TCNT1L)
+	{
+		t1_temp = count >> 8;
+		return count & 0xff;
+	}
+	return t1_temp;
+}
+
+static void tcnt1_write(uint16_t addr, uint8_t value)
+{
+	/* the high byte waits in TEMP for the low byte */
+	if (addr == TCNT1H)
+		t1_temp = value;
+	else
+		t1_set(value | (t1_temp << 8));
+}
+
+static void tccr1b_write(uint16_t addr, uint8_t value)
+{
+	uint16_t count = t1_count();
+
+	avr_mem[addr] = value;
+	t1_set(count);
+	if ((value & CS1_MASK) > CS1_CLK)
+	{
+		fprintf(stderr, "timer 1 only runs at clk/1 here\n");
+		exit(2);
+	}
+}
+
+static void udr_write(uint16_t addr, uint8_t value)
+{
+	(void)addr;
+	putchar(value);
+}
+
+static uint8_t no_irq(void)
+{
+	return 0;
+}
+
+static void no_ack(uint8_t vector)
+{
+	(void)vector;
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "usage: %s [-M mcu] program.elf\n", name);
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	const struct avr_mcu* mcu = avr_find_mcu("atmega32");
+	int opt;
+
+	while ((opt = getopt(argc, argv, "M:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'M':
+			/* the timer and UDR addresses are those of the ATmega8/ATmega32 */
+			mcu = avr_find_mcu(optarg);
+			if (!mcu || (strcmp(optarg, "atmega8") && strcmp(optarg, "atmega32")))
+			{
+				fprintf(stderr, "%s: unknown mcu %s\n", argv[0], optarg);
+				return 2;
+			}
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	avr_load(mcu, argv[optind]);
+	avr_hook(UDR, NULL, udr_write);
+	avr_hook(TCNT1L, tcnt1_read, tcnt1_write);
+	avr_hook(TCNT1H, tcnt1_read, tcnt1_write);
+	avr_hook(TCCR1B, NULL, tccr1b_write);
+	avr_irq_hooks(no_irq, no_ack);
+
+	/* interrupts are never enabled, the program sleeps for good at the end */
+	while (avr_step())
+	{
+		if (avr_cycles > 100000000)
+		{
+			fprintf(stderr, "%s did not finish\n", argv[optind]);
+			return 2;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,446 @@
+/*
+ * sd - SPI and SD card model for uartsim, see sd.h.
+ *
+ * A byte written to SPDR comes back from the card 8 SPI clocks later.
+ * The card answers each byte with what it had queued before it saw the
+ * byte, like the real shift register exchange: 0xff when it has nothing
+ * to say, 0x00 while a block write keeps it busy.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "avr.h"
+#include "sd.h"
+
+#define SD_NEVER UINT64_MAX
+
+/* SPI registers, the same data addresses on the ATmega8 and ATmega32 */
+#define SPCR 0x2d
+#define SPSR 0x2e
+#define SPDR 0x2f
+#define PORTB 0x38
+
+#define SPCR_SPIE 0x80
+#define SPCR_SPE 0x40
+#define SPCR_MSTR 0x10
+#define SPSR_SPIF 0x80
+#define SPSR_WCOL 0x40
+#define SPSR_SPI2X 0x01
+#define CS_BIT 0x04
+
+/* card image */
+#define CARD_BLOCKS 131072UL
+#define PART_START 63UL
+#define CLUSTER_BLOCKS 4
+#define FAT_COPIES 2
+#define ROOT_ENTRIES 512
+
+/* R1 */
+#define R1_IDLE 0x01
+#define R1_ILLEGAL 0x04
+#define R1_ADDRESS 0x20
+#define R1_PARAMETER 0x40
+
+/* bytes of 0xff before the data token of a read */
+#define READ_DELAY 8
+/* SEND_OP_COND calls before the card leaves the idle state */
+#define INIT_POLLS 3
+
+enum card_state
+{
+	CARD_COMMAND,
+	CARD_WRITE_TOKEN,
+	CARD_WRITE_DATA
+};
+
+struct sd_stats sd_stats;
+
+static uint8_t* card;
+static uint64_t cfg_busy;
+static uint32_t cfg_every;
+static uint64_t cfg_stall;
+
+/* SPI */
+static uint8_t spsr;
+static uint8_t spdr_in;
+static uint8_t spdr_out;
+static uint64_t spi_end = SD_NEVER;
+
+/* card */
+static enum card_state state;
+static uint8_t command[6];
+static unsigned command_len;
+static uint8_t queue[4 + READ_DELAY + 1 + 512 + 2];
+static unsigned queue_head;
+static unsigned queue_len;
+static int idle = 1;
+static unsigned init_polls;
+static uint32_t write_address;
+static unsigned write_len;
+static uint64_t busy_until;
+
+static uint32_t get16(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+	return get16(p) | (get16(p + 2) << 16);
+}
+
+static void put16(uint8_t* p, uint32_t value)
+{
+	p[0] = value & 0xff;
+	p[1] = (value >> 8) & 0xff;
+}
+
+static void put32(uint8_t* p, uint32_t value)
+{
+	put16(p, value);
+	put16(p + 2, value >> 16);
+}
+
+static void format(void)
+{
+	uint32_t blocks = CARD_BLOCKS - PART_START;
+	uint32_t fat_blocks = ((blocks / CLUSTER_BLOCKS + 2) * 2 + 511) / 512;
+	uint8_t* mbr = card;
+	uint8_t* bs = card + PART_START * 512;
+	int i;
+
+	memset(card, 0, CARD_BLOCKS * 512);
+
+	mbr[0x1be + 4] = 0x06;
+	put32(mbr + 0x1be + 8, PART_START);
+	put32(mbr + 0x1be + 12, blocks);
+	mbr[510] = 0x55;
+	mbr[511] = 0xaa;
+
+	memcpy(bs, "\xeb\x3c\x90" "MSDOS5.0", 11);
+	put16(bs + 11, 512);
+	bs[13] = CLUSTER_BLOCKS;
+	put16(bs + 14, 1);
+	bs[16] = FAT_COPIES;
+	put16(bs + 17, ROOT_ENTRIES);
+	bs[21] = 0xf8;
+	put16(bs + 22, fat_blocks);
+	put16(bs + 24, 63);
+	put16(bs + 26, 255);
+	put32(bs + 28, PART_START);
+	put32(bs + 32, blocks);
+	memcpy(bs + 0x36, "FAT16   ", 8);
+	bs[510] = 0x55;
+	bs[511] = 0xaa;
+
+	for (i = 0; i < FAT_COPIES; i++)
+	{
+		uint8_t* fat = bs + 512 + i * fat_blocks * 512;
+		put16(fat, 0xfff8);
+		put16(fat + 2, 0xffff);
+	}
+}
+
+/* ---- card */
+
+static void respond(uint8_t b)
+{
+	queue[(queue_head + queue_len++) % sizeof(queue)] = b;
+}
+
+static void execute(void)
+{
+	/* a byte address, big endian on the wire */
+	uint32_t arg = ((uint32_t)command[1] << 24) | ((uint32_t)command[2] << 16) | (command[3] << 8) | command[4];
+	uint8_t r1 = idle ? R1_IDLE : 0;
+
+	/* one byte of nothing before the response */
+	respond(0xff);
+	switch (command[0] & 0x3f)
+	{
+	case 0: /* GO_IDLE_STATE */
+		idle = 1;
+		init_polls = 0;
+		respond(R1_IDLE);
+		break;
+	case 1: /* SEND_OP_COND */
+		if (++init_polls >= INIT_POLLS)
+			idle = 0;
+		respond(idle ? R1_IDLE : 0);
+		break;
+	case 13: /* SEND_STATUS, R2 */
+		respond(r1);
+		respond(0);
+		break;
+	case 16: /* SET_BLOCKLEN */
+		respond(arg == 512 ? r1 : r1 | R1_PARAMETER);
+		break;
+	case 17: /* READ_SINGLE_BLOCK */
+		if (idle || (arg & 511) || arg >= CARD_BLOCKS * 512)
+		{
+			respond(r1 | (idle ? R1_ILLEGAL : R1_ADDRESS));
+			break;
+		}
+		respond(0);
+		for (int i = 0; i < READ_DELAY; i++)
+			respond(0xff);
+		respond(0xfe);
+		for (int i = 0; i < 512; i++)
+			respond(card[arg + i]);
+		respond(0xff);
+		respond(0xff);
+		sd_stats.reads++;
+		break;
+	case 24: /* WRITE_BLOCK */
+		if (idle || (arg & 511) || arg >= CARD_BLOCKS * 512)
+		{
+			respond(r1 | (idle ? R1_ILLEGAL : R1_ADDRESS));
+			break;
+		}
+		respond(0);
+		write_address = arg;
+		state = CARD_WRITE_TOKEN;
+		break;
+	default:
+		respond(r1 | R1_ILLEGAL);
+		break;
+	}
+}
+
+static uint8_t card_out(void)
+{
+	uint8_t b;
+
+	if (queue_len)
+	{
+		b = queue[queue_head];
+		queue_head = (queue_head + 1) % sizeof(queue);
+		queue_len--;
+		return b;
+	}
+	if (avr_cycles < busy_until)
+		return 0x00;
+	return 0xff;
+}
+
+static void card_in(uint8_t b)
+{
+	switch (state)
+	{
+	case CARD_COMMAND:
+		/* a command starts with 01 in the top bits */
+		if (!command_len && (b & 0xc0) != 0x40)
+			break;
+		command[command_len++] = b;
+		if (command_len == sizeof(command))
+		{
+			command_len = 0;
+			execute();
+		}
+		break;
+	case CARD_WRITE_TOKEN:
+		if (b == 0xfe)
+		{
+			state = CARD_WRITE_DATA;
+			write_len = 0;
+		}
+		break;
+	case CARD_WRITE_DATA:
+		/* 512 data bytes and the CRC, which is not checked */
+		if (write_len < 512)
+			card[write_address + write_len] = b;
+		if (++write_len < 512 + 2)
+			break;
+		state = CARD_COMMAND;
+		sd_stats.writes++;
+		/* data accepted, then busy */
+		respond(0x05);
+		if (cfg_every && sd_stats.writes % cfg_every == 0)
+		{
+			busy_until = avr_cycles + cfg_stall;
+			sd_stats.stalls++;
+			sd_stats.busy += cfg_stall;
+		}
+		else
+		{
+			busy_until = avr_cycles + cfg_busy;
+			sd_stats.busy += cfg_busy;
+		}
+		break;
+	}
+}
+
+/* ---- SPI */
+
+static unsigned spi_divider(void)
+{
+	static const unsigned dividers[4] = { 4, 16, 64, 128 };
+	unsigned d = dividers[avr_mem[SPCR] & 3];
+
+	return (spsr & SPSR_SPI2X) ? d / 2 : d;
+}
+
+static uint8_t spsr_read(uint16_t addr)
+{
+	(void)addr;
+	return spsr;
+}
+
+static void spsr_write(uint16_t addr, uint8_t value)
+{
+	(void)addr;
+	/* SPIF and WCOL are read only */
+	spsr = (spsr & ~SPSR_SPI2X) | (value & SPSR_SPI2X);
+}
+
+static uint8_t spdr_read(uint16_t addr)
+{
+	(void)addr;
+	spsr &= ~(SPSR_SPIF | SPSR_WCOL);
+	return spdr_in;
+}
+
+static void spdr_write(uint16_t addr, uint8_t value)
+{
+	(void)addr;
+	spsr &= ~SPSR_SPIF;
+	if (!(avr_mem[SPCR] & SPCR_SPE) || !(avr_mem[SPCR] & SPCR_MSTR))
+		return;
+	if (spi_end != SD_NEVER)
+	{
+		spsr |= SPSR_WCOL;
+		sd_stats.collisions++;
+		return;
+	}
+	spdr_out = value;
+	spi_end = avr_cycles + 8 * spi_divider();
+}
+
+void sd_attach(uint64_t busy, uint32_t every, uint64_t stall)
+{
+	card = (uint8_t*)malloc(CARD_BLOCKS * 512);
+	if (!card)
+	{
+		perror("card image");
+		exit(2);
+	}
+	format();
+	cfg_busy = busy;
+	cfg_every = every;
+	cfg_stall = stall;
+	avr_hook(SPSR, spsr_read, spsr_write);
+	avr_hook(SPDR, spdr_read, spdr_write);
+}
+
+int sd_irq_pending(void)
+{
+	return (avr_mem[SPCR] & SPCR_SPIE) && (spsr & SPSR_SPIF);
+}
+
+void sd_irq_ack(void)
+{
+	spsr &= ~SPSR_SPIF;
+}
+
+uint64_t sd_next_event(void)
+{
+	return spi_end;
+}
+
+void sd_event(void)
+{
+	spi_end = SD_NEVER;
+	sd_stats.last_transfer = avr_cycles;
+	if (avr_mem[PORTB] & CS_BIT)
+	{
+		/* not selected, MISO floats high and the card ignores MOSI */
+		spdr_in = 0xff;
+		command_len = 0;
+	}
+	else
+	{
+		spdr_in = card_out();
+		card_in(spdr_out);
+	}
+	spsr |= SPSR_SPIF;
+}
+
+/* ---- reading the logs back */
+
+struct log_file
+{
+	unsigned number;
+	uint16_t cluster;
+	uint32_t size;
+};
+
+static int log_compare(const void* a, const void* b)
+{
+	return (int)((const struct log_file*)a)->number - (int)((const struct log_file*)b)->number;
+}
+
+long sd_read_logs(uint8_t* data, size_t size, unsigned* files)
+{
+	const uint8_t* bs;
+	const uint8_t* fat;
+	const uint8_t* root;
+	const uint8_t* clusters;
+	uint32_t cluster_size;
+	struct log_file logs[ROOT_ENTRIES];
+	unsigned count = 0;
+	size_t total = 0;
+	unsigned i;
+
+	*files = 0;
+	bs = card + get32(card + 0x1be + 8) * 512;
+	if (get16(bs + 11) != 512 || !bs[13])
+		return -1;
+	cluster_size = bs[13] * 512UL;
+	fat = bs + get16(bs + 14) * 512UL;
+	root = fat + bs[16] * get16(bs + 22) * 512UL;
+	clusters = root + get16(bs + 17) * 32UL;
+
+	for (i = 0; i < get16(bs + 17); i++)
+	{
+		const uint8_t* e = root + i * 32;
+		unsigned number = 0;
+		int k;
+
+		if (!e[0])
+			break;
+		/* deleted entries and long name parts */
+		if (e[0] == 0xe5 || e[11] == 0x0f || memcmp(e, "LOG", 3) || memcmp(e + 8, "TXT", 3))
+			continue;
+		for (k = 3; k < 8 && e[k] >= '0' && e[k] <= '9'; k++)
+			number = number * 10 + e[k] - '0';
+		if (k < 8)
+			continue;
+		logs[count].number = number;
+		logs[count].cluster = get16(e + 26);
+		logs[count].size = get32(e + 28);
+		count++;
+	}
+	qsort(logs, count, sizeof(logs[0]), log_compare);
+
+	for (i = 0; i < count; i++)
+	{
+		uint16_t cluster = logs[i].cluster;
+		uint32_t left = logs[i].size;
+
+		while (left && cluster >= 2 && cluster < 0xfff0)
+		{
+			uint32_t n = left < cluster_size ? left : cluster_size;
+			if (total + n > size)
+				return -1;
+			memcpy(data + total, clusters + (cluster - 2) * cluster_size, n);
+			total += n;
+			left -= n;
+			cluster = get16(fat + cluster * 2);
+		}
+		if (left)
+			return -1;
+	}
+	*files = count;
+	return total;
+}
@@ -0,0 +1,45 @@
+/*
+ * SPI master of the ATmega8/ATmega32 with an SD card in SPI mode behind
+ * it, selected by PB2 low as WriteToSdUART wires it.
+ *
+ * The card holds a 64 MB image with an MBR and one freshly formatted
+ * FAT16 partition. It answers the commands sd_raw.c sends: GO_IDLE_STATE,
+ * SEND_OP_COND, SET_BLOCKLEN, SEND_STATUS, READ_SINGLE_BLOCK and
+ * WRITE_BLOCK, the last one followed by the busy time the bench asks for.
+ */
+#ifndef SD_H
+#define SD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct sd_stats
+{
+	uint32_t reads;          /* READ_SINGLE_BLOCK */
+	uint32_t writes;         /* WRITE_BLOCK */
+	uint32_t stalls;         /* writes that got the long busy time */
+	uint32_t collisions;     /* SPDR written during a transfer */
+	uint64_t busy;           /* cycles the card was busy writing */
+	uint64_t last_transfer;  /* cycle count at the end of the last byte */
+};
+
+extern struct sd_stats sd_stats;
+
+/* hooks SPCR, SPSR and SPDR and formats the card; every block write keeps
+   the card busy for busy cycles, every every-th one for stall cycles */
+void sd_attach(uint64_t busy, uint32_t every, uint64_t stall);
+
+/* SPIF with SPIE set, and the flag clearing of the SPI_STC vector */
+int sd_irq_pending(void);
+void sd_irq_ack(void);
+
+/* end of the SPI transfer in progress, UINT64_MAX if there is none */
+uint64_t sd_next_event(void);
+void sd_event(void);
+
+/* contents of the LOGnnnnn.TXT files in the root directory, joined in
+   the order of their numbers; returns the byte count, -1 if the file
+   system can not be read */
+long sd_read_logs(uint8_t* data, size_t size, unsigned* files);
+
+#endif /* SD_H */
@@ -0,0 +1,1188 @@
+/*
+ * uartsim - throughput and latency bench for the AVR UART drivers.
+ *
+ * usage: uartsim [-M mcu] [-f F_CPU] [-b baud] [-l load] [-n bytes]
+ *                [-s period_us:len_us[:cli]]... [-c [-w busy_us[:every:stall_us]]]
+ *                [-r period_us:len_us] [-m lost] [-p [-t seconds]] program.elf
+ *
+ * program.elf is built with avr-gcc and runs instruction by instruction
+ * on the core in avr.cpp, an ATmega32 unless -M names another part, at
+ * F_CPU (7372800 by default). Around the core sit the USART (two byte
+ * receive FIFO with DOR, UDR plus shift register on transmit, TXC, FE
+ * when the baud rate is too far off), timer 0 in normal mode and, with
+ * -c, the SPI port with an SD card behind it (sd.h). Cycle counts, ISR
+ * costs and stack use are those of the real code.
+ *
+ * Without -p a generator sends -n bytes at -l percent of the line rate;
+ * with -p the RX and TX lines are connected to a PTY whose name is
+ * printed, and virtual time is paced to the wall clock.
+ *
+ * An echo program (app_*.c, see sim.h) passes every byte it receives to
+ * sim_deliver() and sends it back; the run ends once the echo has
+ * drained. With -c the program is a logger such as WriteToSdUART that
+ * writes what it receives to LOGnnnnn.TXT on the card. Its run ends when
+ * the card has been idle for a second after the last byte, and what was
+ * sent is compared with the files read back from the card. -w sets the
+ * busy time after each block write, 500 us by default, and optionally a
+ * longer one for every every-th write.
+ *
+ * -s stalls the main line for len_us every period_us: it executes
+ * nothing, but interrupts are still taken unless ":cli" is given (up to
+ * 4 patterns). Like a long call from the main loop, a stall waits for
+ * the program to leave its critical sections before it starts.
+ *
+ * -r makes the peer of a program with RTS/CTS hold CTS high for len_us
+ * every period_us, as a peer that is busy now and then.
+ *
+ * With -m the exit status is 1 when more than that many bytes were lost,
+ * or when an echo program stopped before it had passed on all bytes, for
+ * use in CI.
+ */
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "avr.h"
+#include "sd.h"
+#include "sim.h"
+
+#define SIM_NEVER UINT64_MAX
+#define SIM_MAX_STALLS 4
+#define SIM_FIFO_SIZE 65536
+#define SIM_MAX_DEPTH 8
+#define SIM_MAX_VECTORS 32
+#define SIM_LOG_SIZE (4UL << 20)
+
+/* data addresses, the same on the ATmega8 and ATmega32 */
+#define UBRRL 0x29
+#define UCSRB 0x2a
+#define UCSRA 0x2b
+#define UDR 0x2c
+#define UBRRH 0x40
+#define TCNT0 0x52
+#define TCCR0 0x53
+#define TIFR 0x58
+#define TIMSK 0x59
+
+/* UCSRA */
+#define A_RXC 0x80
+#define A_TXC 0x40
+#define A_UDRE 0x20
+#define A_FE 0x10
+#define A_DOR 0x08
+#define A_U2X 0x02
+#define A_MPCM 0x01
+/* UCSRB */
+#define B_RXCIE 0x80
+#define B_TXCIE 0x40
+#define B_UDRIE 0x20
+#define B_RXEN 0x10
+#define B_TXEN 0x08
+#define B_UCSZ2 0x04
+/* UCSRC */
+#define C_URSEL 0x80
+#define C_UPM1 0x20
+#define C_USBS 0x08
+/* TIMSK, TIFR */
+#define TOIE0 0x01
+#define TOV0 0x01
+
+#define XON 0x11
+#define XOFF 0x13
+
+struct stall
+{
+	uint64_t period;
+	uint64_t length;
+	uint64_t next;
+	int cli;
+};
+
+struct level
+{
+	int max;
+	double sum;
+};
+
+struct latency
+{
+	uint64_t count;
+	double sum;
+	uint64_t max;
+};
+
+struct vect_stats
+{
+	uint64_t calls;
+	uint64_t cycles;
+	uint64_t min;
+	uint64_t max;
+};
+
+/* an interrupt handler being run */
+struct frame
+{
+	uint8_t vector;
+	uint64_t start;
+};
+
+/* a byte on its way through the driver, matched by value */
+struct mark
+{
+	uint8_t value;
+	uint64_t time;
+};
+
+struct fifo
+{
+	struct mark m[SIM_FIFO_SIZE];
+	unsigned head;
+	unsigned tail;
+};
+
+/* configuration */
+static uint32_t cfg_f_cpu = 7372800;
+static uint32_t cfg_baud = 115200;
+static unsigned cfg_load = 100;
+static uint32_t cfg_bytes = 100000;
+static struct stall stalls[SIM_MAX_STALLS];
+static int stall_count;
+static int cfg_card;
+static double cfg_busy_us = 500;
+static uint32_t cfg_stall_every;
+static double cfg_stall_us;
+static int cfg_pty;
+static double cfg_seconds;
+static long cfg_max_lost = -1;
+static double cfg_cts_period;
+static double cfg_cts_len;
+
+/* program */
+static const char* program;
+static uint32_t deliver_pc = AVR_NO_SYMBOL;
+static uint32_t brkval_addr = AVR_NO_SYMBOL;
+static struct sim_info info;
+static uint64_t stall_until;
+static uint64_t cts_period;
+static uint64_t cts_len;
+static int stall_cli;
+static uint8_t acked_vector;
+static struct frame frames[SIM_MAX_DEPTH];
+
+/* usart */
+static uint8_t ucsra = A_UDRE;
+static uint8_t ucsrb;
+static uint8_t ucsrc = C_URSEL | 0x06;
+static uint8_t ubrrh;
+static uint8_t ubrrl;
+static uint8_t rx_fifo[2];
+static uint8_t rx_fe[2];
+static int rx_count;
+static int rx_dor;
+static uint8_t udr_last;
+static int tx_busy;
+static uint8_t tx_shift;
+static int tx_hold_full;
+static uint8_t tx_hold;
+static uint64_t tx_end = SIM_NEVER;
+static int txc;
+
+/* timer 0 */
+static unsigned timer_prescale;
+static uint8_t timer_count;
+static uint64_t timer_base;
+static uint64_t timer_ovf = SIM_NEVER;
+static int tov0;
+
+/* peer on the other end of the line */
+static uint64_t rx_next = SIM_NEVER;
+static uint64_t peer_frame;
+static uint64_t peer_interval;
+static int peer_fe;
+static uint32_t peer_sent;
+static int peer_xoff;
+static uint64_t peer_held_since = SIM_NEVER;
+static uint64_t peer_held;
+static uint64_t peer_last_sent;
+static uint8_t pty_queue[4096];
+static unsigned pty_head;
+static unsigned pty_tail;
+static int pty_fd = -1;
+static volatile sig_atomic_t stop;
+
+/* results */
+static uint64_t accepted;
+static uint64_t delivered;
+static uint64_t echoed;
+static uint64_t hw_overruns;
+static uint64_t frame_errors;
+static uint64_t tx_collisions;
+static uint64_t pty_dropped;
+static uint64_t unmatched;
+static uint64_t flow_chars;
+static struct level rx_level;
+static struct level tx_level;
+static uint64_t level_samples;
+static struct latency rx_latency;
+static struct latency echo_latency;
+static struct vect_stats vect_stats[SIM_MAX_VECTORS];
+static struct fifo arrivals;
+static struct fifo echoes;
+static uint16_t heap_top;
+static char said[256];
+static unsigned said_len;
+
+static double host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t cycles(double us)
+{
+	return us * cfg_f_cpu / 1e6;
+}
+
+static double us(double cycles)
+{
+	return cycles * 1e6 / cfg_f_cpu;
+}
+
+static void fifo_push(struct fifo* f, uint8_t value, uint64_t time)
+{
+	if (f->head - f->tail == SIM_FIFO_SIZE)
+		f->tail++;
+	f->m[f->head % SIM_FIFO_SIZE].value = value;
+	f->m[f->head % SIM_FIFO_SIZE].time = time;
+	f->head++;
+}
+
+/* drop marks up to the one with this value, those bytes got lost on the way */
+static int fifo_match(struct fifo* f, uint8_t value, uint64_t* time)
+{
+	unsigned i;
+
+	for (i = f->tail; i != f->head; i++)
+	{
+		if (f->m[i % SIM_FIFO_SIZE].value == value)
+		{
+			*time = f->m[i % SIM_FIFO_SIZE].time;
+			f->tail = i + 1;
+			return 1;
+		}
+	}
+	unmatched++;
+	return 0;
+}
+
+static void latency_add(struct latency* l, uint64_t cycles)
+{
+	l->count++;
+	l->sum += cycles;
+	if (cycles > l->max)
+		l->max = cycles;
+}
+
+static void level_add(struct level* l, int n)
+{
+	if (n > l->max)
+		l->max = n;
+	l->sum += n;
+}
+
+/* bytes in a ringbuffer of the driver, -1 if it has none */
+static int ring_level(uint16_t head, uint16_t tail, uint16_t size)
+{
+	if (!head)
+		return -1;
+	if (info.index_size == 2)
+		return (avr_read16(head) - avr_read16(tail)) & (size - 1);
+	return (avr_mem[head] - avr_mem[tail]) & (size - 1);
+}
+
+static unsigned frame_bits(void)
+{
+	unsigned bits = 1 + 5 + ((ucsrc >> 1) & 3) + 1;
+
+	if (ucsrb & B_UCSZ2)
+		bits = 1 + 9 + 1;
+	if (ucsrc & C_UPM1)
+		bits++;
+	if (ucsrc & C_USBS)
+		bits++;
+	return bits;
+}
+
+static uint32_t uart_divider(void)
+{
+	return ((ucsra & A_U2X) ? 8 : 16) * ((((uint32_t)ubrrh << 8) | ubrrl) + 1);
+}
+
+static uint64_t uart_frame(void)
+{
+	return (uint64_t)frame_bits() * uart_divider();
+}
+
+/* ---- the peer */
+
+static int peer_pending(void)
+{
+	if (cfg_pty)
+		return pty_head != pty_tail;
+	return peer_sent < cfg_bytes;
+}
+
+/* held by RTS high or by XOFF */
+static int peer_stopped(void)
+{
+	return peer_xoff || (info.rts_mask && (avr_mem[info.rts_port] & info.rts_mask));
+}
+
+static uint8_t peer_take(void)
+{
+	if (cfg_pty)
+		return pty_queue[pty_tail++ % sizeof(pty_queue)];
+	/* printable, so that no driver treats it as CR or XON/XOFF */
+	return 0x20 + peer_sent++ % 200;
+}
+
+static void peer_start(void)
+{
+	if (rx_next != SIM_NEVER || !peer_pending())
+		return;
+	if (peer_stopped())
+	{
+		if (peer_held_since == SIM_NEVER)
+			peer_held_since = avr_cycles;
+		return;
+	}
+	if (peer_held_since != SIM_NEVER)
+	{
+		peer_held += avr_cycles - peer_held_since;
+		peer_held_since = SIM_NEVER;
+	}
+	rx_next = avr_cycles + peer_frame;
+}
+
+/* RTS is a port pin the program drives; CTS reads low, the peer always
+   takes what it is sent */
+static void rts_write(uint16_t addr, uint8_t value)
+{
+	avr_mem[addr] = value;
+	peer_start();
+}
+
+/* CTS reads high for the last cts_len cycles of each period */
+static uint8_t cts_read(uint16_t addr)
+{
+	if (avr_cycles % cts_period >= cts_period - cts_len)
+		return avr_mem[addr] | info.cts_mask;
+	return avr_mem[addr] & ~info.cts_mask;
+}
+
+/* ---- line events */
+
+static void rx_event(void)
+{
+	uint8_t c = peer_take();
+
+	peer_last_sent = avr_cycles;
+	rx_next = SIM_NEVER;
+	if (peer_pending() && !peer_stopped())
+		rx_next = avr_cycles + (cfg_pty ? peer_frame : peer_interval);
+	else
+		peer_start();
+
+	level_add(&rx_level, ring_level(info.rx_head, info.rx_tail, info.rx_size));
+	level_add(&tx_level, ring_level(info.tx_head, info.tx_tail, info.tx_size));
+	level_samples++;
+
+	if (!(ucsrb & B_RXEN))
+		return;
+	if (rx_count == 2)
+	{
+		/* the third byte, the one in the shift register, is lost */
+		rx_dor = 1;
+		hw_overruns++;
+		return;
+	}
+	rx_fifo[rx_count] = c;
+	rx_fe[rx_count] = peer_fe;
+	rx_count++;
+	if (peer_fe)
+		frame_errors++;
+	accepted++;
+	fifo_push(&arrivals, c, avr_cycles);
+}
+
+static void tx_event(void)
+{
+	uint64_t t;
+
+	if (info.xonxoff && (tx_shift == XON || tx_shift == XOFF))
+	{
+		/* for the peer, not part of the echo */
+		flow_chars++;
+		peer_xoff = tx_shift == XOFF;
+		peer_start();
+	}
+	else if (deliver_pc == AVR_NO_SYMBOL)
+	{
+		/* a logger reports in text */
+		if (said_len < sizeof(said) - 1)
+			said[said_len++] = tx_shift;
+	}
+	else
+	{
+		echoed++;
+		if (fifo_match(&echoes, tx_shift, &t))
+			latency_add(&echo_latency, avr_cycles - t);
+	}
+	if (pty_fd >= 0 && write(pty_fd, &tx_shift, 1) != 1)
+		pty_dropped++;
+
+	if (tx_hold_full)
+	{
+		tx_shift = tx_hold;
+		tx_hold_full = 0;
+		tx_end += uart_frame();
+	}
+	else
+	{
+		tx_busy = 0;
+		tx_end = SIM_NEVER;
+		txc = 1;
+	}
+}
+
+/* ---- USART registers */
+
+static uint8_t udr_read(uint16_t addr)
+{
+	(void)addr;
+	if (rx_count)
+	{
+		udr_last = rx_fifo[0];
+		rx_fifo[0] = rx_fifo[1];
+		rx_fe[0] = rx_fe[1];
+		rx_count--;
+		rx_dor = 0;
+	}
+	return udr_last;
+}
+
+static void udr_write(uint16_t addr, uint8_t value)
+{
+	(void)addr;
+	if (!(ucsrb & B_TXEN))
+		return;
+	if (!tx_busy)
+	{
+		tx_shift = value;
+		tx_busy = 1;
+		tx_end = avr_cycles + uart_frame();
+	}
+	else if (!tx_hold_full)
+	{
+		tx_hold = value;
+		tx_hold_full = 1;
+	}
+	else
+		tx_collisions++;
+}
+
+static uint8_t ucsra_read(uint16_t addr)
+{
+	uint8_t value = ucsra & (A_U2X | A_MPCM);
+
+	(void)addr;
+	if (rx_count)
+		value |= A_RXC | (rx_fe[0] ? A_FE : 0);
+	if (rx_dor)
+		value |= A_DOR;
+	if (txc)
+		value |= A_TXC;
+	if (!tx_hold_full)
+		value |= A_UDRE;
+	return value;
+}
+
+static void ucsra_write(uint16_t addr, uint8_t value)
+{
+	(void)addr;
+	ucsra = value & (A_U2X | A_MPCM);
+	/* TXC is cleared by writing a one to it */
+	if (value & A_TXC)
+		txc = 0;
+}
+
+static uint8_t ucsrb_read(uint16_t addr)
+{
+	(void)addr;
+	return ucsrb;
+}
+
+static void ucsrb_write(uint16_t addr, uint8_t value)
+{
+	(void)addr;
+	ucsrb = value;
+}
+
+static uint8_t ubrr_read(uint16_t addr)
+{
+	return addr == UBRRL ? ubrrl : ubrrh;
+}
+
+static void ubrr_write(uint16_t addr, uint8_t value)
+{
+	if (addr == UBRRL)
+		ubrrl = value;
+	else if (value & C_URSEL)
+		ucsrc = value;
+	else
+		ubrrh = value & 0x0f;
+}
+
+/* ---- timer 0, normal mode */
+
+static uint8_t timer_now(void)
+{
+	if (!timer_prescale)
+		return timer_count;
+	return timer_count + (avr_cycles - timer_base) / timer_prescale;
+}
+
+static void timer_restart(uint8_t count)
+{
+	timer_count = count;
+	timer_base = avr_cycles;
+	timer_ovf = timer_prescale ? timer_base + (256 - count) * (uint64_t)timer_prescale : SIM_NEVER;
+}
+
+static void timer_event(void)
+{
+	tov0 = 1;
+	timer_count = 0;
+	timer_base = timer_ovf;
+	timer_ovf += 256 * (uint64_t)timer_prescale;
+}
+
+static uint8_t tcnt0_read(uint16_t addr)
+{
+	(void)addr;
+	return timer_now();
+}
+
+static void tcnt0_write(uint16_t addr, uint8_t value)
+{
+	(void)addr;
+	timer_restart(value);
+}
+
+static void tccr0_write(uint16_t addr, uint8_t value)
+{
+	/* clock select, the external clock inputs are not modelled */
+	static const unsigned prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+	uint8_t count = timer_now();
+
+	avr_mem[addr] = value;
+	timer_prescale = prescale[value & 7];
+	timer_restart(count);
+}
+
+static uint8_t tifr_read(uint16_t addr)
+{
+	return (avr_mem[addr] & ~TOV0) | (tov0 ? TOV0 : 0);
+}
+
+static void tifr_write(uint16_t addr, uint8_t value)
+{
+	/* flags are cleared by writing a one */
+	avr_mem[addr] &= ~value;
+	if (value & TOV0)
+		tov0 = 0;
+}
+
+/* ---- interrupts, a lower vector number wins */
+
+static uint8_t irq_pending(void)
+{
+	const struct avr_mcu* m = avr_mcu;
+
+	if ((avr_mem[TIMSK] & TOIE0) && tov0)
+		return m->vect_timer0_ovf;
+	if (cfg_card && sd_irq_pending())
+		return m->vect_spi;
+	if ((ucsrb & B_RXCIE) && rx_count)
+		return m->vect_rxc;
+	if ((ucsrb & B_UDRIE) && !tx_hold_full)
+		return m->vect_udre;
+	if ((ucsrb & B_TXCIE) && txc)
+		return m->vect_txc;
+	return 0;
+}
+
+static void irq_ack(uint8_t vector)
+{
+	const struct avr_mcu* m = avr_mcu;
+
+	acked_vector = vector;
+	if (vector == m->vect_txc)
+		txc = 0;
+	else if (vector == m->vect_timer0_ovf)
+		tov0 = 0;
+	else if (vector == m->vect_spi)
+		sd_irq_ack();
+}
+
+static const char* vector_name(uint8_t vector)
+{
+	const struct avr_mcu* m = avr_mcu;
+
+	if (vector == m->vect_timer0_ovf)
+		return "tov0";
+	if (vector == m->vect_spi)
+		return "spi";
+	if (vector == m->vect_rxc)
+		return "rxc";
+	if (vector == m->vect_udre)
+		return "udre";
+	if (vector == m->vect_txc)
+		return "txc";
+	return "?";
+}
+
+/* ---- running the program */
+
+static uint64_t next_event(void)
+{
+	uint64_t e = rx_next;
+
+	if (tx_end < e)
+		e = tx_end;
+	if (timer_ovf < e)
+		e = timer_ovf;
+	if (cfg_card && sd_next_event() < e)
+		e = sd_next_event();
+	return e;
+}
+
+static void run_event(uint64_t e)
+{
+	if (e == rx_next)
+		rx_event();
+	else if (e == tx_end)
+		tx_event();
+	else if (e == timer_ovf)
+		timer_event();
+	else
+		sd_event();
+
+	if (brkval_addr != AVR_NO_SYMBOL && avr_read16(brkval_addr) > heap_top)
+		heap_top = avr_read16(brkval_addr);
+}
+
+static void deliver(uint8_t c)
+{
+	uint64_t t;
+
+	delivered++;
+	if (fifo_match(&arrivals, c, &t))
+	{
+		latency_add(&rx_latency, avr_cycles - t);
+		fifo_push(&echoes, c, t);
+	}
+}
+
+/* one instruction or interrupt entry, returns 0 while the core sleeps */
+static unsigned step(void)
+{
+	int depth = avr_depth;
+	uint64_t start = avr_cycles;
+	uint16_t pc = avr_pc;
+	uint8_t r24 = avr_mem[24];
+	unsigned n = avr_step();
+
+	if (avr_depth > depth)
+	{
+		if (depth < SIM_MAX_DEPTH)
+		{
+			frames[depth].vector = acked_vector;
+			frames[depth].start = start;
+		}
+	}
+	else if (avr_depth < depth)
+	{
+		/* RETI, the cost counts from the interrupt response on */
+		if (avr_depth < SIM_MAX_DEPTH)
+		{
+			struct vect_stats* s = &vect_stats[frames[avr_depth].vector % SIM_MAX_VECTORS];
+			uint64_t c = avr_cycles - frames[avr_depth].start;
+			s->calls++;
+			s->cycles += c;
+			if (!s->min || c < s->min)
+				s->min = c;
+			if (c > s->max)
+				s->max = c;
+		}
+	}
+	else if (pc == deliver_pc && n)
+		deliver(r24);
+	return n;
+}
+
+/* ---- PTY */
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void pty_open(void)
+{
+	struct termios t;
+	int slave;
+
+	pty_fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (pty_fd < 0 || grantpt(pty_fd) || unlockpt(pty_fd))
+	{
+		perror("posix_openpt");
+		exit(2);
+	}
+	/* raw line, and kept open so the master does not see a hangup */
+	slave = open(ptsname(pty_fd), O_RDWR | O_NOCTTY);
+	if (slave < 0 || tcgetattr(slave, &t))
+	{
+		perror(ptsname(pty_fd));
+		exit(2);
+	}
+	cfmakeraw(&t);
+	tcsetattr(slave, TCSANOW, &t);
+	fcntl(pty_fd, F_SETFL, fcntl(pty_fd, F_GETFL) | O_NONBLOCK);
+	printf("%s on %s\n", program, ptsname(pty_fd));
+	fflush(stdout);
+}
+
+static void pty_poll(double start)
+{
+	uint8_t buf[256];
+	ssize_t n;
+	ssize_t i;
+	double ahead;
+
+	while (pty_head - pty_tail <= sizeof(pty_queue) - sizeof(buf) &&
+	       (n = read(pty_fd, buf, sizeof(buf))) > 0)
+	{
+		for (i = 0; i < n; i++)
+			pty_queue[pty_head++ % sizeof(pty_queue)] = buf[i];
+	}
+	peer_start();
+
+	/* keep virtual time in step with the wall clock */
+	ahead = (double)avr_cycles / cfg_f_cpu * 1e9 - (host_ns() - start);
+	if (ahead > 2e6)
+	{
+		struct timespec ts = { 0, (long)ahead };
+		nanosleep(&ts, NULL);
+	}
+	if (cfg_seconds > 0 && host_ns() - start > cfg_seconds * 1e9)
+		stop = 1;
+}
+
+/* ---- bench */
+
+static int line_idle(void)
+{
+	if (peer_pending() || rx_next != SIM_NEVER || rx_count)
+		return 0;
+	if (cfg_card)
+	{
+		/* the logger writes a partly filled buffer only after a quiet spell */
+		uint64_t last = peer_last_sent > sd_stats.last_transfer ? peer_last_sent : sd_stats.last_transfer;
+		return avr_cycles - last > cfg_f_cpu;
+	}
+	return ring_level(info.rx_head, info.rx_tail, info.rx_size) <= 0 && !tx_busy &&
+	       ring_level(info.tx_head, info.tx_tail, info.tx_size) <= 0;
+}
+
+/* bytes of what the generator sent that made it into the LOG files */
+static void read_card(void)
+{
+	static uint8_t logged[SIM_LOG_SIZE];
+	unsigned files;
+	long n = sd_read_logs(logged, sizeof(logged), &files);
+	uint32_t sent = 0;
+	long i;
+
+	printf("  card: %u block writes, %u reads, busy %.0f us per write", sd_stats.writes, sd_stats.reads, cfg_busy_us);
+	if (cfg_stall_every)
+		printf(", %.0f us for every %u. (%u times)", cfg_stall_us, cfg_stall_every, sd_stats.stalls);
+	printf("\n");
+	if (n < 0)
+	{
+		printf("  card: the file system could not be read back\n");
+		return;
+	}
+	printf("  card: %u LOG files, %ld bytes, %.2f block writes per 512 bytes\n",
+	       files, n, n ? sd_stats.writes * 512.0 / n : 0.0);
+	if (cfg_pty)
+	{
+		delivered = n;
+		return;
+	}
+	for (i = 0; i < n; i++)
+	{
+		/* skip what got lost, like fifo_match() */
+		while (sent < peer_sent && logged[i] != 0x20 + sent % 200)
+			sent++;
+		if (sent == peer_sent)
+		{
+			unmatched += n - i;
+			break;
+		}
+		sent++;
+		delivered++;
+	}
+}
+
+/* an echo program that stopped early, e.g. waiting on a transmitter that
+   never restarts, leaves the peer held and the line quiet */
+static int stuck(void)
+{
+	return !cfg_pty && !cfg_card && (peer_sent < cfg_bytes || echoed < delivered);
+}
+
+static void report(void)
+{
+	uint32_t dropped = info.dropped ? avr_read16(info.dropped) : 0;
+	uint64_t sent = cfg_pty ? accepted + hw_overruns : peer_sent;
+	uint64_t lost;
+	double baud = (double)cfg_f_cpu * frame_bits() / uart_frame();
+	uint32_t heap_start = avr_symbol("__heap_start");
+	int v;
+
+	printf("%s on %s at %lu Hz, baud %lu (programmed %.0f, %+.1f%%) load %u%%\n",
+	       program, avr_mcu->name, (unsigned long)cfg_f_cpu, (unsigned long)cfg_baud, baud,
+	       (baud - cfg_baud) * 100.0 / cfg_baud, cfg_load);
+	printf("  time %.3f s\n", (double)avr_cycles / cfg_f_cpu);
+	for (v = 0; v < stall_count; v++)
+		printf("  stall %.0f us every %.0f us%s\n",
+		       us(stalls[v].length), us(stalls[v].period), stalls[v].cli ? " with interrupts off" : "");
+	if (cfg_card)
+		read_card();
+	lost = sent - delivered;
+	printf("  bytes sent %llu delivered %llu", (unsigned long long)sent, (unsigned long long)delivered);
+	if (!cfg_card)
+		printf(" echoed %llu", (unsigned long long)echoed);
+	printf(" lost %llu (usart overrun %llu, driver %lu, other %lld)\n",
+	       (unsigned long long)lost, (unsigned long long)hw_overruns, (unsigned long)dropped,
+	       (long long)(lost - hw_overruns - dropped));
+	if (frame_errors || tx_collisions || pty_dropped)
+		printf("  frame errors %llu, UDR written while full %llu, PTY writes failed %llu\n",
+		       (unsigned long long)frame_errors, (unsigned long long)tx_collisions,
+		       (unsigned long long)pty_dropped);
+	if (peer_held || flow_chars)
+		printf("  peer held for %.0f us, %llu XON/XOFF\n", us(peer_held), (unsigned long long)flow_chars);
+	if (cfg_cts_period)
+		printf("  CTS held high %.0f us every %.0f us\n", cfg_cts_len, cfg_cts_period);
+	if (stuck())
+		printf("  stopped after %llu of %lu bytes, %llu echoed\n", (unsigned long long)peer_sent,
+		       (unsigned long)cfg_bytes, (unsigned long long)echoed);
+	if (level_samples && info.rx_head)
+		printf("  rx ring max %d/%d mean %.1f\n", rx_level.max, info.rx_size - 1, rx_level.sum / level_samples);
+	if (level_samples && info.tx_head)
+		printf("  tx ring max %d/%d mean %.1f\n", tx_level.max, info.tx_size - 1, tx_level.sum / level_samples);
+	for (v = 0; v < SIM_MAX_VECTORS; v++)
+	{
+		struct vect_stats* s = &vect_stats[v];
+		if (!s->calls)
+			continue;
+		printf("  isr %-4s %llu calls, %.1f cycles (min %llu, max %llu), %.1f%% cpu\n",
+		       vector_name(v), (unsigned long long)s->calls, (double)s->cycles / s->calls,
+		       (unsigned long long)s->min, (unsigned long long)s->max, s->cycles * 100.0 / avr_cycles);
+	}
+	if (rx_latency.count)
+		printf("  latency rx->app mean %.0f us max %.0f us\n",
+		       us(rx_latency.sum / rx_latency.count), us(rx_latency.max));
+	if (echo_latency.count)
+		printf("  latency rx->echo out mean %.0f us max %.0f us\n",
+		       us(echo_latency.sum / echo_latency.count), us(echo_latency.max));
+	if (unmatched)
+		printf("  %llu bytes came out that never went in\n", (unsigned long long)unmatched);
+	if (heap_start != AVR_NO_SYMBOL)
+	{
+		uint16_t top = heap_top > heap_start ? heap_top : heap_start;
+		printf("  ram: static %lu bytes, heap %u, lowest stack pointer 0x%03x, %d bytes never used\n",
+		       (unsigned long)(heap_start - 0x60), top - heap_start, avr_sp_min, avr_sp_min + 1 - top);
+	}
+	if (said_len)
+	{
+		said[said_len] = 0;
+		printf("  program said: ");
+		for (v = 0; v < (int)said_len; v++)
+			if (said[v] >= ' ')
+				putchar(said[v]);
+			else if (said[v] == '\n')
+				printf(" / ");
+		printf("\n");
+	}
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr,
+	        "usage: %s [-M mcu] [-f F_CPU] [-b baud] [-l load%%] [-n bytes] [-s period_us:len_us[:cli]]...\n"
+	        "       [-c [-w busy_us[:every:stall_us]]] [-r period_us:len_us] [-m max_lost] [-p [-t seconds]] program.elf\n",
+	        name);
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	const struct avr_mcu* mcu = avr_find_mcu("atmega32");
+	double start = 0;
+	uint64_t deadline;
+	uint64_t idle_since = 0;
+	uint64_t check_at = 0;
+	uint64_t enabled_at = 0;
+	int uses_irq = 0;
+	uint32_t info_addr;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "M:f:b:l:n:s:cw:r:m:pt:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'M':
+			mcu = avr_find_mcu(optarg);
+			/* the peripheral models use the ATmega8/ATmega32 register map */
+			if (!mcu || (strcmp(optarg, "atmega8") && strcmp(optarg, "atmega32")))
+			{
+				fprintf(stderr, "%s: unknown mcu %s\n", argv[0], optarg);
+				return 2;
+			}
+			break;
+		case 'f':
+			cfg_f_cpu = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			cfg_baud = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			cfg_load = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			cfg_bytes = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+		{
+			double period;
+			double length;
+			char cli[4] = "";
+			if (stall_count == SIM_MAX_STALLS ||
+			    sscanf(optarg, "%lf:%lf:%3s", &period, &length, cli) < 2 || period <= length)
+				usage(argv[0]);
+			stalls[stall_count].period = period;
+			stalls[stall_count].length = length;
+			stalls[stall_count].cli = !strcmp(cli, "cli");
+			stall_count++;
+			break;
+		}
+		case 'c':
+			cfg_card = 1;
+			break;
+		case 'w':
+			i = sscanf(optarg, "%lf:%u:%lf", &cfg_busy_us, &cfg_stall_every, &cfg_stall_us);
+			if (i != 1 && i != 3)
+				usage(argv[0]);
+			break;
+		case 'r':
+			if (sscanf(optarg, "%lf:%lf", &cfg_cts_period, &cfg_cts_len) != 2 ||
+			    cfg_cts_period <= cfg_cts_len || cfg_cts_len <= 0)
+				usage(argv[0]);
+			break;
+		case 'm':
+			cfg_max_lost = strtol(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg_pty = 1;
+			break;
+		case 't':
+			cfg_seconds = strtod(optarg, NULL);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || cfg_load < 1 || cfg_load > 100 || !cfg_f_cpu || !cfg_baud)
+		usage(argv[0]);
+	program = argv[optind];
+
+	avr_load(mcu, program);
+	deliver_pc = avr_symbol("sim_deliver");
+	if (deliver_pc != AVR_NO_SYMBOL)
+		deliver_pc /= 2;
+	else if (!cfg_card)
+	{
+		fprintf(stderr, "%s has no sim_deliver(), only a logger with -c can do without\n", program);
+		return 2;
+	}
+	brkval_addr = avr_symbol("__brkval");
+
+	avr_hook(UDR, udr_read, udr_write);
+	avr_hook(UCSRA, ucsra_read, ucsra_write);
+	avr_hook(UCSRB, ucsrb_read, ucsrb_write);
+	avr_hook(UBRRL, ubrr_read, ubrr_write);
+	avr_hook(UBRRH, ubrr_read, ubrr_write);
+	avr_hook(TCNT0, tcnt0_read, tcnt0_write);
+	avr_hook(TCCR0, NULL, tccr0_write);
+	avr_hook(TIFR, tifr_read, tifr_write);
+	avr_irq_hooks(irq_pending, irq_ack);
+	if (cfg_card)
+		sd_attach(cycles(cfg_busy_us), cfg_stall_every, cycles(cfg_stall_us));
+
+	/* start-up code and driver initialisation, the line stays quiet until
+	   the receiver and transmitter are on and the baud rate is set; a
+	   logger also gets to set up the card, until SPI has been quiet for 10 ms */
+	while (!(ucsrb & B_RXEN) || !(ucsrb & B_TXEN) || !enabled_at || avr_cycles < enabled_at + 100 ||
+	       (cfg_card && (!sd_stats.last_transfer || avr_cycles - sd_stats.last_transfer < cycles(10000))))
+	{
+		uint64_t e = next_event();
+
+		if (!enabled_at && (ucsrb & B_RXEN) && (ucsrb & B_TXEN))
+			enabled_at = avr_cycles;
+		if (avr_cycles > 2 * cfg_f_cpu)
+		{
+			fprintf(stderr, "%s did not enable the receiver and transmitter%s\n", program,
+			        cfg_card ? " or set up the card" : "");
+			return 2;
+		}
+		if (avr_cycles >= e)
+			run_event(e);
+		else if (!step())
+			avr_cycles = e != SIM_NEVER ? e : avr_cycles + cfg_f_cpu / 1000;
+	}
+
+	info_addr = avr_symbol("sim_info");
+	if (info_addr != AVR_NO_SYMBOL)
+	{
+		uint16_t* f = (uint16_t*)&info;
+		for (i = 0; i < (int)(sizeof(info) / 2); i++)
+			f[i] = avr_read16(info_addr + 2 * i);
+	}
+	if (info.rts_mask)
+		avr_hook(info.rts_port, NULL, rts_write);
+	if (cfg_cts_period)
+	{
+		if (!info.cts_mask)
+		{
+			fprintf(stderr, "%s has no CTS input for -r\n", program);
+			return 2;
+		}
+		cts_period = cycles(cfg_cts_period);
+		cts_len = cycles(cfg_cts_len);
+		avr_hook(info.cts_pin, cts_read, NULL);
+	}
+
+	peer_frame = (uint64_t)frame_bits() * cfg_f_cpu / cfg_baud;
+	peer_interval = peer_frame * 100 / cfg_load;
+	/* the USART samples the middle of each bit, that fails past about 4.5% */
+	peer_fe = (double)uart_frame() > peer_frame * 1.045 || (double)uart_frame() < peer_frame * 0.955;
+	/* time for the echo to drain plus the stalls, doubled, and the card's quiet spell */
+	deadline = avr_cycles + 2 * ((uint64_t)cfg_bytes * (peer_interval + uart_frame()) + cfg_f_cpu);
+	if (cfg_card)
+		deadline += 4 * (uint64_t)cfg_f_cpu + (uint64_t)cfg_bytes * cycles(cfg_stall_us) / 512;
+
+	for (i = 0; i < stall_count; i++)
+	{
+		stalls[i].period = cycles(stalls[i].period);
+		stalls[i].length = cycles(stalls[i].length);
+		stalls[i].next = avr_cycles + stalls[i].period;
+	}
+	if (cfg_pty)
+	{
+		pty_open();
+		signal(SIGINT, on_signal);
+		signal(SIGTERM, on_signal);
+		start = host_ns();
+	}
+	peer_start();
+
+	while (!stop)
+	{
+		uint64_t e = next_event();
+
+		if (avr_cycles >= e)
+		{
+			run_event(e);
+			continue;
+		}
+		/* a stall is a long call from the main loop, so it does not start
+		   inside a critical section of a program that uses interrupts */
+		if (avr_mem[AVR_SREG] & AVR_I)
+			uses_irq = 1;
+		for (i = 0; i < stall_count; i++)
+		{
+			if (avr_cycles >= stalls[i].next && avr_depth == 0 && (!uses_irq || (avr_mem[AVR_SREG] & AVR_I)))
+			{
+				if (avr_cycles + stalls[i].length > stall_until)
+					stall_until = avr_cycles + stalls[i].length;
+				stall_cli = stalls[i].cli;
+				stalls[i].next += stalls[i].period;
+			}
+		}
+
+		if (avr_depth == 0 && avr_cycles < stall_until)
+		{
+			/* the main line is busy elsewhere, interrupts may still come in */
+			if (!stall_cli && (avr_mem[AVR_SREG] & AVR_I) && irq_pending())
+			{
+				if (!avr_irq_allowed())
+					avr_skip(1);
+				step();
+			}
+			else
+				avr_skip((e < stall_until ? e : stall_until) - avr_cycles);
+		}
+		else if (!step())
+		{
+			/* asleep until the next event */
+			if (e != SIM_NEVER)
+				avr_cycles = e;
+			else
+				avr_cycles += cfg_f_cpu / 1000;
+		}
+
+		if (avr_cycles < check_at)
+			continue;
+		check_at = avr_cycles + peer_frame;
+		if (cfg_pty)
+		{
+			pty_poll(start);
+			continue;
+		}
+		if (!line_idle())
+			idle_since = avr_cycles;
+		else if (avr_cycles - idle_since > 4 * peer_frame)
+			break;
+		if (avr_cycles > deadline)
+		{
+			fprintf(stderr, "%s did not drain in time\n", program);
+			break;
+		}
+	}
+
+	report();
+	if (cfg_max_lost >= 0 && ((long)((cfg_pty ? accepted + hw_overruns : peer_sent) - delivered) > cfg_max_lost || stuck()))
+		return 1;
+	return 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * uartsim - what an AVR program tells the simulator about itself.
+ *
+ * Each app_*.c puts one UART driver into an echo loop, is built with
+ * avr-gcc and runs on the instruction level model in avr.cpp. It calls
+ * sim_deliver() with every byte the driver hands to the application; the
+ * simulator stops there, takes the byte from r24 and counts it as
+ * delivered. sim_info, read from RAM after start-up, says where the
+ * driver keeps its ringbuffer indices and how it does flow control.
+ *
+ * All fields are 16 bit so that the layout is the same on the host.
+ */
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+struct sim_info
+{
+	uint16_t rx_head;     /* addresses of the ringbuffer indices, 0 without ringbuffers */
+	uint16_t rx_tail;
+	uint16_t rx_size;     /* ringbuffer size, a power of 2 */
+	uint16_t tx_head;
+	uint16_t tx_tail;
+	uint16_t tx_size;
+	uint16_t index_size;  /* bytes per index, 1 or 2 */
+	uint16_t dropped;     /* address of the 16 bit count of bytes dropped on a full ringbuffer, or 0 */
+	uint16_t rts_port;    /* RTS output, PORTx address and bit, 0 without RTS/CTS */
+	uint16_t rts_mask;
+	uint16_t cts_pin;     /* CTS input, PINx address and bit */
+	uint16_t cts_mask;
+	uint16_t xonxoff;     /* 1 if the driver sends and obeys XON/XOFF */
+};
+
+#ifdef __AVR__
+/* defined by the app, zero for a driver without ringbuffers */
+extern struct sim_info sim_info;
+
+/* hand one received byte to the simulator */
+void sim_deliver(uint8_t c);
+#endif
+
+#endif /* SIM_H */
@@ -1,28 +1,31 @@
+#ifndef F_CPU
+#define F_CPU 8000000UL  // 8 MHz
+#endif
+#ifndef USART_BAUDRATE
+#define USART_BAUDRATE 9600
+#endif
+
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <inttypes.h>
 #include <avr/pgmspace.h>
+#include <stdlib.h>
 #include "fat16.h"
 #include "partition.h"
 #include "sd_raw.h"
 #include "sd_raw_config.h"
+#include "sdlog.h"
+#include "uart_tx.h"
+#include "baud.h"
 
-#define F_CPU 8000000UL  // 8 MHz
-#define USART_BAUDRATE 9600
-#define BAUD_PRESCALE (((F_CPU / (USART_BAUDRATE * 16UL))) - 1)
 #define ENG_SIG_TAB_SIZE 16
 
 
-void uart_Send(uint8_t u8Data)
-{
-	while((UCSRA &(1<<UDRE)) == 0);
-	UDR = u8Data;
-}
-
 void USART_Init(void)
 {
-	UBRRH = (unsigned char)(BAUD_PRESCALE>>8);
-	UBRRL = (unsigned char)BAUD_PRESCALE;
+	UBRRH = (unsigned char)(BAUD_UBRR>>8);
+	UBRRL = (unsigned char)BAUD_UBRR;
+	UCSRA = (BAUD_U2X<<U2X);
 	UCSRB = (1<<RXEN)|(1<<TXEN)|(1<<RXCIE);
 	UCSRC = (1<<URSEL)|(1<<USBS)|(3<<UCSZ0);
 
@@ -30,32 +33,69 @@ void USART_Init(void)
 
 void strSend(char* msg)
 {
-	uint8_t j=0;
-		while(*(msg + j) != 0)
-		{
-			uart_Send(*(msg + j));
-			j++;
-		}
+	uart_tx_puts(msg);
+}
+
+void Timer0_Init(void)
+{
+	TCCR0 = (1<<CS02)|(1<<CS00); // F_CPU/1024, przepelnienie co 32,8 ms przy 8 MHz
+	TIMSK |= (1<<TOIE0);
+}
+
+void statusSend(uint16_t plik)
+{
+	struct sdlog_stats stats;
+	char liczba[6];
+
+	sdlog_get_stats(&stats, 1);
+	strSend("log ");
+	strSend(utoa(plik, liczba, 10));
+	strSend(" fe ");
+	strSend(utoa(stats.frame, liczba, 10));
+	strSend(" dor ");
+	strSend(utoa(stats.overrun, liczba, 10));
+	strSend(" drop ");
+	strSend(utoa(stats.dropped, liczba, 10));
+	strSend("\r\n");
 }
 
 ISR(USART_RXC_vect)
 {
-	uint8_t dane = UDR;
-	uart_Send(dane);
+	uint8_t status = UCSRA; // FE i DOR trzeba odczytac przed UDR
+	sdlog_rx(UDR, status & (1<<FE), status & (1<<DOR));
+}
+
+ISR(TIMER0_OVF_vect)
+{
+	sdlog_tick();
 }
 
 int main(void){
+	uint16_t plik = 0;
 
 	DDRB |= (1<<PB0)|(1<<PB1);
 	PORTB &= ~((1<<PB0)|(1<<PB1));
 
 	cli(); // blokowanie przerwa� CLEAR INTERRUPTS
 	USART_Init(); //Inicjalizacja komunikacji USART
+	Timer0_Init(); //takt dla zapisu niepelnego bufora i zapisu rozmiaru pliku
 	sei(); // odblokowanie przerwan globalnych SET INTERRUPTS
 
 	if(sd_raw_init()) PORTB |= (1<<PB0); //niebieska
 	if(sd_raw_available()) PORTB |= (1<<PB1); //czerwona
 
+	// przerwanie odbioru zapelnia jeden bufor, petla zapisuje drugi na karte
+	if(sdlog_open()){
+		while(sdlog_task()){
+			if(plik != sdlog_file_number()){ // nowy plik, liczniki bledow z poprzedniego
+				statusSend(plik);
+				plik = sdlog_file_number();
+			}
+		}
+	}
+	PORTB &= ~(1<<PB0); // niebieska gasnie: zapis zatrzymany
+	statusSend(plik);
+
 	while(1){
 	}
 return 0;
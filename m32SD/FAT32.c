@@ -18,6 +18,66 @@
 #include "SD_routines.h"
 #include "RTC_routines.h"
 
+//FAT sector cache; kept apart from the common 'buffer' so that following a
+//cluster chain neither re-reads the same FAT sector nor destroys the
+//directory/file data held in 'buffer'
+static unsigned char FATbuffer[512];
+static unsigned long FATbufferSector = 0xffffffff; //0xffffffff - nothing cached
+static unsigned char FATbufferDirty = 0;
+static unsigned long FATsize;       //count of sectors occupied by one FAT
+static unsigned char numberofFATs;
+
+//free cluster count & next free cluster hint, kept in RAM and maintained by
+//getSetNextCluster(); the FSinfo sector is only updated by syncFileSystem()
+static unsigned long freeClusterCount;
+static unsigned long nextFreeCluster;
+static unsigned char FSinfoDirty;
+static unsigned long countEntriesLeft;   //FAT entries still to be looked at by countFreeSector()
+
+static unsigned long readBytesLeft;  //bytes of the file still to be sent by readFile()
+
+//directory scan state, filled in by scanDirSector() while a directory is read
+#define SCAN_MORE   0
+#define SCAN_FOUND  1
+#define SCAN_END    2
+#define GET_FREE    3   //findFiles() flag used internally: stop at the first free entry
+#define NO_ENTRY    0xffffffff
+
+static unsigned char scanFlag;           //GET_LIST, GET_FILE, DELETE or GET_FREE
+static unsigned char *scanName;          //name looked for, ends with 0 or '/'
+static unsigned char scanShortName[11];  //the same name in FAT format, scanShortName[0] = 0 if it has none
+static unsigned char scanResult;         //SCAN_MORE, SCAN_FOUND or SCAN_END
+static unsigned long scanCluster;        //cluster being read
+static unsigned long scanEntry;          //index of the entry being looked at, counted from the directory start
+static unsigned long scanFreeEntry, scanFreeCluster;  //first free entry seen & its cluster, NO_ENTRY if none
+static unsigned long longNameEntry, longNameCluster;  //first long name entry of the current file
+static unsigned char longName[LONG_NAME_MAX + 1];
+static unsigned char longNameChecksum;   //checksum of the short name the long name belongs to
+static unsigned char longNameValid;
+
+//offsets of the 13 characters (low bytes of UCS-2) in a long name entry
+static const unsigned char longNameOffset[13] PROGMEM = {1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30};
+
+//first free entry of the recently used directories, so that creating a
+//file does not have to search the directory for room again
+static struct dirCache_Structure dirCache[DIR_CACHE_SIZE];
+static unsigned char dirCacheNext;       //cache slot to be replaced next
+
+static unsigned char transmitBlock (unsigned char *block, unsigned long blockIndex);
+static unsigned char countFreeSector (unsigned char *block, unsigned long blockIndex);
+static unsigned char nextFileCluster (struct file_Structure *fp);
+static unsigned char createDirEntry (struct file_Structure *fp, unsigned long dirCluster, unsigned char *shortName);
+static unsigned char scanDir (unsigned long cluster, unsigned long entry);
+static unsigned char scanDirSector (unsigned char *block, unsigned long blockIndex);
+static void collectLongName (unsigned char *entry);
+static unsigned char shortNameChecksum (unsigned char *name);
+static unsigned char entryMatches (struct dir_Structure *dir);
+static unsigned char makeShortName (unsigned char *name, unsigned char *shortName);
+static void markDeleted (unsigned long cluster, unsigned long entry, unsigned long lastEntry);
+static struct dirCache_Structure* getDirCache (unsigned long dirCluster);
+static void setDirCache (unsigned long dirCluster, unsigned long entry, unsigned long cluster, unsigned long lastCluster);
+static void updateDirCache (unsigned long dirCluster);
+
 //***************************************************************************
 //Function: to read data from boot sector of SD card, to determine important
 //parameters like bytesPerSector, sectorsPerCluster etc.
@@ -30,6 +90,7 @@ struct BS_Structure *bpb; //mapping the buffer onto the structure
 struct MBRinfo_Structure *mbr;
 struct partitionInfo_Structure *partition;
 unsigned long dataSectors;
+unsigned char i;
 
 unusedSectors = 0;
 
@@ -56,6 +117,13 @@ sectorPerCluster = bpb->sectorPerCluster;
 //transmitHex(INT, sectorPerCluster); transmitByte(' ');
 reservedSectorCount = bpb->reservedSectorCount;
 rootCluster = bpb->rootCluster;// + (sector / sectorPerCluster) +1;
+FATsize = bpb->FATsize_F32;
+numberofFATs = bpb->numberofFATs;
+FATbufferSector = 0xffffffff; //drop anything cached from a previous card
+FATbufferDirty = 0;
+for(i=0; i<DIR_CACHE_SIZE; i++)
+  dirCache[i].dirCluster = 0;
+currentDirCluster = rootCluster;
 firstDataSector = bpb->hiddenSectors + reservedSectorCount + (bpb->numberofFATs * bpb->FATsize_F32);
 
 dataSectors = bpb->totalSectors_F32
@@ -64,13 +132,39 @@ dataSectors = bpb->totalSectors_F32
 totalClusters = dataSectors / sectorPerCluster;
 //transmitHex(LONG, totalClusters); transmitByte(' ');
 
-if((getSetFreeCluster (TOTAL_FREE, GET, 0)) > totalClusters)  //check if FSinfo free clusters count is valid
-     freeClusterCountUpdated = 0;
-else
-	 freeClusterCountUpdated = 1;
+FSinfoDirty = 0;
+nextFreeCluster = getSetFreeCluster (NEXT_FREE, GET, 0);
+if((nextFreeCluster < 2) || (nextFreeCluster > totalClusters + 1))
+  nextFreeCluster = rootCluster;
+
+freeClusterCount = getSetFreeCluster (TOTAL_FREE, GET, 0);
+if(freeClusterCount > totalClusters)  //FSinfo free clusters count is not valid, count them
+{
+  freeClusterCount = 0;
+  countEntriesLeft = totalClusters + 2;
+  if(SD_readMultipleBlock (unusedSectors + reservedSectorCount, (countEntriesLeft * 4 + 511) / 512,
+                           (unsigned char *)buffer, countFreeSector)) return 1;
+  FSinfoDirty = 1;
+}
 return 0;
 }
 
+//***************************************************************************
+//Function: block consumer for getBootSectorData(), counts the free entries in a FAT sector
+//Arguments: pointer to the sector data & index of the block in the transfer
+//return: 0, to go on with the next sector; 1, when all entries are counted
+//***************************************************************************
+static unsigned char countFreeSector (unsigned char *block, unsigned long blockIndex)
+{
+unsigned int i;
+
+for(i=0; (i<512) && countEntriesLeft; i+=4, countEntriesLeft--)
+  if((block[i] | block[i+1] | block[i+2] | (block[i+3] & 0x0f)) == 0)
+    freeClusterCount++;
+
+return (countEntriesLeft == 0);
+}
+
 //***************************************************************************
 //Function: to calculate first sector address of any given cluster
 //Arguments: cluster number for which first sector is to be found
@@ -81,12 +175,61 @@ unsigned long getFirstSector(unsigned long clusterNumber)
   return (((clusterNumber - 2) * sectorPerCluster) + firstDataSector);
 }
 
+//***************************************************************************
+//Function: to get a FAT sector through the FAT sector cache; the sector is
+//read from the card only if it is not the one already cached, a modified
+//cached sector is written back first
+//Arguments: sector number in the first FAT
+//return: pointer to the cached sector data, 0 if the modified sector could
+//not be written back or the new one could not be read
+//***************************************************************************
+unsigned char* getFATSector (unsigned long FATEntrySector)
+{
+unsigned char retry = 0;
+
+if(FATEntrySector == FATbufferSector)
+  return FATbuffer;
+
+if(flushFATSector()) return 0;   //keep the modified sector, it is not on the card yet
+
+while(retry <10)
+{ if(!SD_readBlock(FATEntrySector, FATbuffer)) break; retry++;}
+
+if(retry == 10)
+{
+  FATbufferSector = 0xffffffff;  //the buffer holds no valid sector now
+  return 0;
+}
+FATbufferSector = FATEntrySector;
+return FATbuffer;
+}
+
+//***************************************************************************
+//Function: to write the cached FAT sector back to the card, if modified;
+//the sector is written to every copy of the FAT
+//Arguments: none
+//return: 0, if no error; the sector stays modified until every copy is written
+//***************************************************************************
+unsigned char flushFATSector (void)
+{
+unsigned char i, error = 0;
+
+if(!FATbufferDirty) return 0;
+
+for(i=0; i<numberofFATs; i++)
+  error |= SD_writeBlock(FATbufferSector + (i * FATsize), FATbuffer);
+
+if(!error) FATbufferDirty = 0;
+return error;
+}
+
 //***************************************************************************
 //Function: get cluster entry value from FAT to find out the next cluster in the chain
 //or set new cluster entry in FAT
 //Arguments: 1. current cluster number, 2. get_set (=GET, if next cluster is to be found or = SET,
 //if next cluster is to be set 3. next cluster number, if argument#2 = SET, else 0
-//return: next cluster number, if if argument#2 = GET, else 0
+//return: next cluster number, if if argument#2 = GET, else 0;
+//FAT_ERROR, if the FAT sector could not be read
 //****************************************************************************
 unsigned long getSetNextCluster (unsigned long clusterNumber,
                                  unsigned char get_set,
@@ -95,7 +238,7 @@ unsigned long getSetNextCluster (unsigned long clusterNumber,
 unsigned int FATEntryOffset;
 unsigned long *FATEntryValue;
 unsigned long FATEntrySector;
-unsigned char retry = 0;
+unsigned char *FATsector;
 
 //get sector number of the cluster entry in the FAT
 FATEntrySector = unusedSectors + reservedSectorCount + ((clusterNumber * 4) / bytesPerSector) ;
@@ -103,20 +246,34 @@ FATEntrySector = unusedSectors + reservedSectorCount + ((clusterNumber * 4) / by
 //get the offset address in that sector number
 FATEntryOffset = (unsigned int) ((clusterNumber * 4) % bytesPerSector);
 
-//read the sector into a buffer
-while(retry <10)
-{ if(!SD_readSingleBlock(FATEntrySector)) break; retry++;}
-
-//get the cluster address from the buffer
-FATEntryValue = (unsigned long *) &buffer[FATEntryOffset];
+//get the cluster address from the cached sector
+FATsector = getFATSector(FATEntrySector);
+if(FATsector == 0) return FAT_ERROR;   //nothing is changed
+FATEntryValue = (unsigned long *) &FATsector[FATEntryOffset];
 
 if(get_set == GET)
   return ((*FATEntryValue) & 0x0fffffff);
 
+clusterEntry &= 0x0fffffff;
+if(((*FATEntryValue) & 0x0fffffff) == 0)
+{
+  if(clusterEntry != 0)   //cluster allocated
+  {
+    freeClusterCount--;
+    nextFreeCluster = clusterNumber;
+    FSinfoDirty = 1;
+  }
+}
+else if(clusterEntry == 0)  //cluster freed
+{
+  freeClusterCount++;
+  if(clusterNumber < nextFreeCluster) nextFreeCluster = clusterNumber;
+  FSinfoDirty = 1;
+}
 
-*FATEntryValue = clusterEntry;   //for setting new value in cluster entry in FAT
-
-SD_writeSingleBlock(FATEntrySector);
+//for setting new value in cluster entry in FAT, upper 4 bits are reserved
+*FATEntryValue = ((*FATEntryValue) & 0xf0000000) | clusterEntry;
+FATbufferDirty = 1;   //written back by flushFATSector()
 
 return (0);
 }
@@ -161,115 +318,425 @@ if((FS->leadSignature != 0x41615252) || (FS->structureSignature != 0x61417272) |
 
 //***************************************************************************
 //Function: to get DIR/FILE list or a single file address (cluster number) or to delete a specified file
-//Arguments: #1 - flag: GET_LIST, GET_FILE or DELETE #2 - pointer to file name (0 if arg#1 is GET_LIST)
-//return: first cluster of the file, if flag = GET_FILE
-//        print file/dir list of the root directory, if flag = GET_LIST
-//		  Delete the file mentioned in arg#2, if flag = DELETE
+//Arguments: #1 - flag: GET_LIST, GET_FILE or DELETE #2 - first cluster of the directory
+//			 #3 - pointer to file name, short (8.3) or long, ending with 0 or '/' (0 if arg#1 is GET_LIST)
+//return: pointer to the directory entry in 'buffer', if flag = GET_FILE
+//        print file/dir list of the directory, if flag = GET_LIST
+//		  Delete the file mentioned in arg#3, if flag = DELETE
 //****************************************************************************
-struct dir_Structure* findFiles (unsigned char flag, unsigned char *fileName)
+struct dir_Structure* findFiles (unsigned char flag, unsigned long dirCluster, unsigned char *fileName)
 {
-unsigned long cluster, sector, firstSector, firstCluster, nextCluster;
 struct dir_Structure *dir;
-unsigned int i;
-unsigned char j;
+unsigned long cluster, firstCluster, nextCluster, entry;
+
+scanFlag = flag;
+scanName = fileName;
+if((flag != GET_LIST) && makeShortName (fileName, scanShortName))
+  scanShortName[0] = 0;   //name can only match a long name
+
+if(scanDir (dirCluster, 0))
+{transmitString_F(PSTR("Error in reading directory")); return 0;}
+
+updateDirCache (dirCluster);
+
+if(scanResult != SCAN_FOUND)
+{
+  if(flag == DELETE)
+    transmitString_F(PSTR("File does not exist!"));
+  return 0;
+}
+
+dir = (struct dir_Structure *) &buffer[(scanEntry % 16) * 32];
+firstCluster = (((unsigned long) dir->firstClusterHI) << 16) | dir->firstClusterLO;
 
-cluster = rootCluster; //root cluster
+if(flag == GET_FILE)
+{
+  appendFileSector = getFirstSector (scanCluster) + ((scanEntry / 16) % sectorPerCluster);
+  appendFileLocation = (scanEntry % 16) * 32;
+  appendStartCluster = firstCluster;
+  fileSize = dir->fileSize;
+  return (dir);
+}
+
+//when flag = DELETE
+if(dir->attrib & ATTR_DIRECTORY)
+{transmitString_F(PSTR("Can't delete a directory!")); return 0;}
+
+TX_NEWLINE;
+transmitString_F(PSTR("Deleting.."));
+TX_NEWLINE;
+TX_NEWLINE;
+
+//mark the file & its long name entries as 'deleted'
+entry = scanEntry;
+cluster = scanCluster;
+if(longNameValid && (longNameChecksum == shortNameChecksum (dir->name)))
+{
+  entry = longNameEntry;
+  cluster = longNameCluster;
+}
+markDeleted (cluster, entry, scanEntry);  //'buffer' is reused from here on
+
+//the freed entries may now be the first free ones of the directory
+if(getDirCache (dirCluster) && (entry < getDirCache (dirCluster)->freeEntry))
+  setDirCache (dirCluster, entry, cluster, 0);
+
+if(firstCluster == 0)  //empty file, no cluster allocated
+{transmitString_F(PSTR("File deleted!")); return 0;}
+
+//mark all the clusters allocated to the file as 'free'
+while(1)  
+{
+   nextCluster = getSetNextCluster (firstCluster, GET, 0);
+   if((nextCluster == FAT_ERROR) || getSetNextCluster (firstCluster, SET, 0))
+      {transmitString_F(PSTR("FAT read failed..")); return 0;}
+   if(nextCluster > 0x0ffffff6) 
+      {transmitString_F(PSTR("File deleted!"));return 0;}
+   firstCluster = nextCluster;
+} 
+}
+
+//***************************************************************************
+//Function: to read a directory, starting from a given entry, until scanDirSector()
+//			finds what findFiles() is looking for (scanFlag), the end of the
+//			directory list or the end of the cluster chain; every cluster is read
+//			with a single multiple block command
+//Arguments: cluster holding the entry & index of the entry in the directory
+//return: 0, if no error; scanResult, scanEntry & scanCluster tell where it stopped
+//***************************************************************************
+static unsigned char scanDir (unsigned long cluster, unsigned long entry)
+{
+unsigned char sector, error;
+unsigned long nextCluster;
+
+scanResult = SCAN_MORE;
+scanEntry = entry;
+scanFreeEntry = NO_ENTRY;
+longNameValid = 0;
 
 while(1)
 {
-   firstSector = getFirstSector (cluster);
+  scanCluster = cluster;
+  sector = (scanEntry / 16) % sectorPerCluster;
+  error = SD_readMultipleBlock (getFirstSector (cluster) + sector, sectorPerCluster - sector,
+                                (unsigned char *)buffer, scanDirSector);
+  if(error) return error;
+  if(scanResult != SCAN_MORE) return 0;
+
+  nextCluster = getSetNextCluster (cluster, GET, 0);
+  if(nextCluster == FAT_ERROR) return 1;
+  if((nextCluster > 0x0ffffff6) || (nextCluster == 0))  //end of the chain, every entry is in use
+  {
+    scanResult = SCAN_END;
+    return 0;
+  }
+  cluster = nextCluster;
+}
+}
+
+//***************************************************************************
+//Function: block consumer for scanDir(), looks at the entries of a directory sector
+//Arguments: pointer to the sector data & index of the block in the transfer
+//return: 0, to go on with the next sector; 1, to stop the transfer
+//***************************************************************************
+static unsigned char scanDirSector (unsigned char *block, unsigned long blockIndex)
+{
+struct dir_Structure *dir;
+unsigned int i;
+unsigned char j;
 
-   for(sector = 0; sector < sectorPerCluster; sector++)
-   {
-     SD_readSingleBlock (firstSector + sector);
-	
+for(i = (scanEntry % 16) * 32; i < 512; i += 32, scanEntry++)
+{
+  dir = (struct dir_Structure *) &block[i];
+
+  if((dir->name[0] == EMPTY) || (dir->name[0] == DELETED))
+  {
+    if(scanFreeEntry == NO_ENTRY)
+    {
+      scanFreeEntry = scanEntry;
+      scanFreeCluster = scanCluster;
+    }
+    longNameValid = 0;
 
-     for(i=0; i<bytesPerSector; i+=32)
+    if(dir->name[0] == EMPTY)  //indicates end of the file list of the directory
+    {
+      scanResult = SCAN_END;
+      return 1;
+    }
+    if(scanFlag == GET_FREE)
+    {
+      scanResult = SCAN_FOUND;
+      return 1;
+    }
+    continue;
+  }
+
+  if(dir->attrib == ATTR_LONG_NAME)
+  {
+    collectLongName (&block[i]);
+    continue;
+  }
+
+  if(scanFlag == GET_LIST)
+  {
+     TX_NEWLINE;
+	 for(j=0; j<11; j++)
      {
-	    dir = (struct dir_Structure *) &buffer[i];
-
-        if(dir->name[0] == EMPTY) //indicates end of the file list of the directory
-		{
-		  if((flag == GET_FILE) || (flag == DELETE))
-		      transmitString_F(PSTR("File does not exist!"));
-		  return 0;   
-		}
-		if((dir->name[0] != DELETED) && (dir->attrib != ATTR_LONG_NAME))
-        {
-          if((flag == GET_FILE) || (flag == DELETE))
-          {
-            for(j=0; j<11; j++)
-            if(dir->name[j] != fileName[j]) break;
-            if(j == 11)
-			{
-			  if(flag == GET_FILE)
-              {
-			    appendFileSector = firstSector + sector;
-				appendFileLocation = i;
-				appendStartCluster = (((unsigned long) dir->firstClusterHI) << 16) | dir->firstClusterLO;
-				fileSize = dir->fileSize;
-			    return (dir);
-			  }	
-			  else    //when flag = DELETE
-			  {
-			     TX_NEWLINE;
-				 transmitString_F(PSTR("Deleting.."));
-				 TX_NEWLINE;
-				 TX_NEWLINE;
-				 firstCluster = (((unsigned long) dir->firstClusterHI) << 16) | dir->firstClusterLO;
-                
-				 //mark file as 'deleted' in FAT table
-				 dir->name[0] = DELETED;    
-				 SD_writeSingleBlock (firstSector+sector);
-				 			 
-				 freeMemoryUpdate (ADD, dir->fileSize);
-
-				 //update next free cluster entry in FSinfo sector
-				 cluster = getSetFreeCluster (NEXT_FREE, GET, 0); 
-				 if(firstCluster < cluster)
-				     getSetFreeCluster (NEXT_FREE, SET, firstCluster);
-
-				 //mark all the clusters allocated to the file as 'free'
-			     while(1)  
-			     {
-			        nextCluster = getSetNextCluster (firstCluster, GET, 0);
-					getSetNextCluster (firstCluster, SET, 0);
-					if(nextCluster > 0x0ffffff6) 
-					   {transmitString_F(PSTR("File deleted!"));return 0;}
-					firstCluster = nextCluster;
-			  	 } 
-			  }
-            }
-          }
-          else  //when flag = GET_LIST
-		  {
-		     TX_NEWLINE;
-			 for(j=0; j<11; j++)
-		     {
-			   if(j == 8) transmitByte(' ');
-			   transmitByte (dir->name[j]);
-			 }
-		     transmitString_F (PSTR("   "));
-		     if((dir->attrib != 0x10) && (dir->attrib != 0x08))
-			 {
-			     transmitString_F (PSTR("FILE" ));
-		         transmitString_F (PSTR("   "));
-			     displayMemory (LOW, dir->fileSize);
-			 }
-			 else
-			   transmitString_F ((dir->attrib == 0x10)? PSTR("DIR") : PSTR("ROOT"));
-		  }
-       }
+	   if(j == 8) transmitByte(' ');
+	   transmitByte (dir->name[j]);
+	 }
+     transmitString_F (PSTR("   "));
+     if(!(dir->attrib & (ATTR_DIRECTORY | ATTR_VOLUME_ID)))
+	 {
+	     transmitString_F (PSTR("FILE" ));
+         transmitString_F (PSTR("   "));
+	     displayMemory (LOW, dir->fileSize);
+	 }
+	 else
+	   transmitString_F ((dir->attrib & ATTR_DIRECTORY)? PSTR("DIR") : PSTR("ROOT"));
+
+     if(longNameValid && (longNameChecksum == shortNameChecksum (dir->name)))
+     {
+       transmitString_F (PSTR("   "));
+       transmitString (longName);
      }
-   }
+  }
+  else if((scanFlag != GET_FREE) && entryMatches (dir))
+  {
+    scanResult = SCAN_FOUND;
+    return 1;
+  }
+  longNameValid = 0;
+}
+return 0;
+}
+
+//***************************************************************************
+//Function: to collect the characters of a long name entry into longName;
+//			only the low byte of each UCS-2 character is kept
+//Arguments: pointer to the long name entry
+//return: none
+//***************************************************************************
+static void collectLongName (unsigned char *entry)
+{
+unsigned char k;
+unsigned int position;
 
-   cluster = (getSetNextCluster (cluster, GET, 0));
+if(entry[0] & 0x40)  //the last part of the long name is stored first
+{
+  longNameEntry = scanEntry;
+  longNameCluster = scanCluster;
+  longNameChecksum = entry[13];
+  longNameValid = 1;
+  for(position=0; position<=LONG_NAME_MAX; position++)
+    longName[position] = 0;
+}
+else if(!longNameValid || (entry[13] != longNameChecksum))
+{
+  longNameValid = 0;
+  return;
+}
 
-   if(cluster > 0x0ffffff6)
-   	 return 0;
-   if(cluster == 0) 
-   {transmitString_F(PSTR("Error in getting cluster"));  return 0;}
- }
+position = ((entry[0] & 0x3f) - 1) * 13;
+for(k=0; k<13; k++)
+{
+  if((entry[pgm_read_byte(&longNameOffset[k])] == 0) && (entry[pgm_read_byte(&longNameOffset[k]) + 1] == 0))
+    break;   //end of the name
+  if(position + k >= LONG_NAME_MAX)
+  {
+    longNameValid = 0;  //too long to be kept, can not be matched
+    return;
+  }
+  longName[position + k] = entry[pgm_read_byte(&longNameOffset[k]) + 1] ? '?' : entry[pgm_read_byte(&longNameOffset[k])];
+}
+}
+
+//***************************************************************************
+//Function: to calculate the checksum of a short name, kept in its long name entries
+//Arguments: pointer to the 11 characters of the short name
+//return: checksum
+//***************************************************************************
+static unsigned char shortNameChecksum (unsigned char *name)
+{
+unsigned char j, sum = 0;
+
+for(j=0; j<11; j++)
+  sum = ((sum & 1) << 7) + (sum >> 1) + name[j];
+return sum;
+}
+
+//***************************************************************************
+//Function: to check if a directory entry has the name findFiles() is looking for,
+//			either as short name or (case insensitive) as long name
+//Arguments: pointer to the directory entry
+//return: 1, if it matches, else 0
+//***************************************************************************
+static unsigned char entryMatches (struct dir_Structure *dir)
+{
+unsigned char j, a, b;
+
+if(scanShortName[0])
+{
+  for(j=0; j<11; j++)
+    if(dir->name[j] != scanShortName[j]) break;
+  if(j == 11) return 1;
+}
+
+if(!longNameValid || (longNameChecksum != shortNameChecksum (dir->name)))
+  return 0;
+
+for(j=0; j<=LONG_NAME_MAX; j++)
+{
+  a = longName[j];
+  b = scanName[j];
+  if(b == '/') b = 0;
+  if((a >= 0x61) && (a <= 0x7a)) a -= 0x20;
+  if((b >= 0x61) && (b <= 0x7a)) b -= 0x20;
+  if(a != b) return 0;
+  if(a == 0) return 1;
+}
+return 0;
+}
+
+//***************************************************************************
+//Function: to mark a range of directory entries as 'deleted'
+//Arguments: cluster holding the first entry, index of the first & of the last entry
+//return: none
+//***************************************************************************
+static void markDeleted (unsigned long cluster, unsigned long entry, unsigned long lastEntry)
+{
+unsigned long sector;
+
+while(1)
+{
+  sector = getFirstSector (cluster) + ((entry / 16) % sectorPerCluster);
+  SD_readSingleBlock (sector);
+  do
+  {
+    buffer[(entry % 16) * 32] = DELETED;
+    entry++;
+  }while((entry <= lastEntry) && (entry % 16));
+  SD_writeSingleBlock (sector);
+
+  if(entry > lastEntry) return;
+  if((entry % (16 * sectorPerCluster)) == 0)
+  {
+    cluster = getSetNextCluster (cluster, GET, 0);
+    if((cluster == 0) || (cluster > 0x0ffffff6)) return;  //broken chain or FAT read error
+  }
+}
+}
+
+//***************************************************************************
+//Function: to find the cached first free entry of a directory
+//Arguments: first cluster of the directory
+//return: pointer to the cache slot, 0 if the directory is not cached
+//***************************************************************************
+static struct dirCache_Structure* getDirCache (unsigned long dirCluster)
+{
+unsigned char i;
+
+for(i=0; i<DIR_CACHE_SIZE; i++)
+  if(dirCache[i].dirCluster == dirCluster) return &dirCache[i];
+return 0;
+}
+
+//***************************************************************************
+//Function: to remember the first free entry of a directory
+//Arguments: first cluster of the directory, index of the free entry, cluster holding it
+//			 (0, if the directory is full and must be extended after lastCluster)
+//return: none
+//***************************************************************************
+static void setDirCache (unsigned long dirCluster, unsigned long entry, unsigned long cluster, unsigned long lastCluster)
+{
+struct dirCache_Structure *cache = getDirCache (dirCluster);
+
+if(cache == 0)
+{
+  cache = &dirCache[dirCacheNext];
+  dirCacheNext = (dirCacheNext + 1) % DIR_CACHE_SIZE;
+  cache->dirCluster = dirCluster;
+}
+cache->freeEntry = entry;
+cache->freeCluster = cluster;
+cache->lastCluster = lastCluster;
+}
+
+//***************************************************************************
+//Function: to remember the first free entry found by a scanDir() started at
+//			the first entry of a directory
+//Arguments: first cluster of the directory
+//return: none
+//***************************************************************************
+static void updateDirCache (unsigned long dirCluster)
+{
+if(scanFreeEntry != NO_ENTRY)
+  setDirCache (dirCluster, scanFreeEntry, scanFreeCluster, 0);
+else if(scanResult == SCAN_END)  //no free entry up to the end of the chain
+  setDirCache (dirCluster, scanEntry, 0, scanCluster);
+}
+
+//***************************************************************************
+//Function: to follow the directories named in a path like "LOGS/2011/DATA.TXT";
+//			a path starting with '/' starts at the root, otherwise at the
+//			current directory
+//Arguments: pointer to the path & pointer to store the cluster of the last directory
+//return: pointer to the last name in the path, 0 if a directory was not found
+//***************************************************************************
+unsigned char* resolvePath (unsigned char *path, unsigned long *dirCluster)
+{
+struct dir_Structure *dir;
+unsigned char *next;
+unsigned long cluster = currentDirCluster;
+
+if(*path == '/')
+{
+  cluster = rootCluster;
+  path++;
+}
+
+while(1)
+{
+  for(next = path; (*next != 0) && (*next != '/'); next++);
+  if(*next == 0)
+  {
+    *dirCluster = cluster;
+    return path;
+  }
+
+  dir = findFiles (GET_FILE, cluster, path);
+  if((dir == 0) || !(dir->attrib & ATTR_DIRECTORY)) return 0;
+
+  cluster = appendStartCluster;
+  if(cluster == 0) cluster = rootCluster;  //'..' of a first level directory
+  path = next + 1;
+}
+}
+
+//***************************************************************************
+//Function: to change the current directory
+//Arguments: pointer to the path of the new directory ("/" for root, ".." for parent)
+//return: 0, if successful, 1 if the directory does not exist
+//***************************************************************************
+unsigned char changeDir (unsigned char *path)
+{
+struct dir_Structure *dir;
+unsigned char *name;
+unsigned long dirCluster;
+
+name = resolvePath (path, &dirCluster);
+if(name == 0) return 1;
+
+if(*name != 0)
+{
+  dir = findFiles (GET_FILE, dirCluster, name);
+  if((dir == 0) || !(dir->attrib & ATTR_DIRECTORY)) return 1;
+
+  dirCluster = appendStartCluster;
+  if(dirCluster == 0) dirCluster = rootCluster;
+}
+
+currentDirCluster = dirCluster;
 return 0;
 }
 
@@ -284,16 +751,18 @@ return 0;
 unsigned char readFile (unsigned char flag, unsigned char *fileName)
 {
 struct dir_Structure *dir;
-unsigned long cluster, byteCounter = 0, fileSize, firstSector;
-unsigned int k;
-unsigned char j, error;
+unsigned long cluster, nextCluster, fileSize, blocks, runBlocks, runStart;
+unsigned char error, *name;
 
-error = convertFileName (fileName); //convert fileName into FAT format
-if(error) return 2;
-
-dir = findFiles (GET_FILE, fileName); //get the file location
-if(dir == 0) 
+name = resolvePath (fileName, &cluster);
+if(name == 0) dir = 0;
+else dir = findFiles (GET_FILE, cluster, name); //get the file location
+if((dir == 0) || (dir->attrib & ATTR_DIRECTORY))
+{
+  if(flag == READ)
+    transmitString_F(PSTR("File does not exist!"));
   return (0);
+}
 
 if(flag == VERIFY) return (1);	//specified file name is already existing
 
@@ -304,26 +773,54 @@ fileSize = dir->fileSize;
 TX_NEWLINE;
 TX_NEWLINE;
 
+if((cluster == 0) || (fileSize == 0)) return 0; //empty file, no cluster allocated
+
+readBytesLeft = fileSize;
+blocks = (fileSize + 511) / 512;   //sectors holding the file data
+
 while(1)
 {
-  firstSector = getFirstSector (cluster);
-
-  for(j=0; j<sectorPerCluster; j++)
+  //collect the run of contiguous clusters starting here, it is read with one command
+  runStart = cluster;
+  runBlocks = sectorPerCluster;
+  while(1)
   {
-    SD_readSingleBlock(firstSector + j);
-    
-	for(k=0; k<512; k++)
-    {
-      transmitByte(buffer[k]);
-      if ((byteCounter++) >= fileSize ) return 0;
-    }
+    nextCluster = getSetNextCluster (cluster, GET, 0);
+    if((nextCluster != cluster + 1) || (runBlocks >= blocks)) break;
+    cluster = nextCluster;
+    runBlocks += sectorPerCluster;
   }
-  cluster = getSetNextCluster (cluster, GET, 0);
-  if(cluster == 0) {transmitString_F(PSTR("Error in getting cluster")); return 0;}
+  if(runBlocks > blocks) runBlocks = blocks;
+
+  error = SD_readMultipleBlock (getFirstSector (runStart), runBlocks, (unsigned char *)buffer, transmitBlock);
+  if(error) {transmitString_F(PSTR("Read failed..")); return 0;}
+
+  blocks -= runBlocks;
+  if(blocks == 0) return 0;
+
+  cluster = nextCluster;
+  if((cluster == 0) || (cluster > 0x0ffffff6)) {transmitString_F(PSTR("Error in getting cluster")); return 0;}
 }
 return 0;
 }
 
+//***************************************************************************
+//Function: block consumer for readFile(), sends the file data in a block to UART
+//Arguments: pointer to the block data & index of the block in the transfer
+//return: 0, to continue the transfer; 1, when the end of the file is reached
+//***************************************************************************
+static unsigned char transmitBlock (unsigned char *block, unsigned long blockIndex)
+{
+unsigned int k, count;
+
+count = (readBytesLeft < 512) ? readBytesLeft : 512;
+for(k=0; k<count; k++)
+  transmitByte(block[k]);
+
+readBytesLeft -= count;
+return (readBytesLeft == 0);
+}
+
 //***************************************************************************
 //Function: to convert normal short file name into FAT format
 //Arguments: pointer to the file name
@@ -332,326 +829,526 @@ return 0;
 unsigned char convertFileName (unsigned char *fileName)
 {
 unsigned char fileNameFAT[11];
-unsigned char j, k;
+unsigned char j;
 
-for(j=0; j<12; j++)
-if(fileName[j] == '.') break;
+if(makeShortName (fileName, fileNameFAT))
+{transmitString_F(PSTR("Invalid fileName..")); return 1;}
+
+for(j=0; j<11; j++)
+  fileName[j] = fileNameFAT[j];
+
+return 0;
+}
 
-if(j>8) {transmitString_F(PSTR("Invalid fileName..")); return 1;}
+//***************************************************************************
+//Function: to make the FAT format (8.3, capitals, blank filled) of a name
+//Arguments: pointer to the name, ending with 0 or '/' & pointer to 11 bytes for the result
+//return: 0, if successful; 1, if the name has no short form
+//***************************************************************************
+static unsigned char makeShortName (unsigned char *name, unsigned char *shortName)
+{
+unsigned char j, k;
 
-for(k=0; k<j; k++) //setting file name
-  fileNameFAT[k] = fileName[k];
+for(k=0; k<11; k++)
+  shortName[k] = ' ';
 
-for(k=j; k<=7; k++) //filling file name trail with blanks
-  fileNameFAT[k] = ' ';
+if(name[0] == '.')  //'.' & '..' entries
+{
+  shortName[0] = '.';
+  j = 1;
+  if(name[1] == '.') shortName[j++] = '.';
+  return !((name[j] == 0) || (name[j] == '/'));
+}
 
-j++;
-for(k=8; k<11; k++) //setting file extention
+for(j=0; (name[j] != 0) && (name[j] != '/') && (name[j] != '.'); j++) //setting file name
 {
-  if(fileName[j] != 0)
-    fileNameFAT[k] = fileName[j++];
-  else //filling extension trail with blanks
-    while(k<11)
-      fileNameFAT[k++] = ' ';
+  if(j == 8) return 1;
+  shortName[j] = name[j];
 }
+if(j == 0) return 1;
 
-for(j=0; j<11; j++) //converting small letters to caps
-  if((fileNameFAT[j] >= 0x61) && (fileNameFAT[j] <= 0x7a))
-    fileNameFAT[j] -= 0x20;
+if(name[j] == '.') //setting file extention
+  for(j++, k=8; (name[j] != 0) && (name[j] != '/'); j++, k++)
+  {
+    if((k == 11) || (name[j] == '.')) return 1;
+    shortName[k] = name[j];
+  }
 
-for(j=0; j<11; j++)
-  fileName[j] = fileNameFAT[j];
+for(k=0; k<11; k++) //converting small letters to caps
+  if((shortName[k] >= 0x61) && (shortName[k] <= 0x7a))
+    shortName[k] -= 0x20;
 
 return 0;
 }
 
 //************************************************************************************
-//Function: to create a file in FAT32 format in the root directory if given 
-//			file name does not exist; if the file already exists then append the data
-//Arguments: pointer to the file name
-//return: none
+//Function: to open a file for writing; the file is created if it does not exist,
+//			otherwise new data is appended to it. The name may be a path, new
+//			files get a short (8.3) name. With mode FILE_NEW the name is not looked
+//			up, the caller makes sure that it is not in use.
+//			While the file is open the common 'buffer' holds its last sector, so
+//			only one file can be open at a time and 'buffer' must not be used
+//			by the caller until fileClose()
+//Arguments: pointer to the file structure, pointer to the file name & mode
+//			 (FILE_APPEND or FILE_NEW)
+//return: 0, if successful
+//		  1, if no free cluster or no room in the directory
+//		  2, if file name is incompatible or the directory does not exist
 //************************************************************************************
-void writeFile (unsigned char *fileName)
+unsigned char fileOpen (struct file_Structure *fp, unsigned char *fileName, unsigned char mode)
 {
-unsigned char j, data, error, fileCreatedFlag = 0, start = 0, appendFile = 0, sectorEndFlag = 0, sector=0;
-unsigned int i, firstClusterHigh=0, firstClusterLow=0;  //value 0 is assigned just to avoid warning in compilation
-struct dir_Structure *dir;
-unsigned long cluster, nextCluster, prevCluster, firstSector, clusterCount, extraMemory;
+unsigned char error, *name, shortName[11];
+unsigned long cluster, nextCluster, clusterCount, remainder, dirCluster;
+struct dir_Structure *dir = 0;
 
-j = readFile (VERIFY, fileName);
+name = resolvePath (fileName, &dirCluster);
+if(name == 0) return 2;
 
-if(j == 1) 
+if(mode == FILE_APPEND)
 {
-  transmitString_F(PSTR(" File already exists, appending data..")); 
-  appendFile = 1;
-  cluster = appendStartCluster;
-  clusterCount=0;
-  while(1)
+  dir = findFiles (GET_FILE, dirCluster, name);
+  if(dir && (dir->attrib & ATTR_DIRECTORY)) return 2;
+}
+
+if(dir)  //file exists, data will be appended
+{
+  fp->firstCluster = appendStartCluster;
+  fp->fileSize = fileSize;
+  fp->dirSector = appendFileSector;
+  fp->dirOffset = appendFileLocation;
+}
+else
+{
+  if(makeShortName (name, shortName))
+  {transmitString_F(PSTR("Invalid fileName..")); return 2;}
+  fp->firstCluster = 0;
+  fp->fileSize = 0;
+  fp->dirSector = 0;
+}
+fp->startSize = fp->fileSize;
+
+if(fp->firstCluster == 0)  //new or empty file, give it a first cluster
+{
+  cluster = searchNextFreeCluster(nextFreeCluster);
+  if(cluster == 0) return 1;
+  if(getSetNextCluster(cluster, SET, EOF)) return 1;   //last cluster of the file, marked EOF
+  fp->firstCluster = cluster;
+}
+
+if(fp->dirSector == 0)
+{
+  error = createDirEntry (fp, dirCluster, shortName);
+  if(error)
   {
-    nextCluster = getSetNextCluster (cluster, GET, 0);
-    if(nextCluster == EOF) break;
-	cluster = nextCluster;
-	clusterCount++;
+    getSetNextCluster(fp->firstCluster, SET, 0); //release the cluster given above
+    return 1;
   }
+}
 
-  sector = (fileSize - (clusterCount * sectorPerCluster * bytesPerSector)) / bytesPerSector; //last sector number of the last cluster of the file
-  start = 1;
-//  appendFile();
-//  return;
+//find the cluster holding the file end, the size decides which one it is: after a
+//reset the chain may still hold preallocated clusters that fileClose() did not free
+clusterCount = fp->fileSize ? (fp->fileSize - 1) / ((unsigned long)sectorPerCluster * bytesPerSector) : 0;
+cluster = fp->firstCluster;
+for(remainder = 0; remainder < clusterCount; remainder++)
+{
+  cluster = getSetNextCluster (cluster, GET, 0);
+  if((cluster == FAT_ERROR) || (cluster > 0x0ffffff6) || (cluster < 2)) return 1; //chain shorter than the file
 }
-else if(j == 2) 
+fp->cluster = cluster;
+
+//clusters after it are kept as preallocated ones, fileClose() frees what stays unused
+while(1)
 {
-   return; //invalid file name
+  nextCluster = getSetNextCluster (cluster, GET, 0);
+  if(nextCluster == FAT_ERROR) return 1;
+  if((nextCluster > 0x0ffffff6) || (nextCluster == 0)) break;
+  cluster = nextCluster;
 }
-else
+fp->lastCluster = cluster;
+
+remainder = fp->fileSize - (clusterCount * sectorPerCluster * bytesPerSector);
+fp->sector = remainder / bytesPerSector;  //equals sectorPerCluster if the last cluster is full
+fp->bufferIndex = remainder % bytesPerSector;
+
+if(fp->bufferIndex)   //partially filled last sector is continued
+  SD_readSingleBlock (getFirstSector (fp->cluster) + fp->sector);
+
+return 0;
+}
+
+//************************************************************************************
+//Function: to write data to a file opened with fileOpen(); data is collected in
+//			'buffer' and written to the card a whole sector at a time
+//Arguments: pointer to the file structure, pointer to the data & number of bytes
+//return: 0, if successful
+//		  1, if no free cluster
+//		  otherwise the response byte of the failed sector write
+//************************************************************************************
+unsigned char fileWrite (struct file_Structure *fp, unsigned char *data, unsigned int count)
 {
-  TX_NEWLINE;
-  transmitString_F(PSTR(" Creating File.."));
+unsigned char error;
+unsigned int i;
+unsigned long cluster, blocks, runBlocks, clusters;
+
+while(count)
+{
+  if((fp->bufferIndex == 0) && (fp->sector == sectorPerCluster)) //current cluster is full
+  {
+    error = nextFileCluster (fp);
+    if(error) return error;
+  }
+
+  if((fp->bufferIndex == 0) && (count >= 512))  //whole sectors go straight from the caller's data
+  {
+    blocks = count / 512;
 
-  cluster = getSetFreeCluster (NEXT_FREE, GET, 0);
-  if(cluster > totalClusters)
-     cluster = rootCluster;
+    //sectors left in this cluster & in the contiguous clusters already linked after it
+    runBlocks = sectorPerCluster - fp->sector;
+    cluster = fp->cluster;
+    while((runBlocks < blocks) && (cluster != fp->lastCluster)
+          && (getSetNextCluster (cluster, GET, 0) == cluster + 1))
+    {
+      cluster++;
+      runBlocks += sectorPerCluster;
+    }
+    if(blocks > runBlocks) blocks = runBlocks;
+
+    error = SD_writeMultipleBlock (getFirstSector (fp->cluster) + fp->sector, blocks, data, 0);
+    if(error) return error;
+
+    data += blocks * 512;
+    count -= blocks * 512;
+    fp->fileSize += blocks * 512;
+
+    blocks += fp->sector;                    //sector position counted from fp->cluster
+    clusters = (blocks - 1) / sectorPerCluster;  //a just filled cluster stays current
+    fp->cluster += clusters;
+    fp->sector = blocks - (clusters * sectorPerCluster);
+    continue;
+  }
+
+  i = fp->bufferIndex;
+  while(count && (i < 512))
+  {
+    buffer[i++] = *data++;
+    count--;
+  }
+  fp->fileSize += i - fp->bufferIndex;
+  fp->bufferIndex = i;
 
-  cluster = searchNextFreeCluster(cluster);
-   if(cluster == 0)
-   {
-      TX_NEWLINE;
-      transmitString_F(PSTR(" No free cluster!"));
-	  return;
-   }
-  getSetNextCluster(cluster, SET, EOF);   //last cluster of the file, marked EOF
-   
-  firstClusterHigh = (unsigned int) ((cluster & 0xffff0000) >> 16 );
-  firstClusterLow = (unsigned int) ( cluster & 0x0000ffff);
-  fileSize = 0;
+  if(i == 512)
+  {
+    error = SD_writeSingleBlock (getFirstSector (fp->cluster) + fp->sector);
+    if(error) return error;
+    fp->bufferIndex = 0;
+    fp->sector++;
+  }
+}
+return 0;
 }
 
+//************************************************************************************
+//Function: to close a file opened with fileOpen(); writes the last partial sector,
+//			releases unused preallocated clusters and updates the directory entry;
+//			the FSinfo sector is left to syncFileSystem()
+//Arguments: pointer to the file structure
+//return: 0, if successful, otherwise the response byte of the failed write
+//************************************************************************************
+unsigned char fileClose (struct file_Structure *fp)
+{
+unsigned char error = 0;
+unsigned int i;
+unsigned long cluster, nextCluster;
+struct dir_Structure *dir;
 
+if(fp->bufferIndex)
+{
+  for(i=fp->bufferIndex; i<512; i++)  //fill the rest of the buffer with 0x00
+    buffer[i] = 0x00;
+  error = SD_writeSingleBlock (getFirstSector (fp->cluster) + fp->sector);
+}
 
-while(1)
+if(fp->cluster != fp->lastCluster)  //free the preallocated clusters not used
 {
-   if(start)
-   {
-      start = 0;
-	  startBlock = getFirstSector (cluster) + sector;
-	  SD_readSingleBlock (startBlock);
-	  i = fileSize % bytesPerSector;
-	  j = sector;
-   }
-   else
-   {
-      startBlock = getFirstSector (cluster);
-	  i=0;
-	  j=0;
-   }
-   
-
-   TX_NEWLINE;
-   transmitString_F(PSTR(" Enter text (end with ~):"));
-   
-   do
-   {
-     if(sectorEndFlag == 1) //special case when the last character in previous sector was '\r'
-	 {
-	 	transmitByte ('\n');
-        buffer[i++] = '\n'; //appending 'Line Feed (LF)' character
-		fileSize++;
-	 }
+  cluster = getSetNextCluster (fp->cluster, GET, 0);
+  if((cluster == FAT_ERROR) || getSetNextCluster (fp->cluster, SET, EOF))
+    error = 1;   //the unused clusters stay linked to the file
+  else
+  {
+    while(1)
+    {
+      nextCluster = getSetNextCluster (cluster, GET, 0);
+      if(getSetNextCluster (cluster, SET, 0)) error = 1;
+      if((nextCluster > 0x0ffffff6) || (nextCluster == 0)) break;
+      cluster = nextCluster;
+    }
+    fp->lastCluster = fp->cluster;
+  }
+}
 
-	sectorEndFlag = 0;
-
-	 data = receiveByte();
-	 if(data == 0x08)	//'Back Space' key pressed
-	 { 
-	   if(i != 0)
-	   { 
-	     transmitByte(data);
-		 transmitByte(' '); 
-	     transmitByte(data); 
-	     i--; 
-		 fileSize--;
-	   } 
-	   continue;     
-	 }
-	 transmitByte(data);
-     buffer[i++] = data;
-	 fileSize++;
-     if(data == '\r')  //'Carriege Return (CR)' character
-     {
-        if(i == 512)
-		   sectorEndFlag = 1;  //flag to indicate that the appended '\n' char should be put in the next sector
-	    else
-		{ 
-		   transmitByte ('\n');
-           buffer[i++] = '\n'; //appending 'Line Feed (LF)' character
-		   fileSize++;
-	    }
-     }
-	 
-     if(i >= 512)   //though 'i' will never become greater than 512, it's kept here to avoid 
-	 {				//infinite loop in case it happens to be greater than 512 due to some data corruption
-	   i=0;
-	   error = SD_writeSingleBlock (startBlock);
-       j++;
-	   if(j == sectorPerCluster) {j = 0; break;}
-	   startBlock++; 
-     }
-	}while (data != '~');
+if(getDateTime_FAT()) { dateFAT = 0; timeFAT = 0;} //get current date & time from the RTC
 
-   if(data == '~') 
-   {
-      fileSize--;	//to remove the last entered '~' character
-	  i--;
-	  for(;i<512;i++)  //fill the rest of the buffer with 0x00
-        buffer[i]= 0x00;
-   	  error = SD_writeSingleBlock (startBlock);
+SD_readSingleBlock (fp->dirSector);
+dir = (struct dir_Structure *) &buffer[fp->dirOffset];
 
-      break;
-   } 
-	  
-   prevCluster = cluster;
+dir->lastAccessDate = 0;   //date of last access ignored
+dir->writeTime = timeFAT;  //setting new time of last write, obtained from RTC
+dir->writeDate = dateFAT;  //setting new date of last write, obtained from RTC
+dir->firstClusterHI = (unsigned int) ((fp->firstCluster & 0xffff0000) >> 16 );
+dir->firstClusterLO = (unsigned int) ( fp->firstCluster & 0x0000ffff);
+dir->fileSize = fp->fileSize;
+error |= SD_writeSingleBlock (fp->dirSector);
 
-   cluster = searchNextFreeCluster(prevCluster); //look for a free cluster starting from the current cluster
+error |= flushFATSector();
+return error;
+}
 
-   if(cluster == 0)
-   {
-      TX_NEWLINE;
-      transmitString_F(PSTR(" No free cluster!"));
-	  return;
-   }
+//************************************************************************************
+//Function: to move an open file on to its next cluster; clusters are linked to the
+//			file FILE_PREALLOC_CLUSTERS at a time, so most cluster changes only
+//			follow the already allocated chain
+//Arguments: pointer to the file structure
+//return: 0, if successful, 1 if no free cluster
+//************************************************************************************
+static unsigned char nextFileCluster (struct file_Structure *fp)
+{
+unsigned long cluster, prevCluster;
+unsigned char i;
 
-   getSetNextCluster(prevCluster, SET, cluster);
-   getSetNextCluster(cluster, SET, EOF);   //last cluster of the file, marked EOF
-}        
+if(fp->cluster == fp->lastCluster)  //no preallocated cluster left
+{
+  prevCluster = fp->lastCluster;
+  for(i=0; i<FILE_PREALLOC_CLUSTERS; i++)
+  {
+    cluster = searchNextFreeCluster(prevCluster); //look for a free cluster starting from the last one
+    if(cluster == 0) break;
+    if(getSetNextCluster(cluster, SET, EOF)) break;   //last cluster of the file, marked EOF
+    if(getSetNextCluster(prevCluster, SET, cluster)) break;
+    prevCluster = cluster;
+  }
+  if(prevCluster == fp->lastCluster) return 1;
+  fp->lastCluster = prevCluster;
+}
 
-getSetFreeCluster (NEXT_FREE, SET, cluster); //update FSinfo next free cluster entry
+cluster = getSetNextCluster (fp->cluster, GET, 0);
+if((cluster == 0) || (cluster > 0x0ffffff6)) return 1;
+fp->cluster = cluster;
+fp->sector = 0;
+return 0;
+}
 
-error = getDateTime_FAT();    //get current date & time from the RTC
-if(error) { dateFAT = 0; timeFAT = 0;}
+//************************************************************************************
+//Function: to make a new directory entry for a file opened with fileOpen(); the
+//			first free entry of the directory is cached, so it is found without
+//			reading the directory again. The directory is extended by a cluster if full
+//Arguments: pointer to the file structure, first cluster of the directory &
+//			 pointer to the file name in FAT format
+//return: 0, if successful, 1 if no room could be found
+//************************************************************************************
+static unsigned char createDirEntry (struct file_Structure *fp, unsigned long dirCluster, unsigned char *shortName)
+{
+unsigned char j, sector, endOfList;
+unsigned int i;
+struct dir_Structure *dir;
+struct dirCache_Structure *cache;
+unsigned long cluster, entry, firstSector;
 
-if(appendFile)  //executes this loop if file is to be appended
+if(getDateTime_FAT()) { dateFAT = 0; timeFAT = 0;} //get current date & time from the RTC
+
+cache = getDirCache (dirCluster);
+if(cache == 0)   //look for the first free entry
 {
-  SD_readSingleBlock (appendFileSector);    
-  dir = (struct dir_Structure *) &buffer[appendFileLocation]; 
+  scanFlag = GET_FREE;
+  if(scanDir (dirCluster, 0)) return 1;
+  updateDirCache (dirCluster);
+  cache = getDirCache (dirCluster);
+}
 
-  dir->lastAccessDate = 0;   //date of last access ignored
-  dir->writeTime = timeFAT;  //setting new time of last write, obtained from RTC
-  dir->writeDate = dateFAT;  //setting new date of last write, obtained from RTC
-  extraMemory = fileSize - dir->fileSize;
-  dir->fileSize = fileSize;
-  SD_writeSingleBlock (appendFileSector);
-  freeMemoryUpdate (REMOVE, extraMemory); //updating free memory count in FSinfo sector;
+if(cache->freeCluster == 0)  //directory is full, it gets one more cluster
+{
+  cluster = searchNextFreeCluster(cache->lastCluster); //find next cluster for directory entries
+  if(cluster == 0) return 1;
+  if(getSetNextCluster(cluster, SET, EOF)) return 1;  //set the new cluster as end of the directory
+  if(getSetNextCluster(cache->lastCluster, SET, cluster)) return 1; //link the new cluster to the previous cluster
 
-  
-  TX_NEWLINE;
-  transmitString_F(PSTR(" File appended!"));
-  TX_NEWLINE;
+  for(i=0; i<512; i++)  //new directory cluster must start out empty
+    buffer[i] = 0x00;
+  firstSector = getFirstSector (cluster);
+  for(sector = 0; sector < sectorPerCluster; sector++)
+    SD_writeSingleBlock (firstSector + sector);
+
+  cache->freeCluster = cluster;
+}
+
+fp->dirSector = getFirstSector (cache->freeCluster) + ((cache->freeEntry / 16) % sectorPerCluster);
+fp->dirOffset = (cache->freeEntry % 16) * 32;
+
+SD_readSingleBlock (fp->dirSector);
+dir = (struct dir_Structure *) &buffer[fp->dirOffset];
+endOfList = (dir->name[0] == EMPTY);
+
+for(j=0; j<11; j++)
+  dir->name[j] = shortName[j];
+dir->attrib = ATTR_ARCHIVE;	//settting file attribute as 'archive'
+dir->NTreserved = 0;			//always set to 0
+dir->timeTenth = 0;			//always set to 0
+dir->createTime = timeFAT; 	//setting time of file creation, obtained from RTC
+dir->createDate = dateFAT; 	//setting date of file creation, obtained from RTC
+dir->lastAccessDate = 0;   	//date of last access ignored
+dir->writeTime = timeFAT;  	//setting new time of last write, obtained from RTC
+dir->writeDate = dateFAT;  	//setting new date of last write, obtained from RTC
+dir->firstClusterHI = (unsigned int) ((fp->firstCluster & 0xffff0000) >> 16 );
+dir->firstClusterLO = (unsigned int) ( fp->firstCluster & 0x0000ffff);
+dir->fileSize = 0;
+
+SD_writeSingleBlock (fp->dirSector);
+
+//move the cached free entry on past the new one
+entry = cache->freeEntry + 1;
+cluster = cache->freeCluster;
+if((entry % (16 * sectorPerCluster)) == 0)
+{
+  cluster = getSetNextCluster (cluster, GET, 0);
+  if((cluster > 0x0ffffff6) || (cluster == 0))
+  {
+    setDirCache (dirCluster, entry, 0, cache->freeCluster);
+    return 0;
+  }
+}
+
+if(endOfList)   //entries after the end of the list are all free
+  setDirCache (dirCluster, entry, cluster, 0);
+else
+{
+  scanFlag = GET_FREE;
+  if(scanDir (cluster, entry))
+    cache->dirCluster = 0;  //forget it, the directory will be searched again
+  else if(scanFreeEntry != NO_ENTRY)
+    setDirCache (dirCluster, scanFreeEntry, scanFreeCluster, 0);
+  else
+    setDirCache (dirCluster, scanEntry, 0, scanCluster);
+}
+return 0;
+}
+
+//************************************************************************************
+//Function: to create a file in FAT32 format in the root directory if given 
+//			file name does not exist; if the file already exists then append the data.
+//			Text is received from UART until '~' is entered
+//Arguments: pointer to the file name
+//return: none
+//************************************************************************************
+void writeFile (unsigned char *fileName)
+{
+struct file_Structure file;
+unsigned char text[64];   //text entered since the last write, can be edited with 'Back Space'
+unsigned char i = 0, data, error;
 
+error = fileOpen (&file, fileName, FILE_APPEND);
+if(error == 2) return; //invalid file name
+if(error)
+{
+  TX_NEWLINE;
+  transmitString_F(PSTR(" No free cluster!"));
+  flushFATSector();
   return;
 }
 
-//executes following portion when new file is created
+TX_NEWLINE;
+if(file.startSize)
+  transmitString_F(PSTR(" File already exists, appending data.."));
+else
+  transmitString_F(PSTR(" Creating File.."));
 
-prevCluster = rootCluster; //root cluster
+TX_NEWLINE;
+transmitString_F(PSTR(" Enter text (end with ~):"));
 
 while(1)
 {
-   firstSector = getFirstSector (prevCluster);
+  data = receiveByte();
+  if(data == '~') break;
+  if(data == 0x08)	//'Back Space' key pressed
+  { 
+    if(i != 0)
+    { 
+      transmitByte(data);
+      transmitByte(' '); 
+      transmitByte(data); 
+      i--; 
+    } 
+    continue;     
+  }
+  transmitByte(data);
+  text[i++] = data;
+  if(data == '\r')  //'Carriege Return (CR)' character
+  {
+    transmitByte ('\n');
+    text[i++] = '\n'; //appending 'Line Feed (LF)' character
+  }
 
-   for(sector = 0; sector < sectorPerCluster; sector++)
-   {
-     SD_readSingleBlock (firstSector + sector);
-	
+  if((data == '\r') || (i >= sizeof(text) - 1))  //text is passed on at the end of each line
+  {
+    error = fileWrite (&file, text, i);
+    i = 0;
+    if(error) break;
+  }
+}
 
-     for(i=0; i<bytesPerSector; i+=32)
-     {
-	    dir = (struct dir_Structure *) &buffer[i];
-
-		if(fileCreatedFlag)   //to mark last directory entry with 0x00 (empty) mark
-		 { 					  //indicating end of the directory file list
-		   //dir->name[0] = EMPTY;
-		   //SD_writeSingleBlock (firstSector + sector);
-           return;
-         }
-
-        if((dir->name[0] == EMPTY) || (dir->name[0] == DELETED))  //looking for an empty slot to enter file info
-		{
-		  for(j=0; j<11; j++)
-  			dir->name[j] = fileName[j];
-		  dir->attrib = ATTR_ARCHIVE;	//settting file attribute as 'archive'
-		  dir->NTreserved = 0;			//always set to 0
-		  dir->timeTenth = 0;			//always set to 0
-		  dir->createTime = timeFAT; 	//setting time of file creation, obtained from RTC
-		  dir->createDate = dateFAT; 	//setting date of file creation, obtained from RTC
-		  dir->lastAccessDate = 0;   	//date of last access ignored
-		  dir->writeTime = timeFAT;  	//setting new time of last write, obtained from RTC
-		  dir->writeDate = dateFAT;  	//setting new date of last write, obtained from RTC
-		  dir->firstClusterHI = firstClusterHigh;
-		  dir->firstClusterLO = firstClusterLow;
-		  dir->fileSize = fileSize;
-
-		  SD_writeSingleBlock (firstSector + sector);
-		  fileCreatedFlag = 1;
-
-		  TX_NEWLINE;
-		  TX_NEWLINE;
-		  transmitString_F(PSTR(" File Created! "));
-
-		  freeMemoryUpdate (REMOVE, fileSize); //updating free memory count in FSinfo sector
-	     
-        }
-     }
-   }
-
-   cluster = getSetNextCluster (prevCluster, GET, 0);
-
-   if(cluster > 0x0ffffff6)
-   {
-      if(cluster == EOF)   //this situation will come when total files in root is multiple of (32*sectorPerCluster)
-	  {  
-		cluster = searchNextFreeCluster(prevCluster); //find next cluster for root directory entries
-		getSetNextCluster(prevCluster, SET, cluster); //link the new cluster of root to the previous cluster
-		getSetNextCluster(cluster, SET, EOF);  //set the new cluster as end of the root directory
-      } 
-
-      else
-      {	
-	    transmitString_F(PSTR("End of Cluster Chain")); 
-	    return;
-      }
-   }
-   if(cluster == 0) {transmitString_F(PSTR("Error in getting cluster")); return;}
-   
-   prevCluster = cluster;
- }
- 
- return;
+if(i && !error)
+  error = fileWrite (&file, text, i);
+
+if(error)
+{
+  TX_NEWLINE;
+  transmitString_F(PSTR(" Write failed.."));
+}
+
+fileClose (&file);  //also writes back the FAT, FSinfo waits for syncFileSystem()
+
+TX_NEWLINE;
+TX_NEWLINE;
+if(file.startSize)
+  transmitString_F(PSTR(" File appended!"));
+else
+  transmitString_F(PSTR(" File Created! "));
+TX_NEWLINE;
 }
 
 
 //***************************************************************************
-//Function: to search for the next free cluster in the root directory
-//          starting from a specified cluster
+//Function: to search for the next free cluster in the FAT, starting from a
+//          specified cluster; the search goes on to the last cluster and then
+//          wraps around from cluster 2 to the start, so clusters freed below
+//          the start are found again
 //Arguments: Starting cluster
-//return: the next free cluster
+//return: the next free cluster, 0 if there is none
 //****************************************************************
 unsigned long searchNextFreeCluster (unsigned long startCluster)
 {
-  unsigned long cluster, *value, sector;
-  unsigned char i;
-    
-	startCluster -=  (startCluster % 128);   //to start with the first file in a FAT sector
-    for(cluster =startCluster; cluster <totalClusters; cluster+=128) 
+  unsigned long cluster, end, *value, sector;
+  unsigned char i, pass, *FATsector;
+
+  if((startCluster < 2) || (startCluster > totalClusters + 1))
+    startCluster = 2;
+  cluster = startCluster;
+  end = totalClusters + 1;   //last cluster of the volume
+  for(pass=0; pass<2; pass++)
+  {
+    while(cluster <= end)
     {
       sector = unusedSectors + reservedSectorCount + ((cluster * 4) / bytesPerSector);
-      SD_readSingleBlock(sector);
-      for(i=0; i<128; i++)
+      FATsector = getFATSector(sector);
+      if(FATsector == 0) return 0;
+      for(i = cluster % 128; (i < 128) && (cluster <= end); i++, cluster++)
       {
-       	 value = (unsigned long *) &buffer[i*4];
-         if(((*value) & 0x0fffffff) == 0)
-            return(cluster+i);
-      }  
-    } 
+        value = (unsigned long *) &FATsector[i*4];
+        if(((*value) & 0x0fffffff) == 0)
+          return cluster;
+      }
+    }
+    cluster = 2;               //second pass, from the first cluster up to the start
+    end = startCluster - 1;
+  }
 
  return 0;
 }
@@ -660,18 +1357,12 @@ unsigned long searchNextFreeCluster (unsigned long startCluster)
 //Function: to display total memory and free memory of SD card, using UART
 //Arguments: none
 //return: none
-//Note: this routine can take upto 15sec for 1GB card (@1MHz clock)
-//it tries to read from SD whether a free cluster count is stored, if it is stored
-//then it will return immediately. Otherwise it will count the total number of
-//free clusters, which takes time
+//Note: free memory comes from the free cluster count kept in RAM, which is
+//counted once at mount if the FSinfo sector does not hold a valid one
 //****************************************************************************
 void memoryStatistics (void)
 {
-unsigned long freeClusters, totalClusterCount, cluster;
 unsigned long totalMemory, freeMemory;
-unsigned long sector, *value;
-unsigned int i;
-
 
 totalMemory = totalClusters * sectorPerCluster / 1024;
 totalMemory *= bytesPerSector;
@@ -682,37 +1373,7 @@ transmitString_F(PSTR("Total Memory: "));
 
 displayMemory (HIGH, totalMemory);
 
-freeClusters = getSetFreeCluster (TOTAL_FREE, GET, 0);
-//freeClusters = 0xffffffff;    
-
-if(freeClusters > totalClusters)
-{
-   freeClusterCountUpdated = 0;
-   freeClusters = 0;
-   totalClusterCount = 0;
-   cluster = rootCluster;    
-    while(1)
-    {
-      sector = unusedSectors + reservedSectorCount + ((cluster * 4) / bytesPerSector) ;
-      SD_readSingleBlock(sector);
-      for(i=0; i<128; i++)
-      {
-           value = (unsigned long *) &buffer[i*4];
-         if(((*value)& 0x0fffffff) == 0)
-            freeClusters++;;
-        
-         totalClusterCount++;
-         if(totalClusterCount == (totalClusters+2)) break;
-      }  
-      if(i < 128) break;
-      cluster+=128;
-    } 
-}
-
-if(!freeClusterCountUpdated)
-  getSetFreeCluster (TOTAL_FREE, SET, freeClusters); //update FSinfo next free cluster entry
-freeClusterCountUpdated = 1;  //set flag
-freeMemory = freeClusters * sectorPerCluster / 1024;
+freeMemory = freeClusterCount * sectorPerCluster / 1024;
 freeMemory *= bytesPerSector ;
 TX_NEWLINE;
 transmitString_F(PSTR(" Free Memory: "));
@@ -747,45 +1408,48 @@ void displayMemory (unsigned char flag, unsigned long memory)
 }
 
 //********************************************************************
-//Function: to delete a specified file from the root directory
+//Function: to delete a specified file, the name may be a path
 //Arguments: pointer to the file name
 //return: none
 //********************************************************************
 void deleteFile (unsigned char *fileName)
 {
-  unsigned char error;
+  unsigned char *name;
+  unsigned long dirCluster;
 
-  error = convertFileName (fileName);
-  if(error) return;
+  name = resolvePath (fileName, &dirCluster);
+  if(name == 0)
+  {transmitString_F(PSTR("File does not exist!")); return;}
 
-  findFiles (DELETE, fileName);
+  findFiles (DELETE, dirCluster, name);
+  flushFATSector();  //FSinfo waits for syncFileSystem()
 }
 
 //********************************************************************
-//Function: update the free memory count in the FSinfo sector. 
-//			Whenever a file is deleted or created, this function will be called
-//			to ADD or REMOVE clusters occupied by the file
-//Arguments: #1.flag ADD or REMOVE #2.file size in Bytes
-//return: none
+//Function: to bring the card up to date: writes back the cached FAT sector
+//			and, if changed, the free cluster count & next free cluster of
+//			the FSinfo sector. To be called before the card may be removed
+//			or powered down (unmount)
+//Arguments: none
+//return: 0, if no error
 //********************************************************************
-void freeMemoryUpdate (unsigned char flag, unsigned long size)
+unsigned char syncFileSystem (void)
 {
-  unsigned long freeClusters;
-  //convert file size into number of clusters occupied
-  if((size % 512) == 0) size = size / 512;
-  else size = (size / 512) +1;
-  if((size % 8) == 0) size = size / 8;
-  else size = (size / 8) +1;
+  struct FSInfo_Structure *FS = (struct FSInfo_Structure *) &buffer;
+  unsigned char error;
 
-  if(freeClusterCountUpdated)
-  {
-	freeClusters = getSetFreeCluster (TOTAL_FREE, GET, 0);
-	if(flag == ADD)
-  	   freeClusters = freeClusters + size;
-	else  //when flag = REMOVE
-	   freeClusters = freeClusters - size;
-	getSetFreeCluster (TOTAL_FREE, SET, freeClusters);
-  }
+  error = flushFATSector();
+  if(!FSinfoDirty) return error;
+
+  SD_readSingleBlock(unusedSectors + 1);
+  if((FS->leadSignature != 0x41615252) || (FS->structureSignature != 0x61417272) || (FS->trailSignature !=0xaa550000))
+    return 1;
+
+  FS->freeClusterCount = freeClusterCount;
+  FS->nextFreeCluster = nextFreeCluster;
+  error |= SD_writeSingleBlock(unusedSectors + 1);	//update FSinfo
+  if(!error) FSinfoDirty = 0;
+  return error;
 }
 
 //******** END ****** www.dharmanitech.com *****
@@ -95,6 +95,27 @@ unsigned int firstClusterLO; //lower word of the first cluster number
 unsigned long fileSize; //size of file in bytes
 };
 
+//Structure to keep track of a file opened for writing with fileOpen()
+struct file_Structure{
+unsigned long firstCluster; //first cluster of the file
+unsigned long cluster; //cluster being written
+unsigned long lastCluster; //last cluster linked to the file, preallocated ones included
+unsigned long fileSize; //current size of file in bytes
+unsigned long startSize; //size of file when it was opened
+unsigned long dirSector; //sector holding the directory entry of the file
+unsigned int dirOffset; //offset of the directory entry in that sector
+unsigned int bufferIndex; //write position in the sector buffer
+unsigned char sector; //sector being written, within the cluster
+};
+
+//Structure to remember the first free entry of a directory
+struct dirCache_Structure{
+unsigned long dirCluster; //first cluster of the directory, 0 if slot unused
+unsigned long freeEntry; //index of the first free entry in the directory
+unsigned long freeCluster; //cluster holding that entry, 0 if the directory must be extended
+unsigned long lastCluster; //last cluster of the directory, if freeCluster is 0
+};
+
 //Attribute definitions for file/directory
 #define ATTR_READ_ONLY     0x01
 #define ATTR_HIDDEN        0x02
@@ -122,32 +143,43 @@ unsigned long fileSize; //size of file in bytes
 #define GET_FILE     1
 #define DELETE		 2
 #define EOF		0x0fffffff
+#define FAT_ERROR    0xffffffff  //getSetNextCluster(): the FAT sector could not be read
+#define FILE_PREALLOC_CLUSTERS  4   //clusters linked to a growing file at a time
+#define FILE_APPEND  0
+#define FILE_NEW     1
+#define LONG_NAME_MAX   64  //longest long file name that can be matched
+#define DIR_CACHE_SIZE  4   //directories whose first free entry is remembered
 
 
 //************* external variables *************
 volatile unsigned long firstDataSector, rootCluster, totalClusters;
+unsigned long currentDirCluster;
 volatile unsigned int  bytesPerSector, sectorPerCluster, reservedSectorCount;
 unsigned long unusedSectors, appendFileSector, appendFileLocation, fileSize, appendStartCluster;
 
-//global flag to keep track of free cluster count updating in FSinfo sector
-unsigned char freeClusterCountUpdated;
-
 
 
 //************* functions *************
 unsigned char getBootSectorData (void);
 unsigned long getFirstSector(unsigned long clusterNumber);
 unsigned long getSetFreeCluster(unsigned char totOrNext, unsigned char get_set, unsigned long FSEntry);
-struct dir_Structure* findFiles (unsigned char flag, unsigned char *fileName);
+struct dir_Structure* findFiles (unsigned char flag, unsigned long dirCluster, unsigned char *fileName);
+unsigned char* resolvePath (unsigned char *path, unsigned long *dirCluster);
+unsigned char changeDir (unsigned char *path);
+unsigned char* getFATSector (unsigned long FATEntrySector);
+unsigned char flushFATSector (void);
 unsigned long getSetNextCluster (unsigned long clusterNumber,unsigned char get_set,unsigned long clusterEntry);
 unsigned char readFile (unsigned char flag, unsigned char *fileName);
 unsigned char convertFileName (unsigned char *fileName);
 void writeFile (unsigned char *fileName);
+unsigned char fileOpen (struct file_Structure *fp, unsigned char *fileName, unsigned char mode);
+unsigned char fileWrite (struct file_Structure *fp, unsigned char *data, unsigned int count);
+unsigned char fileClose (struct file_Structure *fp);
 void appendFile (void);
 unsigned long searchNextFreeCluster (unsigned long startCluster);
 void memoryStatistics (void);
 void displayMemory (unsigned char flag, unsigned long memory);
 void deleteFile (unsigned char *fileName);
-void freeMemoryUpdate (unsigned char flag, unsigned long size);
+unsigned char syncFileSystem (void);
 
 #endif
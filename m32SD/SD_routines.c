@@ -195,13 +195,24 @@ return 0; //normal return
 }
 
 //******************************************************************
-//Function	: to read a single block from SD card
-//Arguments	: none
+//Function	: to read a single block from SD card into the common buffer
+//Arguments	: block address
 //return	: unsigned char; will be 0 if no error,
 // 			  otherwise the response byte will be sent
 //******************************************************************
 unsigned char SD_readSingleBlock(unsigned long startBlock)
 {
+return SD_readBlock(startBlock, (unsigned char *)buffer);
+}
+
+//******************************************************************
+//Function	: to read a single block from SD card into a given buffer
+//Arguments	: block address & pointer to a 512 byte buffer
+//return	: unsigned char; will be 0 if no error,
+// 			  otherwise the response byte will be sent
+//******************************************************************
+unsigned char SD_readBlock(unsigned long startBlock, unsigned char *buf)
+{
 unsigned char response;
 unsigned int i, retry=0;
 
@@ -216,7 +227,7 @@ while(SPI_receive() != 0xfe) //wait for start block token 0xfe (0x11111110)
   if(retry++ > 0xfffe){SD_CS_DEASSERT; return 1;} //return if time-out
 
 for(i=0; i<512; i++) //read 512 bytes
-  buffer[i] = SPI_receive();
+  buf[i] = SPI_receive();
 
 SPI_receive(); //receive incoming CRC (16-bit), CRC is ignored here
 SPI_receive();
@@ -228,13 +239,24 @@ return 0;
 }
 
 //******************************************************************
-//Function	: to write to a single block of SD card
-//Arguments	: none
+//Function	: to write the common buffer to a single block of SD card
+//Arguments	: block address
 //return	: unsigned char; will be 0 if no error,
 // 			  otherwise the response byte will be sent
 //******************************************************************
 unsigned char SD_writeSingleBlock(unsigned long startBlock)
 {
+return SD_writeBlock(startBlock, (unsigned char *)buffer);
+}
+
+//******************************************************************
+//Function	: to write a given buffer to a single block of SD card
+//Arguments	: block address & pointer to a 512 byte buffer
+//return	: unsigned char; will be 0 if no error,
+// 			  otherwise the response byte will be sent
+//******************************************************************
+unsigned char SD_writeBlock(unsigned long startBlock, unsigned char *buf)
+{
 unsigned char response;
 unsigned int i, retry=0;
 
@@ -247,7 +269,7 @@ SD_CS_ASSERT;
 SPI_transmit(0xfe);     //Send start block token 0xfe (0x11111110)
 
 for(i=0; i<512; i++)    //send 512 bytes data
-  SPI_transmit(buffer[i]);
+  SPI_transmit(buf[i]);
 
 SPI_transmit(0xff);     //transmit dummy CRC (16-bit), CRC is ignored here
 SPI_transmit(0xff);
@@ -275,54 +297,44 @@ return 0;
 }
 
 
-#ifndef FAT_TESTING_ONLY
-
 //***************************************************************************
-//Function	: to read multiple blocks from SD card & send every block to UART
-//Arguments	: none
+//Function	: to read multiple blocks from SD card (CMD18)
+//Arguments	: start block, number of blocks, pointer to a buffer & a consumer;
+//			  if consumer is 0, the blocks are stored one after another in
+//			  the buffer, otherwise every block is read into the first 512
+//			  bytes of the buffer and passed to the consumer, which returns
+//			  non-zero to stop the transfer early
 //return	: unsigned char; will be 0 if no error,
 // 			  otherwise the response byte will be sent
 //****************************************************************************
-unsigned char SD_readMultipleBlock (unsigned long startBlock, unsigned long totalBlocks)
+unsigned char SD_readMultipleBlock (unsigned long startBlock, unsigned long totalBlocks,
+                                    unsigned char *buf, SD_blockHandler consumer)
 {
-unsigned char response;
+unsigned char response, *block = buf;
 unsigned int i, retry=0;
+unsigned long blockCounter = 0;
 
-retry = 0;
-
-response = SD_sendCommand(READ_MULTIPLE_BLOCKS, startBlock); //write a Block command
+response = SD_sendCommand(READ_MULTIPLE_BLOCKS, startBlock); //read multiple blocks command
   
 if(response != 0x00) return response; //check for SD status: 0x00 - OK (No flags set)
 
 SD_CS_ASSERT;
 
-while( totalBlocks )
+while( blockCounter < totalBlocks )
 {
   retry = 0;
   while(SPI_receive() != 0xfe) //wait for start block token 0xfe (0x11111110)
   if(retry++ > 0xfffe){SD_CS_DEASSERT; return 1;} //return if time-out
 
   for(i=0; i<512; i++) //read 512 bytes
-    buffer[i] = SPI_receive();
+    block[i] = SPI_receive();
 
   SPI_receive(); //receive incoming CRC (16-bit), CRC is ignored here
   SPI_receive();
 
-  SPI_receive(); //extra 8 cycles
-  TX_NEWLINE;
-  transmitString_F(PSTR(" --------- "));
-  TX_NEWLINE;
-
-  for(i=0; i<512; i++) //send the block to UART
-  {
-    if(buffer[i] == '~') break;
-    transmitByte ( buffer[i] );
-  }
-
-  TX_NEWLINE;
-  transmitString_F(PSTR(" --------- "));
-  TX_NEWLINE;
-  totalBlocks--;
+  blockCounter++;
+  if(consumer == 0) block += 512;
+  else if(consumer(block, blockCounter - 1)) break;
 }
 
 SD_sendCommand(STOP_TRANSMISSION, 0); //command to stop transmission
@@ -333,63 +345,47 @@ return 0;
 }
 
 //***************************************************************************
-//Function: to receive data from UART and write to multiple blocks of SD card
-//Arguments: none
-//return: unsigned char; will be 0 if no error,
-// otherwise the response byte will be sent
+//Function	: to write multiple blocks of SD card (CMD25); when the blocks
+//			  come from the buffer their number is announced first (ACMD23)
+//			  so that the card can pre-erase them
+//Arguments	: start block, number of blocks, pointer to a buffer & a producer;
+//			  if producer is 0, the blocks are taken one after another from
+//			  the buffer, otherwise the producer fills the first 512 bytes of
+//			  the buffer before every block and returns non-zero when there
+//			  is no more data. The count is not announced then, so blocks
+//			  left unwritten by an early stop keep their old data instead
+//			  of the undefined contents of a pre-erase
+//return	: unsigned char; will be 0 if no error,
+// 			  otherwise the response byte will be sent
 //****************************************************************************
-unsigned char SD_writeMultipleBlock(unsigned long startBlock, unsigned long totalBlocks)
+unsigned char SD_writeMultipleBlock(unsigned long startBlock, unsigned long totalBlocks,
+                                    unsigned char *buf, SD_blockHandler producer)
 {
-unsigned char response, data;
+unsigned char response, *block = buf;
 unsigned int i, retry=0;
-unsigned long blockCounter=0, size;
+unsigned long blockCounter=0;
+
+if(producer == 0)  //the number of blocks is known, only a producer can stop early
+{
+  SD_sendCommand(APP_CMD, 0); //CMD55, must be sent before sending any ACMD command
+  SD_sendCommand(SET_WR_BLK_ERASE_COUNT, totalBlocks); //ACMD23, failure only costs the pre-erase
+}
 
-response = SD_sendCommand(WRITE_MULTIPLE_BLOCKS, startBlock); //write a Block command
+response = SD_sendCommand(WRITE_MULTIPLE_BLOCKS, startBlock); //write multiple blocks command
 
 if(response != 0x00) return response; //check for SD status: 0x00 - OK (No flags set)
 
 SD_CS_ASSERT;
 
-TX_NEWLINE;
-transmitString_F(PSTR(" Enter text (End with ~): "));
-TX_NEWLINE;
-
 while( blockCounter < totalBlocks )
 {
-   i=0;
-   do
-   {
-     data = receiveByte();
-     if(data == 0x08)	//'Back Space' key pressed
-	 { 
-	   if(i != 0)
-	   { 
-	     transmitByte(data);
-	     transmitByte(' '); 
-	     transmitByte(data); 
-	     i--; 
-		 size--;
-	   } 
-	   continue;     
-	 }
-     transmitByte(data);
-     buffer[i++] = data;
-     if(data == 0x0d)
-     {
-        transmitByte(0x0a);
-        buffer[i++] = 0x0a;
-     }
-	 if(i == 512) break;
-   }while (data != '~');
-
-   TX_NEWLINE;
-   transmitString_F(PSTR(" ---- "));
-   TX_NEWLINE;
+   if(producer != 0)
+     if(producer(block, blockCounter)) break;
 
    SPI_transmit(0xfc); //Send start block token 0xfc (0x11111100)
 
    for(i=0; i<512; i++) //send 512 bytes data
-     SPI_transmit( buffer[i] );
+     SPI_transmit( block[i] );
 
    SPI_transmit(0xff); //transmit dummy CRC (16-bit), CRC is ignored here
    SPI_transmit(0xff);
@@ -401,11 +397,13 @@ while( blockCounter < totalBlocks )
       return response;
    }
 
+   retry = 0;
    while(!SPI_receive()) //wait for SD card to complete writing and get idle
      if(retry++ > 0xfffe){SD_CS_DEASSERT; return 1;}
 
    SPI_receive(); //extra 8 bits
    blockCounter++;
+   if(producer == 0) block += 512;
 }
 
 SPI_transmit(0xfd); //send 'stop transmission token'
@@ -427,6 +425,4 @@ return 0;
 }
 //*********************************************
 
-#endif
-
 //******** END ****** www.dharmanitech.com *****
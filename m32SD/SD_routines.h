@@ -14,8 +14,8 @@
 #ifndef _SD_ROUTINES_H_
 #define _SD_ROUTINES_H_
 
-//Use following macro if you don't want to activate the multiple block access functions
-//those functions are not required for FAT32
+//Use following macro if you don't want to activate the multiple block access options
+//(UART text entry/display) in the main menu; the functions themselves are used by FAT32
 
 #define FAT_TESTING_ONLY
 
@@ -42,6 +42,7 @@
 #define ERASE_BLOCK_START_ADDR   32
 #define ERASE_BLOCK_END_ADDR     33
 #define ERASE_SELECTED_BLOCKS    38
+#define SET_WR_BLK_ERASE_COUNT   23   //ACMD
 #define SD_SEND_OP_COND			 41   //ACMD
 #define APP_CMD					 55
 #define READ_OCR				 58
@@ -51,6 +52,11 @@
 #define ON     1
 #define OFF    0
 
+//per-block producer/consumer for the multiple block functions;
+//arguments: pointer to the block data & index of the block in the transfer
+//return: 0 to continue, non-zero to stop the transfer
+typedef unsigned char (*SD_blockHandler)(unsigned char *block, unsigned long blockIndex);
+
 volatile unsigned long startBlock, totalBlocks; 
 volatile unsigned char SDHC_flag, cardType, buffer[512];
 
@@ -58,8 +64,12 @@ unsigned char SD_init(void);
 unsigned char SD_sendCommand(unsigned char cmd, unsigned long arg);
 unsigned char SD_readSingleBlock(unsigned long startBlock);
 unsigned char SD_writeSingleBlock(unsigned long startBlock);
-unsigned char SD_readMultipleBlock (unsigned long startBlock, unsigned long totalBlocks);
-unsigned char SD_writeMultipleBlock(unsigned long startBlock, unsigned long totalBlocks);
+unsigned char SD_readBlock(unsigned long startBlock, unsigned char *buf);
+unsigned char SD_writeBlock(unsigned long startBlock, unsigned char *buf);
+unsigned char SD_readMultipleBlock (unsigned long startBlock, unsigned long totalBlocks,
+                                    unsigned char *buf, SD_blockHandler consumer);
+unsigned char SD_writeMultipleBlock(unsigned long startBlock, unsigned long totalBlocks,
+                                    unsigned char *buf, SD_blockHandler producer);
 unsigned char SD_erase (unsigned long startBlock, unsigned long totalBlocks);
 
 #endif
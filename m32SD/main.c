@@ -37,6 +37,69 @@ DDRD  = 0xFE;
 }
 
 
+#ifndef FAT_TESTING_ONLY
+
+//block consumer for option 4, sends every block read to UART
+unsigned char transmitBlockText (unsigned char *block, unsigned long blockIndex)
+{
+unsigned int i;
+
+TX_NEWLINE;
+transmitString_F(PSTR(" --------- "));
+TX_NEWLINE;
+
+for(i=0; i<512; i++)
+{
+  if(block[i] == '~') break;
+  transmitByte ( block[i] );
+}
+
+TX_NEWLINE;
+transmitString_F(PSTR(" --------- "));
+TX_NEWLINE;
+return 0;
+}
+
+//block producer for option 3, fills every block with text received from UART
+unsigned char receiveBlockText (unsigned char *block, unsigned long blockIndex)
+{
+unsigned char data;
+unsigned int i=0;
+
+do
+{
+  data = receiveByte();
+  if(data == 0x08)	//'Back Space' key pressed
+  { 
+    if(i != 0)
+    { 
+      transmitByte(data);
+      transmitByte(' '); 
+      transmitByte(data); 
+      i--; 
+    } 
+    continue;     
+  }
+  transmitByte(data);
+  block[i++] = data;
+  if(data == 0x0d)
+  {
+    transmitByte(0x0a);
+    block[i++] = 0x0a;
+  }
+  if(i >= 511) break;
+}while (data != '~');
+
+while(i < 512) block[i++] = 0x00;
+
+TX_NEWLINE;
+transmitString_F(PSTR(" ---- "));
+TX_NEWLINE;
+return 0;
+}
+
+#endif
+
 //call this routine to initialize all peripherals
 void init_devices(void)
 {
@@ -57,7 +120,7 @@ int main(void)
 {
 unsigned char option, error, data, FAT32_active;
 unsigned int i;
-unsigned char fileName[13];
+unsigned char fileName[LONG_NAME_MAX + 1];
 
 _delay_ms(100);  //delay for VCC stabilization
 
@@ -142,10 +205,12 @@ transmitString_F(PSTR("> 9: Read SD Memory Capacity     a: Show Date & Time"));
 TX_NEWLINE;
 transmitString_F(PSTR("> b: Update Date                 c: Update Time"));
 TX_NEWLINE;
+transmitString_F(PSTR("> d: Change Directory            e: Unmount (save free space)"));
+TX_NEWLINE;
 
 TX_NEWLINE;
 TX_NEWLINE;
-transmitString_F(PSTR("> Select Option (0-9/a/b/c): "));
+transmitString_F(PSTR("> Select Option (0-9/a/b/c/d/e): "));
 
 
 /*WARNING: If option 0, 1 or 3 is selected, the card data may not be detected by PC/Laptop again,
@@ -155,7 +220,7 @@ This options are given for learnig the raw data transfer to & from the SD Card*/
 option = receiveByte();
 transmitByte(option);
 
-if(option >=0x35 && option <=0x39)  //options 5 to 9 disabled if FAT32 not found
+if((option >=0x35 && option <=0x39) || option == 'd' || option == 'D' || option == 'e' || option == 'E')  //options 5 to 9, d & e disabled if FAT32 not found
 {
   if(!FAT32_active) 
   {
@@ -258,8 +323,10 @@ case '2': error = SD_readSingleBlock (startBlock);
 //next two options will work only if following macro is cleared from SD_routines.h
 #ifndef FAT_TESTING_ONLY
 
-case '3': 
-          error = SD_writeMultipleBlock (startBlock, totalBlocks);
+case '3': TX_NEWLINE;
+          transmitString_F(PSTR(" Enter text (End with ~): "));
+          TX_NEWLINE;
+          error = SD_writeMultipleBlock (startBlock, totalBlocks, (unsigned char *)buffer, receiveBlockText);
           TX_NEWLINE;
           if(error)
             transmitString_F(PSTR("Write failed.."));
@@ -267,7 +334,7 @@ case '3':
             transmitString_F(PSTR("Write successful!"));
           break;
 
-case '4': error = SD_readMultipleBlock (startBlock, totalBlocks);
+case '4': error = SD_readMultipleBlock (startBlock, totalBlocks, (unsigned char *)buffer, transmitBlockText);
           TX_NEWLINE;
           if(error)
             transmitString_F(PSTR("Read failed.."));
@@ -277,15 +344,20 @@ case '4': error = SD_readMultipleBlock (startBlock, totalBlocks);
 #endif
 
 case '5': TX_NEWLINE;
-  		  findFiles(GET_LIST,0);
+  		  findFiles(GET_LIST, currentDirCluster, 0);
           break;
 
 case '6': 
 case '7': 
-case '8': TX_NEWLINE;
+case '8': 
+case 'd':
+case 'D': TX_NEWLINE;
 		  TX_NEWLINE;
-          transmitString_F(PSTR("Enter file name: "));
-          for(i=0; i<13; i++)
+          if(option == 'd' || option == 'D')
+            transmitString_F(PSTR("Enter directory path: "));
+          else
+            transmitString_F(PSTR("Enter file name: "));
+          for(i=0; i<sizeof(fileName); i++)
 			fileName[i] = 0x00;   //clearing any previously stored file name
           i=0;
           while(1)
@@ -306,9 +378,9 @@ case '8': TX_NEWLINE;
 			if(data <0x20 || data > 0x7e) continue;  //check for valid English text character
 			transmitByte(data);
             fileName[i++] = data;
-            if(i==13){transmitString_F(PSTR(" file name too long..")); break;}
+            if(i==sizeof(fileName)){transmitString_F(PSTR(" file name too long..")); break;}
           }
-          if(i>12) break;
+          if(i>=sizeof(fileName)) break;
        
 	      TX_NEWLINE;
 		  if(option == '6')
@@ -317,6 +389,8 @@ case '8': TX_NEWLINE;
 		  	 writeFile(fileName);
  		  if(option == '8')
 		     deleteFile(fileName);
+		  if(option == 'd' || option == 'D')
+		     if(changeDir(fileName)) transmitString_F(PSTR("Directory not found!"));
           break;
 
 case '9': memoryStatistics();
@@ -332,6 +406,14 @@ case 'B': RTC_updateDate();
 case 'c': 
 case 'C': RTC_updateTime();
 	      break;
+case 'e': 
+case 'E': TX_NEWLINE;
+          TX_NEWLINE;
+          if(syncFileSystem())   //the card may be removed after this
+            transmitString_F(PSTR("Sync failed.."));
+          else
+            transmitString_F(PSTR("Card may be removed!"));
+          break;
 
 default: TX_NEWLINE;
          TX_NEWLINE;
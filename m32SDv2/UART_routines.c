@@ -17,19 +17,25 @@
 #include <avr/io.h>
 #include <avr/pgmspace.h>
 
+#ifndef USART_BAUDRATE
+#define USART_BAUDRATE 19200
+#endif
+#include "baud.h"
+#include "fmt.h"
+
 //**************************************************
 //UART0 initialize
-//baud rate: 19200  (for controller clock = 8MHz)
+//baud rate: USART_BAUDRATE (19200), UBRR from baud.h
 //char size: 8 bit
 //parity: Disabled
 //**************************************************
 void uart0_init(void)
 {
  UCSRB = 0x00; //disable while setting baud rate
- UCSRA = 0x00;
+ UCSRA = (BAUD_U2X << U2X);
  UCSRC = (1 << URSEL) | 0x06;
- UBRRL = 0x19; //set baud rate lo
- UBRRH = 0x00; //set baud rate hi
+ UBRRL = (unsigned char)BAUD_UBRR; //set baud rate lo
+ UBRRH = (unsigned char)(BAUD_UBRR >> 8); //set baud rate hi
  UCSRB = 0x18;
 }
 
@@ -66,23 +72,18 @@ void transmitByte( unsigned char data )
 //***************************************************
 void transmitHex( unsigned char dataType, unsigned long data )
 {
-unsigned char count, i, temp;
-unsigned char dataString[] = "0x        ";
-
-if (dataType == CHAR) count = 2;
-if (dataType == INT) count = 4;
-if (dataType == LONG) count = 8;
+unsigned char count = 8;
 
-for(i=count; i>0; i--)
-{
-  temp = data % 16;
-  if((temp>=0) && (temp<10)) dataString [i+1] = temp + 0x30;
-  else dataString [i+1] = (temp - 10) + 0x41;
+transmitByte('0');
+transmitByte('x');
 
-  data = data/16;
-}
+if (dataType == CHAR) { fmt_hex8(data, transmitByte); count = 2; }
+if (dataType == INT) { fmt_hex16(data, transmitByte); count = 4; }
+if (dataType == LONG) fmt_hex32(data, transmitByte);
 
-transmitString (dataString);
+//pad to the width of the longest type, as before
+for(; count<8; count++)
+  transmitByte(' ');
 }
 
 //***************************************************
@@ -1,15 +1,20 @@
+#ifndef F_CPU
+#define F_CPU 8000000UL  // 8 MHz
+#endif
+#ifndef USART_BAUDRATE
+#define USART_BAUDRATE 9600
+#endif
+
 #include <avr/io.h>
 #include <util/delay.h>
 #include <avr/interrupt.h>
 #include <inttypes.h>
+#include "uart_tx.h"
+#include "baud.h"
 
 volatile char * komunikat = "Test!\r\n";
 volatile uint8_t i;
 
-#define F_CPU 8000000UL  // 8 MHz
-#define USART_BAUDRATE 9600
-#define BAUD_PRESCALE (((F_CPU / (USART_BAUDRATE * 16UL))) - 1)
-
 void InitSPI(void)
 {
 DDRB = (1<<PB4)|(1<<PB5) | (1<<PB7);	 // Set MOSI , SCK , and SS output
@@ -32,13 +37,11 @@ char ReadByteSPI(char addr)
 	return addr;
 }
 
-void uartSend(uint8_t);
-
 void USART_Init(void)
 {
-	UCSRA &= ~(1<<U2X); //Rejest ustawienia preskalera do obliczania BAUD
-	UBRRL = (unsigned char)BAUD_PRESCALE; //wsp�czynnik do okreslenia predkosci transmisji 9600 kb/s (UBBR=f_sys/(16*BAUD)-1)
-	UBRRH = (BAUD_PRESCALE >> 8);
+	UCSRA = (BAUD_U2X<<U2X); //Rejest ustawienia preskalera do obliczania BAUD
+	UBRRL = (unsigned char)BAUD_UBRR; //wsp�czynnik do okreslenia predkosci transmisji (UBRR i U2X wylicza baud.h)
+	UBRRH = (BAUD_UBRR >> 8);
 	UCSRC &= ~(1<<UMSEL); //Draca asynchroniczna
 	UCSRB |= ((1<<RXEN) | (1<<TXEN)); //wlaczone moduly nadawcze i odbiorcze
 	UCSRB |= (1<<RXCIE); //Umozliwia wyzwolenia przerwan przy odbiorze
@@ -46,20 +49,8 @@ void USART_Init(void)
 
 void strSend(char* msg)
 {
-	uint8_t j=0;
-		while(*(msg + j) != 0)
-		{
-			uartSend(*(msg + j));
-			j++;
-		}
-		uartSend('\r');
-		uartSend('\n');
-}
-
-void uartSend(uint8_t u8Data)
-{
-	while((UCSRA &(1<<UDRE)) == 0);
-	UDR = u8Data;
+	uart_tx_puts(msg);
+	uart_tx_puts("\r\n");
 }
 
 ISR(INT0_vect) // Interrupt PD2
@@ -67,7 +58,7 @@ ISR(INT0_vect) // Interrupt PD2
 i=0;
 	while(*(komunikat + i) != 0)
 	{
-		uartSend(*(komunikat + i));
+		uart_tx_putc(*(komunikat + i));
 		i++;
 	}
 }
@@ -95,7 +86,7 @@ int main(void){
 
 		PORTB &=~(1<<PB0);
 		WriteByteSPI(0x0B);
-		uartSend(ReadByteSPI(0x08));
+		uart_tx_putc(ReadByteSPI(0x08));
 		PORTB |=(1<<PB0);
 
 	}
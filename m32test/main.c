@@ -1,22 +1,26 @@
+#ifndef F_CPU
+#define F_CPU 8000000UL  // 8 MHz
+#endif
+#ifndef USART_BAUDRATE
+#define USART_BAUDRATE 9600
+#endif
+
 #include <avr/io.h>
 #include <util/delay.h>
 #include <stdio.h>
 #include <avr/interrupt.h>
+#include "baud.h"
 
 volatile char * komunikat = "Test!\r\n";
 volatile uint8_t i;
 
-#define F_CPU 8000000UL  // 8 MHz
-#define USART_BAUDRATE 9600
-#define BAUD_PRESCALE (((F_CPU / (USART_BAUDRATE * 16UL))) - 1)
-
 void uartSend(uint8_t);
 
 void USART_Init(void)
 {
-	UCSRA &= ~(1<<U2X); //Rejest ustawienia preskalera do obliczania BAUD
-	UBRRL = (unsigned char)BAUD_PRESCALE; //wsp�czynnik do okreslenia predkosci transmisji 9600 kb/s (UBBR=f_sys/(16*BAUD)-1)
-	UBRRH = (BAUD_PRESCALE >> 8);
+	UCSRA = (BAUD_U2X<<U2X); //Rejest ustawienia preskalera do obliczania BAUD
+	UBRRL = (unsigned char)BAUD_UBRR; //wsp�czynnik do okreslenia predkosci transmisji (UBRR i U2X wylicza baud.h)
+	UBRRH = (BAUD_UBRR >> 8);
 	UCSRC &= ~(1<<UMSEL); //Draca asynchroniczna
 	UCSRB |= ((1<<RXEN) | (1<<TXEN)); //wlaczone moduly nadawcze i odbiorcze
 	UCSRB |= (1<<RXCIE); //Umozliwia wyzwolenia przerwan przy odbiorze
@@ -1,11 +1,15 @@
+#ifndef F_CPU
 #define F_CPU 8000000UL  // 8 MHz
+#endif
+#ifndef USART_BAUDRATE
+#define USART_BAUDRATE 9600
+#endif
+
 
 #include <avr/io.h>
 #include <util/delay.h>
 #include <avr/interrupt.h>
-
-#define USART_BAUDRATE 9600
-#define BAUD_PRESCALE (((F_CPU / (USART_BAUDRATE * 16UL))) - 1)
+#include "baud.h"
 
 volatile unsigned char value;
 
@@ -18,12 +22,12 @@ ISR(USART_RXC_vect)
 
 void USART_Init(void){
    // Set baud rate
-   UBRRL = BAUD_PRESCALE;// Load lower 8-bits into the low byte of the UBRR register
-   UBRRH = (BAUD_PRESCALE >> 8);
+   UCSRA = (BAUD_U2X<<U2X);
+   UBRRL = BAUD_UBRR;// Load lower 8-bits into the low byte of the UBRR register
+   UBRRH = (BAUD_UBRR >> 8);
    UCSRB = ((1<<TXEN)|(1<<RXEN) | (1<<RXCIE));
 }
 
-
 void USART_SendByte(uint8_t u8Data){
 
   // Wait until last byte has been transmitted
@@ -4,13 +4,19 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
-../main.c 
+../fmt.c \
+../main.c \
+../uart_tx.c 
 
 OBJS += \
-./main.o 
+./fmt.o \
+./main.o \
+./uart_tx.o 
 
 C_DEPS += \
-./main.d 
+./fmt.d \
+./main.d \
+./uart_tx.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
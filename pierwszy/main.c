@@ -1,3 +1,10 @@
+#ifndef F_CPU
+#define F_CPU 8000000UL  // 8 MHz
+#endif
+#ifndef USART_BAUDRATE
+#define USART_BAUDRATE 9600
+#endif
+
 #include <avr/io.h>
 #include <util/delay.h>
 #include <avr/interrupt.h>
@@ -5,10 +12,10 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include "uart_tx.h"
+#include "fmt.h"
+#include "baud.h"
 
-#define F_CPU 8000000UL  // 8 MHz
-#define USART_BAUDRATE 9600
-#define BAUD_PRESCALE (((F_CPU / (USART_BAUDRATE * 16UL))) - 1)
 #define ENG_SIG_TAB_SIZE 16
 
 
@@ -30,9 +37,9 @@ volatile uint16_t speed = 100;
 volatile bool kierunek =0;
 void USART_Init(void)
 {
-	UCSRA &= ~(1<<U2X); //Rejest ustawienia preskalera do obliczania BAUD
-	UBRRL = (unsigned char)BAUD_PRESCALE; //wsp�czynnik do okreslenia predkosci transmisji 9600 kb/s (UBBR=f_sys/(16*BAUD)-1)
-	UBRRH = (BAUD_PRESCALE >> 8);
+	UCSRA = (BAUD_U2X<<U2X); //Rejest ustawienia preskalera do obliczania BAUD
+	UBRRL = (unsigned char)BAUD_UBRR; //wsp�czynnik do okreslenia predkosci transmisji (UBRR i U2X wylicza baud.h)
+	UBRRH = (BAUD_UBRR >> 8);
 	UCSRC &= ~(1<<UMSEL); //Draca asynchroniczna
 	//Odkomentowanie tego nie dzi
 	//UCSRC |= (1<<URSEL); //Mozliwosc konfigurowania UCSRC
@@ -49,20 +56,8 @@ void Timer_Init(void)
 }
 void strSend(char* msg)
 {
-	uint8_t j=0;
-		while(*(msg + j) != 0)
-		{
-			uartSend(*(msg + j));
-			j++;
-		}
-		uartSend('\r');
-		uartSend('\n');
-}
-
-void uartSend(uint8_t u8Data)
-{
-	while((UCSRA &(1<<UDRE)) == 0);
-	UDR = u8Data;
+	uart_tx_puts(msg);
+	uart_tx_puts("\r\n");
 }
 
 ISR(USART_RXC_vect) //Odczyt z UART
@@ -80,9 +75,8 @@ ISR(USART_RXC_vect) //Odczyt z UART
 	if (dane == 'D')
 			kierunek = 1;
 		OCR1A = speed;
-		itoa(speed, wartosc, 10);
-		strSend(wartosc);
-		_delay_ms(10);
+		fmt_dec16(speed, uart_tx_putc);
+		uart_tx_puts("\r\n");
 }
 
 ISR(INT0_vect) // Interrupt PD2
@@ -90,11 +84,11 @@ ISR(INT0_vect) // Interrupt PD2
 i=0;
 	while(*(komunikat + i) != 0)
 	{
-		uartSend(*(komunikat + i));
+		uart_tx_putc(*(komunikat + i));
 		i++;
 	}
-uartSend('\r');
-uartSend('\n');
+uart_tx_putc('\r');
+uart_tx_putc('\n');
 }
 
 ISR(TIMER1_COMPA_vect)
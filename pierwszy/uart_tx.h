@@ -0,0 +1,23 @@
+#ifndef UART_TX_H
+#define UART_TX_H
+
+#include <inttypes.h>
+
+/* size of the transmit queue, power of 2 up to 256 */
+#ifndef UART_TX_BUFFER_SIZE
+#define UART_TX_BUFFER_SIZE 64
+#endif
+
+/* bytes dropped because the queue was full while interrupts were disabled */
+extern volatile uint8_t uart_tx_dropped;
+
+/* queue one byte, returns 0 if the queue is full; safe to call from an ISR */
+uint8_t uart_tx_put(uint8_t);
+
+/* queue one byte, waits for space only when interrupts are enabled,
+   inside an ISR a byte that does not fit is dropped */
+void uart_tx_putc(uint8_t);
+
+void uart_tx_puts(const char*);
+
+#endif /* UART_TX_H*/
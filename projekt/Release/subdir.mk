@@ -4,16 +4,22 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
+../fmt.c \
 ../i2c.c \
-../main.c 
+../main.c \
+../uart_tx.c 
 
 OBJS += \
+./fmt.o \
 ./i2c.o \
-./main.o 
+./main.o \
+./uart_tx.o 
 
 C_DEPS += \
+./fmt.d \
 ./i2c.d \
-./main.d 
+./main.d \
+./uart_tx.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -0,0 +1,232 @@
+#include "fmt.h"
+#include <avr/pgmspace.h>
+
+/*
+ * Cycles per call as fmt_benchmark() measures them, Timer 1 at clk/1,
+ * put() a store to a volatile and its calls counted. Taken with
+ * "make -C UartSim fmt", which runs the benchmark on UartSim's AVR core
+ * (ATmega32, -Os, built with an LLVM based AVR compiler, avr-gcc may
+ * differ by some percent), over the values it prints:
+ *
+ *                        division loop       fmt
+ *   16 bit decimal        2360..2397          158..416
+ *   32 bit decimal        17416..17465        1007..1933
+ *   16 bit hex            -                   63
+ *   32 bit hex            -                   124
+ *
+ * The division loop is w / num plus num /= 10 per digit, two library
+ * divisions for each of the 5 or 10 digits whatever the value. Here each
+ * digit costs one subtraction per unit of its value (at most 9) and one
+ * table read from flash, so the time grows with the digit sum.
+ */
+
+static const char fmt_hex_digits[16] PROGMEM = "0123456789abcdef";
+
+static const uint16_t fmt_pow10_16[4] PROGMEM = { 10000, 1000, 100, 10 };
+
+static const uint32_t fmt_pow10_32[9] PROGMEM =
+{
+	1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL,
+	10000UL, 1000UL, 100UL, 10UL
+};
+
+void fmt_hex8(uint8_t b, void (*put)(uint8_t))
+{
+	put(pgm_read_byte(&fmt_hex_digits[b >> 4]));
+	put(pgm_read_byte(&fmt_hex_digits[b & 0x0f]));
+}
+
+void fmt_hex16(uint16_t w, void (*put)(uint8_t))
+{
+	fmt_hex8(w >> 8, put);
+	fmt_hex8(w & 0xff, put);
+}
+
+void fmt_hex32(uint32_t dw, void (*put)(uint8_t))
+{
+	fmt_hex16(dw >> 16, put);
+	fmt_hex16(dw & 0xffff, put);
+}
+
+void fmt_dec16(uint16_t w, void (*put)(uint8_t))
+{
+	uint8_t started = 0;
+	uint8_t i;
+
+	for (i = 0; i < 4; i++)
+	{
+		uint16_t p = pgm_read_word(&fmt_pow10_16[i]);
+		uint8_t d = '0';
+
+		while (w >= p)
+		{
+			w -= p;
+			d++;
+		}
+		if (d != '0' || started)
+		{
+			put(d);
+			started = 1;
+		}
+	}
+	put('0' + w);
+}
+
+void fmt_dec32(uint32_t dw, void (*put)(uint8_t))
+{
+	uint8_t started = 0;
+	uint8_t i;
+
+	/* the upper powers cost a 32 bit compare each, skip them for small values */
+	if (dw <= 0xffff)
+	{
+		fmt_dec16(dw, put);
+		return;
+	}
+
+	for (i = 0; i < 9; i++)
+	{
+		uint32_t p = pgm_read_dword(&fmt_pow10_32[i]);
+		uint8_t d = '0';
+
+		while (dw >= p)
+		{
+			dw -= p;
+			d++;
+		}
+		if (d != '0' || started)
+		{
+			put(d);
+			started = 1;
+		}
+	}
+	put('0' + dw);
+}
+
+void fmt_int16(int16_t w, void (*put)(uint8_t))
+{
+	if (w < 0)
+	{
+		put('-');
+		fmt_dec16(-(uint16_t)w, put);
+	}
+	else
+		fmt_dec16(w, put);
+}
+
+#ifdef FMT_BENCHMARK
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/* stores every digit, so that the compiler cannot drop the loops it times */
+static volatile uint8_t fmt_sink;
+
+static void fmt_discard(uint8_t c)
+{
+	fmt_sink = c;
+}
+
+/* the loops this module replaces, kept only for comparison */
+static void fmt_div_dec16(uint16_t w, void (*put)(uint8_t))
+{
+	uint16_t num = 10000;
+	uint8_t started = 0;
+
+	while (num > 0)
+	{
+		uint8_t b = w / num;
+		if (b > 0 || started || num == 1)
+		{
+			put('0' + b);
+			started = 1;
+		}
+		w -= b * num;
+		num /= 10;
+	}
+}
+
+static void fmt_div_dec32(uint32_t dw, void (*put)(uint8_t))
+{
+	uint32_t num = 1000000000;
+	uint8_t started = 0;
+
+	while (num > 0)
+	{
+		uint8_t b = dw / num;
+		if (b > 0 || started || num == 1)
+		{
+			put('0' + b);
+			started = 1;
+		}
+		dw -= b * num;
+		num /= 10;
+	}
+}
+
+static uint16_t fmt_time16(void (*f)(uint16_t, void (*)(uint8_t)), uint16_t w)
+{
+	uint8_t sreg = SREG;
+	uint16_t t;
+
+	cli();
+	TCNT1 = 0;
+	f(w, fmt_discard);
+	t = TCNT1;
+	SREG = sreg;
+	return t;
+}
+
+static uint16_t fmt_time32(void (*f)(uint32_t, void (*)(uint8_t)), uint32_t dw)
+{
+	uint8_t sreg = SREG;
+	uint16_t t;
+
+	cli();
+	TCNT1 = 0;
+	f(dw, fmt_discard);
+	t = TCNT1;
+	SREG = sreg;
+	return t;
+}
+
+static void fmt_bench_line(uint32_t value, uint16_t div, uint16_t sub, void (*put)(uint8_t))
+{
+	fmt_dec32(value, put);
+	put(' ');
+	fmt_dec16(div, put);
+	put(' ');
+	fmt_dec16(sub, put);
+	put('\n');
+}
+
+void fmt_benchmark(void (*put)(uint8_t))
+{
+	static const uint16_t values16[] PROGMEM = { 0, 9, 255, 59999, 65535 };
+	static const uint32_t values32[] PROGMEM = { 65536UL, 9999999UL, 3999999999UL, 4294967295UL };
+	uint16_t w;
+	uint32_t dw;
+	uint8_t i;
+
+	TCCR1A = 0;
+	TCCR1B = _BV(CS10);
+
+	/* value, cycles with division, cycles here */
+	for (i = 0; i < sizeof(values16) / sizeof(values16[0]); i++)
+	{
+		w = pgm_read_word(&values16[i]);
+		fmt_bench_line(w, fmt_time16(fmt_div_dec16, w), fmt_time16(fmt_dec16, w), put);
+	}
+	for (i = 0; i < sizeof(values32) / sizeof(values32[0]); i++)
+	{
+		dw = pgm_read_dword(&values32[i]);
+		fmt_bench_line(dw, fmt_time32(fmt_div_dec32, dw), fmt_time32(fmt_dec32, dw), put);
+	}
+	/* hex has no division loop to compare with, 0 in its place */
+	w = pgm_read_word(&values16[4]);
+	fmt_bench_line(w, 0, fmt_time16(fmt_hex16, w), put);
+	dw = pgm_read_dword(&values32[3]);
+	fmt_bench_line(dw, 0, fmt_time32(fmt_hex32, dw), put);
+
+	TCCR1B = 0;
+}
+#endif
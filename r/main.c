@@ -1,41 +1,33 @@
+#ifndef F_CPU
+#define F_CPU 8000000UL  // 8 MHz
+#endif
+#ifndef USART_BAUDRATE
+#define USART_BAUDRATE 9600
+#endif
+
 #include <avr/io.h>
 #include <util/delay.h>
+#include <avr/interrupt.h>
 #include <stdio.h>
 
 #include "i2c.h"
-
-#define F_CPU 8000000UL  // 8 MHz
-#define USART_BAUDRATE 9600
-#define BAUD_PRESCALE (((F_CPU / (USART_BAUDRATE * 16UL))) - 1)
-
-void uartSend(uint8_t);
+#include "uart_tx.h"
+#include "fmt.h"
+#include "baud.h"
 
 void USART_Init(void)
 {
-	UCSRA &= ~(1<<U2X); //Rejest ustawienia preskalera do obliczania BAUD
-	UBRRL = (unsigned char)BAUD_PRESCALE; //wspczynnik do okreslenia predkosci transmisji 9600 kb/s (UBBR=f_sys/(16*BAUD)-1)
-	UBRRH = (BAUD_PRESCALE >> 8);
+	UCSRA = (BAUD_U2X<<U2X); //Rejest ustawienia preskalera do obliczania BAUD
+	UBRRL = (unsigned char)BAUD_UBRR; //wspczynnik do okreslenia predkosci transmisji (UBRR i U2X wylicza baud.h)
+	UBRRH = (BAUD_UBRR >> 8);
 	UCSRC &= ~(1<<UMSEL); //Draca asynchroniczna
 	UCSRB |= ((1<<RXEN) | (1<<TXEN)); //wlaczone moduly nadawcze i odbiorcze
-	UCSRB |= (1<<RXCIE); //Umozliwia wyzwolenia przerwan przy odbiorze
 }
 
 void strSend(char* msg)
 {
-	uint8_t j=0;
-		while(*(msg + j) != 0)
-		{
-			uartSend(*(msg + j));
-			j++;
-		}
-		uartSend('\r');
-		uartSend('\n');
-}
-
-void uartSend(uint8_t u8Data)
-{
-	while((UCSRA &(1<<UDRE)) == 0);
-	UDR = u8Data;
+	uart_tx_puts(msg);
+	uart_tx_puts("\r\n");
 }
 
 void uintToA (uint8_t num, char* ptr, uint8_t base)
@@ -64,13 +56,13 @@ void beginTransmission(uint8_t devAddr, uint8_t isWriting)
 void checkRegister(uint8_t devAddr, uint8_t regAddr)
 {
 	uint8_t buff;
-	char ptr [16]="0xwwww";
 	beginTransmission(devAddr, 1);
 	i2c_write(regAddr);
 	beginTransmission(devAddr, 0);
 	buff = i2c_read(0);
-	itoa(buff, ptr+2, 16);
-	strSend(ptr);
+	uart_tx_puts("0x");
+	fmt_hex8(buff, uart_tx_putc);
+	uart_tx_puts("\r\n");
 	i2c_stop();
 }
 void setRegister(uint8_t devAddr, uint8_t regAddr, uint8_t data)
@@ -84,6 +76,7 @@ int main(void)
 {
 	USART_Init();
 	i2c_init();
+	sei(); // nadawanie UART w przerwaniu UDRE
 	uint8_t addr = 0x1D;
 	uint8_t readAddr = (addr << 1) + 1;
 	uint8_t writeAddr = (addr << 1);
@@ -106,7 +99,6 @@ int main(void)
 	strSend("FIFO_CTL---");
 	checkRegister(addr,0x38);
 	strSend("---");
-	char wynik[16];
 	while(1)
 	{
 
@@ -118,8 +110,8 @@ int main(void)
 		for(i=0;i<2;i++)
 		{
 			cos = i2c_read(1);
-			itoa(cos, wynik, 10);
-						strSend(wynik);
+			fmt_dec16(cos, uart_tx_putc);
+			uart_tx_puts("\r\n");
 						_delay_ms(100);
 		}
 		i2c_read(0);
@@ -135,12 +135,23 @@ struct fat16_fs_struct
     struct fat16_header_struct header;
 };
 
+struct fat16_cluster_run_struct
+{
+    uint16_t cluster;
+    uint16_t count;
+};
+
 struct fat16_file_struct
 {
     struct fat16_fs_struct* fs;
     struct fat16_dir_entry_struct dir_entry;
     uint32_t pos;
     uint16_t pos_cluster;
+#if FAT16_CLUSTER_MAP_RUNS
+    struct fat16_cluster_run_struct cluster_map[FAT16_CLUSTER_MAP_RUNS];
+    uint8_t cluster_map_runs;
+    uint8_t cluster_map_complete;
+#endif
 };
 
 struct fat16_dir_struct
@@ -165,6 +176,12 @@ static uint8_t fat16_dir_entry_seek_callback(uint8_t* buffer, uint32_t offset, v
 static uint8_t fat16_dir_entry_read_callback(uint8_t* buffer, uint32_t offset, void* p);
 static uint8_t fat16_interpret_dir_entry(struct fat16_dir_entry_struct* dir_entry, const uint8_t* raw_entry);
 static uint16_t fat16_get_next_cluster(const struct fat16_fs_struct* fs, uint16_t cluster_num);
+static uint16_t fat16_get_file_cluster(const struct fat16_file_struct* fd, uint16_t cluster_index);
+static uint16_t fat16_get_next_file_cluster(const struct fat16_file_struct* fd, uint16_t cluster_num);
+#if FAT16_CLUSTER_MAP_RUNS
+static void fat16_build_cluster_map(struct fat16_file_struct* fd);
+static void fat16_append_cluster_map(struct fat16_file_struct* fd, uint16_t cluster_num);
+#endif
 static uint16_t fat16_append_clusters(const struct fat16_fs_struct* fs, uint16_t cluster_num, uint16_t count);
 static uint8_t fat16_free_clusters(const struct fat16_fs_struct* fs, uint16_t cluster_num);
 static uint8_t fat16_write_dir_entry(const struct fat16_fs_struct* fs, const struct fat16_dir_entry_struct* dir_entry);
@@ -670,6 +687,173 @@ uint16_t fat16_get_next_cluster(const struct fat16_fs_struct* fs, uint16_t clust
     return cluster_num;
 }
 
+/**
+ * \ingroup fat16_file
+ * Retrieves the cluster of a file which holds a given part of it.
+ *
+ * The cluster is taken from the file's cluster map as far as it goes,
+ * the FAT is only read for the clusters following the mapped ones.
+ *
+ * \param[in] fd The file whose cluster chain to use.
+ * \param[in] cluster_index The position of the wanted cluster within the chain, starting at 0.
+ * \returns The wanted cluster number, or 0 if the chain is shorter.
+ */
+uint16_t fat16_get_file_cluster(const struct fat16_file_struct* fd, uint16_t cluster_index)
+{
+    uint16_t cluster_num = fd->dir_entry.cluster;
+
+#if FAT16_CLUSTER_MAP_RUNS
+    const struct fat16_cluster_run_struct* run = fd->cluster_map;
+    uint8_t i;
+    for(i = 0; i < fd->cluster_map_runs; ++i, ++run)
+    {
+        if(cluster_index < run->count)
+            return run->cluster + cluster_index;
+
+        cluster_index -= run->count;
+        cluster_num = run->cluster + run->count - 1;
+    }
+
+    if(fd->cluster_map_runs)
+    {
+        if(fd->cluster_map_complete)
+            return 0;
+
+        /* continue from the last mapped cluster */
+        ++cluster_index;
+    }
+#endif
+
+    while(cluster_index-- > 0 && cluster_num)
+        cluster_num = fat16_get_next_cluster(fd->fs, cluster_num);
+
+    return cluster_num;
+}
+
+/**
+ * \ingroup fat16_file
+ * Retrieves the cluster of a file following a given one.
+ *
+ * Like fat16_get_next_cluster(), but the cluster map of the file is used
+ * instead of the FAT where possible.
+ *
+ * \param[in] fd The file to which the cluster belongs.
+ * \param[in] cluster_num The number of the cluster for which to determine its successor.
+ * \returns The wanted cluster number, or 0 at the end of the chain or on error.
+ */
+uint16_t fat16_get_next_file_cluster(const struct fat16_file_struct* fd, uint16_t cluster_num)
+{
+#if FAT16_CLUSTER_MAP_RUNS
+    const struct fat16_cluster_run_struct* run = fd->cluster_map;
+    uint8_t i;
+    for(i = 0; i < fd->cluster_map_runs; ++i, ++run)
+    {
+        if(cluster_num < run->cluster || cluster_num - run->cluster >= run->count)
+            continue;
+
+        if(cluster_num - run->cluster + 1 < run->count)
+            return cluster_num + 1;
+        if(i + 1 < fd->cluster_map_runs)
+            return run[1].cluster;
+        if(fd->cluster_map_complete)
+            return 0;
+        break;
+    }
+#endif
+
+    return fat16_get_next_cluster(fd->fs, cluster_num);
+}
+
+#if FAT16_CLUSTER_MAP_RUNS
+/**
+ * \ingroup fat16_file
+ * Builds the cluster map of a file.
+ *
+ * The cluster chain of the file is stored as runs of consecutive clusters,
+ * up to FAT16_CLUSTER_MAP_RUNS of them. The FAT is read in chunks, so a
+ * contiguous file costs one device read per 16 clusters. If the chain has
+ * more runs than fit into the map, only its beginning is mapped.
+ *
+ * \param[in] fd The file whose cluster chain to map.
+ */
+void fat16_build_cluster_map(struct fat16_file_struct* fd)
+{
+    struct fat16_cluster_run_struct* run = fd->cluster_map;
+    uint16_t cluster_num = fd->dir_entry.cluster;
+    uint16_t chunk_first = 0;
+    uint8_t chunk[32];
+
+    fd->cluster_map_runs = 0;
+    fd->cluster_map_complete = 0;
+
+    while(cluster_num)
+    {
+        /* extend the current run or start a new one */
+        if(fd->cluster_map_runs && cluster_num == run->cluster + run->count)
+        {
+            ++run->count;
+        }
+        else
+        {
+            if(fd->cluster_map_runs == FAT16_CLUSTER_MAP_RUNS)
+                return;
+
+            run = &fd->cluster_map[fd->cluster_map_runs++];
+            run->cluster = cluster_num;
+            run->count = 1;
+        }
+
+        /* read the next part of the fat if the entry is not in memory */
+        if(!chunk_first || cluster_num < chunk_first || cluster_num >= chunk_first + sizeof(chunk) / 2)
+        {
+            if(!fd->fs->partition->device_read(fd->fs->header.fat_offset + 2 * (uint32_t) cluster_num, chunk, sizeof(chunk)))
+                return;
+            chunk_first = cluster_num;
+        }
+
+        uint8_t* fat_entry = &chunk[2 * (cluster_num - chunk_first)];
+        cluster_num = ((uint16_t) fat_entry[0]) |
+                      ((uint16_t) fat_entry[1] << 8);
+
+        /* free, reserved, bad and last cluster marks end the chain */
+        if(cluster_num < 2 || cluster_num >= FAT16_CLUSTER_RESERVED_MIN)
+            cluster_num = 0;
+    }
+
+    fd->cluster_map_complete = 1;
+}
+
+/**
+ * \ingroup fat16_file
+ * Adds a cluster appended to a file to its cluster map.
+ *
+ * \param[in] fd The file to which the cluster was appended.
+ * \param[in] cluster_num The new last cluster of the file, or 0 if none was appended.
+ */
+void fat16_append_cluster_map(struct fat16_file_struct* fd, uint16_t cluster_num)
+{
+    if(!cluster_num || !fd->cluster_map_complete)
+        return;
+
+    struct fat16_cluster_run_struct* run = &fd->cluster_map[fd->cluster_map_runs];
+    if(fd->cluster_map_runs && cluster_num == run[-1].cluster + run[-1].count)
+    {
+        ++run[-1].count;
+    }
+    else if(fd->cluster_map_runs < FAT16_CLUSTER_MAP_RUNS)
+    {
+        run->cluster = cluster_num;
+        run->count = 1;
+        ++fd->cluster_map_runs;
+    }
+    else
+    {
+        /* the end of the chain is not mapped anymore */
+        fd->cluster_map_complete = 0;
+    }
+}
+#endif
+
 /**
  * \ingroup fat16_fs
  * Appends a new cluster chain to an existing one.
@@ -837,6 +1021,9 @@ struct fat16_file_struct* fat16_open_file(struct fat16_fs_struct* fs, const stru
     fd->fs = fs;
     fd->pos = 0;
     fd->pos_cluster = dir_entry->cluster;
+#if FAT16_CLUSTER_MAP_RUNS
+    fat16_build_cluster_map(fd);
+#endif
 
     return fd;
 }
@@ -898,14 +1085,9 @@ int16_t fat16_read_file(struct fat16_file_struct* fd, uint8_t* buffer, uint16_t
 
         if(fd->pos)
         {
-            uint32_t pos = fd->pos;
-            while(pos >= cluster_size)
-            {
-                pos -= cluster_size;
-                cluster_num = fat16_get_next_cluster(fd->fs, cluster_num);
-                if(!cluster_num)
-                    return -1;
-            }
+            cluster_num = fat16_get_file_cluster(fd, fd->pos / cluster_size);
+            if(!cluster_num)
+                return -1;
         }
     }
     
@@ -931,7 +1113,7 @@ int16_t fat16_read_file(struct fat16_file_struct* fd, uint8_t* buffer, uint16_t
         if(first_cluster_offset + copy_length >= cluster_size)
         {
             /* we are on a cluster boundary, so get the next cluster */
-            if((cluster_num = fat16_get_next_cluster(fd->fs, cluster_num)))
+            if((cluster_num = fat16_get_next_file_cluster(fd, cluster_num)))
             {
                 first_cluster_offset = 0;
             }
@@ -988,6 +1170,9 @@ int16_t fat16_write_file(struct fat16_file_struct* fd, const uint8_t* buffer, ui
                 fd->dir_entry.cluster = cluster_num = fat16_append_clusters(fd->fs, 0, 1);
                 if(!cluster_num)
                     return -1;
+#if FAT16_CLUSTER_MAP_RUNS
+                fat16_append_cluster_map(fd, cluster_num);
+#endif
             }
             else
             {
@@ -997,20 +1182,18 @@ int16_t fat16_write_file(struct fat16_file_struct* fd, const uint8_t* buffer, ui
 
         if(fd->pos)
         {
-            uint32_t pos = fd->pos;
-            uint16_t cluster_num_next;
-            while(pos >= cluster_size)
+            uint16_t cluster_index = fd->pos / cluster_size;
+            cluster_num = fat16_get_file_cluster(fd, cluster_index);
+            if(!cluster_num && fd->pos % cluster_size == 0)
             {
-                pos -= cluster_size;
-                cluster_num_next = fat16_get_next_cluster(fd->fs, cluster_num);
-                if(!cluster_num_next && pos == 0)
-                    /* the file exactly ends on a cluster boundary, and we append to it */
-                    cluster_num_next = fat16_append_clusters(fd->fs, cluster_num, 1);
-                if(!cluster_num_next)
-                    return -1;
-
-                cluster_num = cluster_num_next;
+                /* the file exactly ends on a cluster boundary, and we append to it */
+                cluster_num = fat16_append_clusters(fd->fs, fat16_get_file_cluster(fd, cluster_index - 1), 1);
+#if FAT16_CLUSTER_MAP_RUNS
+                fat16_append_cluster_map(fd, cluster_num);
+#endif
             }
+            if(!cluster_num)
+                return -1;
         }
     }
     
@@ -1036,10 +1219,15 @@ int16_t fat16_write_file(struct fat16_file_struct* fd, const uint8_t* buffer, ui
         if(first_cluster_offset + write_length >= cluster_size)
         {
             /* we are on a cluster boundary, so get the next cluster */
-            uint16_t cluster_num_next = fat16_get_next_cluster(fd->fs, cluster_num);
+            uint16_t cluster_num_next = fat16_get_next_file_cluster(fd, cluster_num);
             if(!cluster_num_next && buffer_left > 0)
+            {
                 /* we reached the last cluster, append a new one */
                 cluster_num_next = fat16_append_clusters(fd->fs, cluster_num, 1);
+#if FAT16_CLUSTER_MAP_RUNS
+                fat16_append_cluster_map(fd, cluster_num_next);
+#endif
+            }
             if(!cluster_num_next)
             {
                 fd->pos_cluster = 0;
@@ -1233,6 +1421,10 @@ uint8_t fat16_resize_file(struct fat16_file_struct* fd, uint32_t size)
     fd->dir_entry.file_size = size;
     if(size == 0)
         fd->dir_entry.cluster = 0;
+#if FAT16_CLUSTER_MAP_RUNS
+    /* the cluster chain changed */
+    fat16_build_cluster_map(fd);
+#endif
     if(!fat16_write_dir_entry(fd->fs, &fd->dir_entry))
         return 0;
 
@@ -20,6 +20,19 @@
  */
 #define FAT16_WRITE_SUPPORT 1
 
+/**
+ * \ingroup fat16_config
+ * Controls the cluster map of opened files.
+ *
+ * When a file is opened, its cluster chain is stored as up to this
+ * number of runs of consecutive clusters (4 bytes of RAM each). Reading
+ * and seeking within the mapped part of the file never reads the FAT.
+ * Set to 0 to always follow the cluster chain in the FAT.
+ */
+#ifndef FAT16_CLUSTER_MAP_RUNS
+#define FAT16_CLUSTER_MAP_RUNS 8
+#endif
+
 /**
  * @}
  */
@@ -0,0 +1,77 @@
+#include "frame.h"
+#include <util/crc16.h>
+
+/* position in the sequence type, payload parts, crc */
+struct frame_pos
+{
+	uint8_t part;
+	uint8_t offset;
+};
+
+static void frame_skip_empty(const struct frame_part* seq, uint8_t count, struct frame_pos* pos)
+{
+	while (pos->part < count && pos->offset == seq[pos->part].length)
+	{
+		pos->part++;
+		pos->offset = 0;
+	}
+}
+
+void frame_send(uint8_t type, const struct frame_part* parts, uint8_t count, void (*put)(uint8_t))
+{
+	struct frame_part seq[FRAME_MAX_PARTS + 2];
+	struct frame_pos pos = {0, 0};
+	struct frame_pos scan;
+	uint8_t crc[2];
+	uint16_t c = 0xffff;
+	uint8_t i, j, run;
+
+	if (count > FRAME_MAX_PARTS)
+		count = FRAME_MAX_PARTS;
+
+	seq[0].data = &type;
+	seq[0].length = 1;
+	for (i = 0; i < count; i++)
+		seq[i + 1] = parts[i];
+	count++;
+
+	for (i = 0; i < count; i++)
+		for (j = 0; j < seq[i].length; j++)
+			c = _crc_ccitt_update(c, ((const uint8_t*)seq[i].data)[j]);
+	crc[0] = c & 0xff;
+	crc[1] = c >> 8;
+	seq[count].data = crc;
+	seq[count].length = 2;
+	count++;
+
+	/* COBS: every block starts with 1 + its number of non-zero bytes,
+	   found by looking ahead in the source instead of buffering the block */
+	while (1)
+	{
+		frame_skip_empty(seq, count, &pos);
+		scan = pos;
+		for (run = 0; run < 254; run++)
+		{
+			frame_skip_empty(seq, count, &scan);
+			if (scan.part == count || ((const uint8_t*)seq[scan.part].data)[scan.offset] == 0)
+				break;
+			scan.offset++;
+		}
+
+		put(run + 1);
+		for (i = 0; i < run; i++)
+		{
+			frame_skip_empty(seq, count, &pos);
+			put(((const uint8_t*)seq[pos.part].data)[pos.offset++]);
+		}
+
+		frame_skip_empty(seq, count, &pos);
+		if (pos.part == count)
+			break;
+		/* a full block has no zero behind it */
+		if (run < 254)
+			pos.offset++;
+	}
+
+	put(0);
+}
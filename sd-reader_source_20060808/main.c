@@ -5,6 +5,7 @@
 #include <avr/pgmspace.h>
 #include "fat16.h"
 #include "fat16_config.h"
+#include "frame.h"
 #include "partition.h"
 #include "sd_raw.h"
 #include "sd_raw_config.h"
@@ -304,6 +305,45 @@ int main()
                 offset += 8;
             }
 
+            fat16_close_file(fd);
+        }
+        else if(strncmp_P(command, PSTR("bcat "), 5) == 0)
+        {
+            command += 5;
+            if(command[0] == '\0')
+                continue;
+
+            struct fat16_file_struct* fd = open_file_in_dir(fs, dd, command);
+            if(!fd)
+            {
+                printf_P(PSTR("error opening %s\n"), command);
+                continue;
+            }
+
+            /* send file contents as FRAME_TYPE_FILE_DATA frames, each carrying
+             * its file offset, followed by a FRAME_TYPE_FILE_END frame
+             */
+            uint8_t data[64];
+            uint8_t header[4];
+            struct frame_part parts[2] = { { header, sizeof(header) }, { data, 0 } };
+            uint32_t offset = 0;
+            int16_t count;
+            while((count = fat16_read_file(fd, data, sizeof(data))) > 0)
+            {
+                header[0] = offset;
+                header[1] = offset >> 8;
+                header[2] = offset >> 16;
+                header[3] = offset >> 24;
+                parts[1].length = count;
+                frame_send(FRAME_TYPE_FILE_DATA, parts, 2, uart_putc_raw);
+                offset += count;
+            }
+            header[0] = offset;
+            header[1] = offset >> 8;
+            header[2] = offset >> 16;
+            header[3] = offset >> 24;
+            frame_send(FRAME_TYPE_FILE_END, parts, 1, uart_putc_raw);
+
             fat16_close_file(fd);
         }
 #if FAT16_WRITE_SUPPORT
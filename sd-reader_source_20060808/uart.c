@@ -3,6 +3,7 @@
 #include <avr/io.h>
 #include <avr/sfr_defs.h>
 
+#include "baud.h"
 #include "uart.h"
 
 /* some mcus have multiple uarts */
@@ -12,6 +13,7 @@
 #define UDR UDR0
 
 #define UCSRA UCSR0A
+#define U2X U2X0
 #define UDRE UDRE0
 #define RXC RXC0
 
@@ -28,8 +30,6 @@
 #define UCSRC_SELECT (1 << URSEL)
 #endif
 
-#define BAUD 9600UL
-#define UBRRVAL (F_CPU/(BAUD*16)-1)
 
 static int _uart_putc(char c, FILE* stream);
 static int _uart_getc(FILE* stream);
@@ -39,8 +39,9 @@ static FILE stdio = FDEV_SETUP_STREAM(_uart_putc, _uart_getc, _FDEV_SETUP_RW);
 void uart_init()
 {
     /* set baud rate */
-    UBRRH = UBRRVAL >> 8;
-    UBRRL = UBRRVAL & 0xff;
+    UBRRH = BAUD_UBRR >> 8;
+    UBRRL = BAUD_UBRR & 0xff;
+    UCSRA = BAUD_U2X << U2X;
     /* set frame format: 8 bit, no parity, 1 bit */
     UCSRC = UCSRC_SELECT | (1 << UCSZ1) | (1 << UCSZ0);
     /* enable serial receiver and transmitter */
@@ -55,7 +56,12 @@ void uart_connect_stdio()
 void uart_putc(uint8_t c)
 {
     if(c == '\n')
-        uart_putc('\r');
+        uart_putc_raw('\r');
+    uart_putc_raw(c);
+}
+
+void uart_putc_raw(uint8_t c)
+{
     /* wait until transmit buffer is empty */
     loop_until_bit_is_set(UCSRA, UDRE);
     /* send next byte */
@@ -7,6 +7,7 @@
 void uart_init();
 void uart_connect_stdio();
 void uart_putc(uint8_t c);
+void uart_putc_raw(uint8_t c);
 void uart_putc_hex(uint8_t b);
 uint8_t uart_getc();
 
@@ -16,6 +16,7 @@
 #include "sd_raw.h"
 #include "sd_raw_config.h"
 #include "uart.h"
+#include "fmt.h"
 
 #define DEBUG 1
 
@@ -65,6 +66,8 @@
  * via the UART at 9600 Baud. With commands similiar to the Unix shell you can browse different
  * directories, read and write files, create new ones and delete them again. Not all commands are
  * available in all software configurations.
+ * - <tt>bench</tt>\n
+ *   Prints cycle counts of the number formatting routines (only with FMT_BENCHMARK defined).
  * - <tt>cat \<file\></tt>\n
  *   Writes a hexdump of \<file\> to the terminal.
  * - <tt>cd \<directory\></tt>\n
@@ -391,6 +394,13 @@ int main()
                 if(!print_disk_info(fs))
                     uart_puts_p(PSTR("error reading disk info\n"));
             }
+#ifdef FMT_BENCHMARK
+            else if(strcmp_P(command, PSTR("bench")) == 0)
+            {
+                uart_puts_p(PSTR("value div fmt\n"));
+                fmt_benchmark(uart_putc);
+            }
+#endif
 #if FAT_WRITE_SUPPORT
             else if(strncmp_P(command, PSTR("rm "), 3) == 0)
             {
@@ -14,6 +14,8 @@
 #include <avr/sfr_defs.h>
 #include <avr/sleep.h>
 
+#include "baud.h"
+#include "fmt.h"
 #include "uart.h"
 
 /* some mcus have multiple uarts */
@@ -23,6 +25,7 @@
 #define UDR UDR0
 
 #define UCSRA UCSR0A
+#define U2X U2X0
 #define UDRE UDRE0
 #define RXC RXC0
 
@@ -58,15 +61,14 @@
 #endif
 #endif
 
-#define BAUD 9600UL
-#define UBRRVAL (F_CPU/(BAUD*16)-1)
 #define USE_SLEEP 1
 
 void uart_init()
 {
     /* set baud rate */
-    UBRRH = UBRRVAL >> 8;
-    UBRRL = UBRRVAL & 0xff;
+    UBRRH = BAUD_UBRR >> 8;
+    UBRRL = BAUD_UBRR & 0xff;
+    UCSRA = BAUD_U2X << U2X;
     /* set frame format: 8 bit, no parity, 1 bit */
     UCSRC = UCSRC_SELECT | (1 << UCSZ1) | (1 << UCSZ0);
     /* enable serial receiver and transmitter */
@@ -91,67 +93,27 @@ void uart_putc(uint8_t c)
 
 void uart_putc_hex(uint8_t b)
 {
-    /* upper nibble */
-    if((b >> 4) < 0x0a)
-        uart_putc((b >> 4) + '0');
-    else
-        uart_putc((b >> 4) - 0x0a + 'a');
-
-    /* lower nibble */
-    if((b & 0x0f) < 0x0a)
-        uart_putc((b & 0x0f) + '0');
-    else
-        uart_putc((b & 0x0f) - 0x0a + 'a');
+    fmt_hex8(b, uart_putc);
 }
 
 void uart_putw_hex(uint16_t w)
 {
-    uart_putc_hex((uint8_t) (w >> 8));
-    uart_putc_hex((uint8_t) (w & 0xff));
+    fmt_hex16(w, uart_putc);
 }
 
 void uart_putdw_hex(uint32_t dw)
 {
-    uart_putw_hex((uint16_t) (dw >> 16));
-    uart_putw_hex((uint16_t) (dw & 0xffff));
+    fmt_hex32(dw, uart_putc);
 }
 
 void uart_putw_dec(uint16_t w)
 {
-    uint16_t num = 10000;
-    uint8_t started = 0;
-
-    while(num > 0)
-    {
-        uint8_t b = w / num;
-        if(b > 0 || started || num == 1)
-        {
-            uart_putc('0' + b);
-            started = 1;
-        }
-        w -= b * num;
-
-        num /= 10;
-    }
+    fmt_dec16(w, uart_putc);
 }
 
 void uart_putdw_dec(uint32_t dw)
 {
-    uint32_t num = 1000000000;
-    uint8_t started = 0;
-
-    while(num > 0)
-    {
-        uint8_t b = dw / num;
-        if(b > 0 || started || num == 1)
-        {
-            uart_putc('0' + b);
-            started = 1;
-        }
-        dw -= b * num;
-
-        num /= 10;
-    }
+    fmt_dec32(dw, uart_putc);
 }
 
 void uart_puts(const char* str)
@@ -39,6 +39,7 @@ LICENSE:
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <string.h>
 #include "uart.h"
 
 
@@ -467,6 +468,101 @@ void uart_puts_p(const char *progmem_s )
 }/* uart_puts_p */
 
 
+/*************************************************************************
+Function: uart_write()
+Purpose:  copy a block of bytes to the transmit ringbuffer
+Input:    buffer and number of bytes to be transmitted
+Returns:  number of bytes copied, less than n only with UART_NONBLOCKING
+          when the ringbuffer is full
+**************************************************************************/
+unsigned int uart_write(const void *buf, unsigned int n)
+{
+    const unsigned char *src = (const unsigned char *)buf;
+    unsigned int done = 0;
+    unsigned char head;
+    unsigned int count;
+    unsigned int len;
+
+    
+    while ( done < n ) {
+        count = (UART_TxTail - UART_TxHead - 1) & UART_TX_BUFFER_MASK;
+        if ( count == 0 ) {
+#if defined( UART_NONBLOCKING )
+            break;
+#else
+            continue;   /* wait for free space in buffer */
+#endif
+        }
+        if ( count > n - done )
+            count = n - done;
+
+        /* at most two segments: up to the end of the buffer, then from its start */
+        head = (UART_TxHead + 1) & UART_TX_BUFFER_MASK;
+        len  = UART_TX_BUFFER_SIZE - head;
+        if ( len > count )
+            len = count;
+        memcpy((unsigned char *)&UART_TxBuf[head], src, len);
+        memcpy((unsigned char *)UART_TxBuf, src + len, count - len);
+        src  += count;
+        done += count;
+
+        /* publish the new head once, then enable UDRE interrupt */
+        UART_TxHead = (head + count - 1) & UART_TX_BUFFER_MASK;
+        UART0_CONTROL    |= _BV(UART0_UDRIE);
+    }
+    
+    return done;
+
+}/* uart_write */
+
+
+/*************************************************************************
+Function: uart_read()
+Purpose:  copy a block of received bytes from the receive ringbuffer
+Input:    buffer and number of bytes to be read
+Returns:  number of bytes copied, less than n only with UART_NONBLOCKING
+          when the ringbuffer runs empty
+**************************************************************************/
+unsigned int uart_read(void *buf, unsigned int n)
+{
+    unsigned char *dst = (unsigned char *)buf;
+    unsigned int done = 0;
+    unsigned char tail;
+    unsigned int count;
+    unsigned int len;
+
+    
+    while ( done < n ) {
+        count = (UART_RxHead - UART_RxTail) & UART_RX_BUFFER_MASK;
+        if ( count == 0 ) {
+#if defined( UART_NONBLOCKING )
+            break;
+#else
+            continue;   /* wait for received data */
+#endif
+        }
+        if ( count > n - done )
+            count = n - done;
+
+        /* at most two segments: up to the end of the buffer, then from its start */
+        tail = (UART_RxTail + 1) & UART_RX_BUFFER_MASK;
+        len  = UART_RX_BUFFER_SIZE - tail;
+        if ( len > count )
+            len = count;
+        memcpy(dst, (const unsigned char *)&UART_RxBuf[tail], len);
+        memcpy(dst + len, (const unsigned char *)UART_RxBuf, count - len);
+        dst  += count;
+        done += count;
+
+        /* release the space to the receive interrupt once */
+        UART_RxTail = (tail + count - 1) & UART_RX_BUFFER_MASK;
+    }
+    
+    return done;
+
+}/* uart_read */
+
+
 /*
  * these functions are only for ATmegas with two USART
  */
@@ -648,4 +744,99 @@ void uart1_puts_p(const char *progmem_s )
 }/* uart1_puts_p */
 
 
+/*************************************************************************
+Function: uart1_write()
+Purpose:  copy a block of bytes to the transmit ringbuffer
+Input:    buffer and number of bytes to be transmitted
+Returns:  number of bytes copied, less than n only with UART_NONBLOCKING
+          when the ringbuffer is full
+**************************************************************************/
+unsigned int uart1_write(const void *buf, unsigned int n)
+{
+    const unsigned char *src = (const unsigned char *)buf;
+    unsigned int done = 0;
+    unsigned char head;
+    unsigned int count;
+    unsigned int len;
+
+    
+    while ( done < n ) {
+        count = (UART1_TxTail - UART1_TxHead - 1) & UART_TX_BUFFER_MASK;
+        if ( count == 0 ) {
+#if defined( UART_NONBLOCKING )
+            break;
+#else
+            continue;   /* wait for free space in buffer */
+#endif
+        }
+        if ( count > n - done )
+            count = n - done;
+
+        /* at most two segments: up to the end of the buffer, then from its start */
+        head = (UART1_TxHead + 1) & UART_TX_BUFFER_MASK;
+        len  = UART_TX_BUFFER_SIZE - head;
+        if ( len > count )
+            len = count;
+        memcpy((unsigned char *)&UART1_TxBuf[head], src, len);
+        memcpy((unsigned char *)UART1_TxBuf, src + len, count - len);
+        src  += count;
+        done += count;
+
+        /* publish the new head once, then enable UDRE interrupt */
+        UART1_TxHead = (head + count - 1) & UART_TX_BUFFER_MASK;
+        UART1_CONTROL    |= _BV(UART1_UDRIE);
+    }
+    
+    return done;
+
+}/* uart1_write */
+
+
+/*************************************************************************
+Function: uart1_read()
+Purpose:  copy a block of received bytes from the receive ringbuffer
+Input:    buffer and number of bytes to be read
+Returns:  number of bytes copied, less than n only with UART_NONBLOCKING
+          when the ringbuffer runs empty
+**************************************************************************/
+unsigned int uart1_read(void *buf, unsigned int n)
+{
+    unsigned char *dst = (unsigned char *)buf;
+    unsigned int done = 0;
+    unsigned char tail;
+    unsigned int count;
+    unsigned int len;
+
+    
+    while ( done < n ) {
+        count = (UART1_RxHead - UART1_RxTail) & UART_RX_BUFFER_MASK;
+        if ( count == 0 ) {
+#if defined( UART_NONBLOCKING )
+            break;
+#else
+            continue;   /* wait for received data */
+#endif
+        }
+        if ( count > n - done )
+            count = n - done;
+
+        /* at most two segments: up to the end of the buffer, then from its start */
+        tail = (UART1_RxTail + 1) & UART_RX_BUFFER_MASK;
+        len  = UART_RX_BUFFER_SIZE - tail;
+        if ( len > count )
+            len = count;
+        memcpy(dst, (const unsigned char *)&UART1_RxBuf[tail], len);
+        memcpy(dst + len, (const unsigned char *)UART1_RxBuf, count - len);
+        dst  += count;
+        done += count;
+
+        /* release the space to the receive interrupt once */
+        UART1_RxTail = (tail + count - 1) & UART_RX_BUFFER_MASK;
+    }
+    
+    return done;
+
+}/* uart1_read */
+
+
 #endif
@@ -79,6 +79,9 @@ LICENSE:
 #define UART_TX_BUFFER_SIZE 32
 #endif
 
+/* Let uart_write() and uart_read() return a partial count instead of
+   waiting for the ringbuffer, add CDEFS += -DUART_NONBLOCKING */
+
 /* test if the size of the circular buffers fits into SRAM */
 #if ( (UART_RX_BUFFER_SIZE+UART_TX_BUFFER_SIZE) >= (RAMEND-0x60 ) )
 #error "size of UART_RX_BUFFER_SIZE + UART_TX_BUFFER_SIZE larger than size of SRAM"
@@ -173,6 +176,35 @@ extern void uart_puts_p(const char *s );
 #define uart_puts_P(__s)       uart_puts_p(PSTR(__s))
 
 
+/**
+ *  @brief   Put a block of bytes to ringbuffer for transmitting via UART
+ *
+ *  The data is copied in at most two contiguous segments and the new
+ *  ringbuffer head is published once per copy, so the transmit interrupt
+ *  is enabled once instead of once per byte.
+ *  Blocks until all bytes are buffered unless UART_NONBLOCKING is defined.
+ *
+ *  @param   buf data to be transmitted
+ *  @param   n   number of bytes
+ *  @return  number of bytes buffered
+ */
+extern unsigned int uart_write(const void *buf, unsigned int n);
+
+
+/**
+ *  @brief   Get a block of bytes from the receive ringbuffer
+ *
+ *  Copies in at most two contiguous segments and releases the space once.
+ *  Blocks until n bytes were received unless UART_NONBLOCKING is defined.
+ *  Receive errors are not reported, use uart_getc() to check them.
+ *
+ *  @param   buf buffer for the received data
+ *  @param   n   number of bytes
+ *  @return  number of bytes copied
+ */
+extern unsigned int uart_read(void *buf, unsigned int n);
+
+
 
 /** @brief  Initialize USART1 (only available on selected ATmegas) @see uart_init */
 extern void uart1_init(unsigned int baudrate);
@@ -186,6 +218,10 @@ extern void uart1_puts(const char *s );
 extern void uart1_puts_p(const char *s );
 /** @brief  Macro to automatically put a string constant into program memory */
 #define uart1_puts_P(__s)       uart1_puts_p(PSTR(__s))
+/** @brief  Put a block of bytes to ringbuffer for transmitting via USART1 (only available on selected ATmega) @see uart_write */
+extern unsigned int uart1_write(const void *buf, unsigned int n);
+/** @brief  Get a block of bytes from the USART1 receive ringbuffer (only available on selected ATmega) @see uart_read */
+extern unsigned int uart1_read(void *buf, unsigned int n);
 
 /**@}*/
 